@@ -0,0 +1,102 @@
+#include "stdafx.h"
+#include "AccelerationStructurePool.h"
+#include "DXSampleHelper.h"
+
+PooledBuffer& PooledBuffer::operator=(PooledBuffer&& other)
+{
+	if (this != &other)
+	{
+		Release();
+		m_pool = other.m_pool;
+		m_kind = other.m_kind;
+		m_allocation = other.m_allocation;
+		m_resource = other.m_resource;
+		m_address = other.m_address;
+		other.m_pool = nullptr;
+		other.m_resource = nullptr;
+		other.m_address = 0;
+	}
+	return *this;
+}
+
+void PooledBuffer::Release()
+{
+	if (m_pool)
+		m_pool->Release(m_kind, m_allocation);
+	m_pool = nullptr;
+	m_resource = nullptr;
+	m_address = 0;
+}
+
+void AccelerationStructurePool::Initialize(ID3D12Device* device, uint64_t pageSize, std::function<uint64_t()> releaseFence)
+{
+	m_device = device;
+	m_releaseFence = releaseFence;
+
+	for (int kind = 0; kind < KindCount; kind++)
+	{
+		Pool& pool = m_pools[kind];
+		pool.allocator = BlockAllocator(pageSize, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+		pool.allocator.onPageCreated = [this, kind](uint32_t page, uint64_t size) {
+			Pool& owner = m_pools[kind];
+			const D3D12_RESOURCE_STATES state = kind == Result ?
+				D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE : D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+
+			D3D12_HEAP_DESC heapDesc = {};
+			heapDesc.SizeInBytes = (size + D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1) & ~static_cast<uint64_t>(D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT - 1);
+			heapDesc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+			heapDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+			heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+			Microsoft::WRL::ComPtr<ID3D12Heap> heap;
+			ThrowIfFailed(m_device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap)));
+
+			D3D12_RESOURCE_DESC bufferDesc = {};
+			bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+			bufferDesc.Width = heapDesc.SizeInBytes;
+			bufferDesc.Height = 1;
+			bufferDesc.DepthOrArraySize = 1;
+			bufferDesc.MipLevels = 1;
+			bufferDesc.SampleDesc.Count = 1;
+			bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+			bufferDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+			Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+			ThrowIfFailed(m_device->CreatePlacedResource(heap.Get(), 0, &bufferDesc, state, nullptr, IID_PPV_ARGS(&buffer)));
+			SetName(buffer.Get(), kind == Result ? L"AS pool page" : L"AS scratch pool page");
+
+			if (page >= owner.heaps.size())
+			{
+				owner.heaps.resize(page + 1);
+				owner.buffers.resize(page + 1);
+			}
+			owner.heaps[page] = heap;
+			owner.buffers[page] = buffer;
+		};
+		pool.allocator.onPageReleased = [this, kind](uint32_t page) {
+			m_pools[kind].buffers[page].Reset();
+			m_pools[kind].heaps[page].Reset();
+		};
+	}
+}
+
+PooledBuffer AccelerationStructurePool::Allocate(Kind kind, uint64_t size)
+{
+	Pool& pool = m_pools[kind];
+	PooledBuffer buffer;
+	buffer.m_allocation = pool.allocator.Allocate(size);
+	buffer.m_pool = this;
+	buffer.m_kind = kind;
+	buffer.m_resource = pool.buffers[buffer.m_allocation.page].Get();
+	buffer.m_address = buffer.m_resource->GetGPUVirtualAddress() + buffer.m_allocation.offset;
+	return buffer;
+}
+
+void AccelerationStructurePool::Collect(uint64_t completedFenceValue)
+{
+	for (Pool& pool : m_pools)
+		pool.allocator.Collect(completedFenceValue);
+}
+
+void AccelerationStructurePool::Release(int kind, const BlockAllocation& allocation)
+{
+	m_pools[kind].allocator.FreeAfter(allocation, m_releaseFence());
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "BlockAllocator.h"
+#include <d3d12.h>
+#include <wrl.h>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+class AccelerationStructurePool;
+
+// A 256-byte aligned range of a pooled buffer, returned to the pool when the
+// handle goes away. The pool only reuses it once the GPU is past the fence
+// value that was next when it was released, so a handle can be dropped as
+// soon as the command list using it is recorded.
+class PooledBuffer
+{
+public:
+	PooledBuffer() {}
+	~PooledBuffer() { Release(); }
+	PooledBuffer(PooledBuffer&& other) { *this = std::move(other); }
+	PooledBuffer& operator=(PooledBuffer&& other);
+	PooledBuffer(const PooledBuffer&) = delete;
+	PooledBuffer& operator=(const PooledBuffer&) = delete;
+
+	explicit operator bool() const { return m_pool != nullptr; }
+	D3D12_GPU_VIRTUAL_ADDRESS Address() const { return m_address; }
+	uint64_t Size() const { return m_allocation.size; }
+	// The whole buffer the range is in, for barriers
+	ID3D12Resource* Resource() const { return m_resource; }
+
+	void Release();
+
+private:
+	friend class AccelerationStructurePool;
+
+	AccelerationStructurePool* m_pool = nullptr;
+	int m_kind = 0;
+	BlockAllocation m_allocation;
+	ID3D12Resource* m_resource = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS m_address = 0;
+};
+
+// Acceleration structures and their build scratch, sub-allocated from large
+// heaps instead of one committed resource each. Every page of a BlockAllocator
+// is a heap holding a single placed buffer over all of it: placed resources
+// can only start on 64 KB boundaries, so the 256-byte aligned ranges are cut
+// out of that buffer by GPU address. Results and scratch come from separate
+// pools, as the buffers stay in the acceleration structure and unordered
+// access states respectively.
+class AccelerationStructurePool
+{
+public:
+	enum Kind { Result, Scratch, KindCount };
+
+	// `releaseFence` gives the fence value a range released now has to wait
+	// for: one the GPU only reaches after all work recorded so far
+	void Initialize(ID3D12Device* device, uint64_t pageSize, std::function<uint64_t()> releaseFence);
+	PooledBuffer Allocate(Kind kind, uint64_t size);
+	// Makes the ranges released before `completedFenceValue` available again
+	void Collect(uint64_t completedFenceValue);
+
+	BlockAllocatorStats Stats(Kind kind) const { return m_pools[kind].allocator.Stats(); }
+
+private:
+	friend class PooledBuffer;
+	void Release(int kind, const BlockAllocation& allocation);
+
+	struct Pool
+	{
+		BlockAllocator allocator;
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Heap> > heaps;
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource> > buffers;
+	};
+
+	Microsoft::WRL::ComPtr<ID3D12Device> m_device;
+	std::function<uint64_t()> m_releaseFence;
+	Pool m_pools[KindCount];
+};
@@ -0,0 +1,61 @@
+#include "stdafx.h"
+#include "AnimationClock.h"
+
+AnimationClock::AnimationClock()
+	: m_start(std::chrono::steady_clock::now())
+{
+}
+
+void AnimationClock::SetRealTime()
+{
+	m_mode = Mode::RealTime;
+	Reset();
+}
+
+void AnimationClock::SetFixedStep(double stepSeconds)
+{
+	m_mode = Mode::FixedStep;
+	m_step = stepSeconds;
+	Reset();
+}
+
+void AnimationClock::SetScript(std::vector<float> times)
+{
+	m_mode = Mode::Scripted;
+	m_script = std::move(times);
+	Reset();
+}
+
+void AnimationClock::Reset()
+{
+	m_frame = 0;
+	m_start = std::chrono::steady_clock::now();
+}
+
+float AnimationClock::Tick()
+{
+	float seconds = 0.0f;
+	if (m_mode == Mode::RealTime)
+		seconds = static_cast<float>(std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count());
+	else
+		seconds = TimeAtFrame(m_frame);
+	m_frame++;
+	return seconds;
+}
+
+float AnimationClock::TimeAtFrame(uint64_t frame) const
+{
+	switch (m_mode)
+	{
+	case Mode::FixedStep:
+		// Computed from the index rather than accumulated, so frame n does
+		// not depend on how many frames ran before it
+		return static_cast<float>(static_cast<double>(frame) * m_step);
+	case Mode::Scripted:
+		if (m_script.empty())
+			return 0.0f;
+		return m_script[frame < m_script.size() ? static_cast<size_t>(frame) : m_script.size() - 1];
+	default:
+		return 0.0f;
+	}
+}
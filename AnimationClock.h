@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Time source of all animation. Real time follows the wall clock; fixed step
+// and scripted time depend only on the frame index, so a run can be repeated
+// frame for frame (benchmarks, captures, -testanimation).
+class AnimationClock
+{
+public:
+	enum class Mode { RealTime, FixedStep, Scripted };
+
+	AnimationClock();
+
+	void SetRealTime();
+	// Frame n is at n * stepSeconds
+	void SetFixedStep(double stepSeconds);
+	// Frame n is at times[n]; past the end the last time is held
+	void SetScript(std::vector<float> times);
+
+	// Back to frame 0; real time restarts from 0 as well
+	void Reset();
+
+	// Time of the current frame, then moves on to the next one. Call once per frame.
+	float Tick();
+
+	// Time of any frame, in the fixed step and scripted modes
+	float TimeAtFrame(uint64_t frame) const;
+
+	Mode GetMode() const { return m_mode; }
+	uint64_t Frame() const { return m_frame; }
+
+private:
+	Mode m_mode = Mode::RealTime;
+	uint64_t m_frame = 0;
+	double m_step = 1.0 / 60.0;
+	std::vector<float> m_script;
+	std::chrono::steady_clock::time_point m_start;
+};
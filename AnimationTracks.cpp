@@ -0,0 +1,179 @@
+#include "stdafx.h"
+#include "AnimationTracks.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+const char* InterpolationName(RotationInterpolation mode)
+{
+	return mode == RotationInterpolation::Euler ? "euler" : "slerp";
+}
+
+const char* InterpolationName(PositionInterpolation mode)
+{
+	switch (mode)
+	{
+	case PositionInterpolation::CatmullRom: return "catmullrom";
+	case PositionInterpolation::Hermite: return "hermite";
+	default: return "linear";
+	}
+}
+
+bool ParseInterpolation(const std::string& name, RotationInterpolation& outMode)
+{
+	if (name == "euler")
+		outMode = RotationInterpolation::Euler;
+	else if (name == "slerp")
+		outMode = RotationInterpolation::Slerp;
+	else
+		return false;
+	return true;
+}
+
+bool ParseInterpolation(const std::string& name, PositionInterpolation& outMode)
+{
+	if (name == "linear")
+		outMode = PositionInterpolation::Linear;
+	else if (name == "catmullrom")
+		outMode = PositionInterpolation::CatmullRom;
+	else if (name == "hermite")
+		outMode = PositionInterpolation::Hermite;
+	else
+		return false;
+	return true;
+}
+
+void AnimationTracks::Clear()
+{
+	m_targets.clear();
+	m_firstKey.clear();
+	m_sorted.clear();
+	m_cachedSegment.clear();
+	m_rotationModes.clear();
+	m_positionModes.clear();
+	m_times.clear();
+	m_positions.clear();
+	m_rotations.clear();
+	m_scales.clear();
+	m_tangents.clear();
+	m_orientations.clear();
+	m_cacheHits = 0;
+	m_searches = 0;
+}
+
+void AnimationTracks::BeginTrack(uint32_t target, RotationInterpolation rotation, PositionInterpolation position)
+{
+	if (m_firstKey.empty())
+		m_firstKey.push_back(0);
+	m_firstKey.push_back(m_firstKey.back());
+	m_targets.push_back(target);
+	m_sorted.push_back(1);
+	m_cachedSegment.push_back(m_firstKey.back());
+	m_rotationModes.push_back(rotation);
+	m_positionModes.push_back(position);
+}
+
+void AnimationTracks::AddKey(float time, const XMFLOAT3& position, const XMFLOAT3& rotation, const XMFLOAT3& scale, const XMFLOAT3& tangent)
+{
+	if (m_firstKey.back() > m_firstKey[m_firstKey.size() - 2] && time < m_times.back())
+		m_sorted.back() = 0;
+
+	m_times.push_back(time);
+	m_positions.push_back(position);
+	m_rotations.push_back(rotation);
+	m_scales.push_back(scale);
+	m_tangents.push_back(tangent);
+	m_orientations.push_back(XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f));
+	m_firstKey.back()++;
+}
+
+void AnimationTracks::EndTrack()
+{
+	const size_t track = m_targets.size() - 1;
+	const uint32_t first = m_firstKey[track];
+	const uint32_t end = m_firstKey[track + 1];
+
+	if (m_rotationModes[track] == RotationInterpolation::Slerp)
+	{
+		for (uint32_t k = first; k < end; k++)
+			XMStoreFloat4(&m_orientations[k], QuaternionFromEulerDegrees(m_rotations[k]));
+	}
+
+	if (m_positionModes[track] == PositionInterpolation::CatmullRom)
+	{
+		// Slope between the neighbouring keys, one-sided at both ends
+		for (uint32_t k = first; k < end; k++)
+		{
+			const uint32_t before = k > first ? k - 1 : k;
+			const uint32_t after = k + 1 < end ? k + 1 : k;
+			const float span = m_times[after] - m_times[before];
+			if (span <= 0.0f)
+			{
+				m_tangents[k] = XMFLOAT3(0.0f, 0.0f, 0.0f);
+				continue;
+			}
+			XMStoreFloat3(&m_tangents[k], XMVectorScale(
+				XMVectorSubtract(XMLoadFloat3(&m_positions[after]), XMLoadFloat3(&m_positions[before])), 1.0f / span));
+		}
+	}
+}
+
+XMVECTOR AnimationTracks::QuaternionFromEulerDegrees(const XMFLOAT3& degrees)
+{
+	// The conversion of TransformSystem::Compose, so an angle that goes
+	// through a quaternion comes back as the scene wrote it
+	return XMQuaternionRotationRollPitchYaw(
+		XMConvertToRadians(degrees.x), XMConvertToRadians(degrees.y), XMConvertToRadians(degrees.z));
+}
+
+XMFLOAT3 AnimationTracks::EulerDegreesFromQuaternion(FXMVECTOR quaternion)
+{
+	XMFLOAT4 q;
+	XMStoreFloat4(&q, quaternion);
+
+	// Entries of the rotation matrix, which is roll, then pitch, then yaw:
+	// m32 = -sin(pitch), and yaw and roll follow from the third row and column
+	const float m31 = 2.0f * (q.x * q.z + q.y * q.w);
+	const float m33 = 1.0f - 2.0f * (q.x * q.x + q.y * q.y);
+	const float m32 = 2.0f * (q.y * q.z - q.x * q.w);
+	float pitch, yaw, roll;
+	if (fabsf(m32) < 0.99999f)
+	{
+		pitch = asinf(-m32);
+		yaw = atan2f(m31, m33);
+		roll = atan2f(2.0f * (q.x * q.y + q.z * q.w), 1.0f - 2.0f * (q.x * q.x + q.z * q.z));
+	}
+	else
+	{
+		// Looking straight up or down: only yaw + roll is defined, keep it in yaw
+		pitch = m32 < 0.0f ? XM_PIDIV2 : -XM_PIDIV2;
+		yaw = atan2f(-2.0f * (q.x * q.z - q.y * q.w), 1.0f - 2.0f * (q.y * q.y + q.z * q.z));
+		roll = 0.0f;
+	}
+	return XMFLOAT3(XMConvertToDegrees(pitch), XMConvertToDegrees(yaw), XMConvertToDegrees(roll));
+}
+
+uint32_t AnimationTracks::FindSegment(size_t track, float time)
+{
+	const uint32_t first = m_firstKey[track];
+	const uint32_t end = m_firstKey[track + 1];
+	m_searches++;
+
+	if (!m_sorted[track])
+	{
+		// Out of order keys: the first pair around the time wins, like in AnimateModels
+		for (uint32_t k = first; k + 1 < end; k++)
+		{
+			if (time >= m_times[k] && time < m_times[k + 1])
+				return k;
+		}
+		return UINT32_MAX;
+	}
+
+	const float* keys = m_times.data();
+	const uint32_t next = static_cast<uint32_t>(std::upper_bound(keys + first, keys + end, time) - keys);
+	if (next == first || next == end)
+		return UINT32_MAX;
+	return next - 1;
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Keyframe tracks of all animated instances, stored as structure-of-arrays:
+// the keys of every track sit back to back in one array per attribute, so
+// sampling touches only the times and the two keys it blends. Scene files keep
+// the per-model AnimationFrame lists; these tracks are built from them.
+//
+// Time loops over the last key time of a track, and a track whose time falls
+// before its first key is skipped. With Euler rotations and linear positions
+// sampling matches D3D12HelloTriangle::AnimateModels exactly.
+
+// Euler angles are blended per angle, as the scene stores them; Slerp blends
+// the orientations along the shortest arc
+enum class RotationInterpolation : int32_t { Euler, Slerp };
+
+// CatmullRom derives the tangents from the neighbouring keys, Hermite uses the
+// tangent stored with each key (units per second)
+enum class PositionInterpolation : int32_t { Linear, CatmullRom, Hermite };
+
+// Names used in scene.json ("euler", "slerp", "linear", "catmullrom", "hermite")
+const char* InterpolationName(RotationInterpolation mode);
+const char* InterpolationName(PositionInterpolation mode);
+bool ParseInterpolation(const std::string& name, RotationInterpolation& outMode);
+bool ParseInterpolation(const std::string& name, PositionInterpolation& outMode);
+
+class AnimationTracks
+{
+public:
+	void Clear();
+
+	// Starts the track of instance `target`; AddKey appends to it and EndTrack
+	// finishes it. Rotations are Euler angles in degrees (pitch, yaw, roll).
+	void BeginTrack(uint32_t target, RotationInterpolation rotation = RotationInterpolation::Euler,
+		PositionInterpolation position = PositionInterpolation::Linear);
+	void AddKey(float time, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& rotation, const DirectX::XMFLOAT3& scale,
+		const DirectX::XMFLOAT3& tangent = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f));
+	void EndTrack();
+
+	size_t TrackCount() const { return m_targets.size(); }
+	size_t KeyCount() const { return m_times.size(); }
+
+	// Samples every track at `seconds` and hands the pose to
+	// sink(target, position, rotation, scale), in track order. The key pair
+	// found last time is tried first, then the next one, and only then the
+	// track is searched. Linear/Euler tracks are blended four at a time.
+	template <typename Sink>
+	void Evaluate(float seconds, Sink&& sink);
+
+	// Lookups since Clear that the cached key pair answered, and those that searched
+	uint64_t CacheHits() const { return m_cacheHits; }
+	uint64_t Searches() const { return m_searches; }
+
+	// Euler angles in degrees of the same orientation as XMMatrixRotationRollPitchYaw
+	static DirectX::XMFLOAT3 EulerDegreesFromQuaternion(DirectX::FXMVECTOR quaternion);
+	static DirectX::XMVECTOR QuaternionFromEulerDegrees(const DirectX::XMFLOAT3& degrees);
+
+private:
+	// Index of the first key of the pair around `time` in the track, or UINT32_MAX
+	uint32_t FindSegment(size_t track, float time);
+
+	// Per track; m_firstKey has one more entry, the end of the last track
+	std::vector<uint32_t> m_targets;
+	std::vector<uint32_t> m_firstKey;
+	std::vector<uint8_t> m_sorted; // key times never decrease, so the cache and binary search apply
+	std::vector<uint32_t> m_cachedSegment;
+	std::vector<RotationInterpolation> m_rotationModes;
+	std::vector<PositionInterpolation> m_positionModes;
+
+	// Per key
+	std::vector<float> m_times;
+	std::vector<DirectX::XMFLOAT3> m_positions;
+	std::vector<DirectX::XMFLOAT3> m_rotations;
+	std::vector<DirectX::XMFLOAT3> m_scales;
+	std::vector<DirectX::XMFLOAT3> m_tangents;     // unused for linear tracks
+	std::vector<DirectX::XMFLOAT4> m_orientations; // quaternions, for slerp tracks
+
+	uint64_t m_cacheHits = 0;
+	uint64_t m_searches = 0;
+};
+
+template <typename Sink>
+void AnimationTracks::Evaluate(float seconds, Sink&& sink)
+{
+	using namespace DirectX;
+
+	const float* times = m_times.data();
+	const size_t trackCount = m_targets.size();
+
+	// Consecutive linear/Euler tracks wait here until four can be blended at
+	// once: the key pairs are transposed so each vector holds one component of
+	// four tracks. Lane by lane this is the same V0 + t * (V1 - V0) as below.
+	uint32_t laneTrack[4];
+	uint32_t laneKey[4];
+	float laneFactor[4];
+	size_t lanes = 0;
+	const std::vector<XMFLOAT3>* laneAttributes[3] = { &m_positions, &m_rotations, &m_scales };
+	auto flushLanes = [&]() {
+		if (lanes == 0)
+			return;
+		for (size_t l = lanes; l < 4; l++)
+		{
+			laneKey[l] = laneKey[0];
+			laneFactor[l] = laneFactor[0];
+		}
+		const XMVECTOR factor = XMVectorSet(laneFactor[0], laneFactor[1], laneFactor[2], laneFactor[3]);
+		XMMATRIX blended[3];
+		for (int a = 0; a < 3; a++)
+		{
+			const XMFLOAT3* keys = laneAttributes[a]->data();
+			const XMMATRIX from = XMMatrixTranspose(XMMATRIX(XMLoadFloat3(&keys[laneKey[0]]), XMLoadFloat3(&keys[laneKey[1]]),
+				XMLoadFloat3(&keys[laneKey[2]]), XMLoadFloat3(&keys[laneKey[3]])));
+			const XMMATRIX to = XMMatrixTranspose(XMMATRIX(XMLoadFloat3(&keys[laneKey[0] + 1]), XMLoadFloat3(&keys[laneKey[1] + 1]),
+				XMLoadFloat3(&keys[laneKey[2] + 1]), XMLoadFloat3(&keys[laneKey[3] + 1])));
+			blended[a] = XMMatrixTranspose(XMMATRIX(XMVectorLerpV(from.r[0], to.r[0], factor), XMVectorLerpV(from.r[1], to.r[1], factor),
+				XMVectorLerpV(from.r[2], to.r[2], factor), XMVectorZero()));
+		}
+		for (size_t l = 0; l < lanes; l++)
+		{
+			XMFLOAT3 position, rotation, scale;
+			XMStoreFloat3(&position, blended[0].r[l]);
+			XMStoreFloat3(&rotation, blended[1].r[l]);
+			XMStoreFloat3(&scale, blended[2].r[l]);
+			sink(m_targets[laneTrack[l]], position, rotation, scale);
+		}
+		lanes = 0;
+	};
+
+	for (size_t i = 0; i < trackCount; i++)
+	{
+		const uint32_t end = m_firstKey[i + 1];
+		if (end - m_firstKey[i] < 2)
+			continue;
+
+		const float time = fmodf(seconds, times[end - 1]);
+
+		// Time moves forward a little every frame, so it is usually still
+		// between the same two keys or has just moved on to the next pair
+		uint32_t k = m_cachedSegment[i];
+		if (m_sorted[i] && time >= times[k] && time < times[k + 1])
+		{
+			m_cacheHits++;
+		}
+		else if (m_sorted[i] && k + 2 < end && time >= times[k + 1] && time < times[k + 2])
+		{
+			m_cacheHits++;
+			m_cachedSegment[i] = ++k;
+		}
+		else
+		{
+			k = FindSegment(i, time);
+			if (k == UINT32_MAX)
+				continue;
+			m_cachedSegment[i] = k;
+		}
+
+		// V0 + t * (V1 - V0) on whole vectors rounds exactly like the scalar
+		// blend in AnimateModels
+		const float duration = times[k + 1] - times[k];
+		const float t = (time - times[k]) / duration;
+		if (m_positionModes[i] == PositionInterpolation::Linear && m_rotationModes[i] == RotationInterpolation::Euler)
+		{
+			laneTrack[lanes] = static_cast<uint32_t>(i);
+			laneKey[lanes] = k;
+			laneFactor[lanes] = t;
+			if (++lanes == 4)
+				flushLanes();
+			continue;
+		}
+
+		// Keeps the sink calls in track order
+		flushLanes();
+		const XMVECTOR factor = XMVectorReplicate(t);
+		XMFLOAT3 position, rotation, scale;
+
+		if (m_positionModes[i] == PositionInterpolation::Linear)
+		{
+			XMStoreFloat3(&position, XMVectorLerpV(XMLoadFloat3(&m_positions[k]), XMLoadFloat3(&m_positions[k + 1]), factor));
+		}
+		else
+		{
+			// Tangents are per second, the curve runs over the key interval
+			const XMVECTOR scaleToSegment = XMVectorReplicate(duration);
+			XMStoreFloat3(&position, XMVectorHermite(XMLoadFloat3(&m_positions[k]), XMVectorMultiply(XMLoadFloat3(&m_tangents[k]), scaleToSegment),
+				XMLoadFloat3(&m_positions[k + 1]), XMVectorMultiply(XMLoadFloat3(&m_tangents[k + 1]), scaleToSegment), t));
+		}
+
+		if (m_rotationModes[i] == RotationInterpolation::Euler)
+			XMStoreFloat3(&rotation, XMVectorLerpV(XMLoadFloat3(&m_rotations[k]), XMLoadFloat3(&m_rotations[k + 1]), factor));
+		else
+			rotation = EulerDegreesFromQuaternion(XMQuaternionSlerpV(XMLoadFloat4(&m_orientations[k]), XMLoadFloat4(&m_orientations[k + 1]), factor));
+
+		XMStoreFloat3(&scale, XMVectorLerpV(XMLoadFloat3(&m_scales[k]), XMLoadFloat3(&m_scales[k + 1]), factor));
+		sink(m_targets[i], position, rotation, scale);
+	}
+	flushLanes();
+}
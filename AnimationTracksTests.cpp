@@ -0,0 +1,365 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "SceneGenerator.h"
+#include "TestUtils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	bool SameBits(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return memcmp(&a, &b, sizeof(XMFLOAT3)) == 0;
+	}
+
+	float LargestDifference(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		float d = fabsf(a.x - b.x);
+		d = fabsf(a.y - b.y) > d ? fabsf(a.y - b.y) : d;
+		d = fabsf(a.z - b.z) > d ? fabsf(a.z - b.z) : d;
+		return d;
+	}
+}
+
+// With Euler rotations and linear positions AnimationTracks has to give the
+// very same poses as AnimateModels, on the generated scenes and on tracks with
+// keys before zero, repeated and out of order key times, and a zero length
+// loop. Then the clock, scene reload diffs of animated instances, the
+// determinism of a frame, and slerp and the splines.
+int D3D12HelloTriangle::RunAnimationSelfTest()
+{
+	TestChecks check;
+
+	uint32_t seed = 777;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<float>(seed >> 8) / static_cast<float>(1 << 24);
+	};
+
+	// Steps both evaluators through the same times and compares every pose
+	auto compare = [&](std::vector<ModelDesc> descs, const std::vector<float>& times, const std::string& what) {
+		for (ModelDesc& desc : descs)
+		{
+			desc.rotationInterpolation = RotationInterpolation::Euler;
+			desc.positionInterpolation = PositionInterpolation::Linear;
+		}
+		std::vector<ModelDesc> reference = descs;
+		std::vector<ModelDesc> sampled = descs;
+		AnimationTracks tracks;
+		BuildAnimationTracks(descs, tracks);
+
+		size_t mismatches = 0;
+		float largest = 0.0f;
+		for (float time : times)
+		{
+			AnimateModels(reference, time);
+			EvaluateAnimationTracks(tracks, time, sampled);
+			for (size_t i = 0; i < descs.size(); i++)
+			{
+				const ModelDesc& a = reference[i];
+				const ModelDesc& b = sampled[i];
+				if (!SameBits(a.position, b.position) || !SameBits(a.rotation, b.rotation) || !SameBits(a.scale, b.scale))
+					mismatches++;
+				float d = LargestDifference(a.position, b.position);
+				d = LargestDifference(a.rotation, b.rotation) > d ? LargestDifference(a.rotation, b.rotation) : d;
+				d = LargestDifference(a.scale, b.scale) > d ? LargestDifference(a.scale, b.scale) : d;
+				largest = d > largest ? d : largest;
+			}
+		}
+		if (mismatches)
+			std::cout << "  " << mismatches << " poses differ, by up to " << largest << "\n";
+		check(mismatches == 0, what);
+		return tracks.CacheHits();
+	};
+
+	std::vector<float> playback;
+	for (int frame = 0; frame < 600; frame++)
+		playback.push_back(frame / 60.0f);
+	std::vector<float> scrubbing;
+	for (int i = 0; i < 600; i++)
+		scrubbing.push_back(random() * 12.0f - 1.0f);
+
+	SceneGeneratorOptions options;
+	options.instances = 2000;
+	options.animated = 1500;
+	const SceneData scene = GenerateScene(options);
+	const uint64_t hits = compare(scene.models, playback, "generated scene, played back at 60 fps");
+	check(hits > 0, "playback is answered from the cached key pair");
+	compare(scene.models, scrubbing, "generated scene, random times");
+
+	// Tracks of 2 to 8 keys: sorted, sorted with repeated times, starting
+	// after zero, ending at zero or before it, and shuffled
+	std::vector<ModelDesc> odd(1000);
+	for (size_t i = 0; i < odd.size(); i++)
+	{
+		ModelDesc& desc = odd[i];
+		desc.id = static_cast<int>(i);
+		const int kind = static_cast<int>(i % 5);
+		const int keyCount = 2 + static_cast<int>(random() * 7.0f);
+		float time = kind == 2 ? 0.5f + random() * 2.0f : (kind == 3 ? -3.0f : 0.0f);
+		for (int k = 0; k < keyCount; k++)
+		{
+			AnimationFrame frame;
+			frame.time = time;
+			frame.position = { random() * 10.0f, random() * 10.0f, random() * 10.0f };
+			frame.rotation = { random() * 360.0f, random() * 360.0f, random() * 360.0f };
+			frame.scale = { random() + 0.5f, random() + 0.5f, random() + 0.5f };
+			desc.animationFrames.push_back(frame);
+			time += (kind == 1 && random() < 0.4f) ? 0.0f : random() * 2.0f;
+		}
+		if (kind == 3)
+			desc.animationFrames.back().time = random() < 0.5f ? 0.0f : -0.5f;
+		if (kind == 4)
+		{
+			for (size_t k = desc.animationFrames.size(); k > 1; k--)
+				std::swap(desc.animationFrames[k - 1].time, desc.animationFrames[static_cast<size_t>(random() * k)].time);
+		}
+	}
+	compare(odd, playback, "unusual key times, played back at 60 fps");
+	compare(odd, scrubbing, "unusual key times, random times");
+
+	// Fixed step and scripted clocks depend on the frame index only
+	AnimationClock clock;
+	clock.SetFixedStep(1.0 / 60.0);
+	bool ticksMatch = true;
+	for (uint64_t frame = 0; frame < 100000; frame++)
+		ticksMatch = ticksMatch && clock.Tick() == clock.TimeAtFrame(frame);
+	check(ticksMatch && clock.TimeAtFrame(60) == 1.0f, "fixed step: tick n is at n * step");
+	clock.SetScript({ 0.5f, 0.25f, 2.0f });
+	const float t0 = clock.Tick(), t1 = clock.Tick(), t2 = clock.Tick(), t3 = clock.Tick();
+	check(t0 == 0.5f && t1 == 0.25f && t2 == 2.0f && t3 == 2.0f, "scripted: times in order, then the last one held");
+
+	// A scene reload diffs the file against ModelDescriptions, where animated
+	// instances hold the pose of the last frame. That pose is no edit; a
+	// changed key of an animated instance and a moved still one are.
+	{
+		std::vector<ModelDesc> playing = scene.models;
+		AnimationTracks tracks;
+		BuildAnimationTracks(playing, tracks);
+		EvaluateAnimationTracks(tracks, 1.25f, playing);
+		size_t animated = 0, still = 0;
+		bool posed = false;
+		for (size_t i = 0; i < playing.size(); i++)
+		{
+			if (playing[i].animationFrames.size() >= 2)
+			{
+				posed = posed || !SameBits(playing[i].position, scene.models[i].position);
+				animated = i;
+			}
+			else
+				still = i;
+		}
+		check(posed, "scene reload: the animated instances are posed");
+		check(DiffScenes(MakeSceneDiffItems(playing), MakeSceneDiffItems(scene.models)).Empty(),
+			"scene reload: reloading the same file while animating is an empty diff");
+
+		std::vector<ModelDesc> edited = scene.models;
+		edited[animated].animationFrames[0].position.x += 1.0f;
+		edited[still].position.x += 1.0f;
+		const SceneDiff diff = DiffScenes(MakeSceneDiffItems(playing), MakeSceneDiffItems(edited));
+		bool editsFound = diff.EditCount() == 2 && !diff.ChangesStructure() && !diff.ChangesOrder();
+		for (const SceneDiff::Match& match : diff.matched)
+		{
+			if (match.to == animated)
+				editsFound = editsFound && match.animationChanged && !match.transformChanged;
+			if (match.to == still)
+				editsFound = editsFound && match.transformChanged && !match.animationChanged;
+		}
+		check(editsFound, "scene reload: an edited key and a moved still instance are the only edits");
+	}
+
+	// Frame n of a fixed step run is the same whether it is evaluated on
+	// fresh tracks, after the frames before it, or after random frames
+	std::vector<ModelDesc> curves = scene.models;
+	for (size_t i = 0; i < curves.size(); i++)
+	{
+		curves[i].positionInterpolation = static_cast<PositionInterpolation>(i % 3);
+		for (AnimationFrame& frame : curves[i].animationFrames)
+			frame.tangent = { random() * 4.0f - 2.0f, random() * 4.0f - 2.0f, random() * 4.0f - 2.0f };
+	}
+	clock.SetFixedStep(1.0 / 60.0);
+	AnimationTracks sequential, shuffled;
+	BuildAnimationTracks(curves, sequential);
+	BuildAnimationTracks(curves, shuffled);
+	std::vector<ModelDesc> sequentialPose = curves, shuffledPose = curves, freshPose = curves;
+	size_t poseMismatches = 0, transformMismatches = 0;
+	for (uint64_t frame = 0; frame < 400; frame++)
+	{
+		const float seconds = clock.Tick();
+		EvaluateAnimationTracks(sequential, seconds, sequentialPose);
+		if (frame % 40 != 0)
+			continue;
+
+		for (int k = 0; k < 5; k++)
+			EvaluateAnimationTracks(shuffled, clock.TimeAtFrame(static_cast<uint64_t>(random() * 2000.0f)), shuffledPose);
+		EvaluateAnimationTracks(shuffled, seconds, shuffledPose);
+		AnimationTracks fresh;
+		BuildAnimationTracks(curves, fresh);
+		EvaluateAnimationTracks(fresh, seconds, freshPose);
+
+		for (size_t i = 0; i < curves.size(); i++)
+		{
+			const ModelDesc& a = sequentialPose[i];
+			for (const ModelDesc* b : { &shuffledPose[i], &freshPose[i] })
+			{
+				if (!SameBits(a.position, b->position) || !SameBits(a.rotation, b->rotation) || !SameBits(a.scale, b->scale))
+					poseMismatches++;
+				XMFLOAT4X4 x, y;
+				XMStoreFloat4x4(&x, ModelTransform(a));
+				XMStoreFloat4x4(&y, ModelTransform(*b));
+				if (memcmp(&x, &y, sizeof(x)) != 0)
+					transformMismatches++;
+			}
+		}
+	}
+	check(poseMismatches == 0, "fixed step: a frame's poses do not depend on the frames evaluated before it");
+	check(transformMismatches == 0, "fixed step: so do the instance transforms");
+
+	// One track per case, evaluated at a single time
+	auto sample = [](const ModelDesc& desc, float seconds) {
+		std::vector<ModelDesc> descs(1, desc);
+		AnimationTracks tracks;
+		BuildAnimationTracks(descs, tracks);
+		EvaluateAnimationTracks(tracks, seconds, descs);
+		return descs[0];
+	};
+	auto key = [](float time, XMFLOAT3 position, XMFLOAT3 rotation, XMFLOAT3 tangent) {
+		AnimationFrame frame;
+		frame.time = time;
+		frame.position = position;
+		frame.rotation = rotation;
+		frame.scale = { 1.0f, 1.0f, 1.0f };
+		frame.tangent = tangent;
+		return frame;
+	};
+	const XMFLOAT3 zero = { 0.0f, 0.0f, 0.0f };
+
+	ModelDesc turn;
+	turn.animationFrames = { key(0.0f, zero, { 0.0f, 350.0f, 0.0f }, zero), key(1.0f, zero, { 0.0f, 10.0f, 0.0f }, zero) };
+	const float slerpYaw = sample(turn, 0.5f).rotation.y;
+	check(fabsf(slerpYaw) < 1e-3f, "slerp: 350 to 10 degrees passes 0, not 180 (got " + std::to_string(slerpYaw) + ")");
+	turn.rotationInterpolation = RotationInterpolation::Euler;
+	check(sample(turn, 0.5f).rotation.y == 180.0f, "euler: 350 to 10 degrees blends the angles");
+
+	bool roundTrips = true;
+	for (int i = 0; i < 2000; i++)
+	{
+		const XMFLOAT3 degrees = { random() * 178.0f - 89.0f, random() * 358.0f - 179.0f, random() * 358.0f - 179.0f };
+		const XMFLOAT3 back = AnimationTracks::EulerDegreesFromQuaternion(AnimationTracks::QuaternionFromEulerDegrees(degrees));
+		roundTrips = roundTrips && LargestDifference(degrees, back) < 0.05f;
+	}
+	check(roundTrips, "euler angles survive a quaternion round trip");
+	bool gimbalMatches = true;
+	for (float pitch : { 90.0f, -90.0f })
+	{
+		const XMFLOAT3 degrees = { pitch, random() * 180.0f - 90.0f, random() * 180.0f - 90.0f };
+		const XMFLOAT3 back = AnimationTracks::EulerDegreesFromQuaternion(AnimationTracks::QuaternionFromEulerDegrees(degrees));
+		XMFLOAT4X4 x, y;
+		XMStoreFloat4x4(&x, XMMatrixRotationQuaternion(AnimationTracks::QuaternionFromEulerDegrees(degrees)));
+		XMStoreFloat4x4(&y, XMMatrixRotationQuaternion(AnimationTracks::QuaternionFromEulerDegrees(back)));
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				gimbalMatches = gimbalMatches && fabsf(x.m[r][c] - y.m[r][c]) < 1e-3f;
+	}
+	check(gimbalMatches, "euler angles straight up and down give the same orientation back");
+
+	ModelDesc spline;
+	spline.animationFrames = {
+		key(0.0f, { 0.0f, 0.0f, 0.0f }, zero, { 1.0f, 0.0f, 0.0f }),
+		key(1.0f, { 1.0f, 2.0f, 0.0f }, zero, { 0.0f, 0.0f, 3.0f }),
+		key(3.0f, { 4.0f, 0.0f, 1.0f }, zero, { 0.0f, 1.0f, 0.0f }),
+		key(4.0f, { 5.0f, 1.0f, 1.0f }, zero, zero),
+	};
+	bool throughKeys = true;
+	for (PositionInterpolation mode : { PositionInterpolation::CatmullRom, PositionInterpolation::Hermite })
+	{
+		spline.positionInterpolation = mode;
+		for (size_t k = 0; k + 1 < spline.animationFrames.size(); k++)
+			throughKeys = throughKeys && LargestDifference(sample(spline, spline.animationFrames[k].time).position, spline.animationFrames[k].position) < 1e-5f;
+	}
+	check(throughKeys, "catmull-rom and hermite curves pass through their keys");
+	const XMFLOAT3 curved = sample(spline, 2.0f).position;
+	spline.positionInterpolation = PositionInterpolation::CatmullRom;
+	const XMFLOAT3 catmullRom = sample(spline, 2.0f).position;
+	// Tangents (4, 0, 1) / 3 and (4, -1, 1) / 3 over a 2 second segment
+	check(LargestDifference(catmullRom, { 2.5f, 1.0f + 1.0f / 12.0f, 0.5f }) < 1e-5f, "catmull-rom takes its tangents from the neighbouring keys");
+	check(LargestDifference(curved, catmullRom) > 0.1f, "hermite follows the stored tangents");
+	for (AnimationFrame& frame : spline.animationFrames)
+		frame.tangent = zero;
+	spline.positionInterpolation = PositionInterpolation::Hermite;
+	check(LargestDifference(sample(spline, 2.0f).position, { 2.5f, 1.0f, 0.5f }) < 1e-5f, "hermite with flat tangents is halfway at half time");
+
+	return check.Finish("animation");
+}
+
+int D3D12HelloTriangle::RunAnimationBenchmark(unsigned instanceCount)
+{
+	if (instanceCount == 0)
+		instanceCount = 100000;
+
+	SceneGeneratorOptions options;
+	options.instances = instanceCount;
+	options.animated = instanceCount;
+	SceneData scene = GenerateScene(options);
+	for (ModelDesc& desc : scene.models)
+	{
+		desc.rotationInterpolation = RotationInterpolation::Euler;
+		desc.positionInterpolation = PositionInterpolation::Linear;
+	}
+
+	const int frameCount = 300;
+	std::vector<float> scrubbing;
+	uint32_t seed = 99;
+	for (int i = 0; i < frameCount; i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		scrubbing.push_back(static_cast<float>(seed >> 8) / static_cast<float>(1 << 24) * 10.0f);
+	}
+
+	std::cout << instanceCount << " animated instances, " << frameCount << " frames\n";
+	for (int mode = 0; mode < 2; mode++)
+	{
+		auto timeAt = [&](int frame) { return mode == 0 ? frame / 60.0f : scrubbing[frame]; };
+
+		std::vector<ModelDesc> descs = scene.models;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frameCount; frame++)
+			AnimateModels(descs, timeAt(frame));
+		const double scanMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frameCount;
+
+		descs = scene.models;
+		AnimationTracks tracks;
+		start = std::chrono::high_resolution_clock::now();
+		BuildAnimationTracks(descs, tracks);
+		const double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frameCount; frame++)
+			EvaluateAnimationTracks(tracks, timeAt(frame), descs);
+		const double tracksMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frameCount;
+
+		const double lookups = static_cast<double>(tracks.CacheHits() + tracks.Searches());
+		std::cout << (mode == 0 ? "playback at 60 fps" : "random times") << ":\n"
+			<< "  frame scan " << scanMs << " ms/frame\n"
+			<< "  tracks " << tracksMs << " ms/frame (" << scanMs / tracksMs << "x), built in " << buildMs << " ms, "
+			<< (lookups > 0 ? 100.0 * tracks.CacheHits() / lookups : 0.0) << "% of lookups cached\n";
+
+		// What slerp and the curves cost on top
+		descs = scene.models;
+		for (ModelDesc& desc : descs)
+		{
+			desc.rotationInterpolation = RotationInterpolation::Slerp;
+			desc.positionInterpolation = PositionInterpolation::CatmullRom;
+		}
+		BuildAnimationTracks(descs, tracks);
+		start = std::chrono::high_resolution_clock::now();
+		for (int frame = 0; frame < frameCount; frame++)
+			EvaluateAnimationTracks(tracks, timeAt(frame), descs);
+		const double curvesMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frameCount;
+		std::cout << "  tracks, slerp + catmull-rom " << curvesMs << " ms/frame\n";
+	}
+	return 0;
+}
@@ -0,0 +1,52 @@
+#include "stdafx.h"
+#include "BlasBatchPlanner.h"
+#include <algorithm>
+
+BlasBatchPlan PlanBlasBatch(const std::vector<BlasBuildRequest>& requests, uint64_t scratchBudget, uint64_t alignment)
+{
+	BlasBatchPlan plan;
+	if (requests.empty())
+		return plan;
+
+	std::vector<uint64_t> sizes(requests.size());
+	std::vector<uint32_t> order(requests.size());
+	for (uint32_t i = 0; i < requests.size(); i++)
+	{
+		sizes[i] = (requests[i].scratchSize + alignment - 1) & ~(alignment - 1);
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&sizes](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
+
+	// First fit decreasing: each build goes into the first wave with room left
+	std::vector<uint64_t> waveUsed;
+	std::vector<std::vector<BlasBatchPlan::Build> > waves;
+	for (uint32_t request : order)
+	{
+		size_t wave = 0;
+		while (wave < waves.size() && waveUsed[wave] + sizes[request] > scratchBudget)
+			wave++;
+		if (wave == waves.size())
+		{
+			waves.emplace_back();
+			waveUsed.push_back(0);
+		}
+		waves[wave].push_back({ request, waveUsed[wave] });
+		waveUsed[wave] += sizes[request];
+	}
+
+	// Within a wave the order does not matter; request order keeps recording predictable
+	for (size_t wave = 0; wave < waves.size(); wave++)
+	{
+		std::sort(waves[wave].begin(), waves[wave].end(),
+			[](const BlasBatchPlan::Build& a, const BlasBatchPlan::Build& b) { return a.request < b.request; });
+		plan.waveStarts.push_back(static_cast<uint32_t>(plan.builds.size()));
+		plan.builds.insert(plan.builds.end(), waves[wave].begin(), waves[wave].end());
+		plan.scratchSize = waveUsed[wave] > plan.scratchSize ? waveUsed[wave] : plan.scratchSize;
+	}
+
+	for (const BlasBuildRequest& request : requests)
+		plan.resultBuffers.push_back(request.resultBuffer);
+	std::sort(plan.resultBuffers.begin(), plan.resultBuffers.end());
+	plan.resultBuffers.erase(std::unique(plan.resultBuffers.begin(), plan.resultBuffers.end()), plan.resultBuffers.end());
+	return plan;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Layout of a batch of BLAS builds recorded back to back on one command list.
+// The builds share one scratch region: those in the same wave get disjoint
+// ranges of it and may run concurrently, and a UAV barrier on the scratch
+// between waves lets the next wave reuse it. Builds are packed largest first
+// into as few waves as the scratch budget allows. Only the TLAS build reads
+// the results, so they take one barrier per result buffer after the last wave
+// instead of one per build.
+
+struct BlasBuildRequest
+{
+	uint64_t scratchSize = 0;
+	uint64_t resultBuffer = 0; // identifies the buffer the result is placed in
+};
+
+struct BlasBatchPlan
+{
+	struct Build
+	{
+		uint32_t request;       // index into the requests
+		uint64_t scratchOffset; // into the shared scratch region
+	};
+
+	std::vector<Build> builds;           // in recording order, wave after wave
+	std::vector<uint32_t> waveStarts;    // first build of each wave
+	uint64_t scratchSize = 0;            // of the shared region
+	std::vector<uint64_t> resultBuffers; // each gets a UAV barrier after the last wave
+
+	size_t WaveCount() const { return waveStarts.size(); }
+	size_t WaveEnd(size_t wave) const { return wave + 1 < waveStarts.size() ? waveStarts[wave + 1] : builds.size(); }
+	// Scratch barriers between the waves and result barriers at the end
+	size_t BarrierCount() const { return (waveStarts.empty() ? 0 : waveStarts.size() - 1) + resultBuffers.size(); }
+};
+
+// Plans the builds of `requests` in a scratch region of at most `scratchBudget`
+// bytes. A build needing more than the budget gets a wave of its own, and the
+// region grows to fit it.
+BlasBatchPlan PlanBlasBatch(const std::vector<BlasBuildRequest>& requests, uint64_t scratchBudget, uint64_t alignment = 256);
+
+// PlanBlasBatch on hand-made and random batches (-testblasbatch), BlasBatchPlannerTests.cpp
+int RunBlasBatchSelfTest();
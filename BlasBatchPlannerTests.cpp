@@ -0,0 +1,195 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "BlasBatchPlanner.h"
+#include "TestUtils.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <set>
+#include <utility>
+
+// PlanBlasBatch on hand-made and random batches: every build planned once,
+// disjoint aligned scratch within each wave, as few waves as first fit
+// decreasing promises, and one barrier per distinct result buffer.
+int RunBlasBatchSelfTest()
+{
+	TestChecks check;
+
+	// Builds planned once each, scratch of a wave disjoint, aligned and inside the region
+	auto validPlan = [](const std::vector<BlasBuildRequest>& requests, const BlasBatchPlan& plan, uint64_t alignment) {
+		std::vector<int> seen(requests.size(), 0);
+		if (plan.builds.size() != requests.size() || (plan.WaveCount() == 0) != requests.empty())
+			return false;
+		for (size_t wave = 0; wave < plan.WaveCount(); wave++)
+		{
+			if (plan.waveStarts[wave] >= plan.WaveEnd(wave))
+				return false;
+			std::vector<std::pair<uint64_t, uint64_t> > ranges;
+			for (size_t b = plan.waveStarts[wave]; b < plan.WaveEnd(wave); b++)
+			{
+				const BlasBatchPlan::Build& build = plan.builds[b];
+				if (build.request >= requests.size() || seen[build.request]++ || build.scratchOffset % alignment != 0)
+					return false;
+				const uint64_t end = build.scratchOffset + requests[build.request].scratchSize;
+				if (end > plan.scratchSize)
+					return false;
+				ranges.push_back({ build.scratchOffset, end });
+			}
+			std::sort(ranges.begin(), ranges.end());
+			for (size_t r = 1; r < ranges.size(); r++)
+			{
+				if (ranges[r].first < ranges[r - 1].second)
+					return false;
+			}
+		}
+		return true;
+	};
+
+	{
+		const BlasBatchPlan plan = PlanBlasBatch({}, 1024);
+		check(plan.builds.empty() && plan.WaveCount() == 0 && plan.scratchSize == 0 && plan.BarrierCount() == 0,
+			"an empty batch plans nothing");
+	}
+
+	{
+		std::vector<BlasBuildRequest> requests(3);
+		requests[0].scratchSize = 100;
+		requests[1].scratchSize = 300;
+		requests[2].scratchSize = 256;
+		const BlasBatchPlan plan = PlanBlasBatch(requests, 1 << 20, 256);
+		check(validPlan(requests, plan, 256), "small batch: valid plan");
+		check(plan.WaveCount() == 1 && plan.scratchSize == 256 + 512 + 256, "a batch within budget is one wave over the aligned sum");
+		check(plan.builds[0].request == 0 && plan.builds[1].request == 1 && plan.builds[2].request == 2,
+			"a wave records its builds in request order");
+		check(plan.builds[1].scratchOffset == 0, "the largest build is placed first");
+		check(plan.resultBuffers.size() == 1 && plan.BarrierCount() == 1, "one result buffer, one barrier for the batch");
+	}
+
+	{
+		// 60+40 and 50+30+20 fill two waves of 100 exactly
+		const uint64_t sizes[] = { 20, 50, 60, 30, 40 };
+		std::vector<BlasBuildRequest> requests(5);
+		for (size_t i = 0; i < 5; i++)
+		{
+			requests[i].scratchSize = sizes[i];
+			requests[i].resultBuffer = 1 + i % 3;
+		}
+		const BlasBatchPlan plan = PlanBlasBatch(requests, 100, 1);
+		check(validPlan(requests, plan, 1), "tight budget: valid plan");
+		check(plan.WaveCount() == 2 && plan.scratchSize == 100, "tight budget: two full waves");
+		check(plan.resultBuffers.size() == 3 && plan.BarrierCount() == 1 + 3,
+			"one scratch barrier between the waves and one per distinct result buffer");
+	}
+
+	{
+		std::vector<BlasBuildRequest> requests(3);
+		requests[0].scratchSize = 300;
+		requests[1].scratchSize = 5000;
+		requests[2].scratchSize = 400;
+		const BlasBatchPlan plan = PlanBlasBatch(requests, 1024, 256);
+		check(validPlan(requests, plan, 256), "oversized build: valid plan");
+		check(plan.WaveCount() == 2 && plan.scratchSize == 5120, "a build over budget gets a wave of its own and the region grows to it");
+		check(plan.WaveEnd(0) - plan.waveStarts[0] == 1 && plan.builds[0].request == 1, "the oversized build is alone");
+	}
+
+	// Random batches: first fit leaves at most one wave half empty or less,
+	// so the wave count stays under 2 * total / budget + 1
+	uint32_t seed = 57;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	};
+	bool randomValid = true, randomWaves = true, randomBudget = true, randomBarriers = true;
+	for (int round = 0; round < 500; round++)
+	{
+		const uint64_t alignment = 256;
+		const uint64_t budget = alignment * (4 + random() % 400);
+		std::vector<BlasBuildRequest> requests(random() % 200);
+		uint64_t total = 0;
+		std::set<uint64_t> buffers;
+		for (BlasBuildRequest& request : requests)
+		{
+			request.scratchSize = 1 + random() % budget;
+			request.resultBuffer = random() % 6;
+			total += (request.scratchSize + alignment - 1) & ~(alignment - 1);
+			buffers.insert(request.resultBuffer);
+		}
+		const BlasBatchPlan plan = PlanBlasBatch(requests, budget, alignment);
+		randomValid = randomValid && validPlan(requests, plan, alignment);
+		randomWaves = randomWaves && plan.WaveCount() <= 2 * total / budget + 1;
+		randomBudget = randomBudget && plan.scratchSize <= budget;
+		randomBarriers = randomBarriers && plan.resultBuffers.size() == buffers.size();
+	}
+	check(randomValid, "random batches: valid plans");
+	check(randomWaves, "random batches: wave count within the first fit bound");
+	check(randomBudget, "random batches: the region stays within budget");
+	check(randomBarriers, "random batches: one barrier per distinct result buffer");
+
+	return check.Finish("BLAS batch");
+}
+
+// Plans batches of synthetic meshes, sized like RunBlockAllocatorBenchmark's,
+// with the scratch budget BuildMeshBLASes uses. Reports planning time, waves,
+// barriers and the shared scratch region against building each BLAS with its
+// own scratch and a barrier after it.
+int D3D12HelloTriangle::RunBlasBatchBenchmark(unsigned meshCount)
+{
+	if (meshCount == 0)
+		meshCount = 1000;
+
+	uint32_t seed = 99;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	};
+
+	// 100 to 1M triangles, log uniform, about 64 bytes of scratch per triangle;
+	// results spread over the pool pages they would land in
+	std::vector<BlasBuildRequest> requests(meshCount);
+	uint64_t totalScratch = 0, pageUsed = 0, page = 0;
+	for (BlasBuildRequest& request : requests)
+	{
+		const double triangles = 100.0 * pow(10000.0, (random() % 10000) / 10000.0);
+		request.scratchSize = static_cast<uint64_t>(triangles * 64.0);
+		if (pageUsed + request.scratchSize > BlasScratchBudget)
+		{
+			page++;
+			pageUsed = 0;
+		}
+		pageUsed += request.scratchSize;
+		request.resultBuffer = page;
+		totalScratch += request.scratchSize;
+	}
+
+	for (unsigned batchSize : { 1u, 10u, 100u, meshCount })
+	{
+		const int iterations = 20;
+		size_t waves = 0, barriers = 0, batches = 0;
+		uint64_t peakScratch = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int iteration = 0; iteration < iterations; iteration++)
+		{
+			for (size_t first = 0; first < requests.size(); first += batchSize)
+			{
+				const size_t end = first + batchSize < requests.size() ? first + batchSize : requests.size();
+				const std::vector<BlasBuildRequest> batch(requests.begin() + first, requests.begin() + end);
+				const BlasBatchPlan plan = PlanBlasBatch(batch, BlasScratchBudget);
+				if (iteration == 0)
+				{
+					waves += plan.WaveCount();
+					barriers += plan.BarrierCount();
+					batches++;
+					peakScratch = plan.scratchSize > peakScratch ? plan.scratchSize : peakScratch;
+				}
+			}
+		}
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / iterations;
+
+		std::cout << meshCount << " meshes in batches of " << batchSize << ": " << batches << " submissions, " << waves << " waves, "
+			<< barriers << " UAV barriers (" << meshCount << " one by one), largest scratch region "
+			<< peakScratch / 1024 / 1024 << " MB; planning " << ms << " ms\n";
+	}
+	std::cout << "scratch of every build: " << totalScratch / 1024 / 1024 << " MB in " << meshCount << " allocations\n";
+	return 0;
+}
@@ -0,0 +1,60 @@
+#include "stdafx.h"
+#include "BlasCompaction.h"
+
+BlasCompactionQueue::BlasCompactionQueue(uint32_t slotCount)
+	: m_slotCount(slotCount)
+{
+	// Handed out from the back, so slot 0 goes first
+	for (uint32_t slot = slotCount; slot > 0; slot--)
+		m_freeSlots.push_back(slot - 1);
+}
+
+uint32_t BlasCompactionQueue::Add(uint64_t id, uint64_t size, uint64_t fenceValue)
+{
+	if (m_freeSlots.empty())
+	{
+		m_stats.noSlot++;
+		return UINT32_MAX;
+	}
+
+	const uint32_t slot = m_freeSlots.back();
+	m_freeSlots.pop_back();
+	m_pending.push_back({ id, size, fenceValue, slot });
+	return slot;
+}
+
+size_t BlasCompactionQueue::Process(uint64_t completedFenceValue, BlasCompactionDevice& device)
+{
+	size_t compacted = 0;
+	size_t kept = 0;
+	for (size_t i = 0; i < m_pending.size(); i++)
+	{
+		const Entry entry = m_pending[i];
+		if (entry.fenceValue > completedFenceValue)
+		{
+			m_pending[kept++] = entry;
+			continue;
+		}
+
+		const uint64_t compactedSize = device.CompactedSize(entry.slot);
+		m_freeSlots.push_back(entry.slot);
+		if (compactedSize == 0 || compactedSize >= entry.size)
+		{
+			m_stats.skipped++;
+		}
+		else if (device.Compact(entry.id, compactedSize))
+		{
+			m_stats.compacted++;
+			m_stats.bytesBefore += entry.size;
+			m_stats.bytesAfter += compactedSize;
+			compacted++;
+		}
+		else
+		{
+			m_stats.released++;
+		}
+		device.Release(entry.id);
+	}
+	m_pending.resize(kept);
+	return compacted;
+}
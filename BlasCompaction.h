@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Bookkeeping of BLAS compaction. A BLAS built with ALLOW_COMPACTION writes
+// its compacted size to a postbuild slot; once the fence of that build has
+// completed, the size is read back and, when smaller than the build, the BLAS
+// is copied into a right-sized buffer that replaces it. The GPU side is
+// behind BlasCompactionDevice so the queue runs against a mock in tests.
+
+class BlasCompactionDevice
+{
+public:
+	virtual ~BlasCompactionDevice() {}
+
+	// Compacted size written to `slot` by a build whose fence has completed
+	virtual uint64_t CompactedSize(uint32_t slot) = 0;
+	// Records the copy of BLAS `id` into `compactedSize` bytes and puts the
+	// copy in its place; false when the BLAS is gone
+	virtual bool Compact(uint64_t id, uint64_t compactedSize) = 0;
+	// The queue is done with `id`, compacted or not
+	virtual void Release(uint64_t id) = 0;
+};
+
+struct BlasCompactionStats
+{
+	size_t compacted = 0;
+	size_t skipped = 0;   // no smaller when compacted
+	size_t released = 0;  // gone before its turn
+	size_t noSlot = 0;    // every postbuild slot was taken, so never queued
+	uint64_t bytesBefore = 0; // of the compacted BLASes
+	uint64_t bytesAfter = 0;
+};
+
+class BlasCompactionQueue
+{
+public:
+	explicit BlasCompactionQueue(uint32_t slotCount = 4096);
+	uint32_t SlotCount() const { return m_slotCount; }
+
+	// Tracks the build of BLAS `id`, `size` bytes, finished once `fenceValue`
+	// completes. Returns the postbuild slot the build has to write its
+	// compacted size to, or UINT32_MAX when none is free.
+	uint32_t Add(uint64_t id, uint64_t size, uint64_t fenceValue);
+	// Compacts the builds whose fence completed; returns how many were replaced
+	size_t Process(uint64_t completedFenceValue, BlasCompactionDevice& device);
+
+	size_t PendingCount() const { return m_pending.size(); }
+	const BlasCompactionStats& Stats() const { return m_stats; }
+
+private:
+	struct Entry
+	{
+		uint64_t id;
+		uint64_t size;
+		uint64_t fenceValue;
+		uint32_t slot;
+	};
+
+	uint32_t m_slotCount;
+	std::vector<uint32_t> m_freeSlots;
+	std::vector<Entry> m_pending;
+	BlasCompactionStats m_stats;
+};
+
+// BlasCompactionQueue against a mock device (-testblascompaction), BlasCompactionTests.cpp
+int RunBlasCompactionSelfTest();
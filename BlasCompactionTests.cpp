@@ -0,0 +1,150 @@
+#include "stdafx.h"
+#include "BlasCompaction.h"
+#include "TestUtils.h"
+#include <iostream>
+#include <map>
+#include <set>
+
+namespace
+{
+	// Stands in for the GPU: postbuild slots written by "builds", BLASes that
+	// exist or were released, and a log of what the queue asked for
+	class MockCompactionDevice : public BlasCompactionDevice
+	{
+	public:
+		std::vector<uint64_t> slots;
+		std::set<uint64_t> alive;
+		std::map<uint64_t, uint64_t> sizes;  // current size per BLAS
+		std::vector<uint64_t> released;
+
+		explicit MockCompactionDevice(uint32_t slotCount) : slots(slotCount, 0) {}
+
+		uint64_t CompactedSize(uint32_t slot) override { return slots[slot]; }
+		bool Compact(uint64_t id, uint64_t compactedSize) override
+		{
+			if (!alive.count(id))
+				return false;
+			sizes[id] = compactedSize;
+			return true;
+		}
+		void Release(uint64_t id) override { released.push_back(id); }
+	};
+}
+
+// The compaction bookkeeping without a GPU: slots handed out and taken back,
+// nothing compacted before its fence, only smaller sizes copied, released
+// BLASes skipped, and byte totals that add up.
+int RunBlasCompactionSelfTest()
+{
+	TestChecks check;
+
+	{
+		BlasCompactionQueue queue(4);
+		MockCompactionDevice device(4);
+		const uint32_t a = queue.Add(1, 1000, 5);
+		const uint32_t b = queue.Add(2, 2000, 5);
+		const uint32_t c = queue.Add(3, 3000, 6);
+		check(a != b && b != c && a != c && a < 4 && b < 4 && c < 4 && queue.PendingCount() == 3, "builds get distinct slots");
+		device.slots[a] = 600;
+		device.slots[b] = 2000;
+		device.slots[c] = 1000;
+		device.alive = { 1, 2, 3 };
+
+		check(queue.Process(4, device) == 0 && device.released.empty() && queue.PendingCount() == 3,
+			"nothing is read before the fence of its build");
+		check(queue.Process(5, device) == 1 && device.sizes[1] == 600 && device.sizes.count(2) == 0,
+			"at the fence: the smaller BLAS is compacted, the one that would not shrink is left");
+		check(queue.PendingCount() == 1 && device.released.size() == 2, "both are done with, the later build still waits");
+
+		device.alive.erase(3);
+		check(queue.Process(100, device) == 0 && queue.Stats().released == 1 && device.sizes.count(3) == 0,
+			"a BLAS released before its turn is not copied");
+		const BlasCompactionStats& stats = queue.Stats();
+		check(stats.compacted == 1 && stats.skipped == 1 && stats.bytesBefore == 1000 && stats.bytesAfter == 600,
+			"totals count only the compacted BLAS");
+		check(device.released.size() == 3 && queue.PendingCount() == 0, "every id is released exactly once");
+	}
+
+	{
+		BlasCompactionQueue queue(2);
+		MockCompactionDevice device(2);
+		queue.Add(1, 512, 1);
+		queue.Add(2, 512, 1);
+		check(queue.Add(3, 512, 1) == UINT32_MAX && queue.Stats().noSlot == 1, "with every slot taken a build is not queued");
+		device.alive = { 1, 2 };
+		device.slots[0] = device.slots[1] = 256;
+		queue.Process(1, device);
+		const uint32_t again = queue.Add(4, 512, 2);
+		check(again < 2, "slots are free again once processed");
+	}
+
+	// Random builds, fences and releases against a straightforward model
+	uint32_t seed = 31;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	};
+	BlasCompactionQueue queue(64);
+	MockCompactionDevice device(64);
+	struct Build { uint64_t id, size, compacted, fence; };
+	std::vector<Build> builds;
+	std::set<uint32_t> busySlots;
+	std::map<uint64_t, uint32_t> slotOf;
+	uint64_t fence = 0, expectBefore = 0, expectAfter = 0;
+	size_t expectCompacted = 0;
+	bool slotsOk = true, sizesOk = true, orderOk = true;
+	for (uint64_t id = 1; id <= 5000; id++)
+	{
+		const uint64_t size = 256 * (1 + random() % 100);
+		const uint64_t compacted = random() % 4 == 0 ? size : 256 * (1 + random() % (size / 256));
+		const uint32_t slot = queue.Add(id, size, fence + 1);
+		if (slot != UINT32_MAX)
+		{
+			slotsOk = slotsOk && busySlots.insert(slot).second;
+			slotOf[id] = slot;
+			device.slots[slot] = compacted;
+			device.alive.insert(id);
+			builds.push_back({ id, size, compacted, fence + 1 });
+		}
+		// A few BLASes go away before their turn
+		if (random() % 10 == 0 && !builds.empty())
+			device.alive.erase(builds[random() % builds.size()].id);
+
+		if (random() % 8 == 0)
+		{
+			fence++;
+			const size_t releasedBefore = device.released.size();
+			queue.Process(fence, device);
+			for (size_t k = releasedBefore; k < device.released.size(); k++)
+			{
+				const uint64_t done = device.released[k];
+				busySlots.erase(slotOf[done]);
+				for (size_t b = 0; b < builds.size(); b++)
+				{
+					if (builds[b].id != done)
+						continue;
+					orderOk = orderOk && builds[b].fence <= fence;
+					if (device.alive.count(done) && builds[b].compacted < builds[b].size)
+					{
+						expectCompacted++;
+						expectBefore += builds[b].size;
+						expectAfter += builds[b].compacted;
+						sizesOk = sizesOk && device.sizes[done] == builds[b].compacted;
+					}
+					builds[b] = builds.back();
+					builds.pop_back();
+					break;
+				}
+			}
+			for (const Build& build : builds)
+				orderOk = orderOk && build.fence > fence;
+		}
+	}
+	check(slotsOk, "random builds: a slot is never handed out twice at once");
+	check(orderOk, "random builds: each is done at its fence, not before and not later");
+	check(sizesOk, "random builds: compacted BLASes get the size their slot held");
+	check(queue.Stats().compacted == expectCompacted && queue.Stats().bytesBefore == expectBefore && queue.Stats().bytesAfter == expectAfter,
+		"random builds: compacted count and bytes match");
+
+	return check.Finish("BLAS compaction");
+}
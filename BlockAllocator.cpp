@@ -0,0 +1,176 @@
+#include "stdafx.h"
+#include "BlockAllocator.h"
+#include <iterator>
+
+BlockAllocator::BlockAllocator(uint64_t pageSize, uint64_t alignment)
+	: m_pageSize((pageSize + alignment - 1) & ~(alignment - 1)), m_alignment(alignment)
+{
+}
+
+BlockAllocation BlockAllocator::Allocate(uint64_t size)
+{
+	size = size ? (size + m_alignment - 1) & ~(m_alignment - 1) : m_alignment;
+
+	BlockAllocation allocation;
+	const FreeBlock key = { size, 0, 0 };
+	std::set<FreeBlock>::iterator fit = m_bySize.lower_bound(key);
+	if (fit == m_bySize.end())
+	{
+		const uint32_t page = AddPage(size > m_pageSize ? size : m_pageSize);
+		fit = m_bySize.find({ m_pages[page].size, page, 0 });
+	}
+
+	allocation.page = fit->page;
+	allocation.offset = fit->offset;
+	allocation.size = size;
+
+	// The front of the block is taken, the rest stays free
+	Page& page = m_pages[allocation.page];
+	const uint64_t blockSize = fit->size;
+	EraseFreeBlock(allocation.page, page.freeBlocks.find(allocation.offset));
+	if (blockSize > size)
+		InsertFreeBlock(allocation.page, allocation.offset + size, blockSize - size);
+
+	page.used += size;
+	m_allocationCount++;
+	return allocation;
+}
+
+void BlockAllocator::Free(const BlockAllocation& allocation)
+{
+	if (!allocation.Valid())
+		return;
+
+	Page& page = m_pages[allocation.page];
+	uint64_t offset = allocation.offset;
+	uint64_t size = allocation.size;
+
+	// Merge with the free neighbours on both sides
+	std::map<uint64_t, uint64_t>::iterator next = page.freeBlocks.lower_bound(offset);
+	if (next != page.freeBlocks.end() && next->first == offset + size)
+	{
+		size += next->second;
+		std::map<uint64_t, uint64_t>::iterator merged = next++;
+		EraseFreeBlock(allocation.page, merged);
+	}
+	if (next != page.freeBlocks.begin())
+	{
+		std::map<uint64_t, uint64_t>::iterator previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			offset = previous->first;
+			size += previous->second;
+			EraseFreeBlock(allocation.page, previous);
+		}
+	}
+	InsertFreeBlock(allocation.page, offset, size);
+
+	page.used -= allocation.size;
+	m_allocationCount--;
+	if (page.used != 0)
+		return;
+
+	if (IsDedicated(page))
+	{
+		ReleasePage(allocation.page);
+		return;
+	}
+	// Keep this page as the spare unless there already is one
+	for (uint32_t i = 0; i < m_pages.size(); i++)
+	{
+		if (i != allocation.page && m_pages[i].size != 0 && m_pages[i].used == 0 && !IsDedicated(m_pages[i]))
+		{
+			ReleasePage(allocation.page);
+			return;
+		}
+	}
+}
+
+void BlockAllocator::FreeAfter(const BlockAllocation& allocation, uint64_t fenceValue)
+{
+	if (allocation.Valid())
+		m_pending.push_back({ fenceValue, allocation });
+}
+
+void BlockAllocator::Collect(uint64_t completedFenceValue)
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < m_pending.size(); i++)
+	{
+		if (m_pending[i].fenceValue <= completedFenceValue)
+			Free(m_pending[i].allocation);
+		else
+			m_pending[kept++] = m_pending[i];
+	}
+	m_pending.resize(kept);
+}
+
+BlockAllocatorStats BlockAllocator::Stats() const
+{
+	BlockAllocatorStats stats;
+	for (const Page& page : m_pages)
+	{
+		if (page.size == 0)
+			continue;
+		stats.pageCount++;
+		stats.reservedBytes += page.size;
+		stats.usedBytes += page.used;
+		stats.freeBlockCount += page.freeBlocks.size();
+	}
+	stats.allocationCount = m_allocationCount;
+	stats.pendingFreeCount = m_pending.size();
+	stats.largestFreeBlock = m_bySize.empty() ? 0 : m_bySize.rbegin()->size;
+	return stats;
+}
+
+uint32_t BlockAllocator::AddPage(uint64_t size)
+{
+	uint32_t page = 0;
+	while (page < m_pages.size() && m_pages[page].size != 0)
+		page++;
+	if (page == m_pages.size())
+		m_pages.push_back(Page());
+
+	// The owner backs the page first, so a failure leaves the allocator as it was
+	if (onPageCreated)
+	{
+		try
+		{
+			onPageCreated(page, size);
+		}
+		catch (...)
+		{
+			if (page + 1 == m_pages.size())
+				m_pages.pop_back();
+			throw;
+		}
+	}
+
+	m_pages[page].size = size;
+	m_pages[page].used = 0;
+	InsertFreeBlock(page, 0, size);
+	return page;
+}
+
+void BlockAllocator::ReleasePage(uint32_t page)
+{
+	Page& released = m_pages[page];
+	while (!released.freeBlocks.empty())
+		EraseFreeBlock(page, released.freeBlocks.begin());
+	released.size = 0;
+	released.used = 0;
+	if (onPageReleased)
+		onPageReleased(page);
+}
+
+void BlockAllocator::InsertFreeBlock(uint32_t page, uint64_t offset, uint64_t size)
+{
+	m_pages[page].freeBlocks[offset] = size;
+	m_bySize.insert({ size, page, offset });
+}
+
+void BlockAllocator::EraseFreeBlock(uint32_t page, std::map<uint64_t, uint64_t>::iterator block)
+{
+	m_bySize.erase({ block->second, page, block->first });
+	m_pages[page].freeBlocks.erase(block);
+}
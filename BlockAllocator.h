@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+// Sub-allocates aligned blocks out of large pages, without knowing what backs
+// them: AccelerationStructurePool puts a D3D12 heap behind every page. Free
+// space is kept per page as address ordered blocks that merge with their free
+// neighbours, and a request takes the smallest free block it fits in (the
+// lowest address among equals), so holes left by freed blocks are filled
+// before a page grows the pool.
+//
+// A block still in use by the GPU is handed back with FreeAfter and only
+// becomes free once Collect sees its fence value completed.
+
+// `size` bytes at `offset` in page `page`
+struct BlockAllocation
+{
+	uint32_t page = UINT32_MAX;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	bool Valid() const { return page != UINT32_MAX; }
+};
+
+struct BlockAllocatorStats
+{
+	size_t pageCount = 0;
+	size_t allocationCount = 0;
+	size_t freeBlockCount = 0;
+	size_t pendingFreeCount = 0;  // waiting for their fence
+	uint64_t reservedBytes = 0;   // all pages
+	uint64_t usedBytes = 0;       // live and pending blocks
+	uint64_t largestFreeBlock = 0;
+
+	// 0 when the free space is one block, towards 1 the more it is scattered
+	double Fragmentation() const
+	{
+		const uint64_t freeBytes = reservedBytes - usedBytes;
+		return freeBytes ? 1.0 - static_cast<double>(largestFreeBlock) / static_cast<double>(freeBytes) : 0.0;
+	}
+};
+
+class BlockAllocator
+{
+public:
+	// Called when a page is added to the pool or taken out of it; a page slot
+	// may be used again by a later page
+	std::function<void(uint32_t page, uint64_t size)> onPageCreated;
+	std::function<void(uint32_t page)> onPageReleased;
+
+	// Pages of `pageSize` bytes; a request larger than that gets a page of its
+	// own, released as soon as it is freed. One empty page is kept for the next
+	// request, any other is released. Sizes and offsets are multiples of
+	// `alignment`, a power of two.
+	explicit BlockAllocator(uint64_t pageSize = 64ull << 20, uint64_t alignment = 256);
+
+	BlockAllocation Allocate(uint64_t size);
+	void Free(const BlockAllocation& allocation);
+	void FreeAfter(const BlockAllocation& allocation, uint64_t fenceValue);
+	// Frees the blocks whose fence value is at most `completedFenceValue`
+	void Collect(uint64_t completedFenceValue);
+
+	uint64_t PageSize() const { return m_pageSize; }
+	uint64_t Alignment() const { return m_alignment; }
+	// Size of page `page`, 0 for a slot whose page was released
+	uint64_t PageSize(uint32_t page) const { return page < m_pages.size() ? m_pages[page].size : 0; }
+	BlockAllocatorStats Stats() const;
+
+	// Free blocks of a page as offset -> size, for tests
+	const std::map<uint64_t, uint64_t>& FreeBlocks(uint32_t page) const { return m_pages[page].freeBlocks; }
+
+private:
+	struct Page
+	{
+		uint64_t size = 0;
+		uint64_t used = 0;
+		std::map<uint64_t, uint64_t> freeBlocks;
+	};
+
+	// Ordered by size, then address: the first block not smaller than a
+	// request is the best fit
+	struct FreeBlock
+	{
+		uint64_t size;
+		uint32_t page;
+		uint64_t offset;
+		bool operator<(const FreeBlock& other) const
+		{
+			if (size != other.size) return size < other.size;
+			if (page != other.page) return page < other.page;
+			return offset < other.offset;
+		}
+	};
+
+	uint32_t AddPage(uint64_t size);
+	void ReleasePage(uint32_t page);
+	void InsertFreeBlock(uint32_t page, uint64_t offset, uint64_t size);
+	void EraseFreeBlock(uint32_t page, std::map<uint64_t, uint64_t>::iterator block);
+	bool IsDedicated(const Page& page) const { return page.size > m_pageSize; }
+
+	uint64_t m_pageSize;
+	uint64_t m_alignment;
+	std::vector<Page> m_pages;
+	std::set<FreeBlock> m_bySize;
+	size_t m_allocationCount = 0;
+
+	struct PendingFree
+	{
+		uint64_t fenceValue;
+		BlockAllocation allocation;
+	};
+	std::vector<PendingFree> m_pending;
+};
+
+// BlockAllocator behind the acceleration structure pool (-testasallocator), and pool size
+// and fragmentation over add/remove model sequences (-benchasallocator [edits]), BlockAllocatorTests.cpp
+int RunBlockAllocatorSelfTest();
+int RunBlockAllocatorBenchmark(unsigned stepCount);
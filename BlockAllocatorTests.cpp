@@ -0,0 +1,336 @@
+#include "stdafx.h"
+#include "BlockAllocator.h"
+#include "TestUtils.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+// BlockAllocator on its own: aligned blocks that never overlap, best fit,
+// free neighbours merged, one spare page, dedicated pages for large requests
+// and blocks held back until their fence completes. The random part checks
+// every page against a byte map of the live blocks after each step.
+int RunBlockAllocatorSelfTest()
+{
+	TestChecks check;
+
+	uint32_t seed = 77;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	};
+
+	const uint64_t kPage = 64 * 1024;
+	size_t created = 0, released = 0;
+	auto track = [&created, &released](BlockAllocator& allocator) {
+		allocator.onPageCreated = [&created](uint32_t, uint64_t) { created++; };
+		allocator.onPageReleased = [&released](uint32_t) { released++; };
+	};
+
+	{
+		BlockAllocator allocator(kPage, 256);
+		track(allocator);
+		const BlockAllocation a = allocator.Allocate(1);
+		const BlockAllocation b = allocator.Allocate(300);
+		const BlockAllocation c = allocator.Allocate(256);
+		check(a.offset == 0 && a.size == 256 && b.offset == 256 && b.size == 512 && c.offset == 768,
+			"sizes are rounded up to 256 bytes and blocks are packed from the start of the page");
+		check(created == 1 && a.page == b.page && b.page == c.page, "small requests share one page");
+
+		allocator.Free(a);
+		allocator.Free(c);
+		check(allocator.FreeBlocks(0).size() == 2, "freeing blocks apart leaves two free blocks");
+		allocator.Free(b);
+		check(allocator.FreeBlocks(0).size() == 1 && allocator.FreeBlocks(0).begin()->second == kPage,
+			"freeing the block between them merges all three into the whole page");
+		check(released == 0 && allocator.Stats().pageCount == 1, "the empty page is kept as the spare");
+	}
+
+	{
+		// Holes of 1024 and 512 bytes; a 512 byte request takes the smaller one
+		BlockAllocator allocator(kPage, 256);
+		BlockAllocation blocks[6];
+		for (int i = 0; i < 6; i++)
+			blocks[i] = allocator.Allocate(i == 1 ? 1024 : 512);
+		allocator.Free(blocks[1]);
+		allocator.Free(blocks[3]);
+		const BlockAllocation fit = allocator.Allocate(512);
+		check(fit.offset == blocks[3].offset, "best fit: the smallest hole that fits is used");
+		const BlockAllocation next = allocator.Allocate(512);
+		check(next.offset == blocks[1].offset, "then the larger hole, from its start");
+	}
+
+	{
+		created = released = 0;
+		BlockAllocator allocator(kPage, 256);
+		track(allocator);
+		const BlockAllocation small = allocator.Allocate(256);
+		const BlockAllocation large = allocator.Allocate(3 * kPage + 1);
+		check(large.page != small.page && allocator.PageSize(large.page) == 3 * kPage + 256 && large.offset == 0,
+			"a request larger than a page gets a page of its own size");
+		allocator.Free(large);
+		check(released == 1 && allocator.PageSize(large.page) == 0, "a dedicated page is released when freed");
+
+		const BlockAllocation fill = allocator.Allocate(kPage - 256);
+		const BlockAllocation second = allocator.Allocate(kPage);
+		check(fill.page == small.page && second.page == large.page && created == 3,
+			"a new page reuses the slot of a released one");
+		allocator.Free(second);
+		check(released == 1, "the second page, now empty, stays as the spare");
+		allocator.Free(small);
+		allocator.Free(fill);
+		check(released == 2 && allocator.Stats().pageCount == 1, "with a spare already there, the next empty page is released");
+	}
+
+	{
+		BlockAllocator allocator(kPage, 256);
+		const BlockAllocation keep = allocator.Allocate(256);
+		const BlockAllocation scratch = allocator.Allocate(4096);
+		allocator.FreeAfter(scratch, 10);
+		const BlockAllocation during = allocator.Allocate(4096);
+		check(during.offset != scratch.offset && allocator.Stats().pendingFreeCount == 1,
+			"a block freed after a fence is not handed out before it");
+		allocator.Collect(9);
+		check(allocator.Stats().pendingFreeCount == 1, "Collect before the fence keeps it pending");
+		allocator.Collect(10);
+		const BlockAllocation after = allocator.Allocate(4096);
+		check(allocator.Stats().pendingFreeCount == 0 && after.offset == scratch.offset, "once the fence completed the block is reused");
+		allocator.Free(keep);
+		allocator.Free(during);
+		allocator.Free(after);
+		check(allocator.Stats().usedBytes == 0 && allocator.Stats().allocationCount == 0, "everything freed: nothing used");
+	}
+
+	// Random allocations and frees, some deferred, checked against a byte map
+	created = released = 0;
+	BlockAllocator allocator(kPage, 256);
+	std::vector<std::vector<int> > owner;
+	allocator.onPageCreated = [&](uint32_t page, uint64_t size) {
+		created++;
+		if (page >= owner.size())
+			owner.resize(page + 1);
+		owner[page].assign(static_cast<size_t>(size / 256), -1);
+	};
+	allocator.onPageReleased = [&](uint32_t page) {
+		released++;
+		owner[page].clear();
+	};
+
+	std::vector<BlockAllocation> live;
+	std::vector<std::pair<uint64_t, BlockAllocation> > pending;
+	bool aligned = true, disjoint = true, consistent = true, merged = true;
+	uint64_t fence = 0;
+	for (int step = 0; step < 20000; step++)
+	{
+		const uint32_t action = random() % 10;
+		if (action < 5 || live.empty())
+		{
+			// Mostly small blocks, now and then one past the page size
+			const uint64_t size = random() % 50 == 0 ? kPage + random() % kPage : 1 + random() % (kPage / 4);
+			const BlockAllocation allocation = allocator.Allocate(size);
+			aligned = aligned && allocation.offset % 256 == 0 && allocation.size % 256 == 0 && allocation.size >= size &&
+				allocation.offset + allocation.size <= allocator.PageSize(allocation.page);
+			for (uint64_t k = allocation.offset / 256; k < (allocation.offset + allocation.size) / 256 && k < owner[allocation.page].size(); k++)
+			{
+				disjoint = disjoint && owner[allocation.page][static_cast<size_t>(k)] == -1;
+				owner[allocation.page][static_cast<size_t>(k)] = step;
+			}
+			live.push_back(allocation);
+		}
+		else
+		{
+			const size_t index = random() % live.size();
+			const BlockAllocation allocation = live[index];
+			live[index] = live.back();
+			live.pop_back();
+			if (action < 8)
+			{
+				for (uint64_t k = allocation.offset / 256; k < (allocation.offset + allocation.size) / 256; k++)
+					owner[allocation.page][static_cast<size_t>(k)] = -1;
+				allocator.Free(allocation);
+			}
+			else
+			{
+				allocator.FreeAfter(allocation, fence + 2);
+				pending.push_back({ fence + 2, allocation });
+			}
+		}
+
+		if (step % 16 == 0)
+		{
+			fence++;
+			for (size_t i = 0; i < pending.size();)
+			{
+				if (pending[i].first <= fence)
+				{
+					for (uint64_t k = pending[i].second.offset / 256; k < (pending[i].second.offset + pending[i].second.size) / 256; k++)
+						owner[pending[i].second.page][static_cast<size_t>(k)] = -1;
+					pending[i] = pending.back();
+					pending.pop_back();
+				}
+				else
+				{
+					i++;
+				}
+			}
+			allocator.Collect(fence);
+		}
+
+		// Every page: free blocks are exactly the unowned bytes, never adjacent
+		if (step % 97 == 0)
+		{
+			for (uint32_t page = 0; page < owner.size(); page++)
+			{
+				if (allocator.PageSize(page) == 0)
+					continue;
+				std::vector<int> isFree(owner[page].size(), 0);
+				uint64_t previousEnd = UINT64_MAX;
+				for (const auto& block : allocator.FreeBlocks(page))
+				{
+					merged = merged && block.first != previousEnd;
+					previousEnd = block.first + block.second;
+					for (uint64_t k = block.first / 256; k < previousEnd / 256 && k < isFree.size(); k++)
+						isFree[static_cast<size_t>(k)] = 1;
+				}
+				for (size_t k = 0; k < isFree.size(); k++)
+					consistent = consistent && (isFree[k] == 1) == (owner[page][k] == -1);
+			}
+		}
+	}
+	check(aligned, "random steps: blocks are aligned, large enough and inside their page");
+	check(disjoint, "random steps: live and pending blocks never overlap");
+	check(consistent, "random steps: the free blocks are exactly the bytes nobody holds");
+	check(merged, "random steps: free neighbours are always merged");
+
+	for (const BlockAllocation& allocation : live)
+		allocator.Free(allocation);
+	allocator.Collect(UINT64_MAX);
+	const BlockAllocatorStats stats = allocator.Stats();
+	check(stats.allocationCount == 0 && stats.usedBytes == 0 && stats.pageCount == 1 && created - released == 1,
+		"after freeing everything only the spare page is left");
+
+	return check.Finish("block allocator");
+}
+
+// Replays loading a scene and then adding and removing models at random, as
+// the BLAS pool sees it: a result block per mesh that lives while an instance
+// uses the mesh, and a scratch block per build freed after the build's fence.
+// Reports how much the pool reserves against what CreateBottomLevelAS used to
+// hold: a committed result and scratch resource per mesh, each rounded to the
+// 64 KB a committed resource takes.
+int RunBlockAllocatorBenchmark(unsigned stepCount)
+{
+	if (stepCount == 0)
+		stepCount = 100000;
+
+	uint32_t seed = 99;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	};
+
+	// 1000 meshes from 100 to 1M triangles, log uniform; a BLAS takes about 64
+	// bytes per triangle and its build about as much scratch
+	const size_t meshCount = 1000;
+	std::vector<uint64_t> meshBytes(meshCount);
+	for (size_t i = 0; i < meshCount; i++)
+	{
+		const double triangles = 100.0 * pow(10000.0, (random() % 10000) / 10000.0);
+		meshBytes[i] = static_cast<uint64_t>(triangles * 64.0);
+	}
+	auto committedSize = [](uint64_t size) { return (size + 65535) & ~static_cast<uint64_t>(65535); };
+
+	BlockAllocator results(64ull << 20, 256), scratch(64ull << 20, 256);
+	size_t pagesCreated = 0, pagesReleased = 0;
+	for (BlockAllocator* allocator : { &results, &scratch })
+	{
+		allocator->onPageCreated = [&pagesCreated](uint32_t, uint64_t) { pagesCreated++; };
+		allocator->onPageReleased = [&pagesReleased](uint32_t) { pagesReleased++; };
+	}
+
+	std::vector<BlockAllocation> meshBlas(meshCount);
+	std::vector<unsigned> meshUsers(meshCount, 0);
+	std::vector<size_t> models;
+	uint64_t fence = 1;
+	uint64_t committedBytes = 0, peakCommitted = 0, peakReserved = 0;
+	double allocateMs = 0.0, freeMs = 0.0;
+	size_t allocations = 0, frees = 0;
+
+	auto addModel = [&](size_t mesh) {
+		models.push_back(mesh);
+		if (meshUsers[mesh]++ > 0)
+			return;
+		auto start = std::chrono::high_resolution_clock::now();
+		meshBlas[mesh] = results.Allocate(meshBytes[mesh]);
+		scratch.FreeAfter(scratch.Allocate(meshBytes[mesh]), fence);
+		allocateMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		allocations += 2;
+		committedBytes += 2 * committedSize(meshBytes[mesh]);
+	};
+	auto removeModel = [&](size_t index) {
+		const size_t mesh = models[index];
+		models[index] = models.back();
+		models.pop_back();
+		if (--meshUsers[mesh] > 0)
+			return;
+		auto start = std::chrono::high_resolution_clock::now();
+		results.FreeAfter(meshBlas[mesh], fence);
+		freeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		frees++;
+		committedBytes -= 2 * committedSize(meshBytes[mesh]);
+	};
+	// One frame: the fence of the work recorded so far completes two frames later
+	auto endFrame = [&]() {
+		fence++;
+		auto start = std::chrono::high_resolution_clock::now();
+		results.Collect(fence > 2 ? fence - 2 : 0);
+		scratch.Collect(fence > 2 ? fence - 2 : 0);
+		freeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		const uint64_t reserved = results.Stats().reservedBytes + scratch.Stats().reservedBytes;
+		peakReserved = reserved > peakReserved ? reserved : peakReserved;
+		peakCommitted = committedBytes > peakCommitted ? committedBytes : peakCommitted;
+	};
+	auto report = [&](const char* label) {
+		const BlockAllocatorStats r = results.Stats(), s = scratch.Stats();
+		std::cout << label << ": " << models.size() << " models, BLAS " << r.usedBytes / 1024 / 1024 << " MB used in "
+			<< r.pageCount << " pages (" << r.reservedBytes / 1024 / 1024 << " MB), " << r.freeBlockCount << " free blocks, fragmentation "
+			<< r.Fragmentation() << "; scratch " << s.reservedBytes / 1024 / 1024 << " MB; committed "
+			<< committedBytes / 1024 / 1024 << " MB\n";
+	};
+
+	// Scene load: 300 models in one frame
+	for (int i = 0; i < 300; i++)
+		addModel(random() % meshCount);
+	endFrame();
+	report("after load");
+
+	for (unsigned step = 0; step < stepCount; step++)
+	{
+		// Add and remove at about the same rate, a few edits per frame
+		if (models.empty() || random() % 2 == 0)
+			addModel(random() % meshCount);
+		else
+			removeModel(random() % models.size());
+		if (step % 4 == 3)
+			endFrame();
+		if ((step + 1) % (stepCount / 4) == 0)
+			report(("after " + std::to_string(step + 1) + " edits").c_str());
+	}
+
+	while (!models.empty())
+		removeModel(models.size() - 1);
+	for (int i = 0; i < 3; i++)
+		endFrame();
+	report("after clearing");
+
+	std::cout << "peak: pool " << peakReserved / 1024 / 1024 << " MB reserved, committed result and scratch per mesh "
+		<< peakCommitted / 1024 / 1024 << " MB\n";
+	std::cout << "pages created " << pagesCreated << ", released " << pagesReleased << "\n";
+	std::cout << "allocate " << (allocations ? allocateMs * 1000.0 / allocations : 0.0) << " us, free and collect "
+		<< (frees ? freeMs * 1000.0 / frees : 0.0) << " us per block\n";
+
+	const bool empty = results.Stats().usedBytes == 0 && scratch.Stats().usedBytes == 0;
+	if (!empty)
+		std::cout << "FAIL blocks left after removing every model\n";
+	return empty ? 0 : 1;
+}
@@ -11,6 +11,8 @@
 
 #include "stdafx.h"
 #include "D3D12HelloTriangle.h"
+#include "StageTimer.h"
+#include "Log.h"
 #include "DXRHelper.h"
 #include "nv_helpers_dx12/BottomLevelASGenerator.h"
 #include "nv_helpers_dx12/RaytracingPipelineGenerator.h"   
@@ -24,7 +26,7 @@
 #include "imgui_impl_win32.h"
 #include "imgui_impl_dx12.h"
 #include <stdexcept>
-#include <iostream>
+#include <fstream>
 #define STB_IMAGE_IMPLEMENTATION
 #include "libraries/stb_image/stb_image.h"
 #include <vector>
@@ -40,6 +42,66 @@ D3D12HelloTriangle::D3D12HelloTriangle(UINT width, UINT height, std::wstring nam
 {
 }
 
+_Use_decl_annotations_
+void D3D12HelloTriangle::ParseCommandLineArgs(WCHAR* argv[], int argc)
+{
+	DXSample::ParseCommandLineArgs(argv, argc);
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (_wcsicmp(argv[i], L"-compactvertices") == 0 ||
+			_wcsicmp(argv[i], L"/compactvertices") == 0)
+		{
+			m_compactVertices = true;
+		}
+		else if (_wcsicmp(argv[i], L"-optimizemeshes") == 0 ||
+			_wcsicmp(argv[i], L"/optimizemeshes") == 0)
+		{
+			m_meshImportOptions.optimize = true;
+		}
+		else if (_wcsicmp(argv[i], L"-assimpobj") == 0 ||
+			_wcsicmp(argv[i], L"/assimpobj") == 0)
+		{
+			m_meshImportOptions.nativeObj = false;
+		}
+		else if (_wcsicmp(argv[i], L"-assimpgltf") == 0 ||
+			_wcsicmp(argv[i], L"/assimpgltf") == 0)
+		{
+			m_meshImportOptions.nativeGltf = false;
+		}
+		else if (_wcsicmp(argv[i], L"-compactblas") == 0 ||
+			_wcsicmp(argv[i], L"/compactblas") == 0)
+		{
+			m_compactBlas = true;
+		}
+		else if (_wcsicmp(argv[i], L"-nolods") == 0 ||
+			_wcsicmp(argv[i], L"/nolods") == 0)
+		{
+			m_meshImportOptions.generateLods = false;
+		}
+		else if ((_wcsicmp(argv[i], L"-fixedstep") == 0 ||
+			_wcsicmp(argv[i], L"/fixedstep") == 0) && i + 1 < argc)
+		{
+			// Animation advances 1/hz seconds per frame, whatever the frame rate
+			double hz = _wtof(argv[++i]);
+			if (hz > 0.0)
+				m_animationClock.SetFixedStep(1.0 / hz);
+		}
+		else if ((_wcsicmp(argv[i], L"-animtimes") == 0 ||
+			_wcsicmp(argv[i], L"/animtimes") == 0) && i + 1 < argc)
+		{
+			// Animation time of every frame, read from a text file of seconds
+			std::ifstream stream(argv[++i]);
+			std::vector<float> times;
+			float time;
+			while (stream >> time)
+				times.push_back(time);
+			if (!times.empty())
+				m_animationClock.SetScript(std::move(times));
+		}
+	}
+}
+
 void D3D12HelloTriangle::OnInit() {
 
 	nv_helpers_dx12::CameraManip.setWindowSize(GetWidth(), GetHeight());
@@ -47,21 +109,30 @@ void D3D12HelloTriangle::OnInit() {
 		glm::vec3(0, 1, 0));
 	nv_helpers_dx12::CameraManip.setMode(nv_helpers_dx12::Manipulator::Fly);
 	nv_helpers_dx12::CameraManip.setSpeed(1);
+	StageTimer timer("Startup");
+	DispatchShaders();
 	LoadPipeline();
+	timer.Lap("device");
 	ModelDescriptions = LoadScene("Models/scene.json");
 	LoadAssets(); // Models
+	timer.Lap("scene");
 
 	HDRImage environment =
 		LoadHDR("HDR/studio.hdr");
 
 	CreateEnvironmentTexture(environment);
+	timer.Lap("environment");
 
 	CheckRaytracingSupport();
 	CreateAccelerationStructures();
+	timer.Lap("acceleration structures");
 
 	ThrowIfFailed(m_commandList->Close());
 
+	JoinShaders();
+	timer.Lap("shader wait");
 	CreateRaytracingPipeline();
+	timer.Lap("RT pipeline");
 	CreateRaytracingOutputBuffer();
 	CreateAOVResources();
 
@@ -70,46 +141,10 @@ void D3D12HelloTriangle::OnInit() {
 	D3D12GetDebugInterface(IID_PPV_ARGS(&debugController));
 	debugController->EnableDebugLayer();
 
-	ComPtr<IDxcUtils> DxcUtils;
-	ComPtr<IDxcCompiler3> DxcCompiler;
-	ComPtr<IDxcIncludeHandler> includeHandler;
-
-	// Create Utils
-	ThrowIfFailed(DxcCreateInstance(
-		CLSID_DxcUtils,
-		IID_PPV_ARGS(&DxcUtils)
-	));
-
-	// Create Compiler
-	ThrowIfFailed(DxcCreateInstance(
-		CLSID_DxcCompiler,
-		IID_PPV_ARGS(&DxcCompiler)
-	));
-
-	//Create Include Handler
-	ThrowIfFailed(DxcUtils->CreateDefaultIncludeHandler(&includeHandler));
-
-	m_denoiseTemporalLibrary = CompileCS(
-		L"shaders/DenoiserTemporalPass.hlsl",
-		L"CSMain",
-		L"cs_6_0",
-		DxcUtils.Get(),
-		DxcCompiler.Get(),
-		includeHandler.Get()
-	);
-
-	m_denoiseSpacialLibrary = CompileCS(
-		L"shaders/DenoiserSpacialPass.hlsl",
-		L"CSMain",
-		L"cs_6_0",
-		DxcUtils.Get(),
-		DxcCompiler.Get(),
-		includeHandler.Get()
-	);
-
 	CreateDenoiseRootSignature();
 	CreateDenoiseTemporalPipeline();
 	CreateDenoiseSpacialPipeline();
+	timer.Lap("denoiser pipelines");
 	CreateCameraBuffer();
 
 	m_lightData.position = XMFLOAT3(2.0f, 5.0f, -3.0f);
@@ -148,6 +183,8 @@ void D3D12HelloTriangle::OnInit() {
 	init_info.SrvDescriptorFreeFn = [](ImGui_ImplDX12_InitInfo*, D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_GPU_DESCRIPTOR_HANDLE) {
 		};
 	ImGui_ImplDX12_Init(&init_info);
+	timer.Lap("resources and UI");
+	timer.Print();
 }
 
 void D3D12HelloTriangle::LoadPipeline()
@@ -190,6 +227,11 @@ void D3D12HelloTriangle::LoadPipeline()
 			IID_PPV_ARGS(&m_device)
 		));
 	}
+
+	// 64 MB heaps hold a few hundred typical BLASes. A range released now is
+	// reused once the fence is past every value signaled so far.
+	m_asPool.Initialize(m_device.Get(), 64ull << 20, [this] { return m_fenceValue + 1; });
+
 	D3D12_COMMAND_QUEUE_DESC queueDesc = {};
 	queueDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
 	queueDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
@@ -253,6 +295,27 @@ void D3D12HelloTriangle::LoadPipeline()
 
 void D3D12HelloTriangle::OnUpdate()
 {
+	// Frame boundary: add models whose meshes finished loading in the background
+	m_modelLoadQueue.Pump();
+	m_modelLoadQueue.PruneFinished(4);
+
+	// The watched scene was saved: reload it, which only applies what changed
+	if (m_reloadSceneOnSave && m_sceneWatcher.Poll())
+	{
+		try
+		{
+			m_sceneLoadError.clear();
+			auto reloadedScene = LoadScene(m_sceneWatcher.Path(), false);
+			if (m_sceneLoadError.empty())
+				QueueLoadScene(m_sceneWatcher.Path(), reloadedScene);
+		}
+		catch (const std::runtime_error& e)
+		{
+			m_sceneLoadError = e.what();
+		}
+	}
+	UpdateShaderHotReload();
+
 	UpdateCameraBuffer();
 
 	ImGui_ImplDX12_NewFrame();
@@ -272,14 +335,7 @@ void D3D12HelloTriangle::OnUpdate()
 	ImGui::InputText("Model Path", modelPathBuffer, _countof(modelPathBuffer));
 
 	if (ImGui::Button("Add Model")) {
-		try
-		{
-			AddModel(modelPathBuffer);
-		}
-		catch (const std::runtime_error& e)
-		{
-			; // TODO : handle error
-		}
+		QueueAddModel(modelPathBuffer);
 	}
 
 	ImGui::InputText("Scene Path", scenePathBuffer, _countof(scenePathBuffer));
@@ -291,33 +347,36 @@ void D3D12HelloTriangle::OnUpdate()
 			m_sceneLoadError.clear();
 			auto loadedScene = LoadScene(scenePathBuffer);
 			if (m_sceneLoadError.empty())
-			{
-				for (int i = Models.size() - 1; i >= 0; i--)
-				{
-					RemoveModel(i);
-				}
-				ModelDescriptions = std::move(loadedScene);
-				for (int i = 0; i < ModelDescriptions.size(); i++)
-				{
-					AddModel(ModelDescriptions[i].path, true);
-					InitializeShaderData(i);
-				}
-			}
+				QueueLoadScene(scenePathBuffer, loadedScene);
+			if (m_reloadSceneOnSave)
+				m_sceneWatcher.Watch(scenePathBuffer);
 		}
 		catch (const std::runtime_error& e)
 		{
 			m_sceneLoadError = e.what();
 		}
 	}
+	ImGui::SameLine();
+	if (ImGui::Checkbox("Reload On Save", &m_reloadSceneOnSave))
+	{
+		if (m_reloadSceneOnSave)
+			m_sceneWatcher.Watch(scenePathBuffer);
+		else
+			m_sceneWatcher.Stop();
+	}
 	if (!m_sceneLoadError.empty())
 	{
 		ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "Scene load error: %s", m_sceneLoadError.c_str());
 	}
+	DrawLoadQueueUI();
 	if (ImGui::Button("Save Scene"))
 	{
 		try
 		{
 			SaveScene(scenePathBuffer);
+			// Our own save is not an edit to reload
+			if (m_reloadSceneOnSave && m_sceneWatcher.Path() == scenePathBuffer)
+				m_sceneWatcher.Watch(scenePathBuffer);
 		}
 		catch (const std::runtime_error& e)
 		{
@@ -325,6 +384,15 @@ void D3D12HelloTriangle::OnUpdate()
 		}
 	}
 
+	ImGui::Separator();
+	if (ImGui::Checkbox("Reload Shaders On Save", &m_reloadShadersOnSave) && m_reloadShadersOnSave)
+	{
+		// Edits made while it was off are not seen by the watchers
+		for (auto& watcher : m_shaderWatchers)
+			watcher.second.Watch(watcher.first);
+	}
+	DrawShaderReloadUI();
+
 	ImGui::Separator();
 	ImGui::Text("Camera Parameters");
 
@@ -523,6 +591,10 @@ void D3D12HelloTriangle::OnUpdate()
 	}
 
 	ImGui::Text("The number of triangles in the scene is %d", m_sceneTriangleCount);
+	DrawBlasMemoryUI();
+	ImGui::Checkbox("Automatic LOD", &m_enableLods);
+	if (m_enableLods)
+		ImGui::DragFloat("LOD Pixel Error", &m_lodPixelError, 0.05f, 0.1f, 16.0f);
 	ImGui::Text("Application average %.3f ms/frame (%.1f FPS)",
 		1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
 
@@ -532,9 +604,34 @@ void D3D12HelloTriangle::OnUpdate()
 		RemoveModel(indexToRemove);
 
 	UpdateModelTranslations();
+	SelectModelLods();
 	UpdateModelDataBuffer();
 }
 
+void D3D12HelloTriangle::DrawLoadQueueUI()
+{
+	for (const auto& job : m_modelLoadQueue.Status())
+	{
+		ImGui::PushID(static_cast<int>(job.id));
+		if (job.state == ModelLoadQueue::JobState::Failed)
+		{
+			ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "%s: %s", job.label.c_str(), job.error.c_str());
+		}
+		else if (job.state == ModelLoadQueue::JobState::Parsing)
+		{
+			float progress = job.stepsTotal > 0 ? static_cast<float>(job.stepsDone) / job.stepsTotal : 1.0f;
+			std::string overlay = std::to_string(job.stepsDone) + "/" + std::to_string(job.stepsTotal) + " meshes";
+			ImGui::TextUnformatted(job.label.c_str());
+			ImGui::ProgressBar(progress, ImVec2(-1.0f, 0.0f), overlay.c_str());
+		}
+		else
+		{
+			ImGui::Text("%s: %s", job.label.c_str(), ModelLoadQueue::StateName(job.state));
+		}
+		ImGui::PopID();
+	}
+}
+
 void D3D12HelloTriangle::OnRender()
 {
 
@@ -550,6 +647,7 @@ void D3D12HelloTriangle::OnRender()
 
 void D3D12HelloTriangle::OnDestroy()
 {
+	m_modelLoadQueue.CancelPending();
 	WaitForPreviousFrame();
 	ImGui_ImplDX12_Shutdown();
 	ImGui_ImplWin32_Shutdown();
@@ -751,6 +849,7 @@ void D3D12HelloTriangle::WaitForPreviousFrame()
 		ThrowIfFailed(m_fence->SetEventOnCompletion(fence, m_fenceEvent));
 		WaitForSingleObject(m_fenceEvent, INFINITE);
 	}
+	m_asPool.Collect(m_fence->GetCompletedValue());
 
 	m_frameIndex = m_swapChain->GetCurrentBackBufferIndex();
 }
@@ -789,118 +888,354 @@ void D3D12HelloTriangle::OnKeyUp(UINT8 key)
 	}
 }
 
-D3D12HelloTriangle::AccelerationStructureBuffers
-D3D12HelloTriangle::CreateBottomLevelAS(
+void D3D12HelloTriangle::PrepareBottomLevelAS(PendingBlasBuild& build, AccelerationStructureBuffers& target,
 	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t> > vVertexBuffers,
-	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t> > vIndexBuffers) {
-	nv_helpers_dx12::BottomLevelASGenerator bottomLevelAS;
+	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t> > vIndexBuffers,
+	UINT vertexStride, DXGI_FORMAT indexFormat, UINT64 indexOffsetInBytes, bool allowCompaction) {
+	nv_helpers_dx12::BottomLevelASGenerator& bottomLevelAS = build.generator;
 
 	for (size_t i = 0; i < vVertexBuffers.size(); i++) {
 		if (i < vIndexBuffers.size() && vIndexBuffers[i].second > 0)
 			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get(), 0,
-				vVertexBuffers[i].second, sizeof(Vertex),
-				vIndexBuffers[i].first.Get(), 0,
-				vIndexBuffers[i].second, nullptr, 0, true);
+				vVertexBuffers[i].second, vertexStride,
+				vIndexBuffers[i].first.Get(), indexOffsetInBytes,
+				vIndexBuffers[i].second, nullptr, 0, true, indexFormat);
 
 		else
 			bottomLevelAS.AddVertexBuffer(vVertexBuffers[i].first.Get(), 0,
-				vVertexBuffers[i].second, sizeof(Vertex), 0,
+				vVertexBuffers[i].second, vertexStride, 0,
 				0);
 	}
 
-	UINT64 scratchSizeInBytes = 0;
 	UINT64 resultSizeInBytes = 0;
+	bottomLevelAS.ComputeASBufferSizes(m_device.Get(), false, &build.scratchSize,
+		&resultSizeInBytes, allowCompaction);
+
+	target = AccelerationStructureBuffers();
+	target.result = m_asPool.Allocate(AccelerationStructurePool::Result, resultSizeInBytes);
+	target.buildSize = resultSizeInBytes;
+	build.target = &target;
+
+	// The build is done once the fence passes a value above every one signaled so far
+	build.postbuildSlot = allowCompaction ?
+		m_blasCompaction.Add(m_nextCompactionId, resultSizeInBytes, m_fenceValue + 1) : UINT32_MAX;
+	if (build.postbuildSlot == UINT32_MAX)
+		return;
 
-	bottomLevelAS.ComputeASBufferSizes(m_device.Get(), false, &scratchSizeInBytes,
-		&resultSizeInBytes);
+	if (!m_postbuildSizes)
+	{
+		const UINT64 size = sizeof(UINT64) * static_cast<UINT64>(m_blasCompaction.SlotCount());
+		m_postbuildSizes = nv_helpers_dx12::CreateBuffer(
+			m_device.Get(), size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nv_helpers_dx12::kDefaultHeapProps);
+		m_postbuildReadback = nv_helpers_dx12::CreateBuffer(
+			m_device.Get(), size, D3D12_RESOURCE_FLAG_NONE,
+			D3D12_RESOURCE_STATE_COPY_DEST, CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK));
+		ThrowIfFailed(m_postbuildReadback->Map(0, nullptr, reinterpret_cast<void**>(&m_postbuildReadbackData)));
+	}
+	target.compactionId = m_nextCompactionId++;
+}
+
+void D3D12HelloTriangle::RecordBlasBatch(std::vector<PendingBlasBuild>& builds)
+{
+	if (builds.empty())
+		return;
+
+	std::vector<BlasBuildRequest> requests(builds.size());
+	for (size_t i = 0; i < builds.size(); i++)
+	{
+		requests[i].scratchSize = builds[i].scratchSize;
+		requests[i].resultBuffer = reinterpret_cast<uint64_t>(builds[i].target->result.Resource());
+	}
+	const BlasBatchPlan plan = PlanBlasBatch(requests, BlasScratchBudget, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
 
-	AccelerationStructureBuffers buffers;
-	buffers.pScratch = nv_helpers_dx12::CreateBuffer(
-		m_device.Get(), scratchSizeInBytes,
-		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON,
-		nv_helpers_dx12::kDefaultHeapProps);
-	buffers.pResult = nv_helpers_dx12::CreateBuffer(
-		m_device.Get(), resultSizeInBytes,
-		D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-		D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-		nv_helpers_dx12::kDefaultHeapProps);
+	// The scratch is only needed by these builds: the handle is dropped on
+	// return, and m_asPool reuses the range once the batch's fence passed
+	PooledBuffer scratch = m_asPool.Allocate(AccelerationStructurePool::Scratch, plan.scratchSize);
+	uint32_t firstSlot = UINT32_MAX, lastSlot = 0;
+	for (size_t wave = 0; wave < plan.WaveCount(); wave++)
+	{
+		// The previous wave has to be done with the scratch before it is reused
+		if (wave > 0)
+		{
+			D3D12_RESOURCE_BARRIER uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(scratch.Resource());
+			m_commandList->ResourceBarrier(1, &uavBarrier);
+		}
 
-	bottomLevelAS.Generate(m_commandList.Get(), buffers.pScratch.Get(),
-		buffers.pResult.Get(), false, nullptr);
+		for (size_t b = plan.waveStarts[wave]; b < plan.WaveEnd(wave); b++)
+		{
+			PendingBlasBuild& build = builds[plan.builds[b].request];
+			const D3D12_GPU_VIRTUAL_ADDRESS scratchAddress = scratch.Address() + plan.builds[b].scratchOffset;
+			if (build.postbuildSlot == UINT32_MAX)
+			{
+				build.generator.Generate(m_commandList.Get(), scratchAddress,
+					build.target->result.Address(), nullptr, false, 0);
+				continue;
+			}
 
-	return buffers;
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC postbuild = {};
+			postbuild.DestBuffer = m_postbuildSizes->GetGPUVirtualAddress() + sizeof(UINT64) * static_cast<UINT64>(build.postbuildSlot);
+			postbuild.InfoType = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_COMPACTED_SIZE;
+			build.generator.Generate(m_commandList.Get(), scratchAddress,
+				build.target->result.Address(), nullptr, false, 0, &postbuild);
+			firstSlot = build.postbuildSlot < firstSlot ? build.postbuildSlot : firstSlot;
+			lastSlot = build.postbuildSlot > lastSlot ? build.postbuildSlot : lastSlot;
+		}
+	}
+
+	// Nothing reads the results before the TLAS build, so one barrier per buffer does for the batch
+	std::vector<D3D12_RESOURCE_BARRIER> uavBarriers;
+	for (uint64_t buffer : plan.resultBuffers)
+		uavBarriers.push_back(CD3DX12_RESOURCE_BARRIER::UAV(reinterpret_cast<ID3D12Resource*>(buffer)));
+	m_commandList->ResourceBarrier(static_cast<UINT>(uavBarriers.size()), uavBarriers.data());
+
+	// The compacted sizes of the whole batch come back with one copy
+	if (firstSlot != UINT32_MAX)
+	{
+		const UINT64 offset = sizeof(UINT64) * static_cast<UINT64>(firstSlot);
+		const UINT64 size = sizeof(UINT64) * static_cast<UINT64>(lastSlot - firstSlot + 1);
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_postbuildSizes.Get(),
+			D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE));
+		m_commandList->CopyBufferRegion(m_postbuildReadback.Get(), offset, m_postbuildSizes.Get(), offset, size);
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_postbuildSizes.Get(),
+			D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS));
+	}
 }
 
-void D3D12HelloTriangle::CreateTopLevelAS(
-	const std::vector<std::pair<ID3D12Resource*, DirectX::XMMATRIX>>& instances,
-	bool updateOnly)
+// BlasCompactionDevice over the renderer: sizes come from the readback
+// buffer, copies are recorded on m_commandList
+class D3D12HelloTriangle::BlasCompactor : public BlasCompactionDevice
 {
-	nv_helpers_dx12::TopLevelASGenerator generator;
+public:
+	explicit BlasCompactor(D3D12HelloTriangle& renderer) : m_renderer(renderer) {}
 
-	for (size_t i = 0; i < instances.size(); i++) {
-		generator.AddInstance(instances[i].first,
-			instances[i].second, static_cast<UINT>(i),
-			static_cast<UINT>(i));
+	uint64_t CompactedSize(uint32_t slot) override
+	{
+		return m_renderer.m_postbuildReadbackData[slot];
 	}
 
-	UINT64 scratchSize, resultSize, instanceDescsSize;
-	generator.ComputeASBufferSizes(m_device.Get(), true, &scratchSize, &resultSize, &instanceDescsSize);
+	bool Compact(uint64_t id, uint64_t compactedSize) override
+	{
+		AccelerationStructureBuffers* buffers = Find(id);
+		if (!buffers)
+			return false;
+
+		// The original goes back to the pool once this frame is done with it
+		PooledBuffer compacted = m_renderer.m_asPool.Allocate(AccelerationStructurePool::Result, compactedSize);
+		m_renderer.m_commandList->CopyRaytracingAccelerationStructure(compacted.Address(), buffers->result.Address(),
+			D3D12_RAYTRACING_ACCELERATION_STRUCTURE_COPY_MODE_COMPACT);
+		buffers->result = std::move(compacted);
+		return true;
+	}
 
-	if (!m_topLevelASBuffers.pScratch || m_topLevelASBuffers.pScratch->GetDesc().Width < scratchSize) {
-		m_topLevelASBuffers.pScratch = nv_helpers_dx12::CreateBuffer(
-			m_device.Get(), scratchSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-			D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-			nv_helpers_dx12::kDefaultHeapProps);
+	void Release(uint64_t id) override
+	{
+		AccelerationStructureBuffers* buffers = Find(id);
+		if (buffers)
+			buffers->compactionId = 0;
+		m_renderer.m_compactionTargets.erase(id);
 	}
-	if (!m_topLevelASBuffers.pResult || m_topLevelASBuffers.pResult->GetDesc().Width < resultSize) {
-		m_topLevelASBuffers.pResult = nv_helpers_dx12::CreateBuffer(
-			m_device.Get(), resultSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS,
-			D3D12_RESOURCE_STATE_RAYTRACING_ACCELERATION_STRUCTURE,
-			nv_helpers_dx12::kDefaultHeapProps);
+
+private:
+	AccelerationStructureBuffers* Find(uint64_t id)
+	{
+		auto target = m_renderer.m_compactionTargets.find(id);
+		if (target == m_renderer.m_compactionTargets.end())
+			return nullptr;
+		auto found = m_renderer.m_meshRegistry.find(target->second.path);
+		if (found == m_renderer.m_meshRegistry.end())
+			return nullptr;
+		std::shared_ptr<MeshGeometry> mesh = found->second.lock();
+		if (!mesh)
+			return nullptr;
+
+		// The path may belong to a mesh loaded again since; its BLASes carry other ids
+		const int lod = target->second.lod;
+		AccelerationStructureBuffers* buffers = lod < 0 ? &mesh->blas :
+			(static_cast<size_t>(lod) < mesh->lodBlas.size() ? &mesh->lodBlas[lod] : nullptr);
+		return buffers && buffers->compactionId == id ? buffers : nullptr;
 	}
-	if (!m_topLevelASBuffers.pInstanceDesc || m_topLevelASBuffers.pInstanceDesc->GetDesc().Width < instanceDescsSize) {
-		m_topLevelASBuffers.pInstanceDesc = nv_helpers_dx12::CreateBuffer(
-			m_device.Get(), instanceDescsSize, D3D12_RESOURCE_FLAG_NONE,
-			D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+
+	D3D12HelloTriangle& m_renderer;
+};
+
+bool D3D12HelloTriangle::ProcessBlasCompaction()
+{
+	if (m_blasCompaction.PendingCount() == 0)
+		return false;
+
+	BlasCompactor compactor(*this);
+	const size_t compacted = m_blasCompaction.Process(m_fence->GetCompletedValue(), compactor);
+	if (compacted)
+	{
+		// The TLAS build that follows reads the copies
+		D3D12_RESOURCE_BARRIER uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
+		m_commandList->ResourceBarrier(1, &uavBarrier);
+	}
+
+	// Report once a batch of builds is through
+	if (m_blasCompaction.PendingCount() == 0 && m_blasCompaction.Stats().compacted != m_reportedCompactions)
+	{
+		m_reportedCompactions = m_blasCompaction.Stats().compacted;
+		ReportBlasMemory();
 	}
-	generator.Generate(m_commandList.Get(),
-		m_topLevelASBuffers.pScratch.Get(),
-		m_topLevelASBuffers.pResult.Get(),
-		m_topLevelASBuffers.pInstanceDesc.Get(),
-		updateOnly,
-		m_topLevelASBuffers.pResult.Get());
+	return compacted != 0;
 }
 
-void D3D12HelloTriangle::CreateAccelerationStructures() {
-	BLASes.reserve(Models.size());
-	for (auto& model : Models)
+uint64_t D3D12HelloTriangle::MeshGeometry::BlasBytes(bool asBuilt) const
+{
+	uint64_t bytes = asBuilt ? blas.buildSize : blas.result.Size();
+	for (const AccelerationStructureBuffers& lod : lodBlas)
+		bytes += asBuilt ? lod.buildSize : lod.result.Size();
+	return bytes;
+}
+
+void D3D12HelloTriangle::ReportBlasMemory()
+{
+	uint64_t builtBytes = 0, currentBytes = 0;
+	for (MeshGeometry* mesh : m_uniqueMeshes)
 	{
-		BLASes.push_back(
-			CreateBottomLevelAS(
-				{ {model.m_vertexBuffer.Get(), (UINT)model.vertices.size()} },
-				{ {model.m_indexBuffer.Get(),  (UINT)model.indices.size()} }
-			)
-		);
+		const uint64_t built = mesh->BlasBytes(true), current = mesh->BlasBytes(false);
+		Log() << "  " << mesh->path << ": " << built / 1024 << " KB -> " << current / 1024 << " KB\n";
+		builtBytes += built;
+		currentBytes += current;
 	}
-	m_instances.clear();
-	m_instances.reserve(BLASes.size());
 
-	for (int i = 0; i < BLASes.size(); i++)
+	const BlasCompactionStats& stats = m_blasCompaction.Stats();
+	Log() << "BLAS memory: " << builtBytes / 1024 << " KB built, " << currentBytes / 1024 << " KB after compaction ("
+		<< stats.compacted << " compacted, " << stats.skipped << " no smaller, " << stats.released << " released first, "
+		<< stats.noSlot << " without a slot)\n";
+}
+
+void D3D12HelloTriangle::DrawBlasMemoryUI()
+{
+	uint64_t builtBytes = 0, currentBytes = 0;
+	for (MeshGeometry* mesh : m_uniqueMeshes)
 	{
-		XMMATRIX scaleMatrix = XMMatrixScaling(ModelDescriptions[i].scale.x, ModelDescriptions[i].scale.y, ModelDescriptions[i].scale.z);
-		XMMATRIX rotationMatrix =
-			XMMatrixRotationRollPitchYaw(degreesToRadians(ModelDescriptions[i].rotation.x), degreesToRadians(ModelDescriptions[i].rotation.y), degreesToRadians(ModelDescriptions[i].rotation.z));
-		XMMATRIX translationMatrix = XMMatrixTranslation(ModelDescriptions[i].position.x, ModelDescriptions[i].position.y, ModelDescriptions[i].position.z);
-		XMMATRIX transform = scaleMatrix * rotationMatrix * translationMatrix;
+		builtBytes += mesh->BlasBytes(true);
+		currentBytes += mesh->BlasBytes(false);
+	}
+	ImGui::Text("BLAS memory %llu KB (%llu KB as built)", currentBytes / 1024, builtBytes / 1024);
+	if (!m_compactBlas || !ImGui::TreeNode("BLAS Memory Per Mesh"))
+		return;
+	for (MeshGeometry* mesh : m_uniqueMeshes)
+		ImGui::Text("%s: %llu -> %llu KB", mesh->path.c_str(), mesh->BlasBytes(true) / 1024, mesh->BlasBytes(false) / 1024);
+	ImGui::TreePop();
+}
 
-		m_instances.push_back({
-			BLASes[i].pResult.Get(),
-			transform
-			});
+void D3D12HelloTriangle::CreateTopLevelAS(
+	const std::vector<std::pair<D3D12_GPU_VIRTUAL_ADDRESS, DirectX::XMMATRIX>>& instances,
+	bool updateOnly, const std::vector<uint32_t>* changed)
+{
+	const UINT instanceCount = static_cast<UINT>(instances.size());
+	const bool resized = instanceCount != m_instanceDescs.Count();
+	m_instanceDescs.Resize(instanceCount);
+
+	// Instances of the same mesh share one hit group record
+	auto setRecord = [&](size_t i) {
+		m_instanceDescs.Set(i, instances[i].first, instances[i].second,
+			static_cast<UINT>(i), Models[i].mesh->sbtIndex);
+	};
+	if (changed && !resized)
+	{
+		for (uint32_t i : *changed)
+			setRecord(i);
+	}
+	else
+	{
+		for (size_t i = 0; i < instances.size(); i++)
+			setRecord(i);
 	}
 
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
+	inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+	inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+	inputs.NumDescs = instanceCount;
+	inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE;
+
+	// The TLAS keeps its scratch for refits; ranges replaced here go back to
+	// m_asPool once the frames still using them are done
+	if (resized || !m_topLevelASBuffers.result)
+	{
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info = {};
+		m_device->GetRaytracingAccelerationStructurePrebuildInfo(&inputs, &info);
+		const UINT64 scratchSize = ROUND_UP(info.ScratchDataSizeInBytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		const UINT64 resultSize = ROUND_UP(info.ResultDataMaxSizeInBytes, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
+		if (!m_topLevelASBuffers.scratch || m_topLevelASBuffers.scratch.Size() < scratchSize)
+			m_topLevelASBuffers.scratch = m_asPool.Allocate(AccelerationStructurePool::Scratch, scratchSize);
+		if (!m_topLevelASBuffers.result || m_topLevelASBuffers.result.Size() < resultSize)
+			m_topLevelASBuffers.result = m_asPool.Allocate(AccelerationStructurePool::Result, resultSize);
+	}
 
+	// The records live in a default heap buffer; the upload buffer has one
+	// region per frame in flight for the records that changed
+	if (instanceCount > m_instanceDescCapacity || !m_topLevelASBuffers.pInstanceDesc)
+	{
+		// Room to grow by half, so adding models does not reallocate every time
+		m_instanceDescCapacity = instanceCount + instanceCount / 2 + 1;
+		const UINT64 regionSize = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(m_instanceDescCapacity);
+		m_topLevelASBuffers.pInstanceDesc = nv_helpers_dx12::CreateBuffer(
+			m_device.Get(), regionSize, D3D12_RESOURCE_FLAG_NONE,
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, nv_helpers_dx12::kDefaultHeapProps);
+		m_instanceUploadRing.Reset(regionSize, FrameCount);
+		m_instanceDescUpload = nv_helpers_dx12::CreateBuffer(
+			m_device.Get(), m_instanceUploadRing.TotalSize(), D3D12_RESOURCE_FLAG_NONE,
+			D3D12_RESOURCE_STATE_GENERIC_READ, nv_helpers_dx12::kUploadHeapProps);
+		ThrowIfFailed(m_instanceDescUpload->Map(0, nullptr, reinterpret_cast<void**>(&m_instanceDescUploadData)));
+		m_instanceDescs.MarkAllDirty();
+	}
+
+	const std::vector<InstanceRecordRange> ranges = m_instanceDescs.TakeDirtyRanges(InstanceRecordGap);
+	if (!ranges.empty())
+	{
+		m_instanceUploadRing.BeginRegion();
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_topLevelASBuffers.pInstanceDesc.Get(),
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+		for (const InstanceRecordRange& range : ranges)
+		{
+			const UINT64 size = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(range.count);
+			const UINT64 offset = m_instanceUploadRing.Allocate(size);
+			memcpy(m_instanceDescUploadData + offset, m_instanceDescs.Records() + range.first, size);
+			m_commandList->CopyBufferRegion(m_topLevelASBuffers.pInstanceDesc.Get(),
+				sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * static_cast<UINT64>(range.first),
+				m_instanceDescUpload.Get(), offset, size);
+		}
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_topLevelASBuffers.pInstanceDesc.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+	}
+
+	// Refit while the instances stay near where the last full build saw them
+	bool refit = updateOnly && !resized;
+	if (refit)
+	{
+		m_tlasRefitPolicy.Moved(m_instanceDescs, ranges);
+		refit = !m_tlasRefitPolicy.ShouldRebuild();
+	}
+	if (refit)
+		m_tlasRefitPolicy.Refitted();
+	else
+		m_tlasRefitPolicy.Rebuilt(m_instanceDescs);
+
+	D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
+	buildDesc.Inputs = inputs;
+	buildDesc.Inputs.InstanceDescs = m_topLevelASBuffers.pInstanceDesc->GetGPUVirtualAddress();
+	buildDesc.DestAccelerationStructureData = m_topLevelASBuffers.result.Address();
+	buildDesc.ScratchAccelerationStructureData = m_topLevelASBuffers.scratch.Address();
+	if (refit)
+	{
+		buildDesc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+		buildDesc.SourceAccelerationStructureData = m_topLevelASBuffers.result.Address();
+	}
+	m_commandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+
+	D3D12_RESOURCE_BARRIER uavBarrier = CD3DX12_RESOURCE_BARRIER::UAV(m_topLevelASBuffers.result.Resource());
+	m_commandList->ResourceBarrier(1, &uavBarrier);
+}
+
+void D3D12HelloTriangle::CreateAccelerationStructures() {
+	BuildMeshBLASes(m_uniqueMeshes);
 
+	RebuildInstanceList();
 	CreateTopLevelAS(m_instances);
 	m_commandList->Close();
 	ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
@@ -913,10 +1248,6 @@ void D3D12HelloTriangle::CreateAccelerationStructures() {
 
 	ThrowIfFailed(
 		m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
-
-	m_bottomLevelAS.clear();
-	for (auto& blas : BLASes)
-		m_bottomLevelAS.push_back(blas.pResult);
 }
 
 ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateRayGenSignature()
@@ -944,6 +1275,7 @@ ComPtr<ID3D12RootSignature> D3D12HelloTriangle::CreateHitSignature() {
 	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 2); // t2 - ModelInstanceGPU buffer
 	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_CBV, 1 /*b1*/); // light(s)
 	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 3 /*t3*/);
+	rsc.AddRootParameter(D3D12_ROOT_PARAMETER_TYPE_SRV, 4 /*t4*/); // compact vertex attributes
 	return rsc.Generate(m_device.Get(), true);
 }
 
@@ -967,14 +1299,7 @@ void D3D12HelloTriangle::CreateRaytracingPipeline()
 {
 	nv_helpers_dx12::RayTracingPipelineGenerator pipeline(m_device.Get());
 
-	m_rayGenLibrary = nv_helpers_dx12::CompileShaderLibrary(L"shaders/RayGen.hlsl");
-	m_missLibrary = nv_helpers_dx12::CompileShaderLibrary(L"shaders/Miss.hlsl");
-	m_flatShaderLibrary = nv_helpers_dx12::CompileShaderLibrary(L"shaders/FlatShader.hlsl");
-	m_normalShaderLibrary = nv_helpers_dx12::CompileShaderLibrary(L"shaders/NormalShader.hlsl");
-	m_phongShaderLibrary = nv_helpers_dx12::CompileShaderLibrary(L"shaders/PhongShader.hlsl");
-	m_mirrorDemoShaderLibrary = nv_helpers_dx12::CompileShaderLibrary(L"shaders/MirrorDemoShader.hlsl");
-	m_BSDFShaderLibrary = nv_helpers_dx12::CompileShaderLibrary(L"shaders/BSDFShader.hlsl");
-
+	// The libraries were compiled by DispatchShaders/JoinShaders
 	pipeline.AddLibrary(m_rayGenLibrary.Get(), { L"RayGen" });
 	pipeline.AddLibrary(m_missLibrary.Get(), { L"Miss" });
 	pipeline.AddLibrary(m_flatShaderLibrary.Get(), { L"ClosestHit_Flat" });
@@ -987,24 +1312,15 @@ void D3D12HelloTriangle::CreateRaytracingPipeline()
 	m_missSignature = CreateMissSignature();
 	m_hitSignature = CreateHitSignature();
 
+	// One hit group per shading mode: the per mesh buffers are in the SBT
+	// records, so the state object does not depend on the scene and is only
+	// built once
 	std::vector<std::wstring> hitGroups;
-	for (int i = 0; i < Models.size(); i++)
-	{
-		std::wstring FlatHitGroup = L"HitGroup_Flat_" + std::to_wstring(i);
-		std::wstring NormalHitGroup = L"HitGroup_Normal_" + std::to_wstring(i);
-		std::wstring PhongHitGroup = L"HitGroup_Phong_" + std::to_wstring(i);
-		std::wstring MirrorDemoHitGroup = L"HitGroup_MirrorDemo_" + std::to_wstring(i);
-		std::wstring BSDFHitGroup = L"HitGroup_BSDF_" + std::to_wstring(i);
-		pipeline.AddHitGroup(FlatHitGroup, L"ClosestHit_Flat");
-		pipeline.AddHitGroup(NormalHitGroup, L"ClosestHit_Normal");
-		pipeline.AddHitGroup(PhongHitGroup, L"ClosestHit_Phong");
-		pipeline.AddHitGroup(MirrorDemoHitGroup, L"ClosestHit_MirrorDemo");
-		pipeline.AddHitGroup(BSDFHitGroup, L"ClosestHit_BSDF");
-		hitGroups.push_back(FlatHitGroup.c_str());
-		hitGroups.push_back(NormalHitGroup.c_str());
-		hitGroups.push_back(PhongHitGroup.c_str());
-		hitGroups.push_back(MirrorDemoHitGroup.c_str());
-		hitGroups.push_back(BSDFHitGroup.c_str());
+	for (const wchar_t* mode : { L"Flat", L"Normal", L"Phong", L"MirrorDemo", L"BSDF" })
+	{
+		const std::wstring hitGroup = std::wstring(L"HitGroup_") + mode;
+		pipeline.AddHitGroup(hitGroup, std::wstring(L"ClosestHit_") + mode);
+		hitGroups.push_back(hitGroup);
 	}
 
 	pipeline.AddRootSignatureAssociation(m_rayGenSignature.Get(), { L"RayGen" });
@@ -1074,7 +1390,7 @@ void D3D12HelloTriangle::CreateShaderResourceHeap()
 	tlas.Format = DXGI_FORMAT_UNKNOWN;
 	tlas.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
 	tlas.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	tlas.RaytracingAccelerationStructure.Location = m_topLevelASBuffers.pResult->GetGPUVirtualAddress();
+	tlas.RaytracingAccelerationStructure.Location = m_topLevelASBuffers.result.Address();
 	m_device->CreateShaderResourceView(nullptr, &tlas, h);
 	h.Offset(1, inc);
 
@@ -1164,21 +1480,24 @@ void D3D12HelloTriangle::CreateShaderBindingTable()
         { envSrvPtr, samplerPtr }
     );
 
-    for (int i = 0; i < Models.size(); i++)
+    // A record per mesh, in sbtIndex order, all of the current mode's hit group
+    const std::wstring hitGroupName = L"HitGroup_" + currentShading;
+    for (MeshGeometry* mesh : m_uniqueMeshes)
     {
-        std::wstring hitGroupName =
-            L"HitGroup_" + currentShading + L"_" + std::to_wstring(i);
 
         void* vertexBufferAddr =
-            (void*)Models[i].m_vertexBuffer->GetGPUVirtualAddress();
+            (void*)mesh->m_vertexBuffer->GetGPUVirtualAddress();
         void* indexBufferAddr =
-            (void*)Models[i].m_indexBuffer->GetGPUVirtualAddress();
+            (void*)mesh->m_indexBuffer->GetGPUVirtualAddress();
         void* instanceBufferAddr =
             (void*)m_instancesBuffer->GetGPUVirtualAddress();
         void* lightsBufferAddr =
             (void*)m_lightsBuffer->GetGPUVirtualAddress();
         void* tlasBufferAddr =
-            (void*)m_topLevelASBuffers.pResult->GetGPUVirtualAddress();
+            (void*)m_topLevelASBuffers.result.Address();
+        // t4 is unused by the full layout, but root SRVs must still point at a valid buffer
+        void* attributeBufferAddr = mesh->m_attributeBuffer ?
+            (void*)mesh->m_attributeBuffer->GetGPUVirtualAddress() : vertexBufferAddr;
 
         m_sbtHelper.AddHitGroup(
             hitGroupName.c_str(),
@@ -1187,7 +1506,8 @@ void D3D12HelloTriangle::CreateShaderBindingTable()
                 indexBufferAddr,
                 instanceBufferAddr,
                 lightsBufferAddr,
-                tlasBufferAddr
+                tlasBufferAddr,
+                attributeBufferAddr
             }
         );
     }
@@ -1241,21 +1561,27 @@ void D3D12HelloTriangle::SetShadingMode(const std::wstring& mode)
 
 
 void D3D12HelloTriangle::BuildTLAS() {
-	if (BLASes.empty()) return;
+	if (Models.empty()) return;
 
-	m_instances.clear();
+	if (ProcessBlasCompaction())
+		BLASChanged = true;
 
-	for (size_t i = 0; i < BLASes.size(); i++)
+	const TransformRange moved = SyncInstanceTransforms();
+	if (BLASChanged || m_instances.size() != Models.size())
 	{
-		XMMATRIX scaleMatrix = XMMatrixScaling(ModelDescriptions[i].scale.x, ModelDescriptions[i].scale.y, ModelDescriptions[i].scale.z);
-		XMMATRIX rotationMatrix = XMMatrixRotationRollPitchYaw(degreesToRadians(ModelDescriptions[i].rotation.x), degreesToRadians(ModelDescriptions[i].rotation.y), degreesToRadians(ModelDescriptions[i].rotation.z));
-		XMMATRIX translationMatrix = XMMatrixTranslation(ModelDescriptions[i].position.x, ModelDescriptions[i].position.y, ModelDescriptions[i].position.z);
-		XMMATRIX transform = scaleMatrix * rotationMatrix * translationMatrix;
-
-		m_instances.push_back({ BLASes[i].pResult.Get(), transform });
+		RebuildInstanceList();
+	}
+	else
+	{
+		// Nothing moved and no BLAS changed: last frame's TLAS is still right
+		if (moved.Empty())
+			return;
+		for (uint32_t i : m_transforms.LastChangedInstances())
+			m_instances[i].second = m_transforms.World(i);
 	}
 
-	CreateTopLevelAS(m_instances, !BLASChanged);
+	// Only the records of moved instances need a look, unless everything was rebuilt
+	CreateTopLevelAS(m_instances, !BLASChanged, BLASChanged ? nullptr : &m_transforms.LastChangedInstances());
 
 	if (BLASChanged == true) {
 		D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = m_srvUavHeap->GetCPUDescriptorHandleForHeapStart();
@@ -1267,13 +1593,69 @@ void D3D12HelloTriangle::BuildTLAS() {
 		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
 		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_RAYTRACING_ACCELERATION_STRUCTURE;
 		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.RaytracingAccelerationStructure.Location = m_topLevelASBuffers.pResult->GetGPUVirtualAddress();
+		srvDesc.RaytracingAccelerationStructure.Location = m_topLevelASBuffers.result.Address();
 
 		m_device->CreateShaderResourceView(nullptr, &srvDesc, srvHandle);
 		BLASChanged = false;
 	}
 }
 
+void D3D12HelloTriangle::SelectModelLods()
+{
+	glm::vec3 eye, center, up;
+	nv_helpers_dx12::CameraManip.getLookat(eye, center, up);
+	XMVECTOR eyePosition = XMVectorSet(eye.x, eye.y, eye.z, 1.0f);
+
+	// Same vertical field of view as the projection in UpdateCameraBuffer
+	const float fovAngleY = 45.0f * XM_PI / 180.0f;
+	const float pixelsPerUnitAtUnitDistance = GetHeight() * 0.5f / tanf(fovAngleY * 0.5f);
+
+	for (size_t i = 0; i < Models.size(); i++)
+	{
+		const MeshGeometry& mesh = *Models[i].mesh;
+		const ModelDesc& desc = ModelDescriptions[i];
+		int lod = 0;
+
+		if (m_enableLods && !mesh.lods.empty())
+		{
+			XMVECTOR worldCenter = XMVector3Transform(XMLoadFloat3(&mesh.boundsCenter), ModelTransform(desc));
+
+			float scale = fabsf(desc.scale.x);
+			scale = fabsf(desc.scale.y) > scale ? fabsf(desc.scale.y) : scale;
+			scale = fabsf(desc.scale.z) > scale ? fabsf(desc.scale.z) : scale;
+
+			// Distance to the nearest point of the bounding sphere; inside it the full mesh is kept
+			float distance = XMVectorGetX(XMVector3Length(worldCenter - eyePosition)) - mesh.boundsRadius * scale;
+			if (distance > 0.0f)
+			{
+				// Coarsest LOD whose error still projects to at most m_lodPixelError pixels
+				for (size_t k = 0; k < mesh.lods.size(); k++)
+				{
+					float pixelError = mesh.lods[k].error * scale / distance * pixelsPerUnitAtUnitDistance;
+					if (pixelError > m_lodPixelError)
+						break;
+					lod = static_cast<int>(k) + 1;
+				}
+			}
+		}
+
+		if (lod != Models[i].lod)
+		{
+			Models[i].lod = lod;
+			BLASChanged = true;
+		}
+		ModelsShaderData[i].lodTriangleOffset = lod == 0 ? 0 : static_cast<int>(mesh.lodFirstTriangle[lod - 1]);
+	}
+}
+
+D3D12_GPU_VIRTUAL_ADDRESS D3D12HelloTriangle::GetModelBLAS(size_t modelIndex) const
+{
+	const ModelInstance& model = Models[modelIndex];
+	if (model.lod > 0 && model.lod <= static_cast<int>(model.mesh->lodBlas.size()))
+		return model.mesh->lodBlas[model.lod - 1].result.Address();
+	return model.mesh->blas.result.Address();
+}
+
 D3D12HelloTriangle::HDRImage D3D12HelloTriangle::LoadHDR(const std::string& path)
 {
 	D3D12HelloTriangle::HDRImage img;
@@ -1301,7 +1683,7 @@ D3D12HelloTriangle::HDRImage D3D12HelloTriangle::LoadHDR(const std::string& path
 
 	stbi_image_free(data);
 
-	std::cout << "Loaded HDR: "
+	Log() << "Loaded HDR: "
 		<< img.width << "x" << img.height << "\n";
 
 	return img;
@@ -1409,9 +1791,40 @@ void D3D12HelloTriangle::CreateEnvironmentTexture(const HDRImage& img)
 	// success
 }
 
-double D3D12HelloTriangle::degreesToRadians(double degrees) {
-	// Conversion formula: radians = degrees * PI / 180
-	return degrees * 3.141592 / 180.0;
+XMMATRIX D3D12HelloTriangle::ModelTransform(const ModelDesc& desc)
+{
+	return TransformSystem::Compose(desc.position, desc.rotation, desc.scale);
+}
+
+TransformRange D3D12HelloTriangle::SyncInstanceTransforms()
+{
+	// A model whose description is not there yet (AddModel while reloading) stays at the origin
+	return SyncInstanceTransforms(ModelDescriptions, Models.size(), m_transforms);
+}
+
+TransformRange D3D12HelloTriangle::SyncInstanceTransforms(const std::vector<ModelDesc>& descs, size_t instanceCount, TransformSystem& transforms)
+{
+	const XMFLOAT3 zero = { 0.0f, 0.0f, 0.0f };
+	const XMFLOAT3 one = { 1.0f, 1.0f, 1.0f };
+
+	transforms.Resize(instanceCount);
+	for (size_t i = 0; i < instanceCount; i++)
+	{
+		if (i < descs.size())
+			transforms.Set(i, descs[i].position, descs[i].rotation, descs[i].scale);
+		else
+			transforms.Set(i, zero, zero, one);
+	}
+	return transforms.Update();
+}
+
+void D3D12HelloTriangle::RebuildInstanceList()
+{
+	SyncInstanceTransforms();
+	m_instances.clear();
+	m_instances.reserve(Models.size());
+	for (size_t i = 0; i < Models.size(); i++)
+		m_instances.push_back({ GetModelBLAS(i), m_transforms.World(i) });
 }
 
 void D3D12HelloTriangle::AdjustSampleCount()
@@ -1583,53 +1996,218 @@ std::vector<char> D3D12HelloTriangle::LoadFile(const wchar_t* filename) {
 	return buffer;
 }
 
-ComPtr<IDxcBlob> D3D12HelloTriangle::CompileCS(
-	const wchar_t* filename,
-	const wchar_t* entryPoint,
-	const wchar_t* target,
-	IDxcUtils* utils,
-	IDxcCompiler3* compiler,
-	IDxcIncludeHandler* includeHandler
-)
+void D3D12HelloTriangle::DispatchShaders()
 {
-	auto sourceData = LoadFile(filename);
-
-	DxcBuffer buffer{};
-	buffer.Ptr = sourceData.data();
-	buffer.Size = sourceData.size();
-	buffer.Encoding = DXC_CP_UTF8;
+	if (!m_shaderScheduler)
+	{
+		m_shaderCompiler.reset(new DxcShaderCompiler());
+		m_shaderScheduler.reset(new ShaderCompileScheduler(
+			[]() { return std::unique_ptr<ShaderCompilerBackend>(new DxcShaderCompiler()); }, "Cache/Shaders/"));
+	}
 
-	LPCWSTR arguments[] = {
-		L"-E", entryPoint,
-		L"-T", target,
-		L"-I", L"shaders"
+	auto library = [](const char* path) {
+		ShaderCompileRequest request;
+		request.path = path;
+		request.target = "lib_6_3";
+		request.includeDirectories = { "shaders" };
+		return request;
+	};
+	// The hit shaders read vertices through VertexFetch.hlsl, which needs to know the layout
+	auto hitLibrary = [&](const char* path) {
+		ShaderCompileRequest request = library(path);
+		if (m_compactVertices)
+			request.defines.push_back({ "COMPACT_VERTICES", "1" });
+		return request;
+	};
+	m_dispatchedShaders = {
+		{ library("shaders/RayGen.hlsl"), &m_rayGenLibrary },
+		{ library("shaders/Miss.hlsl"), &m_missLibrary },
+		{ hitLibrary("shaders/FlatShader.hlsl"), &m_flatShaderLibrary },
+		{ hitLibrary("shaders/NormalShader.hlsl"), &m_normalShaderLibrary },
+		{ hitLibrary("shaders/PhongShader.hlsl"), &m_phongShaderLibrary },
+		{ hitLibrary("shaders/MirrorDemoShader.hlsl"), &m_mirrorDemoShaderLibrary },
+		{ hitLibrary("shaders/BSDFShader.hlsl"), &m_BSDFShaderLibrary },
+		{ { "shaders/DenoiserTemporalPass.hlsl", "CSMain", "cs_6_0", {}, { "shaders" } }, &m_denoiseTemporalLibrary },
+		{ { "shaders/DenoiserSpacialPass.hlsl", "CSMain", "cs_6_0", {}, { "shaders" } }, &m_denoiseSpacialLibrary },
 	};
 
-	ComPtr<IDxcResult> result;
-	ThrowIfFailed(compiler->Compile(
-		&buffer,
-		arguments,
-		_countof(arguments),
-		includeHandler,
-		IID_PPV_ARGS(&result)
-	));
+	std::vector<ShaderCompileRequest> requests;
+	for (const auto& shader : m_dispatchedShaders)
+		requests.push_back(shader.first);
+	m_shaderDispatchTime = std::chrono::high_resolution_clock::now();
+	m_shaderScheduler->Dispatch(requests);
+}
+
+void D3D12HelloTriangle::JoinShaders()
+{
+	const std::vector<ShaderCompileResult> results = m_shaderScheduler->Join();
+	const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_shaderDispatchTime).count();
+
+	std::string errors;
+	double serialMs = 0.0;
+	size_t cached = 0;
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const ShaderCompileResult& result = results[i];
+		const ShaderCompileRequest& request = m_dispatchedShaders[i].first;
+		serialMs += result.ms;
+		cached += result.cached ? 1 : 0;
+		Log() << "  " << request.path << (request.entryPoint.empty() ? "" : " " + request.entryPoint) << ": "
+			<< result.ms << " ms" << (result.ok ? (result.cached ? " (cache)" : "") : " FAILED") << "\n";
+		if (!result.ok)
+			errors += result.errors + "\n";
+		else
+			*m_dispatchedShaders[i].second = m_shaderCompiler->CreateBlob(result.binary);
+	}
+	Log() << "Shaders: " << results.size() << " on " << m_shaderScheduler->ThreadCount() << " threads, " << cached
+		<< " from cache; " << serialMs << " ms of work done " << wallMs << " ms after dispatch\n";
+
+	if (!errors.empty())
+	{
+		OutputDebugStringA(errors.c_str());
+		throw std::runtime_error(errors);
+	}
+
+	std::vector<size_t> shaders;
+	for (size_t i = 0; i < m_dispatchedShaders.size(); i++)
+		shaders.push_back(i);
+	TrackShaderDependencies(shaders);
+}
+
+void D3D12HelloTriangle::TrackShaderDependencies(const std::vector<size_t>& shaders)
+{
+	if (!m_shaderFileScanner)
+		m_shaderFileScanner.reset(new ShaderCache(*m_shaderCompiler));
 
-	HRESULT hr;
-	result->GetStatus(&hr);
-	if (FAILED(hr))
+	for (size_t shader : shaders)
 	{
-		ComPtr<IDxcBlobUtf8> errors;
-		result->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&errors), nullptr);
-		if (errors && errors->GetStringLength() > 0)
+		uint64_t key = 0;
+		std::vector<std::string> files;
+		// A source that cannot be read keeps its old files, so it is still watched
+		if (m_shaderFileScanner->ComputeKey(m_dispatchedShaders[shader].first, key, &files))
+			m_shaderReload.Track(shader, files);
+	}
+
+	// Includes may have come or gone: watch exactly the files in use, keeping
+	// the watchers that already exist so a save they saw is not lost
+	std::map<std::string, FileWatcher> watchers;
+	for (const std::string& file : m_shaderReload.WatchedFiles())
+	{
+		auto existing = m_shaderWatchers.find(file);
+		if (existing != m_shaderWatchers.end())
+			watchers[file] = existing->second;
+		else
+			watchers[file].Watch(file);
+	}
+	m_shaderWatchers.swap(watchers);
+}
+
+void D3D12HelloTriangle::UpdateShaderHotReload()
+{
+	if (!m_reloadShadersOnSave || !m_shaderScheduler)
+		return;
+
+	std::vector<std::string> saved;
+	for (auto& watcher : m_shaderWatchers)
+	{
+		if (watcher.second.Poll())
+			saved.push_back(watcher.first);
+	}
+	m_shaderReload.FilesChanged(saved);
+
+	if (m_shaderReload.GetState() == ShaderHotReload::State::Compiling && !m_shaderScheduler->Busy())
+	{
+		m_reloadResults = m_shaderScheduler->Join();
+		std::vector<bool> ok;
+		std::string errors;
+		for (size_t i = 0; i < m_reloadResults.size(); i++)
+		{
+			ok.push_back(m_reloadResults[i].ok);
+			if (!m_reloadResults[i].ok)
+				errors += m_reloadResults[i].errors + "\n";
+		}
+		TrackShaderDependencies(m_shaderReload.Batch());
+		m_shaderReload.CompileFinished(ok, errors);
+		if (!errors.empty())
+			OutputDebugStringA(errors.c_str());
+	}
+
+	const std::vector<size_t> swap = m_shaderReload.TakeSwap();
+	if (!swap.empty())
+		SwapReloadedShaders(swap);
+
+	const std::vector<size_t> batch = m_shaderReload.BeginCompile();
+	if (!batch.empty())
+	{
+		std::vector<ShaderCompileRequest> requests;
+		for (size_t shader : batch)
+			requests.push_back(m_dispatchedShaders[shader].first);
+		m_shaderScheduler->Dispatch(requests);
+	}
+}
+
+void D3D12HelloTriangle::SwapReloadedShaders(const std::vector<size_t>& shaders)
+{
+	// Called between frames, after OnRender waited for the GPU, so nothing in
+	// flight still uses what gets replaced
+	std::vector<ComPtr<IDxcBlob> > previousLibraries;
+	ComPtr<ID3D12RootSignature> rayGenSignature = m_rayGenSignature;
+	ComPtr<ID3D12RootSignature> missSignature = m_missSignature;
+	ComPtr<ID3D12RootSignature> hitSignature = m_hitSignature;
+	ComPtr<ID3D12StateObject> stateObject = m_rtStateObject;
+	ComPtr<ID3D12StateObjectProperties> stateObjectProps = m_rtStateObjectProps;
+	ComPtr<ID3D12PipelineState> temporalPSO = m_denoiseTemporalPSO;
+	ComPtr<ID3D12PipelineState> spacialPSO = m_denoiseSpacialPSO;
+	bool raytracing = false;
+	try
+	{
+		bool temporal = false;
+		bool spacial = false;
+		for (size_t i = 0; i < shaders.size(); i++)
 		{
-			OutputDebugStringA((char*)errors->GetBufferPointer());
-			throw std::runtime_error((char*)errors->GetBufferPointer());
+			ComPtr<IDxcBlob>* library = m_dispatchedShaders[shaders[i]].second;
+			previousLibraries.push_back(*library);
+			*library = m_shaderCompiler->CreateBlob(m_reloadResults[i].binary);
+			temporal = temporal || library == &m_denoiseTemporalLibrary;
+			spacial = spacial || library == &m_denoiseSpacialLibrary;
+			raytracing = raytracing || (library != &m_denoiseTemporalLibrary && library != &m_denoiseSpacialLibrary);
 		}
+
+		if (raytracing)
+			CreateRaytracingPipeline();
+		if (temporal)
+			CreateDenoiseTemporalPipeline();
+		if (spacial)
+			CreateDenoiseSpacialPipeline();
+	}
+	catch (const std::exception& e)
+	{
+		for (size_t i = 0; i < previousLibraries.size(); i++)
+			*m_dispatchedShaders[shaders[i]].second = previousLibraries[i];
+		m_rayGenSignature = rayGenSignature;
+		m_missSignature = missSignature;
+		m_hitSignature = hitSignature;
+		m_rtStateObject = stateObject;
+		m_rtStateObjectProps = stateObjectProps;
+		m_denoiseTemporalPSO = temporalPSO;
+		m_denoiseSpacialPSO = spacialPSO;
+		m_shaderReload.SwapFailed(e.what());
+		return;
 	}
 
-	ComPtr<IDxcBlob> shader;
-	ThrowIfFailed(result->GetResult(&shader));
-	return shader;
+	// The shader identifiers in the table belong to the old state object
+	if (raytracing)
+		CreateShaderBindingTable();
+	Log() << "Reloaded " << shaders.size() << " shader(s)\n";
+}
+
+void D3D12HelloTriangle::DrawShaderReloadUI()
+{
+	const ShaderHotReload::State state = m_shaderReload.GetState();
+	if (state != ShaderHotReload::State::Idle)
+		ImGui::Text("Shaders: %s", ShaderHotReload::StateName(state));
+	if (!m_shaderReload.Error().empty())
+		ImGui::TextColored(ImVec4(1, 0.4f, 0.4f, 1), "Shader error, keeping the old pipeline:\n%s", m_shaderReload.Error().c_str());
 }
 
 void D3D12HelloTriangle::BindHistoryWriteUAVs(int writeIndex)
@@ -18,11 +18,32 @@
 #include <d3d12.h>
 #include <dxgi1_4.h>
 #include <array>
+#include <chrono>
+#include <map>
+#include <memory>
 #include <stdexcept>
+#include <unordered_map>
+#include "nv_helpers_dx12/BottomLevelASGenerator.h"
 #include "nv_helpers_dx12/TopLevelASGenerator.h"
 #include "nv_helpers_dx12/ShaderBindingTableGenerator.h"
 #include <string>
 #include "DXSample.h"
+#include "ModelLoadQueue.h"
+#include "MeshSimplifier.h"
+#include "SceneDiff.h"
+#include "FileWatcher.h"
+#include "AnimationTracks.h"
+#include "AnimationClock.h"
+#include "TransformSystem.h"
+#include "InstanceDescStore.h"
+#include "AccelerationStructurePool.h"
+#include "BlasCompaction.h"
+#include "BlasBatchPlanner.h"
+#include "DxcShaderCompiler.h"
+#include "ShaderCompileScheduler.h"
+#include "VertexCompression.h"
+#include "ShaderHotReload.h"
+#include "FileUtils.h"
 
 using namespace DirectX;
 
@@ -42,6 +63,7 @@ public:
 	virtual void OnUpdate();
 	virtual void OnRender();
 	virtual void OnDestroy();
+	virtual void ParseCommandLineArgs(_In_reads_(argc) WCHAR* argv[], int argc);
 
 
 
@@ -137,6 +159,10 @@ public:
 private:
 	ComPtr<ID3D12DescriptorHeap> m_imguiHeap;
 	static const UINT FrameCount = 2;
+	// Shared scratch of a batch of BLAS builds, one pool page
+	static const UINT64 BlasScratchBudget = 64ull << 20;
+	// TLAS instance records this far apart or closer are uploaded with one copy
+	static const uint32_t InstanceRecordGap = 4;
 
 	UINT m_frameIndexCPU = 0;
 	UINT m_sampleCount = 4;
@@ -175,6 +201,8 @@ private:
 	XMMATRIX m_prevViewProj = XMMatrixIdentity();
 	bool     m_hasPrevCamera = false;
 
+public:
+	// Plain data shared with the loader and scene file helpers
 	struct Vertex
 	{
 		XMFLOAT3 position;
@@ -185,12 +213,26 @@ private:
 		float pad1;
 	};
 
+	// Options of LoadModel that change the produced geometry
+	struct MeshImportOptions
+	{
+		bool useCache = true;
+		bool optimize = false; // vertex cache + vertex fetch reordering (-optimizemeshes)
+		bool nativeObj = true; // ObjLoader.cpp instead of Assimp for .obj files (-assimpobj turns it off)
+		bool nativeGltf = true; // GltfLoader.cpp instead of Assimp for .gltf/.glb files (-assimpgltf turns it off)
+		bool generateLods = true; // simplified LOD chain for heavy meshes (-nolods turns it off)
+
+		// Post-import processing steps, part of the mesh cache key
+		uint32_t ProcessFlags() const { return (optimize ? 1u : 0u) | (nativeObj ? 2u : 0u) | (generateLods ? 4u : 0u); }
+	};
+
 	struct AnimationFrame
 	{
 		float time;
 		DirectX::XMFLOAT3 position;
 		DirectX::XMFLOAT3 rotation;
 		DirectX::XMFLOAT3 scale;
+		DirectX::XMFLOAT3 tangent = { 0, 0, 0 }; // position tangent per second, Hermite tracks only
 	};
 
 	struct ModelDesc
@@ -207,36 +249,36 @@ private:
 		int isGlass = false;
 		float IOR = 1.5f;
 		std::vector<AnimationFrame> animationFrames;
+		RotationInterpolation rotationInterpolation = RotationInterpolation::Slerp;
+		PositionInterpolation positionInterpolation = PositionInterpolation::Linear;
 	};
 
+private:
+	struct MeshGeometry;
+
 	struct ModelInstance
 	{
 		int id;
-		std::vector<Vertex> vertices;
-		std::vector<uint32_t> indices;
-
-		// App resources.
-		ComPtr<ID3D12Resource> m_vertexBuffer;
-		D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
-
-		// 3D Model
-		ComPtr<ID3D12Resource> m_indexBuffer;
-		D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
+		// Shared by every instance of the same model path, see AcquireMesh
+		std::shared_ptr<MeshGeometry> mesh;
 
 		DirectX::XMMATRIX worldMatrix;
 
 		unsigned int triangleCount = 0;
-		
+		int lod = 0; // 0 is the full mesh, k selects mesh->lods[k - 1], see SelectModelLods
 	};
 public:
 	//buffers:
 	ComPtr<ID3D12Resource> m_instancesBuffer;       // GPU buffer (ModelInstanceGPU)
 	ComPtr<ID3D12Resource> m_instancesUpload;       // Upload buffer
 
+	// BLAS and TLAS memory; declared before everything holding PooledBuffers
+	AccelerationStructurePool m_asPool;
+
 	std::vector<ModelDesc> ModelDescriptions;
 	std::vector<ModelInstance> Models;
 
-	unsigned int m_sceneTriangleCount;
+	unsigned int m_sceneTriangleCount = 0;
 
 	struct ModelInstanceGPU
 	{
@@ -247,7 +289,9 @@ public:
 		int isMetallic = false;
 		int isGlass = false;
 		float IOR = 1.5f;
-		float pad[3];
+		int smallIndices = false; // the mesh index buffer holds 16-bit indices
+		int lodTriangleOffset = 0; // first triangle of the selected LOD in the index buffer
+		float pad;
 	};
 
 	std::vector<ModelInstanceGPU> ModelsShaderData;
@@ -257,6 +301,19 @@ public:
 		XMFLOAT3 position; float intensity = 0;
 		XMFLOAT3 color;    int type;
 	};
+
+	// Everything a scene file holds, independent of its on-disk form (.json or
+	// .bscene, see SceneFile.cpp). glTF entries are not expanded yet.
+	struct SceneData
+	{
+		std::vector<ModelDesc> models;
+		bool hasCamera = false;
+		XMFLOAT3 cameraEye = { 0, 0, 0 };
+		XMFLOAT3 cameraCenter = { 0, 0, 0 };
+		XMFLOAT3 cameraUp = { 0, 1, 0 };
+		bool hasLight = false;
+		LightData light = {};
+	};
 	//HDR Image
 	struct HDRImage
 	{
@@ -272,6 +329,19 @@ public:
 	void CreateCameraBuffer();
 	void UpdateCameraBuffer();
 	void UpdateModelTranslations(); // animating models
+	// Moves every animated description to its pose at `seconds`, blending Euler
+	// angles and positions linearly whatever the model asks for. Scans the
+	// frames of every model; kept as the reference for AnimationTracks.
+	static void AnimateModels(std::vector<ModelDesc>& descs, float seconds);
+	// Runtime form of the animationFrames of descs, rebuilt when they change
+	static void BuildAnimationTracks(const std::vector<ModelDesc>& descs, AnimationTracks& outTracks);
+	static void EvaluateAnimationTracks(AnimationTracks& tracks, float seconds, std::vector<ModelDesc>& descs);
+	AnimationTracks m_animationTracks;
+	bool m_animationTracksDirty = true;
+	// Real time unless -fixedstep or -animtimes picked a repeatable clock
+	AnimationClock m_animationClock;
+	// Object to world matrix of a description, as the TLAS instances use it
+	static DirectX::XMMATRIX ModelTransform(const ModelDesc& desc);
 	void CreateLightsBuffer();
 	void UpdateLightsBuffer();
 
@@ -288,7 +358,6 @@ public:
 	uint32_t m_lightsBufferSize = 0;
 	UINT m_envSrvIndex = UINT_MAX;
 
-	double D3D12HelloTriangle::degreesToRadians(double degrees);
 
 	// Pipeline objects.
 	CD3DX12_VIEWPORT m_viewport;
@@ -331,24 +400,258 @@ public:
 	// #DXR
 	struct AccelerationStructureBuffers
 	{
-		ComPtr<ID3D12Resource> pScratch;      // Scratch memory for AS builder
-		ComPtr<ID3D12Resource> pResult;       // Where the AS is
-		ComPtr<ID3D12Resource> pInstanceDesc; // Hold the matrices of the instances
+		PooledBuffer scratch;                 // Scratch memory for AS builder; BLAS scratch goes back to m_asPool after the build
+		PooledBuffer result;                  // Where the AS is
+		ComPtr<ID3D12Resource> pInstanceDesc; // Hold the matrices of the instances (default heap for the TLAS)
+		uint64_t buildSize = 0;               // result size before any compaction
+		uint64_t compactionId = 0;            // queued in m_blasCompaction, 0 when not
+	};
+
+	// A mesh cache entry mapped in memory (MeshCache.cpp). The arrays point
+	// into the mapping and stay valid while it is open.
+	struct MappedMeshCache
+	{
+		MappedFile file;
+		const Vertex* vertices = nullptr;
+		uint32_t vertexCount = 0;
+		// The full mesh followed by every LOD, the layout of the index buffer
+		const uint32_t* indices = nullptr;
+		uint32_t indexCount = 0; // full mesh only
+		std::vector<uint32_t> lodIndexCounts;
+		std::vector<float> lodErrors;
+	};
+
+	// Geometry loaded once per model path: buffers and BLAS are shared by all
+	// instances, only the transform and material differ per instance (TLAS and
+	// ModelInstanceGPU)
+	struct MeshGeometry
+	{
+		std::string path;
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		// A cache hit stays mapped here instead of filling vertices, indices and
+		// the LOD indices, until CreateMeshBuffers has uploaded it
+		std::unique_ptr<MappedMeshCache> cached;
+		UINT vertexCount = 0;
+		UINT indexCount = 0; // full mesh only
+
+		ComPtr<ID3D12Resource> m_vertexBuffer;
+		D3D12_VERTEX_BUFFER_VIEW m_vertexBufferView;
+
+		// 16-bit whenever every index fits, see CreateMeshBuffers
+		ComPtr<ID3D12Resource> m_indexBuffer;
+		D3D12_INDEX_BUFFER_VIEW m_indexBufferView;
+		DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT;
+
+		// Compact layout only: m_vertexBuffer then holds bare positions and the
+		// quantized shading attributes live here
+		ComPtr<ID3D12Resource> m_attributeBuffer;
+		UINT vertexStride = sizeof(Vertex);
+
+		AccelerationStructureBuffers blas;
+
+		// Simplified versions of indices over the same vertices, coarser last. The
+		// index buffer holds the full mesh followed by every LOD; each LOD has
+		// its own BLAS over its range. Only the errors are set for a cached mesh.
+		std::vector<MeshLod> lods;
+		std::vector<UINT> lodFirstTriangle;
+		std::vector<UINT> lodTriangleCount;
+		std::vector<AccelerationStructureBuffers> lodBlas;
+
+		// Object space bounding sphere, for the projected size of instances
+		XMFLOAT3 boundsCenter = { 0, 0, 0 };
+		float boundsRadius = 0.0f;
+
+		unsigned int triangleCount = 0;
+		UINT sbtIndex = 0; // hit group record used by every instance of this mesh
+
+		// BLAS bytes of the mesh and its LODs, as built or as they are now
+		uint64_t BlasBytes(bool asBuilt) const;
+	};
+
+	// Meshes are reference counted by the instances holding them; the registry
+	// only observes them so a mesh is released with its last instance
+	std::unordered_map<std::string, std::weak_ptr<MeshGeometry> > m_meshRegistry;
+	std::vector<MeshGeometry*> m_uniqueMeshes; // in SBT order
+
+	// Split position / quantized attribute streams (-compactvertices), see VertexCompression.h
+	bool m_compactVertices = false;
+
+	std::shared_ptr<MeshGeometry> AcquireMesh(const std::string& path);
+	void CreateMeshBuffers(MeshGeometry& mesh);
+	// The compact layout's position and quantized attribute streams of `vertices`
+	static void CompressVertices(const Vertex* vertices, size_t vertexCount, std::vector<XMFLOAT3>& outPositions,
+		std::vector<CompactVertexAttributes>& outAttributes);
+	// R16_UINT when every index of a mesh with `vertexCount` vertices fits, else R32_UINT
+	static DXGI_FORMAT ChooseIndexFormat(size_t vertexCount);
+	// Index buffer contents in `format`, read by LoadTriangleIndices in shaders/VertexFetch.hlsl
+	static void PackIndices(const std::vector<uint32_t>& indices, DXGI_FORMAT format, std::vector<uint8_t>& outData);
+	// The same into `outData`, which holds PackedIndexBytes(indexCount, format) bytes
+	static size_t PackedIndexBytes(size_t indexCount, DXGI_FORMAT format);
+	static void PackIndices(const uint32_t* indices, size_t indexCount, DXGI_FORMAT format, uint8_t* outData);
+	void BuildMeshBLASes(const std::vector<MeshGeometry*>& meshes);
+	void RefreshMeshTable();
+	void ReportMeshSharing();
+
+	// Parses the meshes of a scene on worker threads and uploads them in scene
+	// order. Meshes are only kept alive by the returned references, so hold
+	// them until the models using them have been created.
+	std::vector<std::shared_ptr<MeshGeometry> > PreloadMeshes(const std::vector<ModelDesc>& descs);
+	// The mesh of every desc: the registered one while an instance still holds
+	// it, otherwise a new, unparsed mesh registered once per path and listed in
+	// outNew
+	static std::vector<std::shared_ptr<MeshGeometry> > ResolveMeshes(
+		std::unordered_map<std::string, std::weak_ptr<MeshGeometry> >& registry,
+		const std::vector<ModelDesc>& descs, std::vector<MeshGeometry*>& outNew);
+	struct MeshSharingStats
+	{
+		size_t uniqueMeshes = 0;
+		size_t instances = 0;
+		uint64_t sharedBytes = 0;   // geometry of the unique meshes
+		uint64_t unsharedBytes = 0; // what a copy per instance would take
 	};
-	std::vector<ComPtr<ID3D12Resource> > m_bottomLevelAS; // Storage for the bottom Level AS
+	static MeshSharingStats MeasureMeshSharing(const std::vector<const MeshGeometry*>& instanceMeshes);
+	static void ParseMeshesParallel(const std::vector<MeshGeometry*>& meshes, unsigned threadCount,
+		const MeshImportOptions& options);
+	MeshImportOptions m_meshImportOptions;
+
+	// Per instance LOD from the projected geometric error of each level
+	bool m_enableLods = true;
+	float m_lodPixelError = 1.0f; // largest error allowed on screen, in pixels
+	void SelectModelLods();
+	D3D12_GPU_VIRTUAL_ADDRESS GetModelBLAS(size_t modelIndex) const;
+
+	// Non-blocking "Add Model" / "Load Scene": meshes are parsed on the queue's
+	// workers and the models are added by Pump() at the start of a frame
+	ModelLoadQueue m_modelLoadQueue;
+	void QueueAddModel(const std::string& path);
+	void QueueLoadScene(const std::string& label, const std::vector<ModelDesc>& descs);
+	void ApplySceneDescriptions(const std::vector<ModelDesc>& descs);
+	static std::vector<SceneDiffItem> MakeSceneDiffItems(const std::vector<ModelDesc>& descs);
+
+	// "Reload on save": the loaded scene file is polled and diffed back in
+	FileWatcher m_sceneWatcher;
+	bool m_reloadSceneOnSave = false;
+	std::vector<ModelLoadQueue::Step> MakeMeshParseSteps(const std::vector<std::string>& paths,
+		std::vector<std::shared_ptr<MeshGeometry> >& outMeshes) const;
+	// Uploads a mesh parsed off-thread, unless the registry got the same path meanwhile
+	std::shared_ptr<MeshGeometry> RegisterParsedMesh(const std::shared_ptr<MeshGeometry>& parsed);
+	void DrawLoadQueueUI();
+
+	// Headless tests and benchmarks of the renderer's static helpers, each in
+	// the *Tests.cpp file of the module it covers. Those of modules that stand
+	// on their own are declared in the module's header.
+	// Mesh parsing with 1..maxThreads loader threads (-benchload), LoadBenchmark.cpp
+	static int RunLoadBenchmark(unsigned maxThreads);
+	// Vertex cache statistics before and after OptimizeMesh (-benchmeshopt), MeshOptimizerTests.cpp
+	static int RunMeshOptimizationBenchmark();
+	// Error bounds of VertexCompression.h, and both layouts' vertex memory for every
+	// bundled model (-testvertexcompression), VertexCompressionTests.cpp
+	static int RunVertexCompressionCheck();
+	// Mesh registry and sharing over every Models/ExampleScene/*.json (-testmeshsharing), ModelLoadingTests.cpp
+	static int RunMeshSharingCheck();
+	// 16- and 32-bit index buffers of every bundled model and of meshes at the 16-bit
+	// limit, decoded like the hit shaders do (-testindexpacking), ModelLoadingTests.cpp
+	static int RunIndexPackingCheck();
+	// Mesh cache invalidation by the model and its MTL files (-testmeshcache), and cold
+	// against warm loads of the bundled models (-benchmeshcache), MeshCacheTests.cpp
+	static int RunMeshCacheSelfTest();
+	static int RunMeshCacheBenchmark();
+	// Native OBJ parser against Assimp (-objparity, -benchobj), ObjLoaderTests.cpp
+	static int RunObjParityCheck();
+	static int RunObjLoadBenchmark();
+	// Native glTF loader against Assimp on a fixture written to Cache/ (-gltfparity, -benchgltf), GltfLoaderTests.cpp
+	static int RunGltfParityCheck();
+	static int RunGltfLoadBenchmark();
+	// Triangle count and error of every LOD of the bundled models (-lodreport), MeshSimplifierTests.cpp
+	static int RunLodReport();
+	// Converts between scene.json and .bscene (-convertscene <in> <out>), SceneFileTests.cpp
+	static int RunSceneConverter(const std::string& inputPath, const std::string& outputPath);
+	// JSON vs binary scene load time on generated scenes (-benchscene [instances]), SceneFileTests.cpp
+	static int RunSceneLoadBenchmark(unsigned instanceCount);
+	// Streaming and DOM scene.json readers agree on every scene in Models/ (-sceneparity), SceneJsonSaxTests.cpp
+	static int RunSceneJsonParityCheck();
+	// Parse time and heap allocations of both scene.json readers (-benchscenejson [instances]), SceneJsonSaxTests.cpp
+	static int RunSceneJsonBenchmark(unsigned instanceCount);
+	// Writes a procedural stress scene (-genscene <out> [-instances n] [-meshes n] ...), SceneGeneratorTests.cpp
+	static int RunSceneGenerator(const std::string& outputPath, const std::vector<std::string>& options);
+	// Load time, memory and per-frame instance CPU cost from 100 to 100k instances (-benchscale [instances]), SceneGeneratorTests.cpp
+	static int RunSceneScalingBenchmark(unsigned maxInstances);
+	// AnimationTracks against AnimateModels (-testanimation), AnimationTracksTests.cpp
+	static int RunAnimationSelfTest();
+	// Per-frame cost of both animation evaluators (-benchanimation [instances]), AnimationTracksTests.cpp
+	static int RunAnimationBenchmark(unsigned instanceCount);
+	// Matrix rebuild cost with 1%, 10% and 100% of the instances moving (-benchtransforms [instances]), TransformSystemTests.cpp
+	static int RunTransformBenchmark(unsigned instanceCount);
+	// Waves, barriers and planning time for batches of 1k meshes (-benchblasbatch [meshes]), BlasBatchPlannerTests.cpp
+	static int RunBlasBatchBenchmark(unsigned meshCount);
 
 	nv_helpers_dx12::TopLevelASGenerator m_topLevelASGenerator;
 	AccelerationStructureBuffers m_topLevelASBuffers;
-	std::vector<std::pair<ID3D12Resource*, DirectX::XMMATRIX> > m_instances;
-	std::vector<AccelerationStructureBuffers> BLASes;
-
-AccelerationStructureBuffers CreateBottomLevelAS(
+	std::vector<std::pair<D3D12_GPU_VIRTUAL_ADDRESS, DirectX::XMMATRIX> > m_instances;
+	// World matrices of Models, rebuilt only for instances whose description moved
+	TransformSystem m_transforms;
+	// Brings m_transforms up to date with ModelDescriptions; returns the instances that moved
+	TransformRange SyncInstanceTransforms();
+	// The same for `instanceCount` instances described by descs; instances
+	// past the end of descs stay at the origin
+	static TransformRange SyncInstanceTransforms(const std::vector<ModelDesc>& descs, size_t instanceCount, TransformSystem& transforms);
+	// Refills m_instances from Models and their transforms
+	void RebuildInstanceList();
+
+// One BLAS of a batch, set up by PrepareBottomLevelAS and recorded by
+// RecordBlasBatch together with the rest of the batch
+struct PendingBlasBuild
+{
+	nv_helpers_dx12::BottomLevelASGenerator generator;
+	AccelerationStructureBuffers* target = nullptr;
+	UINT64 scratchSize = 0;
+	uint32_t postbuildSlot = UINT32_MAX; // compacted size destination, UINT32_MAX for none
+};
+void PrepareBottomLevelAS(PendingBlasBuild& build, AccelerationStructureBuffers& target,
 	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t> > vVertexBuffers,
 	std::vector<std::pair<ComPtr<ID3D12Resource>, uint32_t> > vIndexBuffers =
-	{});
-
-void CreateTopLevelAS(const std::vector<std::pair<ID3D12Resource*, DirectX::XMMATRIX> >
-	& instances,bool updateOnly = false);
+	{}, UINT vertexStride = sizeof(Vertex), DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT,
+	UINT64 indexOffsetInBytes = 0, bool allowCompaction = false);
+// Records the builds on m_commandList sharing one scratch range, with UAV
+// barriers only where PlanBlasBatch places them
+void RecordBlasBatch(std::vector<PendingBlasBuild>& builds);
+
+// Opt-in BLAS compaction (-compactblas): builds write their compacted size to
+// m_postbuildSizes, and once their fence passed BuildTLAS swaps in compacted
+// copies. Targets find the BLAS of a queued id again through the mesh
+// registry, so a mesh released meanwhile is simply skipped.
+bool m_compactBlas = false;
+BlasCompactionQueue m_blasCompaction;
+struct CompactionTarget
+{
+	std::string path;
+	int lod; // -1 for the full mesh
+};
+std::unordered_map<uint64_t, CompactionTarget> m_compactionTargets;
+uint64_t m_nextCompactionId = 1;
+size_t m_reportedCompactions = 0;
+ComPtr<ID3D12Resource> m_postbuildSizes;    // one UINT64 per slot, unordered access
+ComPtr<ID3D12Resource> m_postbuildReadback; // mapped for good
+UINT64* m_postbuildReadbackData = nullptr;
+class BlasCompactor;
+// Records the copies of the BLASes whose sizes arrived; true when any BLAS moved
+bool ProcessBlasCompaction();
+// Build and current size of the BLASes of every mesh, to stdout and in the UI
+void ReportBlasMemory();
+void DrawBlasMemoryUI();
+
+// Uploads the instance records that changed, then builds the TLAS, or refits
+// it when updateOnly and m_tlasRefitPolicy allow. `changed` limits the
+// instances looked at; without it every record is compared.
+void CreateTopLevelAS(const std::vector<std::pair<D3D12_GPU_VIRTUAL_ADDRESS, DirectX::XMMATRIX> >
+	& instances,bool updateOnly = false, const std::vector<uint32_t>* changed = nullptr);
+InstanceDescStore m_instanceDescs;
+TlasRefitPolicy m_tlasRefitPolicy;
+UploadRing m_instanceUploadRing;
+ComPtr<ID3D12Resource> m_instanceDescUpload; // mapped for good
+uint8_t* m_instanceDescUploadData = nullptr;
+UINT m_instanceDescCapacity = 0;
 
 void CreateAccelerationStructures();
 
@@ -361,6 +664,31 @@ ComPtr<ID3D12RootSignature> CreateHitSignature();
 
 void CreateRaytracingPipeline();
 
+// The startup shaders compile on m_shaderScheduler's workers, through the
+// on-disk cache (Cache/Shaders/), while the scene loads. JoinShaders waits
+// for them, fills the libraries and throws with the compiler's errors when
+// one does not compile.
+void DispatchShaders();
+void JoinShaders();
+std::unique_ptr<DxcShaderCompiler> m_shaderCompiler; // main thread only, wraps binaries into blobs
+std::unique_ptr<ShaderCompileScheduler> m_shaderScheduler;
+std::vector<std::pair<ShaderCompileRequest, ComPtr<IDxcBlob>*> > m_dispatchedShaders; // kept for hot reload
+std::chrono::high_resolution_clock::time_point m_shaderDispatchTime;
+
+// "Reload shaders on save": the files the shaders are built from are polled,
+// and the shaders built from a saved one recompile on m_shaderScheduler while
+// frames go on. UpdateShaderHotReload swaps them in between frames, when the
+// GPU is idle; a batch that does not compile or link leaves the old pipeline.
+void TrackShaderDependencies(const std::vector<size_t>& shaders);
+void UpdateShaderHotReload();
+void SwapReloadedShaders(const std::vector<size_t>& shaders);
+void DrawShaderReloadUI();
+std::unique_ptr<ShaderCache> m_shaderFileScanner; // main thread, finds the files of a shader
+ShaderHotReload m_shaderReload;
+std::map<std::string, FileWatcher> m_shaderWatchers;
+std::vector<ShaderCompileResult> m_reloadResults; // of m_shaderReload.Batch()
+bool m_reloadShadersOnSave = true;
+
 // Shader libraries (compiled DXIL)
 ComPtr<IDxcBlob> m_rayGenLibrary;
 ComPtr<IDxcBlob> m_missLibrary;
@@ -399,21 +727,75 @@ std::wstring D3D12HelloTriangle::OpenFilePicker();
 std::wstring D3D12HelloTriangle::SaveFilePicker();
 std::string D3D12HelloTriangle::WStringToUtf8(const std::wstring& wstr);
 
-void D3D12HelloTriangle::LoadModel(const std::string& modelPath,
+// Only touches its arguments, so it can run on loader threads
+static void LoadModel(const std::string& modelPath,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices,
+	const MeshImportOptions& options = MeshImportOptions(),
+	std::vector<MeshLod>* outLods = nullptr);
+// LoadModel into `mesh` for CreateMeshBuffers, a cache hit is left mapped in
+// mesh.cached. Also runs on loader threads.
+static void LoadMeshGeometry(MeshGeometry& mesh, const MeshImportOptions& options);
+// LoadModel past the cache lookup: parse, process and store in the cache
+static void ImportModel(const std::string& modelPath,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices,
+	const MeshImportOptions& options,
+	std::vector<MeshLod>* outLods,
+	std::chrono::high_resolution_clock::time_point loadStart);
+// The aiProcess steps LoadModel imports with. The native readers reproduce
+// them, the parity checks compare against them and the mesh cache keys on them.
+static const uint32_t AssimpImportFlags;
+static bool ImportModelAssimp(const std::string& modelPath, uint32_t importFlags,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices);
+// Native multithreaded OBJ/MTL reader (ObjLoader.cpp), false if the file has to go through Assimp
+static bool IsObjFile(const std::string& path);
+static bool LoadObjModel(const std::string& modelPath,
 	std::vector<Vertex>& outVertices,
 	std::vector<uint32_t>& outIndices);
-std::vector<ModelDesc> D3D12HelloTriangle::LoadScene(const std::string& filename);
+// The MTL files an OBJ file names, resolved like LoadObjModel resolves them,
+// whether or not they exist
+static void FindObjMaterialLibraries(const std::string& modelPath, std::vector<std::string>& outPaths);
+// Native glTF 2.0 reader (GltfLoader.cpp). "file.gltf#<mesh>" loads a single mesh,
+// ExpandGltfNodes turns a scene entry into one such instance per glTF node.
+static bool IsGltfFile(const std::string& path);
+static bool LoadGltfModel(const std::string& modelPath,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices);
+static bool ExpandGltfNodes(const ModelDesc& desc, std::vector<ModelDesc>& outDescs);
+static void OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+// Binary mesh cache (MeshCache.cpp)
+static std::string GetMeshCachePath(const std::string& modelPath);
+static bool OpenMeshCache(const std::string& modelPath, uint32_t importFlags, uint32_t processFlags,
+	MappedMeshCache& outEntry);
+static bool LoadMeshCache(const std::string& modelPath, uint32_t importFlags, uint32_t processFlags,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices,
+	std::vector<MeshLod>& outLods);
+static void SaveMeshCache(const std::string& modelPath, uint32_t importFlags, uint32_t processFlags,
+	const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices,
+	const std::vector<MeshLod>& lods);
+// applyCamera = false keeps the current view, for reloads of the same scene
+std::vector<ModelDesc> D3D12HelloTriangle::LoadScene(const std::string& filename, bool applyCamera = true);
 void D3D12HelloTriangle::SaveScene(const std::string& filename);
 
+// Scene files without renderer state, so the headless tools can use them.
+// The format follows the extension: .bscene is binary, anything else JSON.
+static bool IsBinarySceneFile(const std::string& path);
+static bool ReadSceneFile(const std::string& path, SceneData& outScene, std::string& outError);
+static bool WriteSceneFile(const std::string& path, const SceneData& scene);
+// DOM reader, kept as the reference for the streaming one (SceneJsonSax.cpp)
+static bool ReadSceneJson(const std::string& path, SceneData& outScene, std::string& outError);
+static bool ReadSceneJsonSax(const std::string& path, SceneData& outScene, std::string& outError);
+static bool WriteSceneJson(const std::string& path, const SceneData& scene);
+static bool ReadSceneBinary(const std::string& path, SceneData& outScene, std::string& outError);
+static bool WriteSceneBinary(const std::string& path, const SceneData& scene);
+// Field by field, floats compared exactly
+static bool SameSceneData(const SceneData& a, const SceneData& b);
+
 std::vector<char> D3D12HelloTriangle::LoadFile(const wchar_t* filename);
-ComPtr<IDxcBlob> D3D12HelloTriangle::CompileCS(
-	const wchar_t* filename,
-	const wchar_t* entryPoint,
-	const wchar_t* target,
-	IDxcUtils* utils,
-	IDxcCompiler3* compiler,
-	IDxcIncludeHandler* includeHandler
-);
 
 
 // #DXR Extra: Perspective Camera++
@@ -0,0 +1,110 @@
+#include "stdafx.h"
+#include "DxcShaderCompiler.h"
+#include "DXSampleHelper.h"
+
+namespace
+{
+	std::wstring Widen(const std::string& text)
+	{
+		if (text.empty())
+			return {};
+		const int size = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, nullptr, 0);
+		std::wstring result(static_cast<size_t>(size > 0 ? size - 1 : 0), L'\0');
+		if (size > 1)
+			MultiByteToWideChar(CP_UTF8, 0, text.c_str(), -1, &result[0], size);
+		return result;
+	}
+}
+
+DxcShaderCompiler::DxcShaderCompiler()
+{
+	ThrowIfFailed(DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&m_utils)));
+	ThrowIfFailed(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&m_compiler)));
+	ThrowIfFailed(m_utils->CreateDefaultIncludeHandler(&m_includeHandler));
+}
+
+std::string DxcShaderCompiler::Version()
+{
+	std::string version = "dxc";
+	Microsoft::WRL::ComPtr<IDxcVersionInfo> info;
+	if (SUCCEEDED(m_compiler.As(&info)))
+	{
+		UINT32 major = 0, minor = 0;
+		info->GetVersion(&major, &minor);
+		version += " " + std::to_string(major) + "." + std::to_string(minor);
+	}
+	// The commit tells apart builds of one version
+	Microsoft::WRL::ComPtr<IDxcVersionInfo2> info2;
+	if (SUCCEEDED(m_compiler.As(&info2)))
+	{
+		UINT32 commitCount = 0;
+		char* commitHash = nullptr;
+		if (SUCCEEDED(info2->GetCommitInfo(&commitCount, &commitHash)))
+		{
+			version += " " + std::to_string(commitCount) + " " + (commitHash ? commitHash : "");
+			CoTaskMemFree(commitHash);
+		}
+	}
+	return version;
+}
+
+bool DxcShaderCompiler::Compile(const ShaderCompileRequest& request, const std::string& source,
+	std::vector<char>& outBinary, std::string& outErrors)
+{
+	// The strings have to outlive the argument pointers
+	std::vector<std::wstring> strings;
+	strings.push_back(Widen(request.path));
+	strings.push_back(L"-T");
+	strings.push_back(Widen(request.target));
+	if (!request.entryPoint.empty())
+	{
+		strings.push_back(L"-E");
+		strings.push_back(Widen(request.entryPoint));
+	}
+	for (const std::string& directory : request.includeDirectories)
+	{
+		strings.push_back(L"-I");
+		strings.push_back(Widen(directory));
+	}
+	for (const auto& define : request.defines)
+	{
+		strings.push_back(L"-D");
+		strings.push_back(Widen(define.second.empty() ? define.first : define.first + "=" + define.second));
+	}
+	std::vector<LPCWSTR> arguments;
+	for (const std::wstring& argument : strings)
+		arguments.push_back(argument.c_str());
+
+	DxcBuffer buffer = {};
+	buffer.Ptr = source.data();
+	buffer.Size = source.size();
+	buffer.Encoding = DXC_CP_UTF8;
+
+	Microsoft::WRL::ComPtr<IDxcResult> result;
+	ThrowIfFailed(m_compiler->Compile(&buffer, arguments.data(), static_cast<UINT32>(arguments.size()),
+		m_includeHandler.Get(), IID_PPV_ARGS(&result)));
+
+	HRESULT status = S_OK;
+	result->GetStatus(&status);
+	if (FAILED(status))
+	{
+		Microsoft::WRL::ComPtr<IDxcBlobUtf8> errors;
+		result->GetOutput(DXC_OUT_ERRORS, IID_PPV_ARGS(&errors), nullptr);
+		outErrors = errors && errors->GetStringLength() > 0 ?
+			std::string(errors->GetStringPointer(), errors->GetStringLength()) : "Failed to compile " + request.path;
+		return false;
+	}
+
+	Microsoft::WRL::ComPtr<IDxcBlob> shader;
+	ThrowIfFailed(result->GetResult(&shader));
+	const char* data = static_cast<const char*>(shader->GetBufferPointer());
+	outBinary.assign(data, data + shader->GetBufferSize());
+	return true;
+}
+
+Microsoft::WRL::ComPtr<IDxcBlob> DxcShaderCompiler::CreateBlob(const std::vector<char>& binary)
+{
+	Microsoft::WRL::ComPtr<IDxcBlobEncoding> blob;
+	ThrowIfFailed(m_utils->CreateBlob(binary.data(), static_cast<UINT32>(binary.size()), DXC_CP_ACP, &blob));
+	return blob;
+}
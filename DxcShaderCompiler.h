@@ -0,0 +1,25 @@
+#pragma once
+
+#include "ShaderCache.h"
+#include <windows.h>
+#include <wrl.h>
+#include <dxcapi.h>
+
+// ShaderCompilerBackend over DXC
+class DxcShaderCompiler : public ShaderCompilerBackend
+{
+public:
+	DxcShaderCompiler();
+
+	std::string Version() override;
+	bool Compile(const ShaderCompileRequest& request, const std::string& source,
+		std::vector<char>& outBinary, std::string& outErrors) override;
+
+	// Wraps a binary from ShaderCache in a blob, as pipeline creation expects
+	Microsoft::WRL::ComPtr<IDxcBlob> CreateBlob(const std::vector<char>& binary);
+
+private:
+	Microsoft::WRL::ComPtr<IDxcUtils> m_utils;
+	Microsoft::WRL::ComPtr<IDxcCompiler3> m_compiler;
+	Microsoft::WRL::ComPtr<IDxcIncludeHandler> m_includeHandler;
+};
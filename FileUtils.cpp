@@ -0,0 +1,255 @@
+#include "stdafx.h"
+#include "FileUtils.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <functional>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#endif
+
+uint64_t HashFnv1a64(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+std::string ToHexString(uint64_t value)
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string result(16, '0');
+	for (int i = 15; i >= 0; i--)
+	{
+		result[i] = digits[value & 0xF];
+		value >>= 4;
+	}
+	return result;
+}
+
+std::string DirectoryOf(const std::string& path)
+{
+	const size_t slash = path.find_last_of("/\\");
+	return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+bool HasExtension(const std::string& path, const char* extension)
+{
+	const size_t length = strlen(extension);
+	if (path.size() <= length)
+		return false;
+#ifdef _WIN32
+	return _stricmp(path.c_str() + path.size() - length, extension) == 0;
+#else
+	return strcasecmp(path.c_str() + path.size() - length, extension) == 0;
+#endif
+}
+
+#ifdef _WIN32
+bool GetFileStamp(const std::string& path, FileStamp& outStamp)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data = {};
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+
+	outStamp.size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+	outStamp.writeTime = (static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) |
+		data.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+bool EnsureDirectory(const std::string& path)
+{
+	for (size_t i = 1; i <= path.size(); i++)
+	{
+		if (i == path.size() || path[i] == '/' || path[i] == '\\')
+		{
+			std::string partial = path.substr(0, i);
+			if (!CreateDirectoryA(partial.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+				return false;
+		}
+	}
+	return true;
+}
+#else
+bool GetFileStamp(const std::string& path, FileStamp& outStamp)
+{
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0)
+		return false;
+
+	outStamp.size = static_cast<uint64_t>(info.st_size);
+	outStamp.writeTime = static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000000ull +
+		static_cast<uint64_t>(info.st_mtim.tv_nsec);
+	return true;
+}
+
+bool EnsureDirectory(const std::string& path)
+{
+	for (size_t i = 1; i <= path.size(); i++)
+	{
+		if (i == path.size() || path[i] == '/')
+		{
+			std::string partial = path.substr(0, i);
+			if (mkdir(partial.c_str(), 0755) != 0 && errno != EEXIST)
+				return false;
+		}
+	}
+	return true;
+}
+#endif
+
+bool ReadWholeFile(const std::string& path, std::vector<char>& outData)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	file.seekg(0, std::ios::end);
+	std::streamoff size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	outData.resize(static_cast<size_t>(size));
+	if (size > 0)
+		file.read(outData.data(), size);
+	return file.good() || file.eof();
+}
+
+bool WriteFileAtomic(const std::string& path, const void* data, size_t size)
+{
+#ifdef _WIN32
+	std::string tempPath = path + ".tmp" + std::to_string(GetCurrentProcessId()) +
+		"_" + std::to_string(GetCurrentThreadId());
+#else
+	std::string tempPath = path + ".tmp" + std::to_string(getpid()) +
+		"_" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+#endif
+	{
+		std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+		file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+		if (!file.good())
+		{
+			file.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+#ifdef _WIN32
+	if (!MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+#else
+	if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+#endif
+	{
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize = {};
+	if (!GetFileSizeEx(m_file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_mapping)
+	{
+		Close();
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!m_data)
+	{
+		Close();
+		return false;
+	}
+
+	m_size = static_cast<size_t>(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE)
+		CloseHandle(m_file);
+
+	m_data = nullptr;
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+	m_size = 0;
+}
+#else
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	m_file = open(path.c_str(), O_RDONLY);
+	if (m_file < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(m_file, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t*>(view);
+	m_size = static_cast<size_t>(info.st_size);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (m_data)
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+	if (m_file >= 0)
+		close(m_file);
+
+	m_data = nullptr;
+	m_file = -1;
+	m_size = 0;
+}
+#endif
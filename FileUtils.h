@@ -0,0 +1,65 @@
+#pragma once
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Small file helpers shared by the on-disk caches (meshes, scenes, shaders).
+// Win32 in the renderer; the POSIX branch lets the cache tests build elsewhere.
+
+// 64-bit FNV-1a hash. Pass the previous result as seed to hash several blocks.
+uint64_t HashFnv1a64(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
+std::string ToHexString(uint64_t value);
+
+// Directory part of a path with its trailing '/' or '\\', empty without one
+std::string DirectoryOf(const std::string& path);
+// Whether the path ends with extension (".obj"), ignoring case
+bool HasExtension(const std::string& path, const char* extension);
+
+// Size and last write time of a file, used for cheap invalidation checks
+struct FileStamp
+{
+	uint64_t size = 0;
+	uint64_t writeTime = 0;
+};
+bool GetFileStamp(const std::string& path, FileStamp& outStamp);
+
+// Creates every missing directory of a '/' or '\\' separated path
+bool EnsureDirectory(const std::string& path);
+
+bool ReadWholeFile(const std::string& path, std::vector<char>& outData);
+
+// Writes to a temporary file next to the target and renames it over the target,
+// so readers never observe a partially written file.
+bool WriteFileAtomic(const std::string& path, const void* data, size_t size);
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::string& path);
+	void Close();
+
+	const uint8_t* Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+
+private:
+#ifdef _WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = nullptr;
+#else
+	int m_file = -1;
+#endif
+	const uint8_t* m_data = nullptr;
+	size_t m_size = 0;
+};
@@ -0,0 +1,61 @@
+#include "stdafx.h"
+#include "FileWatcher.h"
+
+namespace
+{
+	bool SameStamp(const FileStamp& a, const FileStamp& b)
+	{
+		return a.size == b.size && a.writeTime == b.writeTime;
+	}
+}
+
+void FileWatcher::Watch(const std::string& path)
+{
+	m_path = path;
+	m_exists = GetFileStamp(path, m_stamp);
+	m_pending = false;
+	m_nextPoll = std::chrono::steady_clock::now() + pollInterval;
+}
+
+void FileWatcher::Stop()
+{
+	m_path.clear();
+	m_pending = false;
+}
+
+bool FileWatcher::Poll()
+{
+	if (m_path.empty())
+		return false;
+
+	const auto now = std::chrono::steady_clock::now();
+	if (now < m_nextPoll)
+		return false;
+	m_nextPoll = now + pollInterval;
+
+	// Deleted (or being replaced): wait until it is back
+	FileStamp stamp;
+	if (!GetFileStamp(m_path, stamp))
+	{
+		m_pending = false;
+		return false;
+	}
+
+	if (m_exists && SameStamp(stamp, m_stamp))
+	{
+		m_pending = false;
+		return false;
+	}
+
+	if (m_pending && SameStamp(stamp, m_pendingStamp))
+	{
+		m_stamp = stamp;
+		m_exists = true;
+		m_pending = false;
+		return true;
+	}
+
+	m_pendingStamp = stamp;
+	m_pending = true;
+	return false;
+}
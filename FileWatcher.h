@@ -0,0 +1,32 @@
+#pragma once
+
+#include "FileUtils.h"
+#include <chrono>
+#include <string>
+
+// Polls the size and write time of one file. A change is reported once the
+// file looks the same on two polls in a row, so an editor that is still
+// writing it does not trigger a reload of half a file.
+class FileWatcher
+{
+public:
+	// Starts watching from the file's current state
+	void Watch(const std::string& path);
+	void Stop();
+
+	bool IsWatching() const { return !m_path.empty(); }
+	const std::string& Path() const { return m_path; }
+
+	// Cheap enough to call every frame, looks at the file every pollInterval
+	bool Poll();
+
+	std::chrono::milliseconds pollInterval = std::chrono::milliseconds(500);
+
+private:
+	std::string m_path;
+	FileStamp m_stamp;
+	bool m_exists = false;
+	FileStamp m_pendingStamp;
+	bool m_pending = false;
+	std::chrono::steady_clock::time_point m_nextPoll;
+};
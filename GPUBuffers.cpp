@@ -205,25 +205,58 @@ void D3D12HelloTriangle::UpdateCameraBuffer()
 //Animating Model translations
 void D3D12HelloTriangle::UpdateModelTranslations()
 {
-	// --- Timing ---
-	DWORD now = GetTickCount();
+	const float seconds = m_animationClock.Tick();
+
+	if (m_animationTracksDirty)
+	{
+		BuildAnimationTracks(ModelDescriptions, m_animationTracks);
+		m_animationTracksDirty = false;
+	}
+	EvaluateAnimationTracks(m_animationTracks, seconds, ModelDescriptions);
+}
+
+void D3D12HelloTriangle::BuildAnimationTracks(const std::vector<ModelDesc>& descs, AnimationTracks& outTracks)
+{
+	outTracks.Clear();
+	for (size_t i = 0; i < descs.size(); i++)
+	{
+		if (descs[i].animationFrames.size() < 2)
+			continue;
+		outTracks.BeginTrack(static_cast<uint32_t>(i), descs[i].rotationInterpolation, descs[i].positionInterpolation);
+		for (const AnimationFrame& frame : descs[i].animationFrames)
+			outTracks.AddKey(frame.time, frame.position, frame.rotation, frame.scale, frame.tangent);
+		outTracks.EndTrack();
+	}
+}
 
-	for (int i = 0; i < ModelDescriptions.size(); i++ )
+void D3D12HelloTriangle::EvaluateAnimationTracks(AnimationTracks& tracks, float seconds, std::vector<ModelDesc>& descs)
+{
+	tracks.Evaluate(seconds, [&descs](uint32_t target, const XMFLOAT3& position, const XMFLOAT3& rotation, const XMFLOAT3& scale) {
+		ModelDesc& desc = descs[target];
+		desc.position = position;
+		desc.rotation = rotation;
+		desc.scale = scale;
+	});
+}
+
+void D3D12HelloTriangle::AnimateModels(std::vector<ModelDesc>& descs, float seconds)
+{
+	for (int i = 0; i < descs.size(); i++ )
 	{
-		if (ModelDescriptions[i].animationFrames.size() < 2)
+		if (descs[i].animationFrames.size() < 2)
 			continue;
 		// Find current and next frame
-		float animationTime = fmodf(now / 1000.0f, ModelDescriptions[i].animationFrames.back().time);
+		float animationTime = fmodf(seconds, descs[i].animationFrames.back().time);
 		AnimationFrame* currentFrame = nullptr;
 		AnimationFrame* nextFrame = nullptr;
-		int numberOfFrames = ModelDescriptions[i].animationFrames.size();
-		for (size_t j = 0; j < numberOfFrames; j++)
+		int numberOfFrames = descs[i].animationFrames.size();
+		for (size_t j = 0; j + 1 < numberOfFrames; j++)
 		{
-			if (animationTime >= ModelDescriptions[i].animationFrames[j].time &&
-				animationTime < ModelDescriptions[i].animationFrames[j + 1].time)
+			if (animationTime >= descs[i].animationFrames[j].time &&
+				animationTime < descs[i].animationFrames[j + 1].time)
 			{
-				currentFrame = &ModelDescriptions[i].animationFrames[j];
-				nextFrame = &ModelDescriptions[i].animationFrames[(j + 1)%numberOfFrames];
+				currentFrame = &descs[i].animationFrames[j];
+				nextFrame = &descs[i].animationFrames[(j + 1)%numberOfFrames];
 				break;
 			}
 		}
@@ -232,14 +265,14 @@ void D3D12HelloTriangle::UpdateModelTranslations()
 		// Interpolate
 		float frameDelta = nextFrame->time - currentFrame->time;
 		float factor = (animationTime - currentFrame->time) / frameDelta;
-		ModelDescriptions[i].position.x = currentFrame->position.x + factor * (nextFrame->position.x - currentFrame->position.x);
-		ModelDescriptions[i].position.y = currentFrame->position.y + factor * (nextFrame->position.y - currentFrame->position.y);
-		ModelDescriptions[i].position.z = currentFrame->position.z + factor * (nextFrame->position.z - currentFrame->position.z);
-		ModelDescriptions[i].rotation.x = currentFrame->rotation.x + factor * (nextFrame->rotation.x - currentFrame->rotation.x);
-		ModelDescriptions[i].rotation.y = currentFrame->rotation.y + factor * (nextFrame->rotation.y - currentFrame->rotation.y);
-		ModelDescriptions[i].rotation.z = currentFrame->rotation.z + factor * (nextFrame->rotation.z - currentFrame->rotation.z);
-		ModelDescriptions[i].scale.x = currentFrame->scale.x + factor * (nextFrame->scale.x - currentFrame->scale.x);
-		ModelDescriptions[i].scale.y = currentFrame->scale.y + factor * (nextFrame->scale.y - currentFrame->scale.y);
-		ModelDescriptions[i].scale.z = currentFrame->scale.z + factor * (nextFrame->scale.z - currentFrame->scale.z);
+		descs[i].position.x = currentFrame->position.x + factor * (nextFrame->position.x - currentFrame->position.x);
+		descs[i].position.y = currentFrame->position.y + factor * (nextFrame->position.y - currentFrame->position.y);
+		descs[i].position.z = currentFrame->position.z + factor * (nextFrame->position.z - currentFrame->position.z);
+		descs[i].rotation.x = currentFrame->rotation.x + factor * (nextFrame->rotation.x - currentFrame->rotation.x);
+		descs[i].rotation.y = currentFrame->rotation.y + factor * (nextFrame->rotation.y - currentFrame->rotation.y);
+		descs[i].rotation.z = currentFrame->rotation.z + factor * (nextFrame->rotation.z - currentFrame->rotation.z);
+		descs[i].scale.x = currentFrame->scale.x + factor * (nextFrame->scale.x - currentFrame->scale.x);
+		descs[i].scale.y = currentFrame->scale.y + factor * (nextFrame->scale.y - currentFrame->scale.y);
+		descs[i].scale.z = currentFrame->scale.z + factor * (nextFrame->scale.z - currentFrame->scale.z);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,491 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include "libraries/nlohmann/json.hpp"
+#include <cstring>
+#include <memory>
+
+using json = nlohmann::json;
+
+// Native glTF 2.0 (.gltf + .bin, .glb) reader. Binary buffers are memory mapped
+// and every accessor is converted straight into the renderer's Vertex/index
+// layout, without the intermediate aiMesh copy of the Assimp path.
+//
+// A mesh path may name a single glTF mesh as "file.gltf#<mesh index>"; that is
+// what ExpandGltfNodes produces for each node of the scene, so node transforms
+// become separate ModelDesc instances sharing the mesh geometry. A path without
+// the suffix loads every mesh of the file in mesh space, like Assimp did.
+
+namespace
+{
+	const uint32_t kGlbMagic = 0x46546C67; // "glTF"
+	const uint32_t kGlbChunkJson = 0x4E4F534A;
+	const uint32_t kGlbChunkBin = 0x004E4942;
+
+	const int kComponentUnsignedByte = 5121;
+	const int kComponentUnsignedShort = 5123;
+	const int kComponentUnsignedInt = 5125;
+	const int kComponentFloat = 5126;
+	const int kModeTriangles = 4;
+
+	struct GltfBuffer
+	{
+		const uint8_t* data = nullptr;
+		size_t size = 0;
+	};
+
+	struct GltfFile
+	{
+		json document;
+		MappedFile glb;
+		std::vector<std::unique_ptr<MappedFile>> externalBuffers;
+		std::vector<GltfBuffer> buffers;
+	};
+
+	// Strided view of an accessor inside a mapped buffer
+	struct GltfAccessor
+	{
+		const uint8_t* data = nullptr;
+		size_t count = 0;
+		size_t stride = 0;
+		int componentType = 0;
+		int components = 0;
+	};
+
+	// Splits "file.gltf#3" into the file and the mesh index (-1 without suffix)
+	std::string SplitGltfMeshPath(const std::string& path, int& outMeshIndex)
+	{
+		outMeshIndex = -1;
+		size_t hash = path.find_last_of('#');
+		if (hash == std::string::npos || hash + 1 == path.size())
+			return path;
+		for (size_t i = hash + 1; i < path.size(); i++)
+		{
+			if (path[i] < '0' || path[i] > '9')
+				return path;
+		}
+		outMeshIndex = atoi(path.c_str() + hash + 1);
+		return path.substr(0, hash);
+	}
+
+	// Parses the JSON part and, if loadBuffers is set, maps the binary buffers.
+	// Embedded base64 buffers are left to Assimp.
+	bool OpenGltf(const std::string& path, bool loadBuffers, GltfFile& file)
+	{
+		GltfBuffer glbBinary;
+		try
+		{
+			if (HasExtension(path, ".glb"))
+			{
+				if (!file.glb.Open(path) || file.glb.Size() < 20)
+					return false;
+
+				const uint8_t* data = file.glb.Data();
+				uint32_t header[3];
+				memcpy(header, data, sizeof(header));
+				if (header[0] != kGlbMagic || header[1] != 2 || header[2] > file.glb.Size())
+					return false;
+
+				size_t offset = 12;
+				while (offset + 8 <= header[2])
+				{
+					uint32_t chunk[2];
+					memcpy(chunk, data + offset, sizeof(chunk));
+					const uint8_t* chunkData = data + offset + 8;
+					if (offset + 8 + chunk[0] > header[2])
+						return false;
+
+					if (chunk[1] == kGlbChunkJson)
+						file.document = json::parse(chunkData, chunkData + chunk[0]);
+					else if (chunk[1] == kGlbChunkBin && !glbBinary.data)
+						glbBinary = { chunkData, chunk[0] };
+					offset += 8 + ((chunk[0] + 3) & ~3u);
+				}
+				if (file.document.is_null())
+					return false;
+			}
+			else
+			{
+				std::vector<char> text;
+				if (!ReadWholeFile(path, text))
+					return false;
+				file.document = json::parse(text.begin(), text.end());
+			}
+
+			if (!loadBuffers)
+				return true;
+
+			const std::string directory = DirectoryOf(path);
+			for (auto& buffer : file.document.value("buffers", json::array()))
+			{
+				size_t byteLength = buffer.at("byteLength").get<size_t>();
+				GltfBuffer view;
+				if (!buffer.contains("uri"))
+				{
+					view = glbBinary;
+				}
+				else
+				{
+					std::string uri = buffer["uri"].get<std::string>();
+					if (uri.compare(0, 5, "data:") == 0)
+						return false;
+
+					std::unique_ptr<MappedFile> mapped(new MappedFile());
+					if (!mapped->Open(directory + uri))
+						return false;
+					view = { mapped->Data(), mapped->Size() };
+					file.externalBuffers.push_back(std::move(mapped));
+				}
+				if (!view.data || view.size < byteLength)
+					return false;
+				file.buffers.push_back(view);
+			}
+		}
+		catch (const json::exception&)
+		{
+			return false;
+		}
+		return true;
+	}
+
+	bool GetAccessor(const GltfFile& file, int index, GltfAccessor& out)
+	{
+		const json& accessors = file.document.at("accessors");
+		if (index < 0 || index >= static_cast<int>(accessors.size()))
+			return false;
+
+		const json& accessor = accessors[index];
+		if (accessor.contains("sparse") || !accessor.contains("bufferView"))
+			return false;
+
+		static const std::pair<const char*, int> kTypes[] = {
+			{ "SCALAR", 1 }, { "VEC2", 2 }, { "VEC3", 3 }, { "VEC4", 4 } };
+		const std::string type = accessor.at("type").get<std::string>();
+		out.components = 0;
+		for (const auto& t : kTypes)
+		{
+			if (type == t.first)
+				out.components = t.second;
+		}
+
+		out.componentType = accessor.at("componentType").get<int>();
+		size_t componentSize = 0;
+		switch (out.componentType)
+		{
+		case kComponentUnsignedByte: componentSize = 1; break;
+		case kComponentUnsignedShort: componentSize = 2; break;
+		case kComponentUnsignedInt:
+		case kComponentFloat: componentSize = 4; break;
+		}
+		if (out.components == 0 || componentSize == 0)
+			return false;
+
+		const json& view = file.document.at("bufferViews").at(accessor["bufferView"].get<size_t>());
+		size_t bufferIndex = view.at("buffer").get<size_t>();
+		if (bufferIndex >= file.buffers.size())
+			return false;
+
+		const size_t elementSize = componentSize * out.components;
+		const size_t offset = view.value("byteOffset", size_t(0)) + accessor.value("byteOffset", size_t(0));
+		out.count = accessor.at("count").get<size_t>();
+		out.stride = view.value("byteStride", elementSize);
+		if (out.count > 0 && offset + out.stride * (out.count - 1) + elementSize > file.buffers[bufferIndex].size)
+			return false;
+
+		out.data = file.buffers[bufferIndex].data + offset;
+		return true;
+	}
+
+	XMFLOAT3 ReadFloat3(const GltfAccessor& accessor, size_t i)
+	{
+		XMFLOAT3 value;
+		memcpy(&value, accessor.data + i * accessor.stride, sizeof(value));
+		return value;
+	}
+
+	uint32_t ReadIndex(const GltfAccessor& accessor, size_t i)
+	{
+		const uint8_t* element = accessor.data + i * accessor.stride;
+		switch (accessor.componentType)
+		{
+		case kComponentUnsignedByte:
+			return *element;
+		case kComponentUnsignedShort:
+		{
+			uint16_t value;
+			memcpy(&value, element, sizeof(value));
+			return value;
+		}
+		default:
+		{
+			uint32_t value;
+			memcpy(&value, element, sizeof(value));
+			return value;
+		}
+		}
+	}
+
+	// Converts all primitives of one glTF mesh. Positions and normals get z
+	// negated and triangles reversed, matching aiProcess_ConvertToLeftHanded.
+	bool AppendGltfMesh(const GltfFile& file, int meshIndex,
+		std::vector<D3D12HelloTriangle::Vertex>& outVertices,
+		std::vector<uint32_t>& outIndices)
+	{
+		const json& meshes = file.document.at("meshes");
+		if (meshIndex < 0 || meshIndex >= static_cast<int>(meshes.size()))
+			return false;
+
+		const json& materials = file.document.value("materials", json::array());
+		for (const auto& primitive : meshes[meshIndex].at("primitives"))
+		{
+			if (primitive.value("mode", kModeTriangles) != kModeTriangles)
+				return false;
+
+			const json& attributes = primitive.at("attributes");
+			GltfAccessor positions, normals, indices;
+			if (!attributes.contains("POSITION") ||
+				!GetAccessor(file, attributes["POSITION"].get<int>(), positions) ||
+				positions.componentType != kComponentFloat || positions.components != 3)
+				return false;
+
+			bool hasNormals = attributes.contains("NORMAL");
+			if (hasNormals && (!GetAccessor(file, attributes["NORMAL"].get<int>(), normals) ||
+				normals.componentType != kComponentFloat || normals.components != 3 || normals.count != positions.count))
+				return false;
+
+			bool hasIndices = primitive.contains("indices");
+			if (hasIndices && (!GetAccessor(file, primitive["indices"].get<int>(), indices) ||
+				indices.components != 1 || indices.componentType == kComponentFloat))
+				return false;
+
+			// glTF's default material is white
+			XMFLOAT4 color = { 1.0f, 1.0f, 1.0f, 1.0f };
+			int material = primitive.value("material", -1);
+			if (material >= 0 && material < static_cast<int>(materials.size()))
+			{
+				const json& pbr = materials[material].value("pbrMetallicRoughness", json::object());
+				if (pbr.contains("baseColorFactor"))
+				{
+					const json& factor = pbr["baseColorFactor"];
+					color = { factor[0].get<float>(), factor[1].get<float>(), factor[2].get<float>(), factor[3].get<float>() };
+				}
+			}
+
+			const size_t triangleCount = (hasIndices ? indices.count : positions.count) / 3;
+			const uint32_t vertexOffset = static_cast<uint32_t>(outVertices.size());
+
+			D3D12HelloTriangle::Vertex v = {};
+			v.color = color;
+			v.roughness = 0.4f; // same default as the Assimp path
+
+			if (hasNormals)
+			{
+				outVertices.reserve(outVertices.size() + positions.count);
+				for (size_t i = 0; i < positions.count; i++)
+				{
+					v.position = ReadFloat3(positions, i);
+					v.normal = ReadFloat3(normals, i);
+					v.position.z = -v.position.z;
+					v.normal.z = -v.normal.z;
+					outVertices.push_back(v);
+				}
+
+				outIndices.reserve(outIndices.size() + triangleCount * 3);
+				for (size_t t = 0; t < triangleCount; t++)
+				{
+					uint32_t corner[3];
+					for (int k = 0; k < 3; k++)
+					{
+						corner[k] = hasIndices ? ReadIndex(indices, t * 3 + k) : static_cast<uint32_t>(t * 3 + k);
+						if (corner[k] >= positions.count)
+							return false;
+					}
+					outIndices.push_back(vertexOffset + corner[0]);
+					outIndices.push_back(vertexOffset + corner[2]);
+					outIndices.push_back(vertexOffset + corner[1]);
+				}
+			}
+			else
+			{
+				// Flat normals need their own vertices per triangle, as with aiProcess_GenNormals
+				outVertices.reserve(outVertices.size() + triangleCount * 3);
+				outIndices.reserve(outIndices.size() + triangleCount * 3);
+				for (size_t t = 0; t < triangleCount; t++)
+				{
+					XMFLOAT3 p[3];
+					for (int k = 0; k < 3; k++)
+					{
+						uint32_t index = hasIndices ? ReadIndex(indices, t * 3 + k) : static_cast<uint32_t>(t * 3 + k);
+						if (index >= positions.count)
+							return false;
+						p[k] = ReadFloat3(positions, index);
+						p[k].z = -p[k].z;
+					}
+
+					XMVECTOR p0 = XMLoadFloat3(&p[0]);
+					XMVECTOR normal = XMVector3Normalize(XMVector3Cross(XMLoadFloat3(&p[2]) - p0, XMLoadFloat3(&p[1]) - p0));
+					XMStoreFloat3(&v.normal, normal);
+
+					const int order[3] = { 0, 2, 1 };
+					for (int k : order)
+					{
+						v.position = p[k];
+						outIndices.push_back(static_cast<uint32_t>(outVertices.size()));
+						outVertices.push_back(v);
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	XMMATRIX NodeLocalMatrix(const json& node)
+	{
+		if (node.contains("matrix"))
+		{
+			// Column-major column-vector matrix, which is the row-vector matrix DirectXMath uses
+			XMFLOAT4X4 m;
+			const json& values = node["matrix"];
+			for (int i = 0; i < 16; i++)
+				m.m[i / 4][i % 4] = values[i].get<float>();
+			return XMLoadFloat4x4(&m);
+		}
+
+		XMMATRIX local = XMMatrixIdentity();
+		if (node.contains("scale"))
+		{
+			const json& s = node["scale"];
+			local = XMMatrixScaling(s[0].get<float>(), s[1].get<float>(), s[2].get<float>());
+		}
+		if (node.contains("rotation"))
+		{
+			const json& r = node["rotation"];
+			local = local * XMMatrixRotationQuaternion(XMVectorSet(r[0].get<float>(), r[1].get<float>(), r[2].get<float>(), r[3].get<float>()));
+		}
+		if (node.contains("translation"))
+		{
+			const json& t = node["translation"];
+			local = local * XMMatrixTranslation(t[0].get<float>(), t[1].get<float>(), t[2].get<float>());
+		}
+		return local;
+	}
+
+	// Inverse of the scale * XMMatrixRotationRollPitchYaw * translation composition
+	// ModelDesc uses. Shear from non-uniform scales under rotated parents is lost.
+	void DecomposeToModelDesc(FXMMATRIX transform, D3D12HelloTriangle::ModelDesc& desc)
+	{
+		XMVECTOR scale, rotation, translation;
+		if (!XMMatrixDecompose(&scale, &rotation, &translation, transform))
+			return;
+
+		XMStoreFloat3(&desc.position, translation);
+		XMStoreFloat3(&desc.scale, scale);
+		desc.rotation = AnimationTracks::EulerDegreesFromQuaternion(rotation);
+	}
+
+	void ExpandNode(const json& nodes, int nodeIndex, FXMMATRIX parentWorld, int depth,
+		const D3D12HelloTriangle::ModelDesc& sceneDesc, const std::string& filePath,
+		std::vector<D3D12HelloTriangle::ModelDesc>& outDescs)
+	{
+		// Node graphs must be trees; the depth limit only guards against broken files
+		if (nodeIndex < 0 || nodeIndex >= static_cast<int>(nodes.size()) || depth > 64)
+			return;
+
+		const json& node = nodes[nodeIndex];
+		XMMATRIX world = NodeLocalMatrix(node) * parentWorld;
+
+		if (node.contains("mesh"))
+		{
+			// Mirror z on both sides to express the right-handed node transform in
+			// the left-handed space the mesh was converted to, then apply the
+			// transform of the scene entry
+			XMMATRIX mirror = XMMatrixScaling(1.0f, 1.0f, -1.0f);
+			XMMATRIX sceneTransform =
+				XMMatrixScaling(sceneDesc.scale.x, sceneDesc.scale.y, sceneDesc.scale.z) *
+				XMMatrixRotationRollPitchYaw(XMConvertToRadians(sceneDesc.rotation.x), XMConvertToRadians(sceneDesc.rotation.y), XMConvertToRadians(sceneDesc.rotation.z)) *
+				XMMatrixTranslation(sceneDesc.position.x, sceneDesc.position.y, sceneDesc.position.z);
+
+			D3D12HelloTriangle::ModelDesc desc = sceneDesc;
+			desc.path = filePath + "#" + std::to_string(node["mesh"].get<int>());
+			desc.animationFrames.clear();
+			DecomposeToModelDesc(mirror * world * mirror * sceneTransform, desc);
+			outDescs.push_back(desc);
+		}
+
+		for (const auto& child : node.value("children", json::array()))
+			ExpandNode(nodes, child.get<int>(), world, depth + 1, sceneDesc, filePath, outDescs);
+	}
+}
+
+bool D3D12HelloTriangle::IsGltfFile(const std::string& path)
+{
+	int meshIndex;
+	std::string file = SplitGltfMeshPath(path, meshIndex);
+	return HasExtension(file, ".gltf") || HasExtension(file, ".glb");
+}
+
+bool D3D12HelloTriangle::LoadGltfModel(const std::string& modelPath,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices)
+{
+	int meshIndex;
+	const std::string filePath = SplitGltfMeshPath(modelPath, meshIndex);
+
+	GltfFile file;
+	if (!OpenGltf(filePath, true, file))
+		return false;
+
+	try
+	{
+		if (meshIndex >= 0)
+			return AppendGltfMesh(file, meshIndex, outVertices, outIndices) && !outIndices.empty();
+
+		const int meshCount = static_cast<int>(file.document.value("meshes", json::array()).size());
+		for (int m = 0; m < meshCount; m++)
+		{
+			if (!AppendGltfMesh(file, m, outVertices, outIndices))
+				return false;
+		}
+	}
+	catch (const json::exception&)
+	{
+		return false;
+	}
+	return !outIndices.empty();
+}
+
+bool D3D12HelloTriangle::ExpandGltfNodes(const ModelDesc& desc, std::vector<ModelDesc>& outDescs)
+{
+	int meshIndex;
+	SplitGltfMeshPath(desc.path, meshIndex);
+	if (meshIndex >= 0 || !IsGltfFile(desc.path))
+		return false;
+
+	GltfFile file;
+	if (!OpenGltf(desc.path, false, file))
+		return false;
+
+	std::vector<ModelDesc> expanded;
+	try
+	{
+		const json& nodes = file.document.value("nodes", json::array());
+		const json& scenes = file.document.value("scenes", json::array());
+		size_t scene = file.document.value("scene", size_t(0));
+		if (scene < scenes.size())
+		{
+			for (const auto& root : scenes[scene].value("nodes", json::array()))
+				ExpandNode(nodes, root.get<int>(), XMMatrixIdentity(), 0, desc, desc.path, expanded);
+		}
+	}
+	catch (const json::exception&)
+	{
+		return false;
+	}
+
+	// Files without a scene graph are loaded whole
+	if (expanded.empty())
+		return false;
+
+	outDescs.insert(outDescs.end(), expanded.begin(), expanded.end());
+	return true;
+}
@@ -0,0 +1,299 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include "libraries/nlohmann/json.hpp"
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <set>
+
+using json = nlohmann::json;
+
+namespace
+{
+	struct MeshSummary
+	{
+		size_t triangles = 0;
+		XMFLOAT3 boundsMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+		XMFLOAT3 boundsMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	};
+
+	MeshSummary Summarize(const std::vector<D3D12HelloTriangle::Vertex>& vertices, const std::vector<uint32_t>& indices)
+	{
+		MeshSummary summary;
+		summary.triangles = indices.size() / 3;
+		XMVECTOR boundsMin = XMLoadFloat3(&summary.boundsMin);
+		XMVECTOR boundsMax = XMLoadFloat3(&summary.boundsMax);
+		for (uint32_t index : indices)
+		{
+			XMVECTOR p = XMLoadFloat3(&vertices[index].position);
+			boundsMin = XMVectorMin(boundsMin, p);
+			boundsMax = XMVectorMax(boundsMax, p);
+		}
+		XMStoreFloat3(&summary.boundsMin, boundsMin);
+		XMStoreFloat3(&summary.boundsMax, boundsMax);
+		return summary;
+	}
+
+	bool BoundsMatch(const MeshSummary& a, const MeshSummary& b)
+	{
+		const XMVECTOR tolerance = XMVectorReplicate(1e-4f);
+		return XMVector3NearEqual(XMLoadFloat3(&a.boundsMin), XMLoadFloat3(&b.boundsMin), tolerance) &&
+			XMVector3NearEqual(XMLoadFloat3(&a.boundsMax), XMLoadFloat3(&b.boundsMax), tolerance);
+	}
+
+	const char* kGltfTestDirectory = "Cache/GltfTest/";
+
+	// Writes one glTF scene to directory twice, as fixture.gltf + fixture.bin
+	// and as fixture.glb, so the checks do not depend on the bundled models.
+	// Mesh 0 is a cube with normals, 16-bit indices and a material, mesh 1 a
+	// pyramid without normals or indices, mesh 2 a grid x grid height field
+	// with normals and 32-bit indices. The nodes are a rotated cube with the
+	// pyramid as its scaled child, and the grid placed by a matrix.
+	bool WriteGltfFixture(const std::string& directory, int grid)
+	{
+		const int kUnsignedShort = 5123, kUnsignedInt = 5125, kFloat = 5126;
+		std::vector<uint8_t> bin;
+		json bufferViews = json::array();
+		json accessors = json::array();
+
+		// One tightly packed array as its own buffer view and accessor
+		auto addAccessor = [&](const void* data, size_t count, size_t elementSize, int componentType, const char* type) {
+			while (bin.size() % 4)
+				bin.push_back(0);
+			bufferViews.push_back({ { "buffer", 0 }, { "byteOffset", bin.size() }, { "byteLength", count * elementSize } });
+			const uint8_t* bytes = static_cast<const uint8_t*>(data);
+			bin.insert(bin.end(), bytes, bytes + count * elementSize);
+			accessors.push_back({ { "bufferView", bufferViews.size() - 1 }, { "componentType", componentType },
+				{ "count", count }, { "type", type } });
+			return static_cast<int>(accessors.size() - 1);
+		};
+		auto addPositions = [&](const std::vector<XMFLOAT3>& positions) {
+			XMFLOAT3 low = { FLT_MAX, FLT_MAX, FLT_MAX }, high = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (const XMFLOAT3& p : positions)
+			{
+				XMStoreFloat3(&low, XMVectorMin(XMLoadFloat3(&low), XMLoadFloat3(&p)));
+				XMStoreFloat3(&high, XMVectorMax(XMLoadFloat3(&high), XMLoadFloat3(&p)));
+			}
+			const int accessor = addAccessor(positions.data(), positions.size(), sizeof(XMFLOAT3), kFloat, "VEC3");
+			accessors[accessor]["min"] = { low.x, low.y, low.z };
+			accessors[accessor]["max"] = { high.x, high.y, high.z };
+			return accessor;
+		};
+
+		std::vector<XMFLOAT3> cubePositions, cubeNormals;
+		std::vector<uint16_t> cubeIndices;
+		for (int face = 0; face < 6; face++)
+		{
+			const int axis = face / 2, u = (axis + 1) % 3, v = (axis + 2) % 3;
+			const float sign = face % 2 ? -1.0f : 1.0f;
+			const uint16_t base = static_cast<uint16_t>(cubePositions.size());
+			for (int corner = 0; corner < 4; corner++)
+			{
+				float p[3] = {}, n[3] = {};
+				p[axis] = n[axis] = sign;
+				p[u] = corner == 1 || corner == 2 ? 1.0f : -1.0f;
+				p[v] = corner >= 2 ? 1.0f : -1.0f;
+				cubePositions.push_back({ p[0], p[1], p[2] });
+				cubeNormals.push_back({ n[0], n[1], n[2] });
+			}
+			const uint16_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+			for (int k = 0; k < 6; k++)
+				cubeIndices.push_back(base + quad[sign > 0.0f ? k : 5 - k]);
+		}
+
+		const XMFLOAT3 apex = { 0.0f, 1.0f, 0.0f };
+		const XMFLOAT3 base[4] = { { -1.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, -1.0f }, { 1.0f, 0.0f, 1.0f }, { -1.0f, 0.0f, 1.0f } };
+		std::vector<XMFLOAT3> pyramidPositions;
+		for (int side = 0; side < 4; side++)
+			pyramidPositions.insert(pyramidPositions.end(), { base[side], apex, base[(side + 1) % 4] });
+		pyramidPositions.insert(pyramidPositions.end(), { base[0], base[2], base[1], base[0], base[3], base[2] });
+
+		std::vector<XMFLOAT3> gridPositions, gridNormals;
+		std::vector<uint32_t> gridIndices;
+		for (int row = 0; row <= grid; row++)
+		{
+			for (int column = 0; column <= grid; column++)
+			{
+				const float x = 2.0f * column / grid - 1.0f, z = 2.0f * row / grid - 1.0f;
+				gridPositions.push_back({ x, 0.25f * std::sin(3.0f * x) * std::cos(3.0f * z), z });
+				XMVECTOR normal = XMVectorSet(-0.75f * std::cos(3.0f * x) * std::cos(3.0f * z), 1.0f, 0.75f * std::sin(3.0f * x) * std::sin(3.0f * z), 0.0f);
+				XMFLOAT3 n;
+				XMStoreFloat3(&n, XMVector3Normalize(normal));
+				gridNormals.push_back(n);
+			}
+		}
+		for (int row = 0; row < grid; row++)
+		{
+			for (int column = 0; column < grid; column++)
+			{
+				const uint32_t i = static_cast<uint32_t>(row * (grid + 1) + column), next = i + grid + 1;
+				gridIndices.insert(gridIndices.end(), { i, next, i + 1, i + 1, next, next + 1 });
+			}
+		}
+
+		json cube = { { "attributes", { { "POSITION", addPositions(cubePositions) },
+			{ "NORMAL", addAccessor(cubeNormals.data(), cubeNormals.size(), sizeof(XMFLOAT3), kFloat, "VEC3") } } },
+			{ "indices", addAccessor(cubeIndices.data(), cubeIndices.size(), sizeof(uint16_t), kUnsignedShort, "SCALAR") },
+			{ "material", 0 } };
+		json pyramid = { { "attributes", { { "POSITION", addPositions(pyramidPositions) } } } };
+		json heightField = { { "attributes", { { "POSITION", addPositions(gridPositions) },
+			{ "NORMAL", addAccessor(gridNormals.data(), gridNormals.size(), sizeof(XMFLOAT3), kFloat, "VEC3") } } },
+			{ "indices", addAccessor(gridIndices.data(), gridIndices.size(), sizeof(uint32_t), kUnsignedInt, "SCALAR") } };
+		while (bin.size() % 4)
+			bin.push_back(0);
+
+		json document = {
+			{ "asset", { { "version", "2.0" } } },
+			{ "scene", 0 },
+			{ "scenes", { { { "nodes", { 0, 2 } } } } },
+			{ "nodes", {
+				{ { "mesh", 0 }, { "rotation", { 0.0f, 0.38268343f, 0.0f, 0.92387953f } }, { "translation", { 2.0f, 0.0f, 0.0f } }, { "children", { 1 } } },
+				{ { "mesh", 1 }, { "scale", { 0.5f, 2.0f, 0.5f } }, { "translation", { 0.0f, 1.5f, 0.0f } } },
+				{ { "mesh", 2 }, { "matrix", { 4.0f, 0.0f, 0.0f, 0.0f, 0.0f, 4.0f, 0.0f, 0.0f, 0.0f, 0.0f, 4.0f, 0.0f, 0.0f, -1.0f, -3.0f, 1.0f } } } } },
+			{ "meshes", { { { "primitives", { cube } } }, { { "primitives", { pyramid } } }, { { "primitives", { heightField } } } } },
+			{ "materials", { { { "pbrMetallicRoughness", { { "baseColorFactor", { 0.8f, 0.2f, 0.1f, 1.0f } } } } } } },
+			{ "accessors", accessors },
+			{ "bufferViews", bufferViews },
+			{ "buffers", { { { "byteLength", bin.size() }, { "uri", "fixture.bin" } } } } };
+		const std::string gltf = document.dump(1, '\t');
+		if (!WriteFileAtomic(directory + "fixture.bin", bin.data(), bin.size()) ||
+			!WriteFileAtomic(directory + "fixture.gltf", gltf.data(), gltf.size()))
+			return false;
+
+		// The .glb takes the buffer from its BIN chunk, which follows the JSON
+		// chunk padded with spaces
+		document["buffers"][0].erase("uri");
+		std::string chunkJson = document.dump();
+		while (chunkJson.size() % 4)
+			chunkJson.push_back(' ');
+		const uint32_t header[5] = { 0x46546C67, 2, static_cast<uint32_t>(12 + 8 + chunkJson.size() + 8 + bin.size()),
+			static_cast<uint32_t>(chunkJson.size()), 0x4E4F534A };
+		const uint32_t binHeader[2] = { static_cast<uint32_t>(bin.size()), 0x004E4942 };
+		std::vector<uint8_t> glb(reinterpret_cast<const uint8_t*>(header), reinterpret_cast<const uint8_t*>(header) + sizeof(header));
+		glb.insert(glb.end(), chunkJson.begin(), chunkJson.end());
+		glb.insert(glb.end(), reinterpret_cast<const uint8_t*>(binHeader), reinterpret_cast<const uint8_t*>(binHeader) + sizeof(binHeader));
+		glb.insert(glb.end(), bin.begin(), bin.end());
+		return WriteFileAtomic(directory + "fixture.glb", glb.data(), glb.size());
+	}
+}
+
+// Writes the glTF fixture under Cache/GltfTest/ and loads it, as .gltf + .bin
+// and as .glb, with the native loader and with Assimp. Triangle counts and
+// bounds have to match, both files have to give the same mesh, and the nodes
+// have to expand into three instances of three meshes with the pyramid placed
+// under the cube. Returns 1 on a mismatch or a load failure.
+int D3D12HelloTriangle::RunGltfParityCheck()
+{
+	const std::string directory = kGltfTestDirectory;
+	if (!EnsureDirectory(directory) || !WriteGltfFixture(directory, 16))
+	{
+		std::cout << "Cannot write the glTF fixture to " << directory << "\n";
+		return 1;
+	}
+
+	int result = 0;
+	std::vector<Vertex> gltfVertices;
+	std::vector<uint32_t> gltfIndices;
+	for (const char* name : { "fixture.gltf", "fixture.glb" })
+	{
+		const std::string path = directory + name;
+		std::vector<Vertex> nativeVertices, assimpVertices;
+		std::vector<uint32_t> nativeIndices, assimpIndices;
+		if (!LoadGltfModel(path, nativeVertices, nativeIndices))
+		{
+			std::cout << path << ": native loader failed\n";
+			result = 1;
+			continue;
+		}
+		if (!ImportModelAssimp(path, AssimpImportFlags, assimpVertices, assimpIndices))
+		{
+			std::cout << path << ": Assimp failed\n";
+			result = 1;
+			continue;
+		}
+
+		MeshSummary native = Summarize(nativeVertices, nativeIndices);
+		MeshSummary assimp = Summarize(assimpVertices, assimpIndices);
+		bool pass = native.triangles == assimp.triangles && BoundsMatch(native, assimp);
+
+		std::cout << path << ": " << (pass ? "PASS" : "FAIL") << "\n"
+			<< "  native: " << native.triangles << " triangles, bounds (" << native.boundsMin.x << ", " << native.boundsMin.y << ", " << native.boundsMin.z
+			<< ") - (" << native.boundsMax.x << ", " << native.boundsMax.y << ", " << native.boundsMax.z << ")\n"
+			<< "  Assimp: " << assimp.triangles << " triangles, bounds (" << assimp.boundsMin.x << ", " << assimp.boundsMin.y << ", " << assimp.boundsMin.z
+			<< ") - (" << assimp.boundsMax.x << ", " << assimp.boundsMax.y << ", " << assimp.boundsMax.z << ")\n";
+
+		if (gltfVertices.empty())
+		{
+			gltfVertices = nativeVertices;
+			gltfIndices = nativeIndices;
+		}
+		else
+		{
+			const bool same = nativeIndices == gltfIndices && nativeVertices.size() == gltfVertices.size() &&
+				memcmp(nativeVertices.data(), gltfVertices.data(), nativeVertices.size() * sizeof(Vertex)) == 0;
+			std::cout << "  same mesh as the .gltf: " << (same ? "yes" : "no") << "\n";
+			pass = pass && same;
+		}
+
+		ModelDesc sceneDesc;
+		sceneDesc.id = 0;
+		sceneDesc.path = path;
+		std::vector<ModelDesc> nodes;
+		std::set<std::string> meshes;
+		if (ExpandGltfNodes(sceneDesc, nodes))
+		{
+			for (const auto& node : nodes)
+				meshes.insert(node.path);
+		}
+		// The pyramid sits 1.5 above the cube's origin at (2, 0, 0)
+		const bool placed = nodes.size() == 3 && meshes.size() == 3 && nodes[1].path == path + "#1" &&
+			std::fabs(nodes[1].position.x - 2.0f) < 1e-4f && std::fabs(nodes[1].position.y - 1.5f) < 1e-4f && std::fabs(nodes[1].position.z) < 1e-4f;
+		std::cout << "  " << nodes.size() << " node instances of " << meshes.size() << " meshes" << (placed ? "" : ", expected 3 of 3 with the pyramid at (2, 1.5, 0)") << "\n";
+		pass = pass && placed;
+
+		if (!pass)
+			result = 1;
+	}
+	return result;
+}
+
+// Load time of a 512 x 512 grid glTF fixture (.gltf + .bin), native loader
+// against Assimp
+int D3D12HelloTriangle::RunGltfLoadBenchmark()
+{
+	const int iterations = 5;
+	const std::string directory = kGltfTestDirectory;
+	const std::string path = directory + "fixture.gltf";
+	if (!EnsureDirectory(directory) || !WriteGltfFixture(directory, 512))
+	{
+		std::cout << "Cannot write the glTF fixture to " << directory << "\n";
+		return 1;
+	}
+
+	double nativeMs = 0.0, assimpMs = 0.0;
+	for (int i = 0; i < iterations; i++)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!LoadGltfModel(path, vertices, indices))
+		{
+			std::cout << path << ": native loader failed\n";
+			return 1;
+		}
+		nativeMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		vertices.clear();
+		indices.clear();
+		start = std::chrono::high_resolution_clock::now();
+		ImportModelAssimp(path, AssimpImportFlags, vertices, indices);
+		assimpMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	std::cout << path << " (average of " << iterations << "): native " << nativeMs / iterations
+		<< " ms, Assimp " << assimpMs / iterations << " ms\n";
+	return 0;
+}
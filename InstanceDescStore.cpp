@@ -0,0 +1,185 @@
+#include "stdafx.h"
+#include "InstanceDescStore.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace DirectX;
+
+void InstanceDescStore::Resize(size_t count)
+{
+	const size_t oldCount = m_records.size();
+	if (count < oldCount)
+	{
+		size_t kept = 0;
+		for (uint32_t index : m_dirtyList)
+		{
+			if (index < count)
+				m_dirtyList[kept++] = index;
+		}
+		m_dirtyList.resize(kept);
+	}
+
+	D3D12_RAYTRACING_INSTANCE_DESC zero;
+	memset(&zero, 0, sizeof(zero));
+	m_records.resize(count, zero);
+	m_dirty.resize(count, 0);
+	for (size_t i = oldCount; i < count; i++)
+	{
+		m_dirty[i] = 1;
+		m_dirtyList.push_back(static_cast<uint32_t>(i));
+	}
+}
+
+void InstanceDescStore::Set(size_t index, D3D12_GPU_VIRTUAL_ADDRESS blas, const XMMATRIX& transform,
+	UINT instanceID, UINT hitGroupIndex, UINT mask, D3D12_RAYTRACING_INSTANCE_FLAGS flags)
+{
+	const D3D12_RAYTRACING_INSTANCE_DESC record = Pack(blas, transform, instanceID, hitGroupIndex, mask, flags);
+	if (memcmp(&m_records[index], &record, sizeof(record)) == 0)
+		return;
+
+	m_records[index] = record;
+	if (!m_dirty[index])
+	{
+		m_dirty[index] = 1;
+		m_dirtyList.push_back(static_cast<uint32_t>(index));
+	}
+}
+
+void InstanceDescStore::MarkAllDirty()
+{
+	m_dirtyList.clear();
+	for (size_t i = 0; i < m_records.size(); i++)
+	{
+		m_dirty[i] = 1;
+		m_dirtyList.push_back(static_cast<uint32_t>(i));
+	}
+}
+
+std::vector<InstanceRecordRange> InstanceDescStore::TakeDirtyRanges(uint32_t maxGap)
+{
+	std::vector<InstanceRecordRange> ranges;
+	if (m_dirtyList.empty())
+		return ranges;
+
+	// Many dirty records: walking the flags is cheaper than sorting the list
+	if (m_dirtyList.size() * 8 > m_records.size())
+	{
+		m_dirtyList.clear();
+		for (size_t i = 0; i < m_dirty.size(); i++)
+		{
+			if (m_dirty[i])
+				m_dirtyList.push_back(static_cast<uint32_t>(i));
+		}
+	}
+	else
+	{
+		std::sort(m_dirtyList.begin(), m_dirtyList.end());
+	}
+
+	for (uint32_t index : m_dirtyList)
+	{
+		m_dirty[index] = 0;
+		if (!ranges.empty() && index - (ranges.back().first + ranges.back().count) <= maxGap)
+			ranges.back().count = index + 1 - ranges.back().first;
+		else
+			ranges.push_back({ index, 1 });
+	}
+	m_dirtyList.clear();
+	return ranges;
+}
+
+D3D12_RAYTRACING_INSTANCE_DESC InstanceDescStore::Pack(D3D12_GPU_VIRTUAL_ADDRESS blas, const XMMATRIX& transform,
+	UINT instanceID, UINT hitGroupIndex, UINT mask, D3D12_RAYTRACING_INSTANCE_FLAGS flags)
+{
+	D3D12_RAYTRACING_INSTANCE_DESC record;
+	memset(&record, 0, sizeof(record));
+
+	// Same layout as TopLevelASGenerator wrote: the transpose, cut to 3 rows
+	XMMATRIX m = XMMatrixTranspose(transform);
+	memcpy(record.Transform, &m, sizeof(record.Transform));
+	record.InstanceID = instanceID;
+	record.InstanceMask = mask;
+	record.InstanceContributionToHitGroupIndex = hitGroupIndex;
+	record.Flags = static_cast<UINT>(flags);
+	record.AccelerationStructure = blas;
+	return record;
+}
+
+XMFLOAT3 InstanceDescStore::Translation(const D3D12_RAYTRACING_INSTANCE_DESC& record)
+{
+	return XMFLOAT3(record.Transform[0][3], record.Transform[1][3], record.Transform[2][3]);
+}
+
+void UploadRing::Reset(uint64_t regionSize, uint32_t regionCount)
+{
+	m_regionSize = regionSize;
+	m_regionCount = regionCount;
+	// The first BeginRegion lands on region 0
+	m_region = regionCount - 1;
+	m_used = regionSize;
+}
+
+void UploadRing::BeginRegion()
+{
+	m_region = (m_region + 1) % m_regionCount;
+	m_used = 0;
+}
+
+uint64_t UploadRing::Allocate(uint64_t size, uint64_t alignment)
+{
+	const uint64_t offset = (m_used + alignment - 1) & ~(alignment - 1);
+	if (offset + size > m_regionSize)
+		return UINT64_MAX;
+	m_used = offset + size;
+	return m_region * m_regionSize + offset;
+}
+
+void TlasRefitPolicy::Rebuilt(const InstanceDescStore& store)
+{
+	const size_t count = store.Count();
+	m_builtPositions.resize(count);
+	m_drifted.assign(count, 0);
+	m_driftedCount = 0;
+	m_refits = 0;
+
+	XMVECTOR low = XMVectorReplicate(FLT_MAX), high = XMVectorReplicate(-FLT_MAX);
+	for (size_t i = 0; i < count; i++)
+	{
+		m_builtPositions[i] = InstanceDescStore::Translation(store.Record(i));
+		const XMVECTOR position = XMLoadFloat3(&m_builtPositions[i]);
+		low = XMVectorMin(low, position);
+		high = XMVectorMax(high, position);
+	}
+	m_extent = count ? XMVectorGetX(XMVector3Length(XMVectorSubtract(high, low))) : 0.0f;
+}
+
+void TlasRefitPolicy::Moved(const InstanceDescStore& store, const std::vector<InstanceRecordRange>& ranges)
+{
+	const float limit = driftFraction * m_extent;
+	for (const InstanceRecordRange& range : ranges)
+	{
+		for (uint32_t i = range.first; i < range.first + range.count && i < m_builtPositions.size(); i++)
+		{
+			const XMFLOAT3 position = InstanceDescStore::Translation(store.Record(i));
+			const float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&position), XMLoadFloat3(&m_builtPositions[i]))));
+			const uint8_t drifted = distance > limit ? 1 : 0;
+			if (drifted != m_drifted[i])
+			{
+				m_drifted[i] = drifted;
+				if (drifted)
+					m_driftedCount++;
+				else
+					m_driftedCount--;
+			}
+		}
+	}
+}
+
+bool TlasRefitPolicy::ShouldRebuild() const
+{
+	if (maxRefits != 0 && m_refits >= maxRefits)
+		return true;
+	return static_cast<float>(m_driftedCount) > maxDriftedShare * static_cast<float>(m_builtPositions.size());
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <d3d12.h>
+#include <DirectXMath.h>
+#include <cstdint>
+#include <vector>
+
+// CPU side of the TLAS instance buffer. The D3D12_RAYTRACING_INSTANCE_DESC
+// records stay in place from frame to frame; only records whose bytes changed
+// are uploaded, as a few contiguous ranges, into the upload region of the
+// current frame. TlasRefitPolicy decides whether those changes are refitted
+// into the existing TLAS or call for a full build.
+
+// Records [first, first + count)
+struct InstanceRecordRange
+{
+	uint32_t first;
+	uint32_t count;
+};
+
+class InstanceDescStore
+{
+public:
+	// Grows or shrinks to `count` records; new records are zero and dirty
+	void Resize(size_t count);
+	size_t Count() const { return m_records.size(); }
+
+	// Packs an instance into its record, marked dirty if the record changed.
+	// `transform` is the row vector matrix of DirectXMath; the record holds
+	// its transpose, 3 rows of 4.
+	void Set(size_t index, D3D12_GPU_VIRTUAL_ADDRESS blas, const DirectX::XMMATRIX& transform,
+		UINT instanceID, UINT hitGroupIndex, UINT mask = 0xFF,
+		D3D12_RAYTRACING_INSTANCE_FLAGS flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+	void MarkAllDirty();
+	size_t DirtyCount() const { return m_dirtyList.size(); }
+
+	// Dirty records as ascending ranges, and no longer dirty. Ranges at most
+	// `maxGap` clean records apart are merged: copying a few unchanged records
+	// costs less than another copy command.
+	std::vector<InstanceRecordRange> TakeDirtyRanges(uint32_t maxGap);
+
+	const D3D12_RAYTRACING_INSTANCE_DESC& Record(size_t index) const { return m_records[index]; }
+	const D3D12_RAYTRACING_INSTANCE_DESC* Records() const { return m_records.data(); }
+
+	static D3D12_RAYTRACING_INSTANCE_DESC Pack(D3D12_GPU_VIRTUAL_ADDRESS blas, const DirectX::XMMATRIX& transform,
+		UINT instanceID, UINT hitGroupIndex, UINT mask, D3D12_RAYTRACING_INSTANCE_FLAGS flags);
+	// World position of a record's instance
+	static DirectX::XMFLOAT3 Translation(const D3D12_RAYTRACING_INSTANCE_DESC& record);
+
+private:
+	std::vector<D3D12_RAYTRACING_INSTANCE_DESC> m_records;
+	std::vector<uint8_t> m_dirty;
+	std::vector<uint32_t> m_dirtyList;
+};
+
+// Hands out upload space from `regionCount` regions used round robin, one per
+// frame. With as many regions as frames in flight, a region is only written
+// again once the GPU finished the frame that read it.
+class UploadRing
+{
+public:
+	void Reset(uint64_t regionSize, uint32_t regionCount);
+	uint64_t RegionSize() const { return m_regionSize; }
+	uint64_t TotalSize() const { return m_regionSize * m_regionCount; }
+
+	// Moves on to the next region; call once per upload
+	void BeginRegion();
+	// Offset of `size` bytes in the current region, UINT64_MAX when they do not
+	// fit. The alignment is from the start of the region.
+	uint64_t Allocate(uint64_t size, uint64_t alignment = 16);
+
+private:
+	uint64_t m_regionSize = 0;
+	uint32_t m_regionCount = 0;
+	uint32_t m_region = 0;
+	uint64_t m_used = 0;
+};
+
+// A refit keeps the tree of the last full build and only grows its boxes, so
+// rays get slower the further instances move from where that build saw them.
+// An instance has drifted once it is more than driftFraction of the scene's
+// extent (the diagonal of the instance positions at the last build) away from
+// its position then; when more than maxDriftedShare of the instances have,
+// or after maxRefits refits (0: no limit), the next build is a full one.
+class TlasRefitPolicy
+{
+public:
+	float driftFraction = 0.1f;
+	float maxDriftedShare = 0.1f;
+	uint32_t maxRefits = 0;
+
+	// A full build was made from the records of `store`
+	void Rebuilt(const InstanceDescStore& store);
+	// These records changed since the last build
+	void Moved(const InstanceDescStore& store, const std::vector<InstanceRecordRange>& ranges);
+	// A refit was made
+	void Refitted() { m_refits++; }
+
+	bool ShouldRebuild() const;
+	size_t DriftedCount() const { return m_driftedCount; }
+	float SceneExtent() const { return m_extent; }
+
+private:
+	std::vector<DirectX::XMFLOAT3> m_builtPositions;
+	std::vector<uint8_t> m_drifted;
+	size_t m_driftedCount = 0;
+	float m_extent = 0.0f;
+	uint32_t m_refits = 0;
+};
+
+// Instance record packing, dirty ranges, upload ring and refit policy (-testinstancedescs), InstanceDescStoreTests.cpp
+int RunInstanceDescSelfTest();
@@ -0,0 +1,211 @@
+#include "stdafx.h"
+#include "InstanceDescStore.h"
+#include "TestUtils.h"
+#include <cstring>
+#include <iostream>
+
+using namespace DirectX;
+
+// The CPU half of the TLAS upload: records packed as TopLevelASGenerator did,
+// only changed records dirty, dirty ranges that cover exactly what changed,
+// upload regions that never overlap, and when the refit policy asks for a
+// full build. A mirror of the GPU buffer, fed only through the ranges and
+// the ring, has to end up equal to the records.
+int RunInstanceDescSelfTest()
+{
+	TestChecks check;
+
+	uint32_t seed = 4242;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return seed >> 8;
+	};
+
+	// Packing
+	XMFLOAT4X4 values;
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 4; c++)
+			values.m[r][c] = static_cast<float>(r * 4 + c + 1);
+	const D3D12_RAYTRACING_INSTANCE_DESC record = InstanceDescStore::Pack(0x123456789ABCull, XMLoadFloat4x4(&values),
+		0xABCDEF, 0x123456, 0x7F, D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE);
+	bool transposed = true;
+	for (int r = 0; r < 3; r++)
+		for (int c = 0; c < 4; c++)
+			transposed = transposed && record.Transform[r][c] == values.m[c][r];
+	check(transposed, "record holds the transpose of the matrix, 3 rows");
+	check(record.InstanceID == 0xABCDEF && record.InstanceContributionToHitGroupIndex == 0x123456 &&
+		record.InstanceMask == 0x7F && record.Flags == D3D12_RAYTRACING_INSTANCE_FLAG_TRIANGLE_CULL_DISABLE &&
+		record.AccelerationStructure == 0x123456789ABCull, "IDs, mask, flags and BLAS address are packed");
+	const XMFLOAT3 translation = InstanceDescStore::Translation(record);
+	check(translation.x == 13.0f && translation.y == 14.0f && translation.z == 15.0f, "translation is read back from the record");
+
+	// Dirty tracking
+	InstanceDescStore store;
+	store.Resize(100);
+	check(store.DirtyCount() == 100, "new records are dirty");
+	for (size_t i = 0; i < 100; i++)
+		store.Set(i, 0, XMMatrixIdentity(), 0, 0, 0, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+	store.TakeDirtyRanges(0);
+	for (size_t i = 0; i < 100; i++)
+		store.Set(i, 0, XMMatrixIdentity(), 0, 0, 0, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+	check(store.DirtyCount() == 0, "setting the same record again leaves it clean");
+	store.Set(7, 0, XMMatrixTranslation(1.0f, 0.0f, 0.0f), 0, 0, 0, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+	store.Set(7, 0, XMMatrixTranslation(2.0f, 0.0f, 0.0f), 0, 0, 0, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+	store.Set(8, 0, XMMatrixIdentity(), 1, 0, 0, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+	check(store.DirtyCount() == 2, "a record set twice is dirty once");
+	store.Set(90, 0, XMMatrixIdentity(), 0, 3, 0, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+	store.Resize(50);
+	const std::vector<InstanceRecordRange> shrunk = store.TakeDirtyRanges(0);
+	check(shrunk.size() == 1 && shrunk[0].first == 7 && shrunk[0].count == 2, "shrinking forgets dirty records past the end");
+
+	// Coalescing, on the sorting and the flag walking path
+	auto rangesOf = [](const std::vector<uint32_t>& dirty, uint32_t maxGap) {
+		InstanceDescStore s;
+		s.Resize(64);
+		s.TakeDirtyRanges(0);
+		for (uint32_t i : dirty)
+			s.Set(i, 0, XMMatrixIdentity(), 0, 1, 0, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+		std::string text;
+		for (const InstanceRecordRange& range : s.TakeDirtyRanges(maxGap))
+			text += std::to_string(range.first) + "+" + std::to_string(range.count) + " ";
+		return text;
+	};
+	check(rangesOf({ 30, 3, 9, 2, 4, 11 }, 0) == "2+3 9+1 11+1 30+1 ", "gap 0 keeps separate runs apart");
+	check(rangesOf({ 30, 3, 9, 2, 4, 11 }, 1) == "2+3 9+3 30+1 ", "gap 1 merges runs one clean record apart");
+	check(rangesOf({ 30, 3, 9, 2, 4, 11 }, 4) == "2+10 30+1 ", "gap 4 merges runs up to four apart");
+
+	size_t badRanges = 0;
+	for (int round = 0; round < 2000; round++)
+	{
+		const uint32_t count = 1 + random() % 500;
+		const uint32_t maxGap = random() % 6;
+		InstanceDescStore s;
+		s.Resize(count);
+		s.TakeDirtyRanges(0);
+		// Few dirty records use the sort, many the flag walk
+		const uint32_t dirtyCount = round % 2 ? random() % (count / 16 + 1) : random() % (count + 1);
+		std::vector<uint8_t> dirty(count, 0);
+		for (uint32_t k = 0; k < dirtyCount; k++)
+		{
+			const uint32_t i = random() % count;
+			dirty[i] = 1;
+			s.Set(i, 0, XMMatrixIdentity(), k + 1, 0, 0, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+		}
+		const std::vector<InstanceRecordRange> ranges = s.TakeDirtyRanges(maxGap);
+		std::vector<uint8_t> covered(count, 0);
+		for (size_t r = 0; r < ranges.size(); r++)
+		{
+			const InstanceRecordRange& range = ranges[r];
+			if (range.count == 0 || range.first + range.count > count || !dirty[range.first] || !dirty[range.first + range.count - 1])
+				badRanges++;
+			const uint32_t previousEnd = r > 0 ? ranges[r - 1].first + ranges[r - 1].count : 0;
+			if (r > 0 && (range.first < previousEnd || range.first - previousEnd <= maxGap))
+				badRanges++;
+			for (uint32_t i = range.first; i < range.first + range.count && i < count; i++)
+				covered[i] = 1;
+		}
+		for (uint32_t i = 0; i < count; i++)
+		{
+			if (dirty[i] && !covered[i])
+				badRanges++;
+		}
+		if (s.DirtyCount() != 0)
+			badRanges++;
+	}
+	check(badRanges == 0, "random dirty sets: ranges ascend, start and end dirty, cover every dirty record and keep more than the gap apart");
+
+	// Upload ring
+	UploadRing ring;
+	ring.Reset(1024, 3);
+	std::vector<uint64_t> firstOffsets;
+	bool fits = true, aligned = true;
+	for (int frame = 0; frame < 6; frame++)
+	{
+		ring.BeginRegion();
+		const uint64_t a = ring.Allocate(100), b = ring.Allocate(30), c = ring.Allocate(1);
+		firstOffsets.push_back(a);
+		fits = fits && a / 1024 == static_cast<uint64_t>(frame % 3) && b / 1024 == a / 1024 && c / 1024 == a / 1024;
+		aligned = aligned && a % 16 == 0 && b == a + 112 && c == b + 32;
+		fits = fits && ring.Allocate(900) == UINT64_MAX && ring.Allocate(860) != UINT64_MAX;
+	}
+	check(fits, "each frame gets its own region, round robin, and allocations stay inside it");
+	check(aligned, "allocations are 16 byte aligned");
+	check(firstOffsets[0] == firstOffsets[3] && firstOffsets[1] != firstOffsets[0], "the ring wraps after the last region");
+
+	// The whole path: random edits per frame, uploaded through ranges and the ring
+	const uint32_t instanceCount = 3000;
+	InstanceDescStore records;
+	records.Resize(instanceCount);
+	std::vector<D3D12_RAYTRACING_INSTANCE_DESC> gpu(instanceCount);
+	memset(gpu.data(), 0xCD, gpu.size() * sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+	const uint64_t regionSize = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * instanceCount;
+	ring.Reset(regionSize, 2); // a region per frame in flight
+	std::vector<uint8_t> upload(static_cast<size_t>(ring.TotalSize()));
+	bool mirrored = true;
+	size_t copies = 0, copiedRecords = 0, changedRecords = 0;
+	for (int frame = 0; frame < 200; frame++)
+	{
+		const uint32_t edits = frame == 0 ? instanceCount : random() % 60;
+		for (uint32_t k = 0; k < edits; k++)
+		{
+			const uint32_t i = frame == 0 ? k : random() % instanceCount;
+			records.Set(i, 0x10000 + i * 256, XMMatrixTranslation(static_cast<float>(random() % 100), 0.0f, static_cast<float>(i)), i, i % 7,
+				0xFF, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+		}
+		changedRecords += records.DirtyCount();
+		const std::vector<InstanceRecordRange> ranges = records.TakeDirtyRanges(4);
+		ring.BeginRegion();
+		for (const InstanceRecordRange& range : ranges)
+		{
+			const size_t size = sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * range.count;
+			const uint64_t offset = ring.Allocate(size);
+			if (offset == UINT64_MAX)
+			{
+				mirrored = false;
+				break;
+			}
+			memcpy(upload.data() + offset, records.Records() + range.first, size);
+			memcpy(gpu.data() + range.first, upload.data() + offset, size);
+			copies++;
+			copiedRecords += range.count;
+		}
+		mirrored = mirrored && memcmp(gpu.data(), records.Records(), gpu.size() * sizeof(D3D12_RAYTRACING_INSTANCE_DESC)) == 0;
+	}
+	check(mirrored, "200 frames of edits leave the uploaded copy equal to the records");
+	std::cout << "  " << changedRecords << " changed records uploaded as " << copiedRecords << " records in " << copies << " copies\n";
+
+	// Refit policy: 101 instances on a line 100 units long
+	InstanceDescStore line;
+	line.Resize(101);
+	for (uint32_t i = 0; i <= 100; i++)
+		line.Set(i, 0, XMMatrixTranslation(static_cast<float>(i), 0.0f, 0.0f), i, 0, 0xFF, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+	line.TakeDirtyRanges(0);
+	TlasRefitPolicy policy;
+	policy.Rebuilt(line);
+	check(policy.SceneExtent() == 100.0f, "scene extent is the diagonal of the instance positions");
+
+	auto moveTo = [&](uint32_t first, uint32_t count, float y) {
+		for (uint32_t i = first; i < first + count; i++)
+			line.Set(i, 0, XMMatrixTranslation(static_cast<float>(i), y, 0.0f), i, 0, 0xFF, D3D12_RAYTRACING_INSTANCE_FLAG_NONE);
+		policy.Moved(line, line.TakeDirtyRanges(0));
+		policy.Refitted();
+	};
+	moveTo(0, 50, 9.0f);
+	check(policy.DriftedCount() == 0 && !policy.ShouldRebuild(), "half the instances moving 9% of the extent still refit");
+	moveTo(0, 10, 11.0f);
+	check(policy.DriftedCount() == 10 && !policy.ShouldRebuild(), "10 of 101 instances drifted past 10%: refit");
+	moveTo(10, 1, 11.0f);
+	check(policy.DriftedCount() == 11 && policy.ShouldRebuild(), "11 of 101 drifted: full build");
+	moveTo(0, 5, 0.0f);
+	check(policy.DriftedCount() == 6 && !policy.ShouldRebuild(), "instances that come back no longer count");
+	policy.Rebuilt(line);
+	check(policy.DriftedCount() == 0 && !policy.ShouldRebuild(), "a full build starts over from the current positions");
+	policy.maxRefits = 3;
+	moveTo(0, 1, 1.0f);
+	moveTo(0, 1, 2.0f);
+	check(!policy.ShouldRebuild(), "two refits of three allowed");
+	moveTo(0, 1, 3.0f);
+	check(policy.ShouldRebuild(), "after maxRefits refits: full build");
+
+	return check.Finish("instance record");
+}
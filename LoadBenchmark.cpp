@@ -0,0 +1,87 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "ThreadPool.h"
+#include "libraries/nlohmann/json.hpp"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+using json = nlohmann::json;
+
+// Loads the meshes of every Models/ExampleScene/*.json scene with 1..maxThreads
+// loader threads and prints the scaling. Runs without a window or a device and
+// bypasses the mesh cache, so it measures the importer itself.
+int D3D12HelloTriangle::RunLoadBenchmark(unsigned maxThreads)
+{
+	const std::string sceneDirectory = "Models/ExampleScene/";
+	if (maxThreads == 0)
+		maxThreads = ThreadPool::DefaultThreadCount();
+
+	std::vector<std::string> scenes;
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((sceneDirectory + "*.json").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "No scenes found in " << sceneDirectory << "\n";
+		return 1;
+	}
+	do
+	{
+		scenes.push_back(sceneDirectory + findData.cFileName);
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+
+	for (const auto& scenePath : scenes)
+	{
+		std::ifstream file(scenePath);
+		json j;
+		try
+		{
+			file >> j;
+		}
+		catch (const json::parse_error& e)
+		{
+			std::cout << scenePath << ": " << e.what() << "\n";
+			continue;
+		}
+
+		// Same de-duplication as PreloadMeshes: each path is parsed once
+		std::set<std::string> paths;
+		if (j.contains("models"))
+		{
+			for (auto& m : j["models"])
+				paths.insert(m["path"].get<std::string>());
+		}
+
+		std::cout << scenePath << ": " << j["models"].size() << " models, "
+			<< paths.size() << " unique meshes\n";
+		if (paths.empty())
+			continue;
+
+		double singleThreadMs = 0.0;
+		for (unsigned threads = 1; threads <= maxThreads; threads++)
+		{
+			std::vector<MeshGeometry> meshes(paths.size());
+			std::vector<MeshGeometry*> toParse;
+			auto path = paths.begin();
+			for (auto& mesh : meshes)
+			{
+				mesh.path = *path++;
+				toParse.push_back(&mesh);
+			}
+
+			const auto start = std::chrono::high_resolution_clock::now();
+			MeshImportOptions options;
+			options.useCache = false;
+			ParseMeshesParallel(toParse, threads, options);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			if (threads == 1)
+				singleThreadMs = ms;
+
+			std::cout << "  " << threads << " thread(s): " << ms << " ms, speedup x"
+				<< (ms > 0.0 ? singleThreadMs / ms : 0.0) << "\n";
+		}
+	}
+	return 0;
+}
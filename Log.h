@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+
+// Progress and statistics lines of the renderer: mesh loads, shader compiles,
+// memory reports. Off by default, the windowed app has no console to read
+// them; the headless modes and -verbose turn them on.
+
+inline std::atomic<bool>& LogEnabledFlag()
+{
+	static std::atomic<bool> enabled(false);
+	return enabled;
+}
+
+inline void EnableLog(bool enabled)
+{
+	LogEnabledFlag().store(enabled, std::memory_order_relaxed);
+}
+
+// std::cout while logging is on, else a stream without a buffer: its
+// insertions fail up front and format nothing. Lines written from loader
+// threads go in as one insertion so they do not interleave.
+inline std::ostream& Log()
+{
+	if (LogEnabledFlag().load(std::memory_order_relaxed))
+		return std::cout;
+	thread_local std::ostream discard(nullptr);
+	return discard;
+}
@@ -11,14 +11,133 @@
 
 #include "stdafx.h"
 #include "D3D12HelloTriangle.h"
+#include "Log.h"
 #include <CommCtrl.h>
 
 
 #pragma comment(lib, "Comctl32.lib")
 
+namespace
+{
+	// Headless modes print to the console of the shell that started us, or to a new one,
+	// with the renderer's log on
+	void AttachOutputConsole()
+	{
+		if (!AttachConsole(ATTACH_PARENT_PROCESS))
+			AllocConsole();
+		FILE* stream = nullptr;
+		freopen_s(&stream, "CONOUT$", "w", stdout);
+		freopen_s(&stream, "CONOUT$", "w", stderr);
+		EnableLog(true);
+	}
+
+	std::string ToUtf8(const wchar_t* text)
+	{
+		int size = WideCharToMultiByte(CP_UTF8, 0, text, -1, nullptr, 0, nullptr, nullptr);
+		if (size <= 1)
+			return std::string();
+		std::string result(size - 1, '\0');
+		WideCharToMultiByte(CP_UTF8, 0, text, -1, &result[0], size, nullptr, nullptr);
+		return result;
+	}
+
+	// What follows the switch of a headless mode on the command line
+	struct ModeArguments
+	{
+		int argc;
+		LPWSTR* argv;
+		int first;
+
+		// The first argument as a count, 0 when it is missing
+		unsigned Count() const { return first < argc ? static_cast<unsigned>(_wtoi(argv[first])) : 0; }
+		std::string Text(int index) const { return first + index < argc ? ToUtf8(argv[first + index]) : std::string(); }
+		std::vector<std::string> Rest(int index) const
+		{
+			std::vector<std::string> result;
+			for (int k = first + index; k < argc; k++)
+				result.push_back(ToUtf8(argv[k]));
+			return result;
+		}
+	};
+
+	struct HeadlessMode
+	{
+		const wchar_t* name;
+		int (*run)(const ModeArguments& args);
+	};
+
+	const HeadlessMode kHeadlessModes[] =
+	{
+		{ L"-benchload", [](const ModeArguments& args) { return D3D12HelloTriangle::RunLoadBenchmark(args.Count()); } },
+		{ L"-testmeshsharing", [](const ModeArguments&) { return D3D12HelloTriangle::RunMeshSharingCheck(); } },
+		{ L"-testindexpacking", [](const ModeArguments&) { return D3D12HelloTriangle::RunIndexPackingCheck(); } },
+		{ L"-testmeshcache", [](const ModeArguments&) { return D3D12HelloTriangle::RunMeshCacheSelfTest(); } },
+		{ L"-benchmeshcache", [](const ModeArguments&) { return D3D12HelloTriangle::RunMeshCacheBenchmark(); } },
+		{ L"-benchmeshopt", [](const ModeArguments&) { return D3D12HelloTriangle::RunMeshOptimizationBenchmark(); } },
+		{ L"-testvertexcompression", [](const ModeArguments&) { return D3D12HelloTriangle::RunVertexCompressionCheck(); } },
+		{ L"-objparity", [](const ModeArguments&) { return D3D12HelloTriangle::RunObjParityCheck(); } },
+		{ L"-benchobj", [](const ModeArguments&) { return D3D12HelloTriangle::RunObjLoadBenchmark(); } },
+		{ L"-gltfparity", [](const ModeArguments&) { return D3D12HelloTriangle::RunGltfParityCheck(); } },
+		{ L"-benchgltf", [](const ModeArguments&) { return D3D12HelloTriangle::RunGltfLoadBenchmark(); } },
+		{ L"-testloadqueue", [](const ModeArguments&) { return RunLoadQueueSelfTest(); } },
+		{ L"-lodreport", [](const ModeArguments&) { return D3D12HelloTriangle::RunLodReport(); } },
+		{ L"-convertscene", [](const ModeArguments& args) { return D3D12HelloTriangle::RunSceneConverter(args.Text(0), args.Text(1)); } },
+		{ L"-benchscene", [](const ModeArguments& args) { return D3D12HelloTriangle::RunSceneLoadBenchmark(args.Count()); } },
+		{ L"-sceneparity", [](const ModeArguments&) { return D3D12HelloTriangle::RunSceneJsonParityCheck(); } },
+		{ L"-benchscenejson", [](const ModeArguments& args) { return D3D12HelloTriangle::RunSceneJsonBenchmark(args.Count()); } },
+		{ L"-testscenediff", [](const ModeArguments&) { return RunSceneDiffSelfTest(); } },
+		{ L"-genscene", [](const ModeArguments& args) { return D3D12HelloTriangle::RunSceneGenerator(args.Text(0), args.Rest(1)); } },
+		{ L"-benchscale", [](const ModeArguments& args) { return D3D12HelloTriangle::RunSceneScalingBenchmark(args.Count()); } },
+		{ L"-testanimation", [](const ModeArguments&) { return D3D12HelloTriangle::RunAnimationSelfTest(); } },
+		{ L"-benchanimation", [](const ModeArguments& args) { return D3D12HelloTriangle::RunAnimationBenchmark(args.Count()); } },
+		{ L"-benchtransforms", [](const ModeArguments& args) { return D3D12HelloTriangle::RunTransformBenchmark(args.Count()); } },
+		{ L"-testinstancedescs", [](const ModeArguments&) { return RunInstanceDescSelfTest(); } },
+		{ L"-testasallocator", [](const ModeArguments&) { return RunBlockAllocatorSelfTest(); } },
+		{ L"-benchasallocator", [](const ModeArguments& args) { return RunBlockAllocatorBenchmark(args.Count()); } },
+		{ L"-testblascompaction", [](const ModeArguments&) { return RunBlasCompactionSelfTest(); } },
+		{ L"-testblasbatch", [](const ModeArguments&) { return RunBlasBatchSelfTest(); } },
+		{ L"-benchblasbatch", [](const ModeArguments& args) { return D3D12HelloTriangle::RunBlasBatchBenchmark(args.Count()); } },
+		{ L"-testshadercache", [](const ModeArguments&) { return RunShaderCacheSelfTest(); } },
+		{ L"-testshaderscheduler", [](const ModeArguments&) { return RunShaderSchedulerSelfTest(); } },
+		{ L"-testshaderreload", [](const ModeArguments&) { return RunShaderHotReloadSelfTest(); } },
+	};
+
+	// Returns true and the exit code if the command line asked for a headless mode
+	bool RunHeadlessMode(int& exitCode)
+	{
+		int argc;
+		LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+		bool handled = false;
+		for (int i = 1; i < argc && !handled; ++i)
+		{
+			// Not a mode: the windowed app logs to a console too
+			if (_wcsicmp(argv[i], L"-verbose") == 0)
+			{
+				AttachOutputConsole();
+				continue;
+			}
+			for (const HeadlessMode& mode : kHeadlessModes)
+			{
+				if (_wcsicmp(argv[i], mode.name) != 0)
+					continue;
+				AttachOutputConsole();
+				exitCode = mode.run({ argc, argv, i + 1 });
+				handled = true;
+				break;
+			}
+		}
+		LocalFree(argv);
+		return handled;
+	}
+}
+
 _Use_decl_annotations_
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow)
 {
+	int exitCode = 0;
+	if (RunHeadlessMode(exitCode))
+		return exitCode;
+
 	// Initialize COM library for use of DXC compiler
 	HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
 	if (FAILED(hr))
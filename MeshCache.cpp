@@ -0,0 +1,323 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+
+// Binary cache of the final vertex/index arrays produced by LoadModel, so that
+// repeated launches and scene reloads skip the importer entirely.
+//
+// Layout of a cache file:
+//   MeshCacheHeader
+//   dependencies[dependencyCount], each a MeshCacheDependency and its path,
+//     dependencyBytes in all
+//   MeshCacheLod lods[lodCount]
+//   Vertex   vertices[vertexCount]
+//   uint32_t indices[indexCount]
+//   uint32_t lodIndices[sum of lods[i].indexCount]
+//
+// The indices of the full mesh and of its LODs are one range, in the order of
+// the index buffer, so CreateMeshBuffers uploads straight from the mapping.
+//
+// A cache entry is reused when the size and write time of the source file match
+// the ones recorded in the header. If only the write time changed, the source is
+// hashed and compared with the stored content hash before falling back to a
+// full import. The files the mesh was built from besides the source, the MTL
+// libraries of an OBJ, are recorded and checked the same way, and one that
+// appeared or disappeared is a miss too.
+
+namespace
+{
+	const uint32_t kMeshCacheMagic = 0x4853454D; // "MESH"
+	const uint32_t kMeshCacheVersion = 5; // 5: LOD table before the vertices
+	const char* kMeshCacheDirectory = "Cache/Meshes/";
+
+	struct MeshCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t sourceSize;
+		uint64_t sourceWriteTime;
+		uint64_t sourceHash;
+		uint32_t importFlags;
+		uint32_t processFlags; // MeshImportOptions::ProcessFlags
+		uint32_t lodCount;
+		uint32_t vertexStride;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t dependencyCount;
+		uint32_t dependencyBytes;
+	};
+
+	struct MeshCacheDependency
+	{
+		uint64_t size;
+		uint64_t writeTime;
+		uint64_t hash;
+		uint32_t exists;
+		uint32_t pathLength; // the path follows, padded to 8 bytes
+	};
+
+	struct MeshCacheLod
+	{
+		uint32_t indexCount;
+		float error;
+	};
+
+	bool HashSourceFile(const std::string& path, uint64_t& outHash)
+	{
+		std::vector<char> contents;
+		if (!ReadWholeFile(path, contents))
+			return false;
+		outHash = HashFnv1a64(contents.data(), contents.size());
+		return true;
+	}
+
+	size_t DependencyEntrySize(size_t pathLength)
+	{
+		return sizeof(MeshCacheDependency) + ((pathLength + 7) & ~static_cast<size_t>(7));
+	}
+
+	// The dependency section of a cache file for the files a model was built from
+	bool DescribeDependencies(const std::string& modelPath, std::vector<uint8_t>& outSection, uint32_t& outCount)
+	{
+		std::vector<std::string> paths;
+		if (D3D12HelloTriangle::IsObjFile(modelPath))
+			D3D12HelloTriangle::FindObjMaterialLibraries(modelPath, paths);
+
+		outCount = static_cast<uint32_t>(paths.size());
+		for (const auto& path : paths)
+		{
+			MeshCacheDependency dependency = {};
+			FileStamp stamp;
+			if (GetFileStamp(path, stamp))
+			{
+				if (!HashSourceFile(path, dependency.hash))
+					return false;
+				dependency.exists = 1;
+				dependency.size = stamp.size;
+				dependency.writeTime = stamp.writeTime;
+			}
+			dependency.pathLength = static_cast<uint32_t>(path.size());
+
+			const size_t offset = outSection.size();
+			outSection.resize(offset + DependencyEntrySize(path.size()), 0);
+			memcpy(outSection.data() + offset, &dependency, sizeof(dependency));
+			memcpy(outSection.data() + offset + sizeof(dependency), path.data(), path.size());
+		}
+		return true;
+	}
+
+	// False if a recorded dependency changed. A write time that moved while the
+	// content stayed the same sets outTouched, so the stamps can be refreshed.
+	bool DependenciesUnchanged(const uint8_t* section, size_t sectionBytes, uint32_t count, bool& outTouched)
+	{
+		size_t offset = 0;
+		for (uint32_t i = 0; i < count; i++)
+		{
+			MeshCacheDependency dependency;
+			if (sectionBytes - offset < sizeof(dependency))
+				return false;
+			memcpy(&dependency, section + offset, sizeof(dependency));
+			const size_t entryBytes = DependencyEntrySize(dependency.pathLength);
+			if (sectionBytes - offset < entryBytes)
+				return false;
+			const std::string path(reinterpret_cast<const char*>(section + offset + sizeof(dependency)), dependency.pathLength);
+			offset += entryBytes;
+
+			FileStamp stamp;
+			const bool exists = GetFileStamp(path, stamp);
+			if (exists != (dependency.exists != 0))
+				return false;
+			if (!exists || (stamp.size == dependency.size && stamp.writeTime == dependency.writeTime))
+				continue;
+
+			uint64_t hash = 0;
+			if (stamp.size != dependency.size || !HashSourceFile(path, hash) || hash != dependency.hash)
+				return false;
+			outTouched = true;
+		}
+		return offset == sectionBytes;
+	}
+}
+
+std::string D3D12HelloTriangle::GetMeshCachePath(const std::string& modelPath)
+{
+	return kMeshCacheDirectory + ToHexString(HashFnv1a64(modelPath.data(), modelPath.size())) + ".mesh";
+}
+
+bool D3D12HelloTriangle::OpenMeshCache(const std::string& modelPath, uint32_t importFlags, uint32_t processFlags,
+	MappedMeshCache& outEntry)
+{
+	FileStamp sourceStamp;
+	if (!GetFileStamp(modelPath, sourceStamp))
+		return false;
+
+	const std::string cachePath = GetMeshCachePath(modelPath);
+	MappedFile& cacheFile = outEntry.file;
+	if (!cacheFile.Open(cachePath) || cacheFile.Size() < sizeof(MeshCacheHeader))
+		return false;
+
+	MeshCacheHeader header;
+	memcpy(&header, cacheFile.Data(), sizeof(header));
+
+	if (header.magic != kMeshCacheMagic ||
+		header.version != kMeshCacheVersion ||
+		header.importFlags != importFlags ||
+		header.processFlags != processFlags ||
+		header.vertexStride != sizeof(Vertex))
+		return false;
+
+	size_t lodTableOffset = sizeof(MeshCacheHeader) + header.dependencyBytes;
+	const size_t lodTableBytes = static_cast<size_t>(header.lodCount) * sizeof(MeshCacheLod);
+	if (cacheFile.Size() < lodTableOffset + lodTableBytes)
+		return false;
+
+	std::vector<MeshCacheLod> lodTable(header.lodCount);
+	if (lodTableBytes > 0)
+		memcpy(lodTable.data(), cacheFile.Data() + lodTableOffset, lodTableBytes);
+	size_t allIndexCount = header.indexCount;
+	for (const auto& lod : lodTable)
+		allIndexCount += lod.indexCount;
+	const size_t vertexBytes = static_cast<size_t>(header.vertexCount) * sizeof(Vertex);
+	const size_t payloadBytes = lodTableBytes + vertexBytes + allIndexCount * sizeof(uint32_t);
+	if (cacheFile.Size() != lodTableOffset + payloadBytes)
+		return false;
+
+	bool sourceChanged = header.sourceSize != sourceStamp.size ||
+		header.sourceWriteTime != sourceStamp.writeTime;
+	if (sourceChanged)
+	{
+		// The file was touched; only trust the cache if the content is identical
+		uint64_t sourceHash = 0;
+		if (header.sourceSize != sourceStamp.size ||
+			!HashSourceFile(modelPath, sourceHash) ||
+			sourceHash != header.sourceHash)
+			return false;
+	}
+
+	bool dependencyTouched = false;
+	if (!DependenciesUnchanged(cacheFile.Data() + sizeof(MeshCacheHeader), header.dependencyBytes,
+		header.dependencyCount, dependencyTouched))
+		return false;
+
+	if (sourceChanged || dependencyTouched)
+	{
+		// Refresh the stamps so the next load skips hashing again. The entry is
+		// rewritten from a copy and mapped again, an open mapping would keep
+		// the file from being replaced.
+		std::vector<uint8_t> dependencies;
+		if (!DescribeDependencies(modelPath, dependencies, header.dependencyCount))
+			return false;
+		header.sourceSize = sourceStamp.size;
+		header.sourceWriteTime = sourceStamp.writeTime;
+		header.dependencyBytes = static_cast<uint32_t>(dependencies.size());
+
+		std::vector<uint8_t> blob(sizeof(header) + dependencies.size() + payloadBytes);
+		memcpy(blob.data(), &header, sizeof(header));
+		if (!dependencies.empty())
+			memcpy(blob.data() + sizeof(header), dependencies.data(), dependencies.size());
+		memcpy(blob.data() + sizeof(header) + dependencies.size(), cacheFile.Data() + lodTableOffset, payloadBytes);
+		cacheFile.Close();
+		if (!WriteFileAtomic(cachePath, blob.data(), blob.size()) ||
+			!cacheFile.Open(cachePath) || cacheFile.Size() != blob.size())
+			return false;
+		lodTableOffset = sizeof(header) + dependencies.size();
+	}
+
+	const uint8_t* vertices = cacheFile.Data() + lodTableOffset + lodTableBytes;
+	outEntry.vertices = reinterpret_cast<const Vertex*>(vertices);
+	outEntry.vertexCount = header.vertexCount;
+	outEntry.indices = reinterpret_cast<const uint32_t*>(vertices + vertexBytes);
+	outEntry.indexCount = header.indexCount;
+	outEntry.lodIndexCounts.resize(lodTable.size());
+	outEntry.lodErrors.resize(lodTable.size());
+	for (size_t i = 0; i < lodTable.size(); i++)
+	{
+		outEntry.lodIndexCounts[i] = lodTable[i].indexCount;
+		outEntry.lodErrors[i] = lodTable[i].error;
+	}
+	return true;
+}
+
+bool D3D12HelloTriangle::LoadMeshCache(const std::string& modelPath, uint32_t importFlags, uint32_t processFlags,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices,
+	std::vector<MeshLod>& outLods)
+{
+	MappedMeshCache entry;
+	if (!OpenMeshCache(modelPath, importFlags, processFlags, entry))
+		return false;
+
+	outVertices.assign(entry.vertices, entry.vertices + entry.vertexCount);
+	outIndices.assign(entry.indices, entry.indices + entry.indexCount);
+	const uint32_t* lodIndices = entry.indices + entry.indexCount;
+	outLods.resize(entry.lodIndexCounts.size());
+	for (size_t i = 0; i < outLods.size(); i++)
+	{
+		outLods[i].indices.assign(lodIndices, lodIndices + entry.lodIndexCounts[i]);
+		outLods[i].error = entry.lodErrors[i];
+		lodIndices += entry.lodIndexCounts[i];
+	}
+	return true;
+}
+
+void D3D12HelloTriangle::SaveMeshCache(const std::string& modelPath, uint32_t importFlags, uint32_t processFlags,
+	const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices,
+	const std::vector<MeshLod>& lods)
+{
+	FileStamp sourceStamp;
+	MeshCacheHeader header = {};
+	std::vector<uint8_t> dependencies;
+	if (!GetFileStamp(modelPath, sourceStamp) || !HashSourceFile(modelPath, header.sourceHash) ||
+		!DescribeDependencies(modelPath, dependencies, header.dependencyCount))
+		return;
+
+	header.magic = kMeshCacheMagic;
+	header.version = kMeshCacheVersion;
+	header.sourceSize = sourceStamp.size;
+	header.sourceWriteTime = sourceStamp.writeTime;
+	header.importFlags = importFlags;
+	header.processFlags = processFlags;
+	header.vertexStride = sizeof(Vertex);
+	header.vertexCount = static_cast<uint32_t>(vertices.size());
+	header.indexCount = static_cast<uint32_t>(indices.size());
+	header.lodCount = static_cast<uint32_t>(lods.size());
+	header.dependencyBytes = static_cast<uint32_t>(dependencies.size());
+
+	std::vector<MeshCacheLod> lodTable;
+	size_t lodIndexBytes = 0;
+	for (const auto& lod : lods)
+	{
+		lodTable.push_back({ static_cast<uint32_t>(lod.indices.size()), lod.error });
+		lodIndexBytes += lod.indices.size() * sizeof(uint32_t);
+	}
+
+	const size_t vertexBytes = vertices.size() * sizeof(Vertex);
+	const size_t indexBytes = indices.size() * sizeof(uint32_t);
+	const size_t lodTableBytes = lodTable.size() * sizeof(MeshCacheLod);
+	std::vector<uint8_t> blob(sizeof(MeshCacheHeader) + dependencies.size() + vertexBytes + indexBytes + lodTableBytes + lodIndexBytes);
+	uint8_t* cursor = blob.data();
+	memcpy(cursor, &header, sizeof(header));
+	cursor += sizeof(header);
+	if (!dependencies.empty())
+		memcpy(cursor, dependencies.data(), dependencies.size());
+	cursor += dependencies.size();
+	if (lodTableBytes > 0)
+		memcpy(cursor, lodTable.data(), lodTableBytes);
+	cursor += lodTableBytes;
+	if (vertexBytes > 0)
+		memcpy(cursor, vertices.data(), vertexBytes);
+	cursor += vertexBytes;
+	if (indexBytes > 0)
+		memcpy(cursor, indices.data(), indexBytes);
+	cursor += indexBytes;
+	for (const auto& lod : lods)
+	{
+		memcpy(cursor, lod.indices.data(), lod.indices.size() * sizeof(uint32_t));
+		cursor += lod.indices.size() * sizeof(uint32_t);
+	}
+
+	if (!EnsureDirectory(kMeshCacheDirectory))
+		return;
+	WriteFileAtomic(GetMeshCachePath(modelPath), blob.data(), blob.size());
+}
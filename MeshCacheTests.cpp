@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include "TestUtils.h"
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+// The mesh cache on an OBJ and its MTL library written under Cache/: a hit
+// after the first load, misses when the MTL is edited, deleted or comes
+// back, a hit with refreshed stamps when it is only touched, and damaged
+// entries.
+int D3D12HelloTriangle::RunMeshCacheSelfTest()
+{
+	TestChecks check;
+
+	const std::string root = "Cache/MeshCacheTest/";
+	if (!EnsureDirectory(root))
+	{
+		std::cout << "FAIL cannot create " << root << "\n";
+		return 1;
+	}
+	auto writeText = [](const std::string& path, const std::string& text) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << text;
+	};
+
+	// A library name with a space, like the bundled "Cube obj.mtl"
+	const std::string objPath = root + "Quad.obj";
+	const std::string mtlPath = root + "Quad mat.mtl";
+	writeText(objPath, "mtllib Quad mat.mtl\nv 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nvn 0 0 1\nusemtl paint\nf 1//1 2//1 3//1 4//1\n");
+	const std::string red = "newmtl paint\nKd 1 0 0\n";
+	const std::string green = "newmtl paint\nKd 0 0.5 0\n";
+	writeText(mtlPath, red);
+
+	const MeshImportOptions options;
+	std::vector<std::string> entries = { GetMeshCachePath(objPath) };
+	std::remove(entries[0].c_str());
+
+	std::vector<std::string> libraries;
+	FindObjMaterialLibraries(objPath, libraries);
+	check(libraries.size() == 1 && libraries[0] == mtlPath, "the library is found relative to the OBJ, spaces included");
+
+	auto load = [&](std::vector<Vertex>& vertices) {
+		std::vector<uint32_t> indices;
+		vertices.clear();
+		LoadModel(objPath, vertices, indices, options);
+		return !vertices.empty() && indices.size() == 6;
+	};
+	auto cached = [&](std::vector<Vertex>& vertices) {
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> lods;
+		vertices.clear();
+		return LoadMeshCache(objPath, AssimpImportFlags, options.ProcessFlags(), vertices, indices, lods);
+	};
+	auto colored = [](const std::vector<Vertex>& vertices, float r, float g, float b) {
+		if (vertices.empty())
+			return false;
+		for (const Vertex& v : vertices)
+		{
+			if (fabsf(v.color.x - r) > 1e-3f || fabsf(v.color.y - g) > 1e-3f || fabsf(v.color.z - b) > 1e-3f)
+				return false;
+		}
+		return true;
+	};
+
+	std::vector<Vertex> vertices;
+	check(load(vertices) && colored(vertices, 1.0f, 0.0f, 0.0f), "first load takes the MTL color");
+	check(cached(vertices) && colored(vertices, 1.0f, 0.0f, 0.0f), "and leaves a cache entry");
+
+	writeText(mtlPath, green);
+	check(!cached(vertices), "editing the MTL misses");
+	check(load(vertices) && colored(vertices, 0.0f, 0.5f, 0.0f), "and the reload has the new color");
+	check(cached(vertices) && colored(vertices, 0.0f, 0.5f, 0.0f), "which is cached again");
+
+	// Same content, later write time
+	FileStamp before, after;
+	GetFileStamp(mtlPath, before);
+	for (int attempt = 0; attempt < 50; attempt++)
+	{
+		writeText(mtlPath, green);
+		GetFileStamp(mtlPath, after);
+		if (after.writeTime != before.writeTime)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	check(after.writeTime != before.writeTime, "touching the MTL moves its write time");
+	std::vector<char> entryBefore, entryAfter;
+	ReadWholeFile(entries[0], entryBefore);
+	check(cached(vertices) && colored(vertices, 0.0f, 0.5f, 0.0f), "touching the MTL still hits");
+	ReadWholeFile(entries[0], entryAfter);
+	check(entryBefore != entryAfter, "and refreshes the recorded stamp");
+
+	std::remove(mtlPath.c_str());
+	check(!cached(vertices), "deleting the MTL misses");
+	check(load(vertices) && colored(vertices, 0.6f, 0.6f, 0.6f), "and the reload has the default color");
+	check(cached(vertices), "an entry without the MTL is cached");
+	writeText(mtlPath, red);
+	check(!cached(vertices), "the MTL coming back misses");
+	check(load(vertices) && colored(vertices, 1.0f, 0.0f, 0.0f), "and the reload has its color");
+
+	// OBJ files without a library have no dependencies
+	const std::string plainPath = root + "Plain.obj";
+	writeText(plainPath, "v 0 0 0\nv 1 0 0\nv 1 1 0\nvn 0 0 1\nf 1//1 2//1 3//1\n");
+	entries.push_back(GetMeshCachePath(plainPath));
+	std::remove(entries.back().c_str());
+	{
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> lods;
+		vertices.clear();
+		LoadModel(plainPath, vertices, indices, options);
+		vertices.clear();
+		indices.clear();
+		check(LoadMeshCache(plainPath, AssimpImportFlags, options.ProcessFlags(), vertices, indices, lods) &&
+			vertices.size() == 3, "an OBJ without MTL is cached");
+	}
+
+	// Damaged entries are misses, never crashes
+	std::vector<char> entry;
+	ReadWholeFile(entries[0], entry);
+	WriteFileAtomic(entries[0], entry.data(), entry.size() - 1);
+	check(!cached(vertices), "a truncated entry misses");
+	WriteFileAtomic(entries[0], entry.data(), 100);
+	check(!cached(vertices), "an entry cut inside its dependencies misses");
+	std::vector<char> garbage(entry.size(), '\xFF');
+	memcpy(garbage.data(), entry.data(), 8); // magic and version
+	WriteFileAtomic(entries[0], garbage.data(), garbage.size());
+	check(!cached(vertices), "an entry with a garbage header misses");
+	check(load(vertices) && colored(vertices, 1.0f, 0.0f, 0.0f), "and is rebuilt on the next load");
+
+	for (const std::string& path : entries)
+		std::remove(path.c_str());
+	std::remove(objPath.c_str());
+	std::remove(mtlPath.c_str());
+	std::remove(plainPath.c_str());
+
+	return check.Finish("mesh cache");
+}
+
+// Cold and warm LoadModel of every bundled .obj with the default options.
+// Cold deletes the cache entry first, so it parses, builds the LODs and
+// writes the entry; warm is served from it and must give the same mesh.
+int D3D12HelloTriangle::RunMeshCacheBenchmark()
+{
+	std::vector<std::string> paths;
+	FindFiles("Models/", ".obj", paths);
+	if (paths.empty())
+	{
+		std::cout << "No .obj files found in Models/\n";
+		return 1;
+	}
+
+	const MeshImportOptions options;
+	const int warmRuns = 5;
+	int result = 0;
+	double coldTotal = 0.0, warmTotal = 0.0;
+	for (const auto& path : paths)
+	{
+		std::remove(GetMeshCachePath(path).c_str());
+		std::vector<Vertex> coldVertices;
+		std::vector<uint32_t> coldIndices;
+		std::vector<MeshLod> coldLods;
+		auto start = std::chrono::high_resolution_clock::now();
+		LoadModel(path, coldVertices, coldIndices, options, &coldLods);
+		const double coldMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (coldVertices.empty())
+		{
+			std::cout << path << ": load failed\n";
+			result = 1;
+			continue;
+		}
+
+		double warmMs = DBL_MAX;
+		bool same = true;
+		for (int run = 0; run < warmRuns; run++)
+		{
+			std::vector<Vertex> vertices;
+			std::vector<uint32_t> indices;
+			std::vector<MeshLod> lods;
+			start = std::chrono::high_resolution_clock::now();
+			LoadModel(path, vertices, indices, options, &lods);
+			const double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			warmMs = ms < warmMs ? ms : warmMs;
+
+			same = same && vertices.size() == coldVertices.size() && indices == coldIndices && lods.size() == coldLods.size() &&
+				memcmp(vertices.data(), coldVertices.data(), vertices.size() * sizeof(Vertex)) == 0;
+			for (size_t i = 0; same && i < lods.size(); i++)
+				same = lods[i].indices == coldLods[i].indices && lods[i].error == coldLods[i].error;
+		}
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> lods;
+		const bool hit = LoadMeshCache(path, AssimpImportFlags, options.ProcessFlags(), vertices, indices, lods);
+		if (!hit || !same)
+		{
+			std::cout << path << (hit ? ": warm load differs from the cold one\n" : ": no cache entry after the cold load\n");
+			result = 1;
+		}
+
+		coldTotal += coldMs;
+		warmTotal += warmMs;
+		std::cout << path << ": " << coldVertices.size() << " vertices, " << coldIndices.size() / 3 << " triangles, "
+			<< coldLods.size() << " LODs; cold " << coldMs << " ms, warm " << warmMs << " ms (" << coldMs / warmMs << "x)\n";
+	}
+	std::cout << "Total: cold " << coldTotal << " ms, warm " << warmTotal << " ms (best of " << warmRuns << ")\n";
+	return result;
+}
@@ -0,0 +1,198 @@
+#include "stdafx.h"
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Tuning constants from Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+	const int kSimulatedCacheSize = 32;
+	const float kCacheDecayPower = 1.5f;
+	const float kLastTriangleScore = 0.75f;
+	const float kValenceBoostScale = 2.0f;
+	const float kValenceBoostPower = 0.5f;
+
+	float VertexScore(int cachePosition, uint32_t remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+			return -1.0f; // no triangle needs this vertex any more
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			if (cachePosition < 3)
+			{
+				// Used by the last triangle; a fixed score so the next triangle
+				// does not favour any of its three vertices
+				score = kLastTriangleScore;
+			}
+			else
+			{
+				const float scaler = 1.0f / (kSimulatedCacheSize - 3);
+				score = std::pow(1.0f - (cachePosition - 3) * scaler, kCacheDecayPower);
+			}
+		}
+
+		// Vertices with few triangles left are finished first, so they can leave the cache
+		score += kValenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -kValenceBoostPower);
+		return score;
+	}
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+		return;
+
+	// Triangles referencing each vertex, as one flat array
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		remaining[indices[i]]++;
+
+	std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<uint32_t> cursor(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+		{
+			for (int k = 0; k < 3; k++)
+				adjacency[cursor[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	int bestTriangle = 0;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+		if (triangleScore[t] > triangleScore[bestTriangle])
+			bestTriangle = static_cast<int>(t);
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	cache.reserve(kSimulatedCacheSize + 3);
+	newCache.reserve(kSimulatedCacheSize + 3);
+	size_t scanCursor = 0;
+
+	while (bestTriangle >= 0)
+	{
+		const uint32_t* triangle = &indices[bestTriangle * 3];
+		emitted[bestTriangle] = true;
+		output.insert(output.end(), triangle, triangle + 3);
+
+		// Drop the triangle from the adjacency of its vertices
+		for (int k = 0; k < 3; k++)
+		{
+			uint32_t v = triangle[k];
+			uint32_t* begin = &adjacency[adjacencyOffset[v]];
+			uint32_t* end = begin + remaining[v];
+			uint32_t* found = std::find(begin, end, static_cast<uint32_t>(bestTriangle));
+			if (found != end)
+			{
+				*found = *(end - 1);
+				remaining[v]--;
+			}
+		}
+
+		// The triangle's vertices move to the front of the LRU cache
+		newCache.assign(triangle, triangle + 3);
+		for (uint32_t v : cache)
+		{
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache.push_back(v);
+		}
+
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			uint32_t v = newCache[i];
+			cachePosition[v] = i < kSimulatedCacheSize ? static_cast<int>(i) : -1;
+			vertexScore[v] = VertexScore(cachePosition[v], remaining[v]);
+		}
+
+		// Only triangles touching the cache changed score; pick the best of them
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (uint32_t v : newCache)
+		{
+			for (uint32_t a = 0; a < remaining[v]; a++)
+			{
+				uint32_t t = adjacency[adjacencyOffset[v] + a];
+				triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+				if (triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = static_cast<int>(t);
+				}
+			}
+		}
+
+		if (newCache.size() > kSimulatedCacheSize)
+			newCache.resize(kSimulatedCacheSize);
+		cache.swap(newCache);
+
+		// Nothing in the cache is connected to the rest: continue with the next
+		// triangle in the original order
+		if (bestTriangle < 0)
+		{
+			while (scanCursor < triangleCount && emitted[scanCursor])
+				scanCursor++;
+			if (scanCursor < triangleCount)
+				bestTriangle = static_cast<int>(scanCursor);
+		}
+	}
+
+	indices.swap(output);
+}
+
+size_t OptimizeVertexFetchRemap(std::vector<uint32_t>& indices, size_t vertexCount,
+	std::vector<uint32_t>& outRemap)
+{
+	outRemap.assign(vertexCount, UINT32_MAX);
+	uint32_t nextVertex = 0;
+	for (uint32_t& index : indices)
+	{
+		if (outRemap[index] == UINT32_MAX)
+			outRemap[index] = nextVertex++;
+		index = outRemap[index];
+	}
+	return nextVertex;
+}
+
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+	unsigned cacheSize)
+{
+	VertexCacheStats stats;
+	if (indices.empty() || vertexCount == 0)
+		return stats;
+
+	// FIFO cache: a vertex is a hit while fewer than cacheSize misses happened
+	// since it was loaded
+	std::vector<uint32_t> loadedAt(vertexCount, 0);
+	uint32_t misses = 0;
+	uint32_t timestamp = cacheSize + 1;
+	for (uint32_t index : indices)
+	{
+		if (timestamp - loadedAt[index] > cacheSize)
+		{
+			loadedAt[index] = timestamp++;
+			misses++;
+		}
+	}
+
+	stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+	stats.atvr = static_cast<float>(misses) / vertexCount;
+	return stats;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Index/vertex reordering for better memory locality of the loaded meshes.
+// Both passes only permute data, the set of triangles stays the same.
+
+// Reorders triangles for a post-transform vertex cache (Forsyth's linear-speed
+// algorithm), so consecutive triangles mostly reuse recently touched vertices.
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+
+// Renumbers vertices in the order the index buffer first references them.
+// Writes remap[oldIndex] = newIndex (UINT32_MAX for unreferenced vertices) and
+// returns the number of vertices left; apply it with ApplyVertexRemap.
+size_t OptimizeVertexFetchRemap(std::vector<uint32_t>& indices, size_t vertexCount,
+	std::vector<uint32_t>& outRemap);
+
+template <typename T>
+void ApplyVertexRemap(std::vector<T>& vertices, const std::vector<uint32_t>& remap, size_t newVertexCount)
+{
+	std::vector<T> result(newVertexCount);
+	for (size_t i = 0; i < vertices.size() && i < remap.size(); i++)
+	{
+		if (remap[i] != UINT32_MAX)
+			result[remap[i]] = vertices[i];
+	}
+	vertices.swap(result);
+}
+
+struct VertexCacheStats
+{
+	float acmr = 0.0f; // transformed vertices per triangle (0.5 .. 3, lower is better)
+	float atvr = 0.0f; // transformed vertices per vertex (1 is optimal)
+};
+
+// Simulates a FIFO post-transform cache of cacheSize entries
+VertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+	unsigned cacheSize = 16);
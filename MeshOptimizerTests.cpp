@@ -0,0 +1,45 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "MeshOptimizer.h"
+#include <chrono>
+#include <iostream>
+
+// Vertex cache statistics of a few bundled meshes before and after OptimizeMesh
+int D3D12HelloTriangle::RunMeshOptimizationBenchmark()
+{
+	const char* modelPaths[] = {
+		"Models/FinalBaseMesh.obj",
+		"Models/ExampleScene/CrazyGlass.obj",
+	};
+
+	MeshImportOptions options;
+	options.useCache = false;
+
+	int result = 0;
+	for (const char* path : modelPaths)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		LoadModel(path, vertices, indices, options);
+		if (indices.empty())
+		{
+			std::cout << path << ": failed to load\n";
+			result = 1;
+			continue;
+		}
+
+		VertexCacheStats before = AnalyzeVertexCache(indices, vertices.size());
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		OptimizeMesh(vertices, indices);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		VertexCacheStats after = AnalyzeVertexCache(indices, vertices.size());
+
+		std::cout << path << ": " << indices.size() / 3 << " triangles, " << vertices.size() << " vertices\n"
+			<< "  ACMR " << before.acmr << " -> " << after.acmr
+			<< ", ATVR " << before.atvr << " -> " << after.atvr
+			<< " (16 entry FIFO), optimized in " << ms << " ms\n";
+	}
+	return result;
+}
@@ -0,0 +1,319 @@
+#include "stdafx.h"
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+	struct Vector3
+	{
+		double x, y, z;
+	};
+
+	Vector3 Sub(const Vector3& a, const Vector3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	Vector3 Cross(const Vector3& a, const Vector3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+	double Dot(const Vector3& a, const Vector3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	// Symmetric 4x4 matrix of the squared distance to a set of planes
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+		double b0 = 0, b1 = 0, b2 = 0, c = 0;
+
+		void AddPlane(const Vector3& n, double d)
+		{
+			a00 += n.x * n.x; a01 += n.x * n.y; a02 += n.x * n.z;
+			a11 += n.y * n.y; a12 += n.y * n.z; a22 += n.z * n.z;
+			b0 += n.x * d; b1 += n.y * d; b2 += n.z * d;
+			c += d * d;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02;
+			a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+		}
+
+		double Error(const Vector3& p) const
+		{
+			double e = a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z +
+				a11 * p.y * p.y + 2 * a12 * p.y * p.z + a22 * p.z * p.z +
+				2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+			return e > 0 ? e : 0;
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from;
+		uint32_t to;
+
+		bool operator<(const Collapse& other) const { return cost < other.cost; }
+	};
+
+	Vector3 ReadPosition(const float* positions, size_t stride, uint32_t index)
+	{
+		float p[3];
+		memcpy(p, reinterpret_cast<const uint8_t*>(positions) + index * stride, sizeof(p));
+		return { p[0], p[1], p[2] };
+	}
+
+	// Vertices that must not move: attribute seams and open borders, both
+	// detected on positions so seams are not mistaken for borders
+	std::vector<bool> FindLockedVertices(const std::vector<uint32_t>& indices, const std::vector<Vector3>& points)
+	{
+		const size_t vertexCount = points.size();
+
+		struct PositionHash
+		{
+			size_t operator()(const Vector3& p) const
+			{
+				std::hash<double> h;
+				return h(p.x) ^ (h(p.y) * 31) ^ (h(p.z) * 131);
+			}
+		};
+		struct PositionEqual
+		{
+			bool operator()(const Vector3& a, const Vector3& b) const { return a.x == b.x && a.y == b.y && a.z == b.z; }
+		};
+
+		std::unordered_map<Vector3, uint32_t, PositionHash, PositionEqual> firstAtPosition;
+		firstAtPosition.reserve(vertexCount);
+		std::vector<uint32_t> group(vertexCount);
+		std::vector<uint32_t> groupSize(vertexCount, 0);
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			group[v] = firstAtPosition.emplace(points[v], v).first->second;
+			groupSize[group[v]]++;
+		}
+
+		std::vector<bool> locked(vertexCount, false);
+		for (uint32_t v = 0; v < vertexCount; v++)
+			locked[v] = groupSize[group[v]] > 1;
+
+		// An edge used by a single triangle is on a border
+		std::unordered_map<uint64_t, uint32_t> edgeUse;
+		edgeUse.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t a = group[indices[i + k]];
+				uint32_t b = group[indices[i + (k + 1) % 3]];
+				uint64_t key = a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+				edgeUse[key]++;
+			}
+		}
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t a = group[indices[i + k]];
+				uint32_t b = group[indices[i + (k + 1) % 3]];
+				uint64_t key = a < b ? (uint64_t(a) << 32 | b) : (uint64_t(b) << 32 | a);
+				if (edgeUse[key] == 1)
+				{
+					locked[indices[i + k]] = true;
+					locked[indices[i + (k + 1) % 3]] = true;
+				}
+			}
+		}
+		return locked;
+	}
+
+	// Moving `from` onto `to` must not flip any triangle that survives the collapse
+	bool CollapseFlipsTriangle(const std::vector<uint32_t>& indices, const std::vector<Vector3>& points,
+		const uint32_t* triangles, uint32_t triangleCount, uint32_t from, uint32_t to)
+	{
+		for (uint32_t t = 0; t < triangleCount; t++)
+		{
+			const uint32_t* tri = &indices[triangles[t] * 3];
+			if (tri[0] == to || tri[1] == to || tri[2] == to)
+				continue; // removed by the collapse
+
+			Vector3 p[3], q[3];
+			for (int k = 0; k < 3; k++)
+			{
+				p[k] = points[tri[k]];
+				q[k] = tri[k] == from ? points[to] : p[k];
+			}
+			Vector3 before = Cross(Sub(p[1], p[0]), Sub(p[2], p[0]));
+			Vector3 after = Cross(Sub(q[1], q[0]), Sub(q[2], q[0]));
+			if (Dot(before, after) <= 0.0)
+				return true;
+		}
+		return false;
+	}
+}
+
+std::vector<uint32_t> SimplifyMesh(const std::vector<uint32_t>& indices,
+	const float* positions, size_t positionStride, size_t vertexCount,
+	size_t targetIndexCount, float maxError, float* outError)
+{
+	std::vector<uint32_t> result(indices);
+	double resultError = 0.0;
+
+	std::vector<Vector3> points(vertexCount);
+	for (uint32_t v = 0; v < vertexCount; v++)
+		points[v] = ReadPosition(positions, positionStride, v);
+
+	const std::vector<bool> locked = FindLockedVertices(indices, points);
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		const Vector3& p0 = points[result[i]];
+		Vector3 n = Cross(Sub(points[result[i + 1]], p0), Sub(points[result[i + 2]], p0));
+		double length = std::sqrt(Dot(n, n));
+		if (length == 0.0)
+			continue;
+		n = { n.x / length, n.y / length, n.z / length };
+
+		Quadric q;
+		q.AddPlane(n, -Dot(n, p0));
+		for (int k = 0; k < 3; k++)
+			quadrics[result[i + k]].Add(q);
+	}
+
+	const double maxCost = static_cast<double>(maxError) * maxError;
+	std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertexCount);
+	std::vector<bool> deadTriangle;
+
+	size_t triangleCount = result.size() / 3;
+	while (triangleCount * 3 > targetIndexCount)
+	{
+		// Triangles around each vertex
+		std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+		for (uint32_t index : result)
+			adjacencyOffset[index + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			adjacencyOffset[v + 1] += adjacencyOffset[v];
+		adjacency.resize(result.size());
+		{
+			std::vector<uint32_t> cursor(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				adjacency[cursor[result[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		// Cheapest edge to collapse for every free vertex
+		collapses.clear();
+		for (uint32_t v = 0; v < vertexCount; v++)
+		{
+			if (locked[v] || adjacencyOffset[v] == adjacencyOffset[v + 1])
+				continue;
+
+			Collapse best = { DBL_MAX, v, v };
+			for (uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; a++)
+			{
+				const uint32_t* tri = &result[adjacency[a] * 3];
+				for (int k = 0; k < 3; k++)
+				{
+					uint32_t u = tri[k];
+					if (u == v)
+						continue;
+					double cost = quadrics[v].Error(points[u]) + quadrics[u].Error(points[u]);
+					if (cost < best.cost)
+						best = { cost, v, u };
+				}
+			}
+			if (best.to != v)
+				collapses.push_back(best);
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		// Apply the cheapest independent collapses; vertices around a collapsed
+		// one wait for the next pass, when the adjacency is up to date again
+		std::fill(touched.begin(), touched.end(), false);
+		deadTriangle.assign(result.size() / 3, false);
+		size_t collapsed = 0;
+		for (const Collapse& c : collapses)
+		{
+			if (triangleCount * 3 <= targetIndexCount || c.cost > maxCost)
+				break;
+			if (touched[c.from] || touched[c.to])
+				continue;
+
+			const uint32_t* triangles = &adjacency[adjacencyOffset[c.from]];
+			const uint32_t count = adjacencyOffset[c.from + 1] - adjacencyOffset[c.from];
+			if (CollapseFlipsTriangle(result, points, triangles, count, c.from, c.to))
+				continue;
+
+			for (uint32_t t = 0; t < count; t++)
+			{
+				uint32_t* tri = &result[triangles[t] * 3];
+				bool removed = tri[0] == c.to || tri[1] == c.to || tri[2] == c.to;
+				for (int k = 0; k < 3; k++)
+				{
+					touched[tri[k]] = true;
+					if (tri[k] == c.from)
+						tri[k] = c.to;
+				}
+				if (removed)
+				{
+					deadTriangle[triangles[t]] = true;
+					triangleCount--;
+				}
+			}
+
+			quadrics[c.to].Add(quadrics[c.from]);
+			resultError = c.cost > resultError ? c.cost : resultError;
+			collapsed++;
+		}
+
+		if (collapsed == 0)
+			break;
+
+		size_t write = 0;
+		for (size_t t = 0; t < deadTriangle.size(); t++)
+		{
+			if (deadTriangle[t])
+				continue;
+			for (int k = 0; k < 3; k++)
+				result[write++] = result[t * 3 + k];
+		}
+		result.resize(write);
+	}
+
+	if (outError)
+		*outError = static_cast<float>(std::sqrt(resultError));
+	return result;
+}
+
+void GenerateMeshLods(const std::vector<uint32_t>& indices,
+	const float* positions, size_t positionStride, size_t vertexCount,
+	std::vector<MeshLod>& outLods)
+{
+	outLods.clear();
+	if (indices.size() / 3 < kLodMinTriangles)
+		return;
+	outLods.reserve(kMaxLodLevels); // `previous` points into it
+
+	const std::vector<uint32_t>* previous = &indices;
+	float previousError = 0.0f;
+	for (size_t level = 0; level < kMaxLodLevels; level++)
+	{
+		size_t target = previous->size() / 2 / 3 * 3;
+		float error = 0.0f;
+		MeshLod lod;
+		lod.indices = SimplifyMesh(*previous, positions, positionStride, vertexCount, target, FLT_MAX, &error);
+
+		// Locked borders and seams keep some meshes from shrinking much further
+		if (lod.indices.empty() || lod.indices.size() > previous->size() * 8 / 10)
+			break;
+
+		// Each level is simplified from the previous one, so the errors add up
+		lod.error = previousError + error;
+		previousError = lod.error;
+		outLods.push_back(std::move(lod));
+		previous = &outLods.back().indices;
+	}
+}
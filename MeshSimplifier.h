@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert edge collapse).
+// Vertices are only dropped, never moved or created, so every simplified
+// index list still indexes the original vertex buffer and all LODs of a mesh
+// share one vertex buffer. Vertices on open borders and on attribute seams
+// (several vertices at one position) stay in place so LODs do not crack.
+
+// Collapses edges until at most targetIndexCount indices are left or the next
+// collapse would exceed maxError. Positions are read as 3 floats every
+// positionStride bytes. Returns the simplified index list; outError receives
+// the largest collapse error, as an object space distance.
+std::vector<uint32_t> SimplifyMesh(const std::vector<uint32_t>& indices,
+	const float* positions, size_t positionStride, size_t vertexCount,
+	size_t targetIndexCount, float maxError, float* outError = nullptr);
+
+struct MeshLod
+{
+	std::vector<uint32_t> indices;
+	float error = 0.0f; // object space distance to the full resolution mesh (upper bound)
+};
+
+// Meshes with fewer triangles are not worth simplifying
+const size_t kLodMinTriangles = 2048;
+const size_t kMaxLodLevels = 4;
+
+// Builds up to kMaxLodLevels LODs, each with about half the triangles of the
+// previous one, coarser last. Stops early once simplification stalls.
+void GenerateMeshLods(const std::vector<uint32_t>& indices,
+	const float* positions, size_t positionStride, size_t vertexCount,
+	std::vector<MeshLod>& outLods);
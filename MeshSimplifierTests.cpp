@@ -0,0 +1,60 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "TestUtils.h"
+#include <chrono>
+#include <iostream>
+
+// Triangle count and error of every generated LOD level of the bundled meshes.
+// Errors are object space distances, also given relative to the bounds diagonal.
+int D3D12HelloTriangle::RunLodReport()
+{
+	std::vector<std::string> paths;
+	FindFiles("Models/", ".obj", paths);
+	if (paths.empty())
+	{
+		std::cout << "No .obj files found in Models/\n";
+		return 1;
+	}
+
+	MeshImportOptions options;
+	options.useCache = false;
+
+	int result = 0;
+	for (const auto& path : paths)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> lods;
+		const auto start = std::chrono::high_resolution_clock::now();
+		LoadModel(path, vertices, indices, options, &lods);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		if (indices.empty())
+		{
+			std::cout << path << ": failed to load\n";
+			result = 1;
+			continue;
+		}
+
+		XMVECTOR boundsMin = g_XMFltMax;
+		XMVECTOR boundsMax = -g_XMFltMax;
+		for (const Vertex& v : vertices)
+		{
+			XMVECTOR p = XMLoadFloat3(&v.position);
+			boundsMin = XMVectorMin(boundsMin, p);
+			boundsMax = XMVectorMax(boundsMax, p);
+		}
+		float diagonal = XMVectorGetX(XMVector3Length(boundsMax - boundsMin));
+
+		std::cout << path << ": " << indices.size() / 3 << " triangles, " << lods.size() << " LODs (load + simplify "
+			<< ms << " ms)\n";
+		for (size_t i = 0; i < lods.size(); i++)
+		{
+			std::cout << "  LOD " << i + 1 << ": " << lods[i].indices.size() / 3 << " triangles, error "
+				<< lods[i].error;
+			if (diagonal > 0.0f)
+				std::cout << " (" << 100.0f * lods[i].error / diagonal << "% of the bounds diagonal)";
+			std::cout << "\n";
+		}
+	}
+	return result;
+}
@@ -0,0 +1,204 @@
+#include "stdafx.h"
+#include "ModelLoadQueue.h"
+#include <exception>
+
+ModelLoadQueue::ModelLoadQueue(unsigned threadCount)
+	: m_workers(threadCount)
+{
+}
+
+ModelLoadQueue::~ModelLoadQueue()
+{
+	// Remaining CPU steps return immediately, the pool then joins its workers
+	CancelPending();
+}
+
+uint64_t ModelLoadQueue::Enqueue(const std::string& label, std::vector<Step> cpuSteps, Step integrate)
+{
+	auto job = std::make_shared<Job>();
+	job->status.label = label;
+	job->status.stepsTotal = cpuSteps.size();
+	job->cpuSteps = std::move(cpuSteps);
+	job->integrate = std::move(integrate);
+	job->stepsDone = 0;
+	job->failed = false;
+	job->cancelled = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		job->status.id = m_nextId++;
+		job->status.state = job->cpuSteps.empty() ? JobState::Ready : JobState::Parsing;
+		m_jobs.push_back(job);
+	}
+
+	for (size_t i = 0; i < job->cpuSteps.size(); i++)
+		m_workers.Submit([this, job, i] { RunStep(job, i); });
+
+	return job->status.id;
+}
+
+void ModelLoadQueue::RunStep(const std::shared_ptr<Job>& job, size_t stepIndex)
+{
+	std::string error;
+	if (job->cancelled)
+	{
+		error = "cancelled";
+	}
+	else if (!job->failed)
+	{
+		try
+		{
+			if (!job->cpuSteps[stepIndex]())
+				error = "load failed";
+		}
+		catch (const std::exception& e)
+		{
+			error = e.what();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!error.empty() && !job->failed.exchange(true))
+		job->firstError = error;
+
+	if (++job->stepsDone == job->cpuSteps.size())
+		job->status.state = JobState::Ready;
+}
+
+size_t ModelLoadQueue::Pump(size_t maxIntegrations)
+{
+	size_t integrated = 0;
+	while (integrated < maxIntegrations)
+	{
+		std::shared_ptr<Job> job;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto& candidate : m_jobs)
+			{
+				JobState state = candidate->status.state;
+				if (state == JobState::Done || state == JobState::Failed)
+					continue;
+
+				// Only the oldest unfinished job may be integrated
+				if (state == JobState::Ready)
+				{
+					job = candidate;
+					if (job->failed || job->cancelled)
+					{
+						job->status.state = JobState::Failed;
+						job->status.error = job->firstError.empty() ? "cancelled" : job->firstError;
+						job->cpuSteps.clear();
+						job->integrate = nullptr;
+						job.reset();
+						continue;
+					}
+					job->status.state = JobState::Integrating;
+				}
+				break;
+			}
+		}
+		if (!job)
+			break;
+
+		// Integration touches renderer state, so it runs outside the lock and
+		// may take as long as it needs
+		std::string error;
+		try
+		{
+			if (!job->integrate())
+				error = "integration failed";
+		}
+		catch (const std::exception& e)
+		{
+			error = e.what();
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		job->status.state = error.empty() ? JobState::Done : JobState::Failed;
+		job->status.error = error;
+		job->cpuSteps.clear();
+		job->integrate = nullptr;
+		integrated++;
+	}
+	return integrated;
+}
+
+void ModelLoadQueue::Flush()
+{
+	while (HasPendingJobs())
+	{
+		if (Pump(SIZE_MAX) == 0)
+			std::this_thread::yield();
+	}
+}
+
+void ModelLoadQueue::CancelPending()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& job : m_jobs)
+		job->cancelled = true;
+}
+
+std::vector<ModelLoadQueue::JobStatus> ModelLoadQueue::Status() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<JobStatus> result;
+	result.reserve(m_jobs.size());
+	for (const auto& job : m_jobs)
+	{
+		JobStatus status = job->status;
+		status.stepsDone = job->stepsDone;
+		result.push_back(status);
+	}
+	return result;
+}
+
+bool ModelLoadQueue::HasPendingJobs() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (const auto& job : m_jobs)
+	{
+		if (job->status.state != JobState::Done && job->status.state != JobState::Failed)
+			return true;
+	}
+	return false;
+}
+
+void ModelLoadQueue::PruneFinished(size_t keepFinished)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	size_t finished = 0;
+	for (auto it = m_jobs.rbegin(); it != m_jobs.rend(); ++it)
+	{
+		JobState state = (*it)->status.state;
+		if (state == JobState::Done || state == JobState::Failed)
+			finished++;
+	}
+
+	for (auto it = m_jobs.begin(); it != m_jobs.end() && finished > keepFinished;)
+	{
+		JobState state = (*it)->status.state;
+		if (state == JobState::Done || state == JobState::Failed)
+		{
+			it = m_jobs.erase(it);
+			finished--;
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+const char* ModelLoadQueue::StateName(JobState state)
+{
+	switch (state)
+	{
+	case JobState::Parsing: return "parsing";
+	case JobState::Ready: return "waiting for frame";
+	case JobState::Integrating: return "integrating";
+	case JobState::Done: return "done";
+	case JobState::Failed: return "failed";
+	}
+	return "";
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Background loading of models and scenes.
+//
+// A job is a list of CPU steps (mesh parsing and processing) that run on the
+// worker threads, plus one integration step that runs on the render thread when
+// Pump() is called at a frame boundary. Jobs are integrated in submission order,
+// so a scene load queued before an "Add Model" is never overtaken by it.
+//
+// The queue knows nothing about D3D12: whatever the steps capture is the
+// backend, which is how the headless self test drives it with a fake one.
+class ModelLoadQueue
+{
+public:
+	enum class JobState
+	{
+		Parsing,     // CPU steps queued or running
+		Ready,       // all CPU steps finished, waiting for Pump()
+		Integrating, // integration step running on the render thread
+		Done,
+		Failed,
+	};
+
+	// Returns false (or throws std::exception) to fail the job
+	typedef std::function<bool()> Step;
+
+	struct JobStatus
+	{
+		uint64_t id = 0;
+		std::string label;
+		JobState state = JobState::Parsing;
+		size_t stepsTotal = 0;
+		size_t stepsDone = 0;
+		std::string error;
+	};
+
+	explicit ModelLoadQueue(unsigned threadCount = 0);
+	~ModelLoadQueue();
+
+	ModelLoadQueue(const ModelLoadQueue&) = delete;
+	ModelLoadQueue& operator=(const ModelLoadQueue&) = delete;
+
+	uint64_t Enqueue(const std::string& label, std::vector<Step> cpuSteps, Step integrate);
+
+	// Render thread, between frames: integrates up to maxIntegrations finished
+	// jobs in submission order. Returns the number of jobs integrated.
+	size_t Pump(size_t maxIntegrations = 1);
+
+	// Blocks until every job is finished and integrated
+	void Flush();
+
+	// Jobs that are not integrated yet skip their remaining CPU steps and fail
+	void CancelPending();
+
+	std::vector<JobStatus> Status() const;
+	bool HasPendingJobs() const;
+
+	// Forgets Done and Failed jobs, keeping the last `keepFinished` of them for the UI
+	void PruneFinished(size_t keepFinished = 0);
+
+	static const char* StateName(JobState state);
+
+private:
+	struct Job
+	{
+		JobStatus status;
+		std::vector<Step> cpuSteps;
+		Step integrate;
+		std::atomic<size_t> stepsDone;
+		std::atomic<bool> failed;
+		std::atomic<bool> cancelled;
+		std::string firstError; // guarded by m_mutex
+	};
+
+	void RunStep(const std::shared_ptr<Job>& job, size_t stepIndex);
+
+	mutable std::mutex m_mutex;
+	std::deque<std::shared_ptr<Job> > m_jobs;
+	uint64_t m_nextId = 1;
+	// Declared last so the workers are joined before the jobs they touch go away
+	ThreadPool m_workers;
+};
+
+// ModelLoadQueue against a fake renderer (-testloadqueue), ModelLoadQueueTests.cpp
+int RunLoadQueueSelfTest();
@@ -0,0 +1,103 @@
+#include "stdafx.h"
+#include "ModelLoadQueue.h"
+#include "TestUtils.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+// Drives ModelLoadQueue with a fake renderer: CPU steps sleep instead of
+// parsing and integration records what a frame would have added. Checks the
+// ordering and failure rules the application relies on.
+int RunLoadQueueSelfTest()
+{
+	struct FakeRenderer
+	{
+		std::mutex mutex;
+		std::vector<std::string> integrated;
+		int frame = 0;
+		int stepsRunningDuringIntegration = 0;
+	};
+
+	FakeRenderer renderer;
+	std::atomic<int> stepsRunning(0);
+	auto sleepStep = [&stepsRunning](int ms) {
+		return [&stepsRunning, ms]() {
+			stepsRunning++;
+			std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+			stepsRunning--;
+			return true;
+		};
+	};
+	auto integrateAs = [&renderer](const std::string& name) {
+		return [&renderer, name]() {
+			std::lock_guard<std::mutex> lock(renderer.mutex);
+			renderer.integrated.push_back(name);
+			return true;
+		};
+	};
+
+	TestChecks check;
+
+	double slowestPumpMs = 0.0;
+	{
+		ModelLoadQueue queue(4);
+
+		std::vector<ModelLoadQueue::Step> sceneSteps;
+		for (int i = 0; i < 8; i++)
+			sceneSteps.push_back(sleepStep(30));
+		queue.Enqueue("scene", sceneSteps, integrateAs("scene"));
+		queue.Enqueue("model", { sleepStep(1) }, integrateAs("model"));
+		queue.Enqueue("broken mesh", { sleepStep(1), []() -> bool { throw std::runtime_error("bad file"); } }, integrateAs("broken mesh"));
+		queue.Enqueue("broken upload", { sleepStep(1) }, []() -> bool { throw std::runtime_error("device removed"); });
+		queue.Enqueue("no meshes", {}, integrateAs("no meshes"));
+
+		// Frame loop: one integration per frame at most
+		while (queue.HasPendingJobs() && renderer.frame < 10000)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			queue.Pump();
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			slowestPumpMs = ms > slowestPumpMs ? ms : slowestPumpMs;
+			renderer.frame++;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		auto status = queue.Status();
+		check(renderer.integrated == std::vector<std::string>({ "scene", "model", "no meshes" }),
+			"jobs integrate in submission order, failed jobs are skipped");
+		check(status.size() == 5 && status[2].state == ModelLoadQueue::JobState::Failed && status[2].error == "bad file",
+			"a throwing CPU step fails its job with the message");
+		check(status.size() == 5 && status[3].state == ModelLoadQueue::JobState::Failed && status[3].error == "device removed",
+			"a throwing integration fails its job with the message");
+		check(status.size() == 5 && status[0].stepsDone == 8 && status[0].stepsTotal == 8,
+			"progress counts every CPU step");
+		check(renderer.frame > 1, "frames keep running while meshes parse");
+		check(slowestPumpMs < 20.0, "Pump never waits for parsing");
+
+		queue.PruneFinished(1);
+		check(queue.Status().size() == 1 && queue.Status()[0].label == "no meshes", "PruneFinished keeps the newest finished jobs");
+	}
+
+	{
+		ModelLoadQueue queue(1);
+		std::vector<ModelLoadQueue::Step> slowSteps;
+		for (int i = 0; i < 20; i++)
+			slowSteps.push_back(sleepStep(20));
+		queue.Enqueue("cancelled", slowSteps, integrateAs("cancelled"));
+		std::this_thread::sleep_for(std::chrono::milliseconds(30));
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		queue.CancelPending();
+		queue.Flush();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		auto status = queue.Status();
+		check(status.size() == 1 && status[0].state == ModelLoadQueue::JobState::Failed && status[0].error == "cancelled",
+			"cancelled jobs fail instead of integrating");
+		check(ms < 200.0, "cancelling skips the remaining CPU steps");
+	}
+
+	return check.Finish("load queue");
+}
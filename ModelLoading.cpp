@@ -12,12 +12,47 @@
 #include <assimp/postprocess.h>
 #include "libraries/nlohmann/json.hpp"
 #include "manipulator.h"
+#include "ThreadPool.h"
+#include "VertexCompression.h"
+#include "MeshOptimizer.h"
+#include "FileUtils.h"
+#include "SceneDiff.h"
+#include "StageTimer.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
 
 
 using json = nlohmann::json;
 
 namespace
 {
+	// Upload heap buffer of `size` bytes, mapped at *outData until the caller unmaps it
+	ComPtr<ID3D12Resource> CreateMappedUploadBuffer(ID3D12Device* device, UINT64 size, UINT8** outData)
+	{
+		ComPtr<ID3D12Resource> buffer;
+		CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+		CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(size);
+		ThrowIfFailed(device->CreateCommittedResource(
+			&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource,
+			D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer)));
+
+		CD3DX12_RANGE readRange(0, 0); // We do not intend to read from this resource on the CPU.
+		ThrowIfFailed(buffer->Map(0, &readRange, reinterpret_cast<void**>(outData)));
+		return buffer;
+	}
+
+	// Upload heap buffer holding a copy of data, used for the static mesh buffers
+	ComPtr<ID3D12Resource> CreateUploadBuffer(ID3D12Device* device, const void* data, UINT64 size)
+	{
+		UINT8* pDataBegin;
+		ComPtr<ID3D12Resource> buffer = CreateMappedUploadBuffer(device, size, &pDataBegin);
+		memcpy(pDataBegin, data, static_cast<size_t>(size));
+		buffer->Unmap(0, nullptr);
+		return buffer;
+	}
+
 	std::wstring Utf8ToWString(const std::string& str)
 	{
 		if (str.empty())
@@ -136,54 +171,20 @@ void D3D12HelloTriangle::LoadAssets()
 		//Models[3].position = { 0.0f,0.0f,10.0f };
 		//Models[4].scale = { 50.0f,50.0f,1.0f };
 		//ModelsShaderData[4].isGlass = true;
+		// Parse every distinct mesh up front on the worker threads; the loop
+		// below then only picks them up in scene order, keeping model ids stable
+		auto preloadedMeshes = PreloadMeshes(ModelDescriptions);
 		for (int i = 0; i < ModelDescriptions.size(); i++)
 		{
-
-			LoadModel(ModelDescriptions[i].path, Models[i].vertices, Models[i].indices);
+			Models[i].mesh = AcquireMesh(ModelDescriptions[i].path);
 
 			InitializeShaderData(i);
 
-			const UINT vertexBufferSize = static_cast<UINT>(Models[i].vertices.size()) * sizeof(Vertex);
-
-			ThrowIfFailed(m_device->CreateCommittedResource(
-				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-				D3D12_HEAP_FLAG_NONE,
-				&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize),
-				D3D12_RESOURCE_STATE_GENERIC_READ,
-				nullptr,
-				IID_PPV_ARGS(&(Models[i].m_vertexBuffer))));
-
-			UINT8* pVertexDataBegin;
-			CD3DX12_RANGE readRange(0, 0); 		// We do not intend to read from this resource on the CPU.
-			ThrowIfFailed(Models[i].m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-			memcpy(pVertexDataBegin, Models[i].vertices.data(), vertexBufferSize);
-			Models[i].m_vertexBuffer->Unmap(0, nullptr);
-
-			Models[i].m_vertexBufferView.BufferLocation = Models[i].m_vertexBuffer->GetGPUVirtualAddress();
-			Models[i].m_vertexBufferView.StrideInBytes = sizeof(Vertex);
-			Models[i].m_vertexBufferView.SizeInBytes = vertexBufferSize;
-
-			const UINT indexBufferSize = static_cast<UINT>(Models[i].indices.size()) * sizeof(UINT);
-			Models[i].triangleCount = static_cast<int>(Models[i].indices.size() / 3);
+			Models[i].triangleCount = Models[i].mesh->triangleCount;
 			m_sceneTriangleCount += Models[i].triangleCount;
-
-			CD3DX12_HEAP_PROPERTIES heapProperty = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-			CD3DX12_RESOURCE_DESC bufferResource = CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize);
-			ThrowIfFailed(m_device->CreateCommittedResource(
-				&heapProperty, D3D12_HEAP_FLAG_NONE, &bufferResource, //
-				D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&(Models[i].m_indexBuffer))));
-
-			// Copy the triangle data to the index buffer.
-			UINT8* pIndexDataBegin;
-			ThrowIfFailed(Models[i].m_indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pIndexDataBegin)));
-			memcpy(pIndexDataBegin, Models[i].indices.data(), indexBufferSize);
-			Models[i].m_indexBuffer->Unmap(0, nullptr);
-
-			// Initialize the index buffer view.
-			Models[i].m_indexBufferView.BufferLocation = Models[i].m_indexBuffer->GetGPUVirtualAddress();
-			Models[i].m_indexBufferView.Format = DXGI_FORMAT_R32_UINT;
-			Models[i].m_indexBufferView.SizeInBytes = indexBufferSize;
 		}
+		RefreshMeshTable();
+		ReportMeshSharing();
 	}
 
 	// Create synchronization objects and wait until assets have been uploaded to the GPU.
@@ -205,24 +206,122 @@ void D3D12HelloTriangle::LoadAssets()
 	}
 }
 
+const uint32_t D3D12HelloTriangle::AssimpImportFlags =
+	aiProcess_Triangulate |
+	aiProcess_ConvertToLeftHanded |
+	aiProcess_GenNormals |
+	aiProcess_JoinIdenticalVertices;
+
 void D3D12HelloTriangle::LoadModel(const std::string& modelPath,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices,
+	const MeshImportOptions& options,
+	std::vector<MeshLod>* outLods)
+{
+	const auto loadStart = std::chrono::high_resolution_clock::now();
+
+	// glTF buffers are converted in a single pass, the cache would not save anything
+	const bool gltf = options.nativeGltf && IsGltfFile(modelPath);
+	const bool useCache = options.useCache && !gltf;
+	std::vector<MeshLod> lods;
+	if (useCache && LoadMeshCache(modelPath, AssimpImportFlags, options.ProcessFlags(), outVertices, outIndices, lods))
+	{
+		if (outLods)
+			*outLods = std::move(lods);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+		// One insertion per line, LoadModel runs on several threads while loading a scene
+		Log() << ("Loaded mesh: " + modelPath + " (cache, " + std::to_string(ms) + " ms)\n");
+		return;
+	}
+	ImportModel(modelPath, outVertices, outIndices, options, outLods, loadStart);
+}
+
+void D3D12HelloTriangle::LoadMeshGeometry(MeshGeometry& mesh, const MeshImportOptions& options)
+{
+	const auto loadStart = std::chrono::high_resolution_clock::now();
+
+	const bool useCache = options.useCache && !(options.nativeGltf && IsGltfFile(mesh.path));
+	std::unique_ptr<MappedMeshCache> cached(new MappedMeshCache);
+	if (useCache && OpenMeshCache(mesh.path, AssimpImportFlags, options.ProcessFlags(), *cached))
+	{
+		mesh.vertexCount = cached->vertexCount;
+		mesh.indexCount = cached->indexCount;
+		mesh.lods.resize(cached->lodErrors.size());
+		for (size_t i = 0; i < mesh.lods.size(); i++)
+			mesh.lods[i].error = cached->lodErrors[i];
+		mesh.cached = std::move(cached);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+		Log() << ("Loaded mesh: " + mesh.path + " (cache, " + std::to_string(ms) + " ms)\n");
+		return;
+	}
+	// Unmapped before the import writes the entry again
+	cached.reset();
+
+	ImportModel(mesh.path, mesh.vertices, mesh.indices, options, &mesh.lods, loadStart);
+	mesh.vertexCount = static_cast<UINT>(mesh.vertices.size());
+	mesh.indexCount = static_cast<UINT>(mesh.indices.size());
+}
+
+void D3D12HelloTriangle::ImportModel(const std::string& modelPath,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices,
+	const MeshImportOptions& options,
+	std::vector<MeshLod>* outLods,
+	std::chrono::high_resolution_clock::time_point loadStart)
+{
+	const bool gltf = options.nativeGltf && IsGltfFile(modelPath);
+	const bool useCache = options.useCache && !gltf;
+	std::vector<MeshLod> lods;
+
+	// .obj and glTF files go through the native parsers, Assimp handles everything else
+	// and whatever the native parser cannot read
+	const char* importerName = gltf ? "gltf" : "obj";
+	bool imported = gltf ? LoadGltfModel(modelPath, outVertices, outIndices) :
+		options.nativeObj && IsObjFile(modelPath) && LoadObjModel(modelPath, outVertices, outIndices);
+	if (!imported)
+	{
+		outVertices.clear();
+		outIndices.clear();
+		importerName = "assimp";
+		imported = ImportModelAssimp(modelPath, AssimpImportFlags, outVertices, outIndices);
+	}
+	if (!imported)
+		return;
+
+	if (options.optimize)
+		OptimizeMesh(outVertices, outIndices);
+
+	// Generated whenever they end up in the cache, so cached entries are complete
+	if (options.generateLods && (outLods || useCache) && !outVertices.empty())
+	{
+		GenerateMeshLods(outIndices, &outVertices[0].position.x, sizeof(Vertex), outVertices.size(), lods);
+		if (options.optimize)
+		{
+			for (auto& lod : lods)
+				OptimizeVertexCache(lod.indices, outVertices.size());
+		}
+	}
+
+	if (useCache && !outVertices.empty())
+		SaveMeshCache(modelPath, AssimpImportFlags, options.ProcessFlags(), outVertices, outIndices, lods);
+	if (outLods)
+		*outLods = std::move(lods);
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count();
+	Log() << ("Loaded mesh: " + modelPath + " (" + importerName + ", " + std::to_string(ms) + " ms)\n");
+}
+
+bool D3D12HelloTriangle::ImportModelAssimp(const std::string& modelPath, uint32_t importFlags,
 	std::vector<Vertex>& outVertices,
 	std::vector<uint32_t>& outIndices)
 {
-	static int modelId = -1;
-	modelId++;
 	Assimp::Importer importer;
 
-	const aiScene* scene = importer.ReadFile(modelPath,
-		aiProcess_Triangulate |
-		aiProcess_ConvertToLeftHanded |
-		aiProcess_GenNormals |
-		aiProcess_JoinIdenticalVertices
-	);
+	const aiScene* scene = importer.ReadFile(modelPath, importFlags);
 
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
-		return;
+		return false;
 	}
 
 	for (UINT m = 0; m < scene->mNumMeshes; ++m)
@@ -238,7 +337,7 @@ void D3D12HelloTriangle::LoadModel(const std::string& modelPath,
 
 		for (UINT i = 0; i < mesh->mNumVertices; ++i)
 		{
-			Vertex v;
+			Vertex v = {};
 			v.position.x = mesh->mVertices[i].x;
 			v.position.y = mesh->mVertices[i].y;
 			v.position.z = mesh->mVertices[i].z;
@@ -269,92 +368,656 @@ void D3D12HelloTriangle::LoadModel(const std::string& modelPath,
 			}
 		}
 	}
+
+	return true;
+}
+
+// Reorders triangles for the vertex cache, then vertices in first use order.
+// Runs on the joined vertices (aiProcess_JoinIdenticalVertices), and the
+// result is what ends up in the mesh cache.
+void D3D12HelloTriangle::OptimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	OptimizeVertexCache(indices, vertices.size());
+
+	std::vector<uint32_t> remap;
+	size_t usedVertices = OptimizeVertexFetchRemap(indices, vertices.size(), remap);
+	ApplyVertexRemap(vertices, remap, usedVertices);
+}
+
+std::shared_ptr<D3D12HelloTriangle::MeshGeometry> D3D12HelloTriangle::AcquireMesh(const std::string& path)
+{
+	auto found = m_meshRegistry.find(path);
+	if (found != m_meshRegistry.end())
+	{
+		std::shared_ptr<MeshGeometry> existing = found->second.lock();
+		if (existing)
+			return existing;
+	}
+
+	std::shared_ptr<MeshGeometry> mesh = std::make_shared<MeshGeometry>();
+	mesh->path = path;
+	LoadMeshGeometry(*mesh, m_meshImportOptions);
+	CreateMeshBuffers(*mesh);
+
+	m_meshRegistry[path] = mesh;
+	return mesh;
+}
+
+void D3D12HelloTriangle::CompressVertices(const Vertex* vertices, size_t vertexCount, std::vector<XMFLOAT3>& outPositions,
+	std::vector<CompactVertexAttributes>& outAttributes)
+{
+	outPositions.resize(vertexCount);
+	outAttributes.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const Vertex& v = vertices[i];
+		outPositions[i] = v.position;
+		outAttributes[i].normal = EncodeOctahedralNormal(v.normal);
+		outAttributes[i].color = EncodeColorRGBA8(v.color);
+		outAttributes[i].roughness = EncodeHalf(v.roughness);
+		outAttributes[i].emission[0] = EncodeHalf(v.emmision.x);
+		outAttributes[i].emission[1] = EncodeHalf(v.emmision.y);
+		outAttributes[i].emission[2] = EncodeHalf(v.emmision.z);
+	}
+}
+
+DXGI_FORMAT D3D12HelloTriangle::ChooseIndexFormat(size_t vertexCount)
+{
+	return vertexCount <= 0x10000 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+void D3D12HelloTriangle::PackIndices(const std::vector<uint32_t>& indices, DXGI_FORMAT format, std::vector<uint8_t>& outData)
+{
+	outData.resize(PackedIndexBytes(indices.size(), format));
+	if (!outData.empty())
+		PackIndices(indices.data(), indices.size(), format, outData.data());
+}
+
+size_t D3D12HelloTriangle::PackedIndexBytes(size_t indexCount, DXGI_FORMAT format)
+{
+	// 16-bit indices are padded to a multiple of 4 bytes so the shaders' 32-bit loads stay in bounds
+	if (format == DXGI_FORMAT_R16_UINT)
+		return (indexCount + indexCount % 2) * sizeof(uint16_t);
+	return indexCount * sizeof(uint32_t);
+}
+
+void D3D12HelloTriangle::PackIndices(const uint32_t* indices, size_t indexCount, DXGI_FORMAT format, uint8_t* outData)
+{
+	if (format == DXGI_FORMAT_R16_UINT)
+	{
+		uint16_t* smallIndices = reinterpret_cast<uint16_t*>(outData);
+		for (size_t i = 0; i < indexCount; i++)
+			smallIndices[i] = static_cast<uint16_t>(indices[i]);
+		if (indexCount % 2 != 0)
+			smallIndices[indexCount] = 0;
+	}
+	else if (indexCount > 0)
+	{
+		memcpy(outData, indices, indexCount * sizeof(uint32_t));
+	}
+}
+
+void D3D12HelloTriangle::CreateMeshBuffers(MeshGeometry& mesh)
+{
+	// A cached mesh is uploaded straight from the mapped entry, where the LOD
+	// indices already follow the full mesh
+	const Vertex* vertices = mesh.vertices.data();
+	std::vector<uint32_t> allIndices;
+	const uint32_t* indices = nullptr;
+	std::vector<uint32_t> lodIndexCounts;
+	size_t indexCount = mesh.indexCount;
+	if (mesh.cached)
+	{
+		vertices = mesh.cached->vertices;
+		indices = mesh.cached->indices;
+		lodIndexCounts = mesh.cached->lodIndexCounts;
+	}
+	else
+	{
+		// The LODs follow the full mesh in the same index buffer
+		allIndices = mesh.indices;
+		for (const MeshLod& lod : mesh.lods)
+		{
+			lodIndexCounts.push_back(static_cast<uint32_t>(lod.indices.size()));
+			allIndices.insert(allIndices.end(), lod.indices.begin(), lod.indices.end());
+		}
+		indices = allIndices.data();
+	}
+
+	UINT vertexBufferSize = 0;
+	if (m_compactVertices)
+	{
+		// BLAS builds only read the tight position stream, shading attributes
+		// are quantized into a second one
+		std::vector<XMFLOAT3> positions;
+		std::vector<CompactVertexAttributes> attributes;
+		CompressVertices(vertices, mesh.vertexCount, positions, attributes);
+
+		mesh.vertexStride = sizeof(XMFLOAT3);
+		vertexBufferSize = static_cast<UINT>(positions.size() * sizeof(XMFLOAT3));
+		mesh.m_vertexBuffer = CreateUploadBuffer(m_device.Get(), positions.data(), vertexBufferSize);
+		mesh.m_attributeBuffer = CreateUploadBuffer(m_device.Get(), attributes.data(),
+			attributes.size() * sizeof(CompactVertexAttributes));
+	}
+	else
+	{
+		mesh.vertexStride = sizeof(Vertex);
+		vertexBufferSize = mesh.vertexCount * sizeof(Vertex);
+		mesh.m_vertexBuffer = CreateUploadBuffer(m_device.Get(), vertices, vertexBufferSize);
+	}
+
+	mesh.m_vertexBufferView.BufferLocation = mesh.m_vertexBuffer->GetGPUVirtualAddress();
+	mesh.m_vertexBufferView.StrideInBytes = mesh.vertexStride;
+	mesh.m_vertexBufferView.SizeInBytes = vertexBufferSize;
+
+	mesh.triangleCount = mesh.indexCount / 3;
+
+	XMVECTOR boundsMin = g_XMFltMax;
+	XMVECTOR boundsMax = -g_XMFltMax;
+	for (UINT i = 0; i < mesh.vertexCount; i++)
+	{
+		XMVECTOR p = XMLoadFloat3(&vertices[i].position);
+		boundsMin = XMVectorMin(boundsMin, p);
+		boundsMax = XMVectorMax(boundsMax, p);
+	}
+	if (mesh.vertexCount > 0)
+	{
+		XMStoreFloat3(&mesh.boundsCenter, (boundsMin + boundsMax) * 0.5f);
+		mesh.boundsRadius = XMVectorGetX(XMVector3Length(boundsMax - boundsMin)) * 0.5f;
+	}
+
+	mesh.lodFirstTriangle.clear();
+	mesh.lodTriangleCount.clear();
+	for (uint32_t lodIndexCount : lodIndexCounts)
+	{
+		mesh.lodFirstTriangle.push_back(static_cast<UINT>(indexCount / 3));
+		mesh.lodTriangleCount.push_back(lodIndexCount / 3);
+		indexCount += lodIndexCount;
+	}
+
+	// Small meshes get 16-bit indices, halving index memory and BLAS build input
+	mesh.indexFormat = ChooseIndexFormat(mesh.vertexCount);
+	const UINT indexSize = mesh.indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t);
+	const UINT indexBufferSize = static_cast<UINT>(indexCount) * indexSize;
+	UINT8* indexData;
+	mesh.m_indexBuffer = CreateMappedUploadBuffer(m_device.Get(), PackedIndexBytes(indexCount, mesh.indexFormat), &indexData);
+	PackIndices(indices, indexCount, mesh.indexFormat, indexData);
+	mesh.m_indexBuffer->Unmap(0, nullptr);
+
+	// Initialize the index buffer view.
+	mesh.m_indexBufferView.BufferLocation = mesh.m_indexBuffer->GetGPUVirtualAddress();
+	mesh.m_indexBufferView.Format = mesh.indexFormat;
+	mesh.m_indexBufferView.SizeInBytes = indexBufferSize;
+
+	// Closes the mapping, the cache entry can be rewritten again
+	mesh.cached.reset();
+}
+
+// Records the BLAS builds of `meshes`, full meshes and LODs, as one batch on
+// m_commandList, which has to be open. Each mesh must be listed once.
+void D3D12HelloTriangle::BuildMeshBLASes(const std::vector<MeshGeometry*>& meshes)
+{
+	size_t buildCount = 0;
+	for (MeshGeometry* mesh : meshes)
+		buildCount += 1 + mesh->lods.size();
+	std::vector<PendingBlasBuild> builds(buildCount);
+
+	size_t next = 0;
+	for (MeshGeometry* mesh : meshes)
+	{
+		PrepareBottomLevelAS(builds[next++], mesh->blas,
+			{ {mesh->m_vertexBuffer.Get(), (uint32_t)mesh->vertexCount} },
+			{ {mesh->m_indexBuffer.Get(),  (uint32_t)mesh->indexCount} },
+			mesh->vertexStride,
+			mesh->indexFormat,
+			0,
+			m_compactBlas
+		);
+
+		// Sized up front: the pending builds point into it
+		const UINT indexSize = mesh->indexFormat == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t);
+		mesh->lodBlas.clear();
+		mesh->lodBlas.resize(mesh->lods.size());
+		for (size_t i = 0; i < mesh->lods.size(); i++)
+		{
+			PrepareBottomLevelAS(builds[next++], mesh->lodBlas[i],
+				{ {mesh->m_vertexBuffer.Get(), (uint32_t)mesh->vertexCount} },
+				{ {mesh->m_indexBuffer.Get(),  (uint32_t)mesh->lodTriangleCount[i] * 3} },
+				mesh->vertexStride,
+				mesh->indexFormat,
+				static_cast<UINT64>(mesh->lodFirstTriangle[i]) * 3 * indexSize,
+				m_compactBlas
+			);
+		}
+	}
+
+	RecordBlasBatch(builds);
+
+	for (MeshGeometry* mesh : meshes)
+	{
+		if (mesh->blas.compactionId)
+			m_compactionTargets[mesh->blas.compactionId] = { mesh->path, -1 };
+		for (size_t i = 0; i < mesh->lodBlas.size(); i++)
+		{
+			if (mesh->lodBlas[i].compactionId)
+				m_compactionTargets[mesh->lodBlas[i].compactionId] = { mesh->path, static_cast<int>(i) };
+		}
+	}
+}
+
+// Rebuilds the list of meshes referenced by the scene and assigns their hit
+// group records. Must be called whenever Models changes.
+void D3D12HelloTriangle::RefreshMeshTable()
+{
+	for (auto& model : Models)
+		model.mesh->sbtIndex = UINT_MAX;
+
+	m_uniqueMeshes.clear();
+	for (auto& model : Models)
+	{
+		if (model.mesh->sbtIndex == UINT_MAX)
+		{
+			model.mesh->sbtIndex = static_cast<UINT>(m_uniqueMeshes.size());
+			m_uniqueMeshes.push_back(model.mesh.get());
+		}
+	}
+
+	for (auto it = m_meshRegistry.begin(); it != m_meshRegistry.end();)
+	{
+		if (it->second.expired())
+			it = m_meshRegistry.erase(it);
+		else
+			++it;
+	}
+}
+
+D3D12HelloTriangle::MeshSharingStats D3D12HelloTriangle::MeasureMeshSharing(const std::vector<const MeshGeometry*>& instanceMeshes)
+{
+	MeshSharingStats stats;
+	std::set<const MeshGeometry*> unique;
+	for (const MeshGeometry* mesh : instanceMeshes)
+	{
+		const uint64_t bytes = static_cast<uint64_t>(mesh->vertexCount) * sizeof(Vertex) + static_cast<uint64_t>(mesh->indexCount) * sizeof(uint32_t);
+		stats.unsharedBytes += bytes;
+		if (unique.insert(mesh).second)
+			stats.sharedBytes += bytes;
+	}
+	stats.uniqueMeshes = unique.size();
+	stats.instances = instanceMeshes.size();
+	return stats;
+}
+
+void D3D12HelloTriangle::ReportMeshSharing()
+{
+	std::vector<const MeshGeometry*> instanceMeshes;
+	for (auto& model : Models)
+		instanceMeshes.push_back(model.mesh.get());
+	const MeshSharingStats sharing = MeasureMeshSharing(instanceMeshes);
+
+	uint64_t indexBytes = 0;
+	uint64_t fullIndexBytes = 0;
+	for (MeshGeometry* mesh : m_uniqueMeshes)
+	{
+		indexBytes += mesh->m_indexBufferView.SizeInBytes;
+		fullIndexBytes += static_cast<uint64_t>(mesh->indexCount) * sizeof(uint32_t);
+	}
+
+	Log() << "Scene meshes: " << sharing.uniqueMeshes << " unique / "
+		<< sharing.instances << " instances, geometry memory "
+		<< sharing.sharedBytes / 1024 << " KB (saved " << (sharing.unsharedBytes - sharing.sharedBytes) / 1024 << " KB)\n";
+
+	// Vertex memory of both layouts, whichever one is active
+	uint64_t fullVertexBytes = 0;
+	uint64_t compactVertexBytes = 0;
+	for (MeshGeometry* mesh : m_uniqueMeshes)
+	{
+		fullVertexBytes += static_cast<uint64_t>(mesh->vertexCount) * sizeof(Vertex);
+		compactVertexBytes += static_cast<uint64_t>(mesh->vertexCount) * (sizeof(XMFLOAT3) + sizeof(CompactVertexAttributes));
+	}
+	Log() << "Vertex memory: full layout " << fullVertexBytes / 1024 << " KB, compact layout "
+		<< compactVertexBytes / 1024 << " KB (using " << (m_compactVertices ? "compact" : "full") << ")\n";
+	Log() << "Index memory: " << indexBytes / 1024 << " KB (" << fullIndexBytes / 1024
+		<< " KB with 32-bit indices only)\n";
+}
+
+std::vector<std::shared_ptr<D3D12HelloTriangle::MeshGeometry> > D3D12HelloTriangle::ResolveMeshes(
+	std::unordered_map<std::string, std::weak_ptr<MeshGeometry> >& registry,
+	const std::vector<ModelDesc>& descs, std::vector<MeshGeometry*>& outNew)
+{
+	std::vector<std::shared_ptr<MeshGeometry> > meshes;
+	meshes.reserve(descs.size());
+	for (const auto& desc : descs)
+	{
+		auto found = registry.find(desc.path);
+		std::shared_ptr<MeshGeometry> mesh;
+		if (found != registry.end())
+			mesh = found->second.lock();
+
+		if (!mesh)
+		{
+			mesh = std::make_shared<MeshGeometry>();
+			mesh->path = desc.path;
+			registry[desc.path] = mesh;
+			outNew.push_back(mesh.get());
+		}
+		meshes.push_back(mesh);
+	}
+	return meshes;
+}
+
+std::vector<std::shared_ptr<D3D12HelloTriangle::MeshGeometry> > D3D12HelloTriangle::PreloadMeshes(const std::vector<ModelDesc>& descs)
+{
+	std::vector<MeshGeometry*> toParse;
+	std::vector<std::shared_ptr<MeshGeometry> > meshes = ResolveMeshes(m_meshRegistry, descs, toParse);
+
+	const auto parseStart = std::chrono::high_resolution_clock::now();
+	ParseMeshesParallel(toParse, 0, m_meshImportOptions);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - parseStart).count();
+	if (!toParse.empty())
+		Log() << "Parsed " << toParse.size() << " meshes in " << ms << " ms\n";
+
+	// D3D12 resources are created on this thread, in scene order
+	for (MeshGeometry* mesh : toParse)
+		CreateMeshBuffers(*mesh);
+
+	return meshes;
+}
+
+void D3D12HelloTriangle::ParseMeshesParallel(const std::vector<MeshGeometry*>& meshes, unsigned threadCount,
+	const MeshImportOptions& options)
+{
+	if (meshes.empty())
+		return;
+
+	if (threadCount == 0)
+		threadCount = ThreadPool::DefaultThreadCount();
+	if (threadCount > meshes.size())
+		threadCount = static_cast<unsigned>(meshes.size());
+
+	if (threadCount <= 1)
+	{
+		for (MeshGeometry* mesh : meshes)
+			LoadMeshGeometry(*mesh, options);
+		return;
+	}
+
+	// Every task owns its importer (LoadModel creates one), and writes only to
+	// its own mesh, so no locking is needed
+	ThreadPool pool(threadCount);
+	std::vector<std::future<void> > tasks;
+	tasks.reserve(meshes.size());
+	for (MeshGeometry* mesh : meshes)
+	{
+		tasks.push_back(pool.Submit([mesh, &options] {
+			LoadMeshGeometry(*mesh, options);
+		}));
+	}
+
+	// get() rethrows exceptions from the workers on this thread
+	for (auto& task : tasks)
+		task.get();
+}
+
+std::vector<ModelLoadQueue::Step> D3D12HelloTriangle::MakeMeshParseSteps(const std::vector<std::string>& paths,
+	std::vector<std::shared_ptr<MeshGeometry> >& outMeshes) const
+{
+	std::vector<ModelLoadQueue::Step> steps;
+	std::set<std::string> queued;
+	for (const auto& path : paths)
+	{
+		// Meshes already on the GPU are reused at integration time
+		auto found = m_meshRegistry.find(path);
+		if ((found != m_meshRegistry.end() && !found->second.expired()) || !queued.insert(path).second)
+			continue;
+
+		// Not registered until integration, so AcquireMesh never sees a half parsed mesh
+		auto mesh = std::make_shared<MeshGeometry>();
+		mesh->path = path;
+		outMeshes.push_back(mesh);
+
+		const MeshImportOptions options = m_meshImportOptions;
+		steps.push_back([mesh, options]() {
+			LoadMeshGeometry(*mesh, options);
+			if (mesh->indexCount == 0)
+				throw std::runtime_error("Cannot load " + mesh->path);
+			return true;
+		});
+	}
+	return steps;
+}
+
+std::shared_ptr<D3D12HelloTriangle::MeshGeometry> D3D12HelloTriangle::RegisterParsedMesh(const std::shared_ptr<MeshGeometry>& parsed)
+{
+	auto found = m_meshRegistry.find(parsed->path);
+	if (found != m_meshRegistry.end())
+	{
+		std::shared_ptr<MeshGeometry> existing = found->second.lock();
+		if (existing)
+			return existing;
+	}
+
+	CreateMeshBuffers(*parsed);
+	m_meshRegistry[parsed->path] = parsed;
+	return parsed;
+}
+
+void D3D12HelloTriangle::QueueAddModel(const std::string& path)
+{
+	std::vector<std::shared_ptr<MeshGeometry> > meshes;
+	auto steps = MakeMeshParseSteps({ path }, meshes);
+	m_modelLoadQueue.Enqueue("Add " + path, std::move(steps), [this, path, meshes]() {
+		// The references keep the parsed meshes alive until AddModel acquires them
+		std::vector<std::shared_ptr<MeshGeometry> > registered;
+		for (const auto& mesh : meshes)
+			registered.push_back(RegisterParsedMesh(mesh));
+		AddModel(path);
+		return true;
+	});
+}
+
+void D3D12HelloTriangle::QueueLoadScene(const std::string& label, const std::vector<ModelDesc>& descs)
+{
+	std::vector<std::string> paths;
+	for (const auto& desc : descs)
+		paths.push_back(desc.path);
+
+	std::vector<std::shared_ptr<MeshGeometry> > meshes;
+	auto steps = MakeMeshParseSteps(paths, meshes);
+	m_modelLoadQueue.Enqueue("Load " + label, std::move(steps), [this, descs, meshes]() {
+		std::vector<std::shared_ptr<MeshGeometry> > registered;
+		for (const auto& mesh : meshes)
+			registered.push_back(RegisterParsedMesh(mesh));
+
+		ApplySceneDescriptions(descs);
+		return true;
+	});
+}
+
+std::vector<SceneDiffItem> D3D12HelloTriangle::MakeSceneDiffItems(const std::vector<ModelDesc>& descs)
+{
+	std::vector<SceneDiffItem> items(descs.size());
+	for (size_t i = 0; i < descs.size(); i++)
+	{
+		const ModelDesc& desc = descs[i];
+		SceneDiffItem& item = items[i];
+		item.path = desc.path;
+
+		// The transform of an animated instance is the pose of the last frame,
+		// rewritten by EvaluateAnimationTracks; its keys are what the file says
+		if (desc.animationFrames.size() < 2)
+		{
+			item.transformKey = HashFnv1a64(&desc.position, sizeof(desc.position));
+			item.transformKey = HashFnv1a64(&desc.rotation, sizeof(desc.rotation), item.transformKey);
+			item.transformKey = HashFnv1a64(&desc.scale, sizeof(desc.scale), item.transformKey);
+		}
+
+		item.materialKey = HashFnv1a64(&desc.albedo, sizeof(desc.albedo));
+		item.materialKey = HashFnv1a64(&desc.emission, sizeof(desc.emission), item.materialKey);
+		item.materialKey = HashFnv1a64(&desc.roughness, sizeof(desc.roughness), item.materialKey);
+		item.materialKey = HashFnv1a64(&desc.isMetallic, sizeof(desc.isMetallic), item.materialKey);
+		item.materialKey = HashFnv1a64(&desc.isGlass, sizeof(desc.isGlass), item.materialKey);
+		item.materialKey = HashFnv1a64(&desc.IOR, sizeof(desc.IOR), item.materialKey);
+
+		if (!desc.animationFrames.empty())
+		{
+			item.animationKey = HashFnv1a64(desc.animationFrames.data(), desc.animationFrames.size() * sizeof(AnimationFrame));
+			item.animationKey = HashFnv1a64(&desc.rotationInterpolation, sizeof(desc.rotationInterpolation), item.animationKey);
+			item.animationKey = HashFnv1a64(&desc.positionInterpolation, sizeof(desc.positionInterpolation), item.animationKey);
+		}
+	}
+	return items;
+}
+
+// Turns the current scene into `descs` with the fewest changes: kept instances
+// keep their mesh, BLAS and any material edited in the UI (unless the file
+// changed that material too). Only adds and removes rebuild the TLAS, heap,
+// pipeline and SBT, and then only once for the whole scene.
+void D3D12HelloTriangle::ApplySceneDescriptions(const std::vector<ModelDesc>& descs)
+{
+	const SceneDiff diff = DiffScenes(MakeSceneDiffItems(ModelDescriptions), MakeSceneDiffItems(descs));
+	Log() << "Scene reload: " << diff.matched.size() - diff.EditCount() << " unchanged, " << diff.EditCount()
+		<< " edited, " << diff.added.size() << " added, " << diff.removed.size() << " removed\n";
+	if (diff.Empty())
+	{
+		ModelDescriptions = descs;
+		m_animationTracksDirty = true;
+		return;
+	}
+
+	WaitForPreviousFrame();
+	ThrowIfFailed(m_commandAllocator->Reset());
+	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
+
+	std::vector<ModelInstance> models(descs.size());
+	std::vector<ModelInstanceGPU> shaderData(descs.size());
+	for (const SceneDiff::Match& match : diff.matched)
+	{
+		models[match.to] = std::move(Models[match.from]);
+		shaderData[match.to] = ModelsShaderData[match.from];
+	}
+
+	// Materials changed in the file, and new instances
+	auto initializeMaterial = [&](size_t i) {
+		const ModelDesc& desc = descs[i];
+		shaderData[i].albedo = desc.albedo;
+		shaderData[i].emission = static_cast<float>(desc.emission);
+		shaderData[i].roughness = desc.roughness;
+		shaderData[i].isGlass = desc.isGlass;
+		shaderData[i].isMetallic = desc.isMetallic;
+		shaderData[i].IOR = desc.IOR;
+	};
+	for (const SceneDiff::Match& match : diff.matched)
+	{
+		if (match.materialChanged)
+			initializeMaterial(match.to);
+	}
+	// The BLASes of every mesh new to the scene are built as one batch
+	std::vector<MeshGeometry*> unbuilt;
+	for (size_t i : diff.added)
+	{
+		models[i].mesh = AcquireMesh(descs[i].path);
+		MeshGeometry* mesh = models[i].mesh.get();
+		if (!mesh->blas.result && std::find(unbuilt.begin(), unbuilt.end(), mesh) == unbuilt.end())
+			unbuilt.push_back(mesh);
+		models[i].triangleCount = models[i].mesh->triangleCount;
+		shaderData[i].smallIndices = models[i].mesh->indexFormat == DXGI_FORMAT_R16_UINT;
+		initializeMaterial(i);
+	}
+	BuildMeshBLASes(unbuilt);
+
+	m_sceneTriangleCount = 0;
+	for (size_t i = 0; i < models.size(); i++)
+	{
+		models[i].id = shaderData[i].id = static_cast<int>(i);
+		m_sceneTriangleCount += models[i].triangleCount;
+	}
+
+	// Removed instances go away here, and with them meshes nothing uses anymore
+	Models.swap(models);
+	models.clear();
+	ModelsShaderData.swap(shaderData);
+	ModelDescriptions = descs;
+	m_animationTracksDirty = true;
+
+	if (diff.ChangesStructure())
+	{
+		RefreshMeshTable();
+		CreateModelDataBuffer();
+
+		RebuildInstanceList();
+		CreateTopLevelAS(m_instances, false);
+
+		CreateShaderResourceHeap();
+		CreateShaderBindingTable();
+	}
+
+	ThrowIfFailed(m_commandList->Close());
+	ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+	m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
+	WaitForPreviousFrame();
+
+	// Transform edits alone are picked up by the per frame TLAS update; a new
+	// order changes instance IDs, so the TLAS is rebuilt
+	if (diff.ChangesStructure() || diff.ChangesOrder())
+		BLASChanged = true;
 }
 
 void D3D12HelloTriangle::AddModel(const std::string& path, bool reloading) {
+	StageTimer timer("AddModel " + path);
 	WaitForPreviousFrame();
 
 	ThrowIfFailed(m_commandAllocator->Reset());
 	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
+	timer.Lap("wait");
 
 	ModelDesc newDescription;
 	ModelInstance newModel = {};
 	newDescription.id = newModel.id = static_cast<int>(Models.size());
 	newDescription.path = path;
 
-	LoadModel(path, newModel.vertices, newModel.indices);
-
-	const UINT vertexBufferSize = static_cast<UINT>(newModel.vertices.size()) * sizeof(Vertex);
-	ThrowIfFailed(m_device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(vertexBufferSize), D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr, IID_PPV_ARGS(&(newModel.m_vertexBuffer))));
+	newModel.mesh = AcquireMesh(path);
+	timer.Lap("mesh");
+	if (!newModel.mesh->blas.result)
+		BuildMeshBLASes({ newModel.mesh.get() });
+	timer.Lap("BLAS");
 
-	UINT8* pVertexDataBegin;
-	CD3DX12_RANGE readRange(0, 0);
-	ThrowIfFailed(newModel.m_vertexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pVertexDataBegin)));
-	memcpy(pVertexDataBegin, newModel.vertices.data(), vertexBufferSize);
-	newModel.m_vertexBuffer->Unmap(0, nullptr);
-
-	const UINT indexBufferSize = static_cast<UINT>(newModel.indices.size()) * sizeof(uint32_t);
-	newModel.triangleCount = static_cast<int>(newModel.indices.size() / 3);
+	newModel.triangleCount = newModel.mesh->triangleCount;
 	m_sceneTriangleCount += newModel.triangleCount;
-	ThrowIfFailed(m_device->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), D3D12_HEAP_FLAG_NONE,
-		&CD3DX12_RESOURCE_DESC::Buffer(indexBufferSize), D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr, IID_PPV_ARGS(&(newModel.m_indexBuffer))));
-
-	UINT8* pIndexDataBegin;
-	ThrowIfFailed(newModel.m_indexBuffer->Map(0, &readRange, reinterpret_cast<void**>(&pIndexDataBegin)));
-	memcpy(pIndexDataBegin, newModel.indices.data(), indexBufferSize);
-	newModel.m_indexBuffer->Unmap(0, nullptr);
-
-	AccelerationStructureBuffers newBLAS = CreateBottomLevelAS(
-		{ {newModel.m_vertexBuffer.Get(), (uint32_t)newModel.vertices.size()} },
-		{ {newModel.m_indexBuffer.Get(),  (uint32_t)newModel.indices.size()} }
-	);
-
-	BLASes.push_back(newBLAS);
-	m_bottomLevelAS.clear();
-	for (auto& b : BLASes) m_bottomLevelAS.push_back(b.pResult);
 
 	if (!reloading) {
 		ModelDescriptions.push_back(newDescription);
+		m_animationTracksDirty = true;
 	}
 	Models.push_back(newModel);
+	RefreshMeshTable();
 
 	ModelInstanceGPU newModelInstance;
 	newModelInstance.id = newModel.id;
 	newModelInstance.albedo = newDescription.albedo;
 	newModelInstance.roughness = newDescription.roughness;
+	newModelInstance.smallIndices = newModel.mesh->indexFormat == DXGI_FORMAT_R16_UINT;
 	ModelsShaderData.push_back(newModelInstance);
 
 	CreateModelDataBuffer();
+	timer.Lap("model data");
 
-	m_instances.clear();
-	for (size_t i = 0; i < BLASes.size(); i++) {
-		XMMATRIX tr = XMMatrixIdentity();
-		if (i < ModelDescriptions.size()) {
-			XMMATRIX sc = XMMatrixScaling(ModelDescriptions[i].scale.x, ModelDescriptions[i].scale.y, ModelDescriptions[i].scale.z);
-			XMMATRIX rot = XMMatrixRotationRollPitchYaw(degreesToRadians(ModelDescriptions[i].rotation.x), degreesToRadians(ModelDescriptions[i].rotation.y), degreesToRadians(ModelDescriptions[i].rotation.z));
-			XMMATRIX trans = XMMatrixTranslation(ModelDescriptions[i].position.x, ModelDescriptions[i].position.y, ModelDescriptions[i].position.z);
-			tr = sc * rot * trans;
-		}
-		m_instances.push_back({ BLASes[i].pResult.Get(), tr });
-	}
-
+	RebuildInstanceList();
 	CreateTopLevelAS(m_instances, false);
+	timer.Lap("TLAS");
 
-
+	// The raytracing pipeline does not depend on the scene and stays as is
 	CreateShaderResourceHeap();
-	CreateRaytracingPipeline();
+	timer.Lap("heap");
 	CreateShaderBindingTable();
+	timer.Lap("SBT");
 
 	ThrowIfFailed(m_commandList->Close());
 	ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
 	m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
 
 	WaitForPreviousFrame();
+	timer.Lap("GPU");
+	timer.Print();
 	BLASChanged = true;
 }
 
@@ -362,7 +1025,9 @@ void D3D12HelloTriangle::RemoveModel(int index) {
 
 	if (index < 0 || index >= Models.size()) return;
 
+	StageTimer timer("RemoveModel " + std::to_string(index));
 	WaitForPreviousFrame();
+	timer.Lap("wait");
 
 	m_sceneTriangleCount -= Models[index].triangleCount;
 
@@ -371,26 +1036,24 @@ void D3D12HelloTriangle::RemoveModel(int index) {
 
 	ModelDescriptions.erase(ModelDescriptions.begin() + index);
 	for (int i = 0; i < ModelDescriptions.size(); i++) ModelDescriptions[i].id = i;
+	m_animationTracksDirty = true;
 
+	// Dropping the instance releases its mesh once no other instance uses it
 	Models.erase(Models.begin() + index);
 	for (int i = 0; i < Models.size(); i++) Models[i].id = i;
-
-	BLASes.erase(BLASes.begin() + index);
-
-	m_bottomLevelAS.clear();
-	for (auto& b : BLASes) m_bottomLevelAS.push_back(b.pResult);
+	RefreshMeshTable();
 
 	UpdateModelDataBuffer();
+	timer.Lap("model data");
 
-	m_instances.clear();
-	for (size_t i = 0; i < BLASes.size(); i++) {
-		m_instances.push_back({ BLASes[i].pResult.Get(), XMMatrixIdentity() });
-	}
+	RebuildInstanceList();
 	CreateTopLevelAS(m_instances, false);
+	timer.Lap("TLAS");
 
 	CreateShaderResourceHeap();
-	CreateRaytracingPipeline();
+	timer.Lap("heap");
 	CreateShaderBindingTable();
+	timer.Lap("SBT");
 
 	ThrowIfFailed(m_commandAllocator->Reset());
 	ThrowIfFailed(m_commandList->Reset(m_commandAllocator.Get(), m_pipelineState.Get()));
@@ -400,33 +1063,115 @@ void D3D12HelloTriangle::RemoveModel(int index) {
 	m_commandQueue->ExecuteCommandLists(1, ppCommandLists);
 
 	WaitForPreviousFrame();
+	timer.Lap("GPU");
+	timer.Print();
 
 	BLASChanged = true;
 }
 
 //for loading a scene based on a json file
-std::vector<D3D12HelloTriangle::ModelDesc> D3D12HelloTriangle::LoadScene(const std::string& filename)
+std::vector<D3D12HelloTriangle::ModelDesc> D3D12HelloTriangle::LoadScene(const std::string& filename, bool applyCamera)
 {
-	std::ifstream file(filename);
-	if (!file.is_open())
+	std::string path = filename;
+	FileStamp stamp;
+	if (!GetFileStamp(path, stamp))
 	{
 		std::wstring widePath = Utf8ToWString(filename);
-		if (!widePath.empty())
-		{
-			std::wstring fullPathW = GetAssetFullPath(widePath.c_str());
-			std::string fullPath = WStringToUtf8(fullPathW);
-			file.open(fullPath);
-			if (!file.is_open())
-			{
-				m_sceneLoadError = "Cannot open scene file: " + filename;
-				return ModelDescriptions;
-			}
-		}
-		else
+		if (widePath.empty())
 		{
 			m_sceneLoadError = "Cannot open scene file: " + filename;
 			return ModelDescriptions;
 		}
+		path = WStringToUtf8(GetAssetFullPath(widePath.c_str()));
+	}
+
+	SceneData scene;
+	std::string error;
+	if (!ReadSceneFile(path, scene, error))
+	{
+		m_sceneLoadError = error;
+		return ModelDescriptions;
+	}
+
+	//Camera
+	if (scene.hasCamera && applyCamera)
+	{
+		nv_helpers_dx12::Manipulator& manip = nv_helpers_dx12::CameraManip;
+		manip.setLookat(
+			glm::vec3(scene.cameraEye.x, scene.cameraEye.y, scene.cameraEye.z),
+			glm::vec3(scene.cameraCenter.x, scene.cameraCenter.y, scene.cameraCenter.z),
+			glm::vec3(scene.cameraUp.x, scene.cameraUp.y, scene.cameraUp.z)
+		);
+	}
+
+	//Light
+	if (scene.hasLight)
+	{
+		m_lightData = scene.light;
+		UpdateLightsBuffer();
+	}
+
+	std::vector<D3D12HelloTriangle::ModelDesc> result;
+	result.reserve(scene.models.size());
+
+	for (auto& desc : scene.models)
+	{
+		// glTF scenes become one instance per node, sharing the meshes
+		const size_t firstNode = result.size();
+		if (m_meshImportOptions.nativeGltf && desc.animationFrames.empty() && ExpandGltfNodes(desc, result))
+		{
+			for (size_t i = firstNode; i < result.size(); i++)
+				result[i].id = static_cast<int>(i);
+			continue;
+		}
+
+		result.push_back(std::move(desc));
+	}
+
+	return result;
+}
+
+void D3D12HelloTriangle::SaveScene(const std::string& filename)
+{
+	SceneData scene;
+	scene.models = ModelDescriptions;
+
+	// Materials are edited on the shader data
+	for (size_t i = 0; i < scene.models.size() && i < ModelsShaderData.size(); i++)
+	{
+		auto& m = scene.models[i];
+		const auto& m2 = ModelsShaderData[i];
+		m.albedo = m2.albedo;
+		m.emission = static_cast<int>(m2.emission);
+		m.roughness = m2.roughness;
+		m.isMetallic = m2.isMetallic;
+		m.isGlass = m2.isGlass;
+		m.IOR = m2.IOR;
+	}
+
+	//Camera
+	glm::vec3 eye, center, up;
+	nv_helpers_dx12::CameraManip.getLookat(eye, center, up);
+	scene.hasCamera = true;
+	scene.cameraEye = { eye.x, eye.y, eye.z };
+	scene.cameraCenter = { center.x, center.y, center.z };
+	scene.cameraUp = { up.x, up.y, up.z };
+
+	//Light
+	scene.hasLight = true;
+	scene.light = m_lightData;
+
+	if (!WriteSceneFile(filename, scene))
+		throw std::runtime_error("Cannot write scene file: " + filename);
+}
+
+bool D3D12HelloTriangle::ReadSceneJson(const std::string& path, SceneData& outScene, std::string& outError)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		outError = "Cannot open scene file: " + path;
+		return false;
 	}
 
 	json j;
@@ -436,22 +1181,20 @@ std::vector<D3D12HelloTriangle::ModelDesc> D3D12HelloTriangle::LoadScene(const s
 	}
 	catch (const json::parse_error& e)
 	{
-		m_sceneLoadError = std::string("Scene JSON parse error: ") + e.what();
-		return ModelDescriptions;
+		outError = std::string("Scene JSON parse error: ") + e.what();
+		return false;
 	}
 
 	//Camera
 	if (j.contains("camera"))
 	{
-		nv_helpers_dx12::Manipulator& manip = nv_helpers_dx12::CameraManip;
 		auto eye = j["camera"]["eye"];
 		auto center = j["camera"]["center"];
 		auto up = j["camera"]["up"];
-		manip.setLookat(
-			glm::vec3(eye[0], eye[1], eye[2]),
-			glm::vec3(center[0], center[1], center[2]),
-			glm::vec3(up[0], up[1], up[2])
-		);
+		outScene.hasCamera = true;
+		outScene.cameraEye = { eye[0], eye[1], eye[2] };
+		outScene.cameraCenter = { center[0], center[1], center[2] };
+		outScene.cameraUp = { up[0], up[1], up[2] };
 	}
 
 	//Light
@@ -459,16 +1202,17 @@ std::vector<D3D12HelloTriangle::ModelDesc> D3D12HelloTriangle::LoadScene(const s
 	{
 		auto pos = j["light"]["position"];
 		auto color = j["light"]["color"];
-		m_lightData.position = { pos[0], pos[1], pos[2] };
-		m_lightData.color = { color[0], color[1], color[2] };
-		m_lightData.intensity = j["light"]["intensity"];
-		m_lightData.type = j["light"]["type"];
-		UpdateLightsBuffer();
+		outScene.hasLight = true;
+		outScene.light.position = { pos[0], pos[1], pos[2] };
+		outScene.light.color = { color[0], color[1], color[2] };
+		outScene.light.intensity = j["light"]["intensity"];
+		outScene.light.type = j["light"]["type"];
 	}
 
-	std::vector<D3D12HelloTriangle::ModelDesc> result;
+	auto& models = j["models"];
+	outScene.models.reserve(models.size());
 
-	for (auto& m : j["models"])
+	for (auto& m : models)
 	{
 		D3D12HelloTriangle::ModelDesc desc;
 		desc.id = m["id"];
@@ -559,41 +1303,63 @@ std::vector<D3D12HelloTriangle::ModelDesc> D3D12HelloTriangle::LoadScene(const s
 				}
 				else
 					frame.scale = prevScale;
+				if (af.contains("tangent"))
+				{
+					auto t = af["tangent"];
+					frame.tangent = { t[0], t[1], t[2] };
+				}
 				desc.animationFrames.push_back(frame);
 			}
 		}
 
-		result.push_back(desc);
+		if (m.contains("animationFrames"))
+		{
+			auto& animation = m["animationFrames"];
+			if (animation.contains("rotationInterpolation") &&
+				!ParseInterpolation(animation["rotationInterpolation"].get<std::string>(), desc.rotationInterpolation))
+			{
+				outError = "Scene JSON error: unknown rotationInterpolation '" + animation["rotationInterpolation"].get<std::string>() + "'";
+				return false;
+			}
+			if (animation.contains("positionInterpolation") &&
+				!ParseInterpolation(animation["positionInterpolation"].get<std::string>(), desc.positionInterpolation))
+			{
+				outError = "Scene JSON error: unknown positionInterpolation '" + animation["positionInterpolation"].get<std::string>() + "'";
+				return false;
+			}
+		}
+
+		outScene.models.push_back(std::move(desc));
 	}
 
-	return result;
+	return true;
 }
 
-void D3D12HelloTriangle::SaveScene(const std::string& filename)
+bool D3D12HelloTriangle::WriteSceneJson(const std::string& path, const SceneData& scene)
 {
 	json j;
 	j["models"] = json::array();
 
-	for (int i = 0; i < ModelDescriptions.size(); i++)
+	for (const auto& m : scene.models)
 	{
-		auto m = ModelDescriptions[i];
-		auto m2 = ModelsShaderData[i];
 		json jm;
 		jm["id"] = m.id;
 		jm["path"] = m.path;
 		jm["position"] = { m.position.x, m.position.y, m.position.z };
 		jm["rotation"] = { m.rotation.x, m.rotation.y, m.rotation.z };
 		jm["scale"] = { m.scale.x, m.scale.y, m.scale.z };
-		jm["albedo"] = { m2.albedo.x, m2.albedo.y, m2.albedo.z };
-		jm["emission"] = m2.emission;
-		jm["roughness"] = m2.roughness;
-		jm["isMetallic"] = m2.isMetallic;
-		jm["isGlass"] = m2.isGlass;
-		jm["IOR"] = m2.IOR;
+		jm["albedo"] = { m.albedo.x, m.albedo.y, m.albedo.z };
+		jm["emission"] = m.emission;
+		jm["roughness"] = m.roughness;
+		jm["isMetallic"] = m.isMetallic;
+		jm["isGlass"] = m.isGlass;
+		jm["IOR"] = m.IOR;
 
 		if (m.animationFrames.size() > 0)
 		{
 			jm["animationFrames"]["frames"] = json::array();
+			jm["animationFrames"]["rotationInterpolation"] = InterpolationName(m.rotationInterpolation);
+			jm["animationFrames"]["positionInterpolation"] = InterpolationName(m.positionInterpolation);
 			for (auto& af : m.animationFrames)
 			{
 				json jaf;
@@ -601,6 +1367,8 @@ void D3D12HelloTriangle::SaveScene(const std::string& filename)
 				jaf["position"] = { af.position.x, af.position.y, af.position.z };
 				jaf["rotation"] = { af.rotation.x, af.rotation.y, af.rotation.z };
 				jaf["scale"] = { af.scale.x, af.scale.y, af.scale.z };
+				if (m.positionInterpolation == PositionInterpolation::Hermite)
+					jaf["tangent"] = { af.tangent.x, af.tangent.y, af.tangent.z };
 				jm["animationFrames"]["frames"].push_back(jaf);
 			}
 		}
@@ -609,21 +1377,27 @@ void D3D12HelloTriangle::SaveScene(const std::string& filename)
 	}
 
 	//Camera
-	nv_helpers_dx12::Manipulator& manip = nv_helpers_dx12::CameraManip;
-	glm::vec3 eye, center, up;
-	nv_helpers_dx12::CameraManip.getLookat(eye, center, up);
-	j["camera"]["eye"] = { eye.x, eye.y, eye.z };
-	j["camera"]["center"] = { center.x, center.y, center.z };
-	j["camera"]["up"] = { up.x, up.y, up.z };
+	if (scene.hasCamera)
+	{
+		j["camera"]["eye"] = { scene.cameraEye.x, scene.cameraEye.y, scene.cameraEye.z };
+		j["camera"]["center"] = { scene.cameraCenter.x, scene.cameraCenter.y, scene.cameraCenter.z };
+		j["camera"]["up"] = { scene.cameraUp.x, scene.cameraUp.y, scene.cameraUp.z };
+	}
 
 	//Light
-	j["light"]["position"] = { m_lightData.position.x, m_lightData.position.y, m_lightData.position.z };
-	j["light"]["intensity"] = m_lightData.intensity;
-	j["light"]["color"] = { m_lightData.color.x, m_lightData.color.y, m_lightData.color.z };
-	j["light"]["type"] = m_lightData.type;
+	if (scene.hasLight)
+	{
+		j["light"]["position"] = { scene.light.position.x, scene.light.position.y, scene.light.position.z };
+		j["light"]["intensity"] = scene.light.intensity;
+		j["light"]["color"] = { scene.light.color.x, scene.light.color.y, scene.light.color.z };
+		j["light"]["type"] = scene.light.type;
+	}
 
-	std::ofstream file(filename);
+	std::ofstream file(path);
+	if (!file.is_open())
+		return false;
 	file << j.dump(4);
+	return static_cast<bool>(file);
 }
 
 void D3D12HelloTriangle::InitializeShaderData(int i)
@@ -635,4 +1409,5 @@ void D3D12HelloTriangle::InitializeShaderData(int i)
 	ModelsShaderData[i].isGlass = ModelDescriptions[i].isGlass;
 	ModelsShaderData[i].isMetallic = ModelDescriptions[i].isMetallic;
 	ModelsShaderData[i].IOR = ModelDescriptions[i].IOR;
+	ModelsShaderData[i].smallIndices = Models[i].mesh->indexFormat == DXGI_FORMAT_R16_UINT;
 }
\ No newline at end of file
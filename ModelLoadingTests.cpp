@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "TestUtils.h"
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <set>
+
+// Resolves the meshes of every Models/ExampleScene/*.json through a mesh
+// registry, as PreloadMeshes does, and parses them without a device. Checks
+// one mesh per distinct path shared by all its instances, the memory saved
+// against a copy per instance, reuse while the meshes are held and release
+// once they are not.
+int D3D12HelloTriangle::RunMeshSharingCheck()
+{
+	TestChecks check;
+
+	std::vector<std::string> scenes;
+	FindFiles("Models/ExampleScene/", ".json", scenes);
+	if (scenes.empty())
+	{
+		std::cout << "No scenes found in Models/ExampleScene/\n";
+		return 1;
+	}
+
+	for (const auto& scenePath : scenes)
+	{
+		SceneData scene;
+		std::string error;
+		if (!ReadSceneFile(scenePath, scene, error))
+		{
+			std::cout << "FAIL " << error << "\n";
+			check.Fail();
+			continue;
+		}
+
+		std::unordered_map<std::string, std::weak_ptr<MeshGeometry> > registry;
+		std::vector<MeshGeometry*> parsed;
+		std::vector<std::shared_ptr<MeshGeometry> > meshes = ResolveMeshes(registry, scene.models, parsed);
+		ParseMeshesParallel(parsed, 0, MeshImportOptions());
+
+		std::map<std::string, size_t> pathCounts;
+		for (const auto& desc : scene.models)
+			pathCounts[desc.path]++;
+
+		bool shared = meshes.size() == scene.models.size();
+		std::map<std::string, const MeshGeometry*> meshOfPath;
+		std::set<const MeshGeometry*> distinct;
+		for (size_t i = 0; shared && i < meshes.size(); i++)
+		{
+			auto inserted = meshOfPath.insert(std::make_pair(scene.models[i].path, meshes[i].get()));
+			shared = inserted.first->second == meshes[i].get() && meshes[i]->path == scene.models[i].path;
+			distinct.insert(meshes[i].get());
+		}
+
+		uint64_t expectedSaving = 0;
+		for (const auto& entry : pathCounts)
+		{
+			const MeshGeometry* mesh = meshOfPath[entry.first];
+			if (mesh)
+				expectedSaving += (entry.second - 1) * (static_cast<uint64_t>(mesh->vertexCount) * sizeof(Vertex) + static_cast<uint64_t>(mesh->indexCount) * sizeof(uint32_t));
+		}
+
+		std::vector<const MeshGeometry*> instanceMeshes;
+		for (const auto& mesh : meshes)
+			instanceMeshes.push_back(mesh.get());
+		const MeshSharingStats stats = MeasureMeshSharing(instanceMeshes);
+
+		std::cout << scenePath << ": " << stats.uniqueMeshes << " unique / " << stats.instances << " instances, geometry "
+			<< stats.sharedBytes / 1024 << " KB (saved " << (stats.unsharedBytes - stats.sharedBytes) / 1024 << " KB)\n";
+		check(shared && distinct.size() == pathCounts.size(), "instances of a path share one mesh, other paths do not");
+		check(parsed.size() == pathCounts.size(), "each distinct path is parsed once");
+		check(stats.uniqueMeshes == pathCounts.size() && stats.instances == scene.models.size(),
+			"unique mesh and instance counts");
+		check(stats.unsharedBytes - stats.sharedBytes == expectedSaving, "memory saved is one copy per extra instance");
+
+		// While the meshes are held a second load of the scene reuses all of them
+		std::vector<MeshGeometry*> reparsed;
+		std::vector<std::shared_ptr<MeshGeometry> > again = ResolveMeshes(registry, scene.models, reparsed);
+		check(reparsed.empty() && again == meshes, "a reload while the meshes are held parses nothing");
+
+		// The registry only observes; once nothing holds them they are gone
+		std::weak_ptr<MeshGeometry> watched = meshes.empty() ? std::weak_ptr<MeshGeometry>() : meshes[0];
+		meshes.clear();
+		again.clear();
+		check(watched.expired(), "meshes are released with their last instance");
+		reparsed.clear();
+		std::vector<std::shared_ptr<MeshGeometry> > fresh = ResolveMeshes(registry, scene.models, reparsed);
+		check(reparsed.size() == pathCounts.size(), "and a later load registers them anew");
+	}
+
+	return check.Finish("mesh sharing");
+}
+
+namespace
+{
+	// LoadTriangleIndices of shaders/VertexFetch.hlsl on the CPU. ByteAddressBuffer
+	// loads past the end return zeros on the GPU, so they fail here instead.
+	bool LoadTriangleIndices(const std::vector<uint8_t>& buffer, uint32_t primitiveIndex, bool smallIndices, uint32_t outIndices[3])
+	{
+		auto load = [&buffer](uint32_t offset, uint32_t& outValue) {
+			if (offset % 4 != 0 || offset + 4 > buffer.size())
+				return false;
+			memcpy(&outValue, buffer.data() + offset, 4);
+			return true;
+		};
+
+		if (!smallIndices)
+			return load(primitiveIndex * 12, outIndices[0]) && load(primitiveIndex * 12 + 4, outIndices[1]) &&
+				load(primitiveIndex * 12 + 8, outIndices[2]);
+
+		const uint32_t offset = primitiveIndex * 6;
+		uint32_t words[2];
+		if (!load(offset & ~3u, words[0]) || !load((offset & ~3u) + 4, words[1]))
+			return false;
+		if ((offset & 2) == 0)
+		{
+			outIndices[0] = words[0] & 0xFFFF;
+			outIndices[1] = words[0] >> 16;
+			outIndices[2] = words[1] & 0xFFFF;
+		}
+		else
+		{
+			outIndices[0] = words[0] >> 16;
+			outIndices[1] = words[1] & 0xFFFF;
+			outIndices[2] = words[1] >> 16;
+		}
+		return true;
+	}
+}
+
+// Packs the index lists CreateMeshBuffers uploads, full mesh and LODs, of every
+// bundled model at both widths and of generated meshes around the 16-bit limit,
+// and reads every triangle back the way the hit shaders do.
+int D3D12HelloTriangle::RunIndexPackingCheck()
+{
+	TestChecks check;
+
+	auto roundTrips = [](const std::vector<uint32_t>& indices, DXGI_FORMAT format) {
+		std::vector<uint8_t> buffer;
+		PackIndices(indices, format, buffer);
+		const size_t indexSize = format == DXGI_FORMAT_R16_UINT ? sizeof(uint16_t) : sizeof(uint32_t);
+		if (buffer.size() % 4 != 0 || buffer.size() < indices.size() * indexSize || buffer.size() > indices.size() * indexSize + 2)
+			return false;
+		for (uint32_t triangle = 0; triangle < indices.size() / 3; triangle++)
+		{
+			uint32_t loaded[3];
+			if (!LoadTriangleIndices(buffer, triangle, format == DXGI_FORMAT_R16_UINT, loaded) ||
+				loaded[0] != indices[triangle * 3] || loaded[1] != indices[triangle * 3 + 1] || loaded[2] != indices[triangle * 3 + 2])
+				return false;
+		}
+		return true;
+	};
+
+	std::vector<std::string> paths;
+	FindFiles("Models/", ".obj", paths);
+	FindFiles("Models/", ".gltf", paths);
+	if (paths.empty())
+	{
+		std::cout << "No models found in Models/\n";
+		return 1;
+	}
+
+	for (const auto& path : paths)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		std::vector<MeshLod> lods;
+		LoadModel(path, vertices, indices, MeshImportOptions(), &lods);
+		if (vertices.empty())
+		{
+			std::cout << path << ": load failed\n";
+			check.Fail();
+			continue;
+		}
+
+		std::vector<uint32_t> allIndices(indices);
+		for (const MeshLod& lod : lods)
+			allIndices.insert(allIndices.end(), lod.indices.begin(), lod.indices.end());
+
+		const DXGI_FORMAT format = ChooseIndexFormat(vertices.size());
+		std::cout << path << ": " << vertices.size() << " vertices, " << allIndices.size() / 3 << " triangles with "
+			<< lods.size() << " LODs, " << (format == DXGI_FORMAT_R16_UINT ? 16 : 32) << "-bit\n";
+		check(roundTrips(allIndices, DXGI_FORMAT_R32_UINT), "32-bit indices read back");
+		if (format == DXGI_FORMAT_R16_UINT)
+			check(roundTrips(allIndices, DXGI_FORMAT_R16_UINT), "16-bit indices read back");
+	}
+
+	// Random triangles over 0x10000 vertices, the most 16-bit indices can address,
+	// with both odd and even triangle counts so the padding is exercised
+	uint32_t seed = 12345u;
+	for (uint32_t triangleCount = 1; triangleCount <= 4; triangleCount++)
+	{
+		std::vector<uint32_t> small(triangleCount * 3);
+		for (uint32_t& index : small)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			index = seed >> 16;
+		}
+		check(roundTrips(small, DXGI_FORMAT_R16_UINT) && roundTrips(small, DXGI_FORMAT_R32_UINT),
+			std::to_string(triangleCount) + " triangle(s) read back at both widths");
+	}
+
+	// A mesh of exactly 0x10000 vertices that uses every one of them, ending
+	// on an odd triangle count, then the same with one vertex more
+	std::vector<uint32_t> limit(3 * 50001);
+	for (uint32_t i = 0; i < limit.size(); i++)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		limit[i] = i < 0x10000 ? i : seed >> 16;
+	}
+	limit.back() = 0xFFFF;
+	const DXGI_FORMAT limitFormat = ChooseIndexFormat(0x10000);
+	check(limitFormat == DXGI_FORMAT_R16_UINT, "a mesh of exactly 0x10000 vertices gets 16-bit indices");
+	check(roundTrips(limit, limitFormat), "and all its indices, 0xFFFF included, read back");
+	const DXGI_FORMAT overFormat = ChooseIndexFormat(0x10001);
+	limit.back() = 0x10000;
+	check(overFormat == DXGI_FORMAT_R32_UINT, "one more vertex needs 32-bit indices");
+	check(roundTrips(limit, overFormat), "which read back");
+
+	return check.Finish("index packing");
+}
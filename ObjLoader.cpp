@@ -0,0 +1,593 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+// Native Wavefront OBJ/MTL reader used by LoadModel instead of Assimp for .obj
+// files. It produces the same geometry as the Assimp path (Triangulate,
+// ConvertToLeftHanded, flat GenNormals when the file has no normals,
+// JoinIdenticalVertices, diffuse color per material), but reads the memory
+// mapped file directly: large files are split into line ranges that are
+// parsed on separate threads, then merged in file order.
+
+namespace
+{
+	// Files smaller than this are parsed on the calling thread
+	const size_t kObjChunkSize = 1 << 20;
+	const int32_t kNoIndex = INT_MIN;
+
+	// Assimp's default diffuse for faces without a (known) material
+	const DirectX::XMFLOAT4 kObjDefaultColor = { 0.6f, 0.6f, 0.6f, 1.0f };
+
+	const double kPowersOf10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	inline bool IsSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool IsDigit(char c)
+	{
+		return static_cast<unsigned>(c - '0') < 10;
+	}
+
+	inline const char* SkipSpaces(const char* p, const char* end)
+	{
+		while (p < end && IsSpace(*p))
+			p++;
+		return p;
+	}
+
+	// Decimal float without locale handling or allocations. Up to 19
+	// significant digits are accumulated exactly, then scaled once.
+	const char* ParseFloat(const char* p, const char* end, float& out)
+	{
+		p = SkipSpaces(p, end);
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		uint64_t mantissa = 0;
+		int digits = 0;
+		int exponent = 0;
+		while (p < end && IsDigit(*p))
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (*p - '0');
+				if (mantissa != 0)
+					digits++;
+			}
+			else
+			{
+				exponent++;
+			}
+			p++;
+		}
+		if (p < end && *p == '.')
+		{
+			p++;
+			while (p < end && IsDigit(*p))
+			{
+				if (digits < 19)
+				{
+					mantissa = mantissa * 10 + (*p - '0');
+					if (mantissa != 0)
+						digits++;
+					exponent--;
+				}
+				p++;
+			}
+		}
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+				negativeExponent = *p++ == '-';
+			int value = 0;
+			while (p < end && IsDigit(*p))
+			{
+				if (value < 10000)
+					value = value * 10 + (*p - '0');
+				p++;
+			}
+			exponent += negativeExponent ? -value : value;
+		}
+
+		double value = static_cast<double>(mantissa);
+		if (exponent < 0)
+			value = exponent >= -22 ? value / kPowersOf10[-exponent] : value * std::pow(10.0, exponent);
+		else if (exponent > 0)
+			value = exponent <= 22 ? value * kPowersOf10[exponent] : value * std::pow(10.0, exponent);
+
+		out = static_cast<float>(negative ? -value : value);
+		return p;
+	}
+
+	// Leaves p unchanged and clears found when there is no integer
+	const char* ParseInt(const char* p, const char* end, int32_t& out, bool& found)
+	{
+		bool negative = false;
+		const char* start = p;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+
+		int64_t value = 0;
+		found = false;
+		while (p < end && IsDigit(*p))
+		{
+			if (value < INT_MAX)
+				value = value * 10 + (*p - '0');
+			found = true;
+			p++;
+		}
+		if (!found)
+			return start;
+		out = static_cast<int32_t>(negative ? -value : value);
+		return p;
+	}
+
+	std::string ParseName(const char* p, const char* end)
+	{
+		p = SkipSpaces(p, end);
+		while (end > p && IsSpace(*(end - 1)))
+			end--;
+		return std::string(p, end);
+	}
+
+	bool StartsWithKeyword(const char* p, const char* end, const char* keyword, size_t length)
+	{
+		return static_cast<size_t>(end - p) > length && memcmp(p, keyword, length) == 0 && IsSpace(p[length]);
+	}
+
+	struct ObjCorner
+	{
+		int32_t position; // 0-based; chunk relative when relativePosition is set
+		int32_t texcoord; // 0-based or kNoIndex; chunk relative when relativeTexcoord is set
+		int32_t normal;   // 0-based or kNoIndex; chunk relative when relativeNormal is set
+		bool relativePosition;
+		bool relativeTexcoord;
+		bool relativeNormal;
+	};
+
+	struct ObjFace
+	{
+		uint32_t firstCorner;
+		uint32_t cornerCount;
+		int32_t material; // index into ObjChunk::materials, -1 keeps the previous chunk's
+	};
+
+	struct ObjChunk
+	{
+		std::vector<DirectX::XMFLOAT3> positions;
+		std::vector<DirectX::XMFLOAT2> texcoords;
+		std::vector<DirectX::XMFLOAT3> normals;
+		std::vector<ObjCorner> corners;
+		std::vector<ObjFace> faces;
+		std::vector<std::string> materials; // usemtl names in order of appearance
+		std::vector<std::string> materialLibraries;
+	};
+
+	void ParseObjChunk(const char* p, const char* end, ObjChunk& chunk)
+	{
+		int32_t currentMaterial = -1;
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (!lineEnd)
+				lineEnd = end;
+
+			const char* line = SkipSpaces(p, lineEnd);
+			if (lineEnd - line >= 2)
+			{
+				if (line[0] == 'v' && IsSpace(line[1]))
+				{
+					DirectX::XMFLOAT3 position;
+					const char* q = ParseFloat(line + 1, lineEnd, position.x);
+					q = ParseFloat(q, lineEnd, position.y);
+					ParseFloat(q, lineEnd, position.z);
+					chunk.positions.push_back(position);
+				}
+				else if (line[0] == 'v' && line[1] == 'n')
+				{
+					DirectX::XMFLOAT3 normal;
+					const char* q = ParseFloat(line + 2, lineEnd, normal.x);
+					q = ParseFloat(q, lineEnd, normal.y);
+					ParseFloat(q, lineEnd, normal.z);
+					chunk.normals.push_back(normal);
+				}
+				else if (line[0] == 'v' && line[1] == 't')
+				{
+					DirectX::XMFLOAT2 texcoord;
+					const char* q = ParseFloat(line + 2, lineEnd, texcoord.x);
+					ParseFloat(q, lineEnd, texcoord.y);
+					chunk.texcoords.push_back(texcoord);
+				}
+				else if (line[0] == 'f' && IsSpace(line[1]))
+				{
+					ObjFace face;
+					face.firstCorner = static_cast<uint32_t>(chunk.corners.size());
+					face.material = currentMaterial;
+
+					const char* q = SkipSpaces(line + 1, lineEnd);
+					while (q < lineEnd)
+					{
+						// v, v/vt, v//vn or v/vt/vn
+						ObjCorner corner = { kNoIndex, kNoIndex, kNoIndex, false, false, false };
+						int32_t value = 0;
+						bool found = false;
+						q = ParseInt(q, lineEnd, value, found);
+						if (!found)
+							break;
+						corner.relativePosition = value < 0;
+						corner.position = value < 0 ? static_cast<int32_t>(chunk.positions.size()) + value : value - 1;
+
+						if (q < lineEnd && *q == '/')
+						{
+							q++;
+							q = ParseInt(q, lineEnd, value, found);
+							if (found)
+							{
+								corner.relativeTexcoord = value < 0;
+								corner.texcoord = value < 0 ? static_cast<int32_t>(chunk.texcoords.size()) + value : value - 1;
+							}
+							if (q < lineEnd && *q == '/')
+							{
+								q++;
+								q = ParseInt(q, lineEnd, value, found);
+								if (found)
+								{
+									corner.relativeNormal = value < 0;
+									corner.normal = value < 0 ? static_cast<int32_t>(chunk.normals.size()) + value : value - 1;
+								}
+							}
+						}
+						chunk.corners.push_back(corner);
+
+						while (q < lineEnd && !IsSpace(*q))
+							q++;
+						q = SkipSpaces(q, lineEnd);
+					}
+
+					face.cornerCount = static_cast<uint32_t>(chunk.corners.size()) - face.firstCorner;
+					chunk.faces.push_back(face);
+				}
+				else if (StartsWithKeyword(line, lineEnd, "usemtl", 6))
+				{
+					currentMaterial = static_cast<int32_t>(chunk.materials.size());
+					chunk.materials.push_back(ParseName(line + 6, lineEnd));
+				}
+				else if (StartsWithKeyword(line, lineEnd, "mtllib", 6))
+				{
+					chunk.materialLibraries.push_back(ParseName(line + 6, lineEnd));
+				}
+			}
+
+			p = lineEnd + 1;
+		}
+	}
+
+	// Diffuse colors (Kd) of the materials of an MTL file
+	void ParseMtlFile(const std::string& path, std::unordered_map<std::string, DirectX::XMFLOAT4>& colors)
+	{
+		std::vector<char> contents;
+		if (!ReadWholeFile(path, contents))
+			return;
+
+		const char* p = contents.data();
+		const char* end = p + contents.size();
+		std::string currentMaterial;
+		bool inMaterial = false;
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+			if (!lineEnd)
+				lineEnd = end;
+
+			const char* line = SkipSpaces(p, lineEnd);
+			if (StartsWithKeyword(line, lineEnd, "newmtl", 6))
+			{
+				currentMaterial = ParseName(line + 6, lineEnd);
+				colors[currentMaterial] = kObjDefaultColor;
+				inMaterial = true;
+			}
+			else if (inMaterial && lineEnd - line > 2 && line[0] == 'K' && line[1] == 'd' && IsSpace(line[2]))
+			{
+				DirectX::XMFLOAT4& color = colors[currentMaterial];
+				const char* q = ParseFloat(line + 2, lineEnd, color.x);
+				q = ParseFloat(q, lineEnd, color.y);
+				ParseFloat(q, lineEnd, color.z);
+			}
+			p = lineEnd + 1;
+		}
+	}
+
+	// Generated flat normals are keyed in steps of 1e-4, so the corners of
+	// coplanar faces join like aiProcess_JoinIdenticalVertices joins them
+	const float kFlatNormalScale = 1e4f;
+
+	// The renderer has no texture coordinates, but Assimp keeps corners with
+	// different ones apart, so they are part of the key. A texcoord is keyed
+	// by the first vt line with its value, as JoinIdenticalVertices compares
+	// values rather than indices.
+	struct ObjVertexKey
+	{
+		int32_t position;
+		int32_t texcoord;      // kNoIndex without a vt index
+		int32_t normal;        // kNoIndex for a generated flat normal
+		int32_t flatNormal[3]; // quantized generated normal, zero otherwise
+		uint32_t material;
+
+		bool operator==(const ObjVertexKey& other) const
+		{
+			return position == other.position && texcoord == other.texcoord && normal == other.normal && material == other.material &&
+				flatNormal[0] == other.flatNormal[0] && flatNormal[1] == other.flatNormal[1] && flatNormal[2] == other.flatNormal[2];
+		}
+	};
+
+	struct ObjVertexKeyHash
+	{
+		size_t operator()(const ObjVertexKey& key) const
+		{
+			uint64_t h = static_cast<uint32_t>(key.position) * 0x9E3779B97F4A7C15ull;
+			h ^= (static_cast<uint64_t>(static_cast<uint32_t>(key.normal)) << 20) ^ key.material;
+			h = (h ^ static_cast<uint32_t>(key.texcoord)) * 0x100000001B3ull;
+			for (int i = 0; i < 3; i++)
+				h = (h ^ static_cast<uint32_t>(key.flatNormal[i])) * 0x100000001B3ull;
+			return static_cast<size_t>(h ^ (h >> 29));
+		}
+	};
+}
+
+bool D3D12HelloTriangle::IsObjFile(const std::string& path)
+{
+	return HasExtension(path, ".obj");
+}
+
+void D3D12HelloTriangle::FindObjMaterialLibraries(const std::string& modelPath, std::vector<std::string>& outPaths)
+{
+	MappedFile file;
+	if (!file.Open(modelPath))
+		return;
+
+	const std::string directory = DirectoryOf(modelPath);
+	const char* p = reinterpret_cast<const char*>(file.Data());
+	const char* end = p + file.Size();
+	while (p < end)
+	{
+		const char* lineEnd = static_cast<const char*>(memchr(p, '\n', end - p));
+		if (!lineEnd)
+			lineEnd = end;
+
+		const char* line = SkipSpaces(p, lineEnd);
+		if (StartsWithKeyword(line, lineEnd, "mtllib", 6))
+			outPaths.push_back(directory + ParseName(line + 6, lineEnd));
+		p = lineEnd + 1;
+	}
+}
+
+bool D3D12HelloTriangle::LoadObjModel(const std::string& modelPath,
+	std::vector<Vertex>& outVertices,
+	std::vector<uint32_t>& outIndices)
+{
+	MappedFile file;
+	if (!file.Open(modelPath))
+		return false;
+
+	const char* begin = reinterpret_cast<const char*>(file.Data());
+	const char* end = begin + file.Size();
+
+	// Split at line boundaries into roughly equal ranges
+	unsigned chunkCount = static_cast<unsigned>(file.Size() / kObjChunkSize) + 1;
+	unsigned hardwareThreads = std::thread::hardware_concurrency();
+	if (hardwareThreads > 0 && chunkCount > hardwareThreads)
+		chunkCount = hardwareThreads;
+
+	std::vector<const char*> chunkStarts;
+	chunkStarts.push_back(begin);
+	for (unsigned c = 1; c < chunkCount; c++)
+	{
+		const char* split = begin + file.Size() * c / chunkCount;
+		if (split <= chunkStarts.back())
+			continue;
+		const char* lineEnd = static_cast<const char*>(memchr(split, '\n', end - split));
+		if (!lineEnd)
+			break;
+		chunkStarts.push_back(lineEnd + 1);
+	}
+	chunkStarts.push_back(end);
+
+	std::vector<ObjChunk> chunks(chunkStarts.size() - 1);
+	if (chunks.size() == 1)
+	{
+		ParseObjChunk(begin, end, chunks[0]);
+	}
+	else
+	{
+		std::vector<std::thread> workers;
+		for (size_t c = 1; c < chunks.size(); c++)
+			workers.emplace_back(ParseObjChunk, chunkStarts[c], chunkStarts[c + 1], std::ref(chunks[c]));
+		ParseObjChunk(chunkStarts[0], chunkStarts[1], chunks[0]);
+		for (auto& worker : workers)
+			worker.join();
+	}
+
+	// Materials, resolved relative to the OBJ file
+	const std::string directory = DirectoryOf(modelPath);
+	std::unordered_map<std::string, DirectX::XMFLOAT4> materialColors;
+	for (const auto& chunk : chunks)
+	{
+		for (const auto& library : chunk.materialLibraries)
+			ParseMtlFile(directory + library, materialColors);
+	}
+
+	std::vector<DirectX::XMFLOAT4> colors(1, kObjDefaultColor);
+	std::unordered_map<std::string, uint32_t> colorSlots;
+	auto colorSlot = [&](const std::string& name) -> uint32_t {
+		auto slot = colorSlots.find(name);
+		if (slot != colorSlots.end())
+			return slot->second;
+		auto color = materialColors.find(name);
+		colors.push_back(color != materialColors.end() ? color->second : kObjDefaultColor);
+		return colorSlots[name] = static_cast<uint32_t>(colors.size() - 1);
+	};
+
+	size_t totalPositions = 0;
+	size_t totalTexcoords = 0;
+	size_t totalNormals = 0;
+	size_t totalCorners = 0;
+	for (const auto& chunk : chunks)
+	{
+		totalPositions += chunk.positions.size();
+		totalTexcoords += chunk.texcoords.size();
+		totalNormals += chunk.normals.size();
+		totalCorners += chunk.corners.size();
+	}
+
+	std::vector<DirectX::XMFLOAT3> positions;
+	std::vector<DirectX::XMFLOAT3> normals;
+	positions.reserve(totalPositions);
+	normals.reserve(totalNormals);
+
+	// Key of every vt line: the index of the first one with the same value
+	std::vector<int32_t> texcoordKeys;
+	std::unordered_map<uint64_t, int32_t> texcoordValues;
+	texcoordKeys.reserve(totalTexcoords);
+	texcoordValues.reserve(totalTexcoords);
+
+	std::unordered_map<ObjVertexKey, uint32_t, ObjVertexKeyHash> vertexLookup;
+	vertexLookup.reserve(totalCorners);
+	outVertices.reserve(outVertices.size() + totalCorners);
+	outIndices.reserve(outIndices.size() + totalCorners * 3);
+
+	auto makeVertex = [&](const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& normal, uint32_t material) {
+		// Left handed, like aiProcess_ConvertToLeftHanded
+		Vertex v = {};
+		v.position = { position.x, position.y, -position.z };
+		v.normal = { normal.x, normal.y, -normal.z };
+		v.color = colors[material];
+		v.roughness = 0.4f; // Default roughness
+		return v;
+	};
+
+	uint32_t currentMaterial = 0;
+	for (const auto& chunk : chunks)
+	{
+		int32_t chunkMaterial = -1;
+		const int32_t positionBase = static_cast<int32_t>(positions.size());
+		const int32_t texcoordBase = static_cast<int32_t>(texcoordKeys.size());
+		const int32_t normalBase = static_cast<int32_t>(normals.size());
+		positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+		normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+		for (const DirectX::XMFLOAT2& texcoord : chunk.texcoords)
+		{
+			uint32_t bits[2];
+			memcpy(bits, &texcoord, sizeof(bits));
+			const uint64_t value = (static_cast<uint64_t>(bits[0]) << 32) | bits[1];
+			texcoordKeys.push_back(texcoordValues.insert(std::make_pair(value, static_cast<int32_t>(texcoordKeys.size()))).first->second);
+		}
+
+		for (const auto& face : chunk.faces)
+		{
+			if (face.material != chunkMaterial)
+			{
+				chunkMaterial = face.material;
+				currentMaterial = colorSlot(chunk.materials[face.material]);
+			}
+			if (face.cornerCount < 3)
+				continue; // points and lines have no surface to hit
+
+			// Resolve indices; relative ones only refer to data read before the face
+			bool hasNormals = true;
+			int32_t resolved[3][64];
+			std::vector<int32_t> largeFace;
+			int32_t* facePositions = resolved[0];
+			int32_t* faceTexcoords = resolved[1];
+			int32_t* faceNormals = resolved[2];
+			if (face.cornerCount > 64)
+			{
+				largeFace.resize(face.cornerCount * 3);
+				facePositions = largeFace.data();
+				faceTexcoords = largeFace.data() + face.cornerCount;
+				faceNormals = largeFace.data() + face.cornerCount * 2;
+			}
+
+			for (uint32_t k = 0; k < face.cornerCount; k++)
+			{
+				const ObjCorner& corner = chunk.corners[face.firstCorner + k];
+				int32_t position = corner.relativePosition ? positionBase + corner.position : corner.position;
+				if (position < 0 || position >= static_cast<int32_t>(totalPositions))
+					return false;
+				facePositions[k] = position;
+
+				faceTexcoords[k] = kNoIndex;
+				if (corner.texcoord != kNoIndex)
+				{
+					int32_t texcoord = corner.relativeTexcoord ? texcoordBase + corner.texcoord : corner.texcoord;
+					if (texcoord < 0 || texcoord >= static_cast<int32_t>(totalTexcoords))
+						return false;
+					faceTexcoords[k] = texcoordKeys[texcoord];
+				}
+
+				if (corner.normal == kNoIndex)
+				{
+					hasNormals = false;
+					continue;
+				}
+				int32_t normal = corner.relativeNormal ? normalBase + corner.normal : corner.normal;
+				if (normal < 0 || normal >= static_cast<int32_t>(totalNormals))
+					return false;
+				faceNormals[k] = normal;
+			}
+
+			// Fan triangulation, emitted with reversed winding for the left handed frame
+			for (uint32_t k = 1; k + 1 < face.cornerCount; k++)
+			{
+				const uint32_t triangle[3] = { k + 1, k, 0 };
+				if (!hasNormals)
+				{
+					// Flat normal, like aiProcess_GenNormals on a mesh without normals
+					XMVECTOR p0 = XMLoadFloat3(&positions[facePositions[triangle[0]]]);
+					XMVECTOR p1 = XMLoadFloat3(&positions[facePositions[triangle[1]]]);
+					XMVECTOR p2 = XMLoadFloat3(&positions[facePositions[triangle[2]]]);
+					DirectX::XMFLOAT3 normal;
+					XMStoreFloat3(&normal, XMVector3Normalize(XMVector3Cross(p1 - p0, p2 - p0)));
+					normal = { -normal.x, -normal.y, -normal.z }; // the triangle is already in reversed order
+
+					const int32_t flatNormal[3] = {
+						static_cast<int32_t>(lroundf(normal.x * kFlatNormalScale)),
+						static_cast<int32_t>(lroundf(normal.y * kFlatNormalScale)),
+						static_cast<int32_t>(lroundf(normal.z * kFlatNormalScale)) };
+					for (int c = 0; c < 3; c++)
+					{
+						ObjVertexKey key = { facePositions[triangle[c]], faceTexcoords[triangle[c]], kNoIndex, { flatNormal[0], flatNormal[1], flatNormal[2] }, currentMaterial };
+						auto inserted = vertexLookup.insert(std::make_pair(key, static_cast<uint32_t>(outVertices.size())));
+						if (inserted.second)
+							outVertices.push_back(makeVertex(positions[key.position], normal, currentMaterial));
+						outIndices.push_back(inserted.first->second);
+					}
+					continue;
+				}
+
+				for (int c = 0; c < 3; c++)
+				{
+					ObjVertexKey key = { facePositions[triangle[c]], faceTexcoords[triangle[c]], faceNormals[triangle[c]], { 0, 0, 0 }, currentMaterial };
+					auto inserted = vertexLookup.insert(std::make_pair(key, static_cast<uint32_t>(outVertices.size())));
+					if (inserted.second)
+						outVertices.push_back(makeVertex(positions[key.position], normals[key.normal], currentMaterial));
+					outIndices.push_back(inserted.first->second);
+				}
+			}
+		}
+	}
+
+	return !outIndices.empty();
+}
@@ -0,0 +1,131 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include "TestUtils.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// A triangle as quantized position/normal/color of its corners, rotated so the
+	// smallest corner comes first. Vertex and triangle order differ between the
+	// importers, the sorted list of these does not.
+	typedef std::array<int64_t, 30> CanonicalTriangle;
+
+	std::vector<CanonicalTriangle> CanonicalTriangles(const std::vector<D3D12HelloTriangle::Vertex>& vertices,
+		const std::vector<uint32_t>& indices)
+	{
+		auto quantize = [](float v, float scale) { return static_cast<int64_t>(std::llround(v * scale)); };
+
+		std::vector<CanonicalTriangle> triangles(indices.size() / 3);
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			std::array<std::array<int64_t, 10>, 3> corners;
+			for (int k = 0; k < 3; k++)
+			{
+				const D3D12HelloTriangle::Vertex& v = vertices[indices[t * 3 + k]];
+				corners[k] = { {
+					quantize(v.position.x, 1e4f), quantize(v.position.y, 1e4f), quantize(v.position.z, 1e4f),
+					quantize(v.normal.x, 1e2f), quantize(v.normal.y, 1e2f), quantize(v.normal.z, 1e2f),
+					quantize(v.color.x, 1e3f), quantize(v.color.y, 1e3f), quantize(v.color.z, 1e3f),
+					quantize(v.color.w, 1e3f) } };
+			}
+			int first = 0;
+			for (int k = 1; k < 3; k++)
+			{
+				if (corners[k] < corners[first])
+					first = k;
+			}
+			for (int k = 0; k < 3; k++)
+				std::copy(corners[(first + k) % 3].begin(), corners[(first + k) % 3].end(), triangles[t].begin() + k * 10);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+}
+
+// Loads every Models/**/*.obj with the native parser and with Assimp and
+// compares the resulting triangles and vertex counts. Assimp joins positions
+// within a small epsilon where the native reader joins exact matches only, so
+// the native count may be higher but never lower. Returns 1 if any file differs.
+int D3D12HelloTriangle::RunObjParityCheck()
+{
+	std::vector<std::string> paths;
+	FindFiles("Models/", ".obj", paths);
+	if (paths.empty())
+	{
+		std::cout << "No .obj files found in Models/\n";
+		return 1;
+	}
+
+	int result = 0;
+	for (const auto& path : paths)
+	{
+		std::vector<Vertex> nativeVertices, assimpVertices;
+		std::vector<uint32_t> nativeIndices, assimpIndices;
+		bool nativeOk = LoadObjModel(path, nativeVertices, nativeIndices);
+		bool assimpOk = ImportModelAssimp(path, AssimpImportFlags, assimpVertices, assimpIndices);
+
+		std::string status;
+		if (!nativeOk)
+			status = "native parser declined (Assimp fallback)";
+		else if (!assimpOk)
+			status = "Assimp failed";
+		else if (CanonicalTriangles(nativeVertices, nativeIndices) != CanonicalTriangles(assimpVertices, assimpIndices))
+			status = "FAIL";
+		else if (nativeVertices.size() < assimpVertices.size())
+			status = "FAIL (vertex count)";
+		else
+			status = "PASS";
+
+		std::cout << path << ": " << status << " (native " << nativeIndices.size() / 3 << " triangles / "
+			<< nativeVertices.size() << " vertices, Assimp " << assimpIndices.size() / 3 << " / "
+			<< assimpVertices.size() << ")\n";
+		if (status.compare(0, 4, "FAIL") == 0)
+			result = 1;
+	}
+	return result;
+}
+
+// Parse throughput of the native OBJ reader and of Assimp on the bundled meshes
+int D3D12HelloTriangle::RunObjLoadBenchmark()
+{
+	std::vector<std::string> paths;
+	FindFiles("Models/", ".obj", paths);
+
+	double totalMB = 0.0, nativeMs = 0.0, assimpMs = 0.0;
+	for (const auto& path : paths)
+	{
+		FileStamp stamp;
+		if (!GetFileStamp(path, stamp))
+			continue;
+		double mb = stamp.size / (1024.0 * 1024.0);
+
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		auto start = std::chrono::high_resolution_clock::now();
+		LoadObjModel(path, vertices, indices);
+		double native = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		vertices.clear();
+		indices.clear();
+		start = std::chrono::high_resolution_clock::now();
+		ImportModelAssimp(path, AssimpImportFlags, vertices, indices);
+		double assimp = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+		std::cout << path << " (" << mb << " MB): native " << native << " ms, Assimp " << assimp << " ms\n";
+		totalMB += mb;
+		nativeMs += native;
+		assimpMs += assimp;
+	}
+
+	if (nativeMs > 0.0 && assimpMs > 0.0)
+	{
+		std::cout << "Total " << totalMB << " MB: native " << totalMB / (nativeMs / 1000.0) << " MB/s, Assimp "
+			<< totalMB / (assimpMs / 1000.0) << " MB/s\n";
+	}
+	return 0;
+}
@@ -0,0 +1,108 @@
+#include "stdafx.h"
+#include "SceneDiff.h"
+#include <unordered_map>
+
+namespace
+{
+	// Path and all keys, for the exact matches
+	std::string FullKey(const SceneDiffItem& item)
+	{
+		std::string key = item.path;
+		key.push_back('\0');
+		const uint64_t keys[] = { item.transformKey, item.materialKey, item.animationKey };
+		key.append(reinterpret_cast<const char*>(keys), sizeof(keys));
+		return key;
+	}
+
+	// Old indices with the same key, handed out in ascending order
+	struct Candidates
+	{
+		std::vector<size_t> indices;
+		size_t next = 0;
+	};
+}
+
+size_t SceneDiff::EditCount() const
+{
+	size_t count = 0;
+	for (const Match& match : matched)
+	{
+		if (match.transformChanged || match.materialChanged || match.animationChanged)
+			count++;
+	}
+	return count;
+}
+
+bool SceneDiff::ChangesOrder() const
+{
+	for (const Match& match : matched)
+	{
+		if (match.from != match.to)
+			return true;
+	}
+	return false;
+}
+
+SceneDiff DiffScenes(const std::vector<SceneDiffItem>& from, const std::vector<SceneDiffItem>& to)
+{
+	const size_t npos = static_cast<size_t>(-1);
+	std::vector<size_t> matchOf(to.size(), npos); // old index for every new one
+	std::vector<bool> used(from.size(), false);
+
+	// Unchanged instances
+	std::unordered_map<std::string, Candidates> exact;
+	exact.reserve(from.size());
+	for (size_t i = 0; i < from.size(); i++)
+		exact[FullKey(from[i])].indices.push_back(i);
+
+	for (size_t j = 0; j < to.size(); j++)
+	{
+		auto found = exact.find(FullKey(to[j]));
+		if (found == exact.end() || found->second.next == found->second.indices.size())
+			continue;
+		size_t i = found->second.indices[found->second.next++];
+		matchOf[j] = i;
+		used[i] = true;
+	}
+
+	// Edited instances of the same mesh, in list order
+	std::unordered_map<std::string, Candidates> byPath;
+	for (size_t i = 0; i < from.size(); i++)
+	{
+		if (!used[i])
+			byPath[from[i].path].indices.push_back(i);
+	}
+
+	SceneDiff diff;
+	for (size_t j = 0; j < to.size(); j++)
+	{
+		if (matchOf[j] == npos)
+		{
+			auto found = byPath.find(to[j].path);
+			if (found == byPath.end() || found->second.next == found->second.indices.size())
+			{
+				diff.added.push_back(j);
+				continue;
+			}
+			matchOf[j] = found->second.indices[found->second.next++];
+			used[matchOf[j]] = true;
+		}
+
+		const SceneDiffItem& a = from[matchOf[j]];
+		const SceneDiffItem& b = to[j];
+		SceneDiff::Match match;
+		match.from = matchOf[j];
+		match.to = j;
+		match.transformChanged = a.transformKey != b.transformKey;
+		match.materialChanged = a.materialKey != b.materialKey;
+		match.animationChanged = a.animationKey != b.animationKey;
+		diff.matched.push_back(match);
+	}
+
+	for (size_t i = 0; i < from.size(); i++)
+	{
+		if (!used[i])
+			diff.removed.push_back(i);
+	}
+	return diff;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Differ for scene description lists, used to reload a scene by touching only
+// the instances that changed. It knows nothing about the renderer: the caller
+// reduces every instance to its mesh path plus opaque keys of its transform,
+// material and animation (equal keys mean equal values).
+
+struct SceneDiffItem
+{
+	std::string path; // instances are only matched with instances of the same mesh
+	uint64_t transformKey = 0;
+	uint64_t materialKey = 0;
+	uint64_t animationKey = 0;
+};
+
+struct SceneDiff
+{
+	struct Match
+	{
+		size_t from; // index in the old list
+		size_t to;   // index in the new list
+		bool transformChanged;
+		bool materialChanged;
+		bool animationChanged;
+	};
+
+	std::vector<Match> matched;  // ascending `to`
+	std::vector<size_t> removed; // old indices, ascending
+	std::vector<size_t> added;   // new indices, ascending
+
+	// Number of instances whose transform, material or animation changed
+	size_t EditCount() const;
+	// Adds or removes, which change the set of instances (and maybe meshes)
+	bool ChangesStructure() const { return !removed.empty() || !added.empty(); }
+	// Some kept instance moved to another index
+	bool ChangesOrder() const;
+	bool Empty() const { return !ChangesStructure() && !ChangesOrder() && EditCount() == 0; }
+};
+
+// Unchanged instances are matched first, whatever their position, so reordering
+// a file costs nothing. The remaining instances of each mesh are then paired in
+// list order as edits; whatever is left over is removed or added.
+SceneDiff DiffScenes(const std::vector<SceneDiffItem>& from, const std::vector<SceneDiffItem>& to);
+
+// DiffScenes on hand-made and random edits (-testscenediff), SceneDiffTests.cpp
+int RunSceneDiffSelfTest();
@@ -0,0 +1,155 @@
+#include "stdafx.h"
+#include "SceneDiff.h"
+#include "TestUtils.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+// DiffScenes on hand-made cases and on random edits of a large scene. Every
+// diff is applied to the old list and must reproduce the new one.
+int RunSceneDiffSelfTest()
+{
+	TestChecks check;
+
+	auto item = [](const char* path, uint64_t transform, uint64_t material = 0, uint64_t animation = 0) {
+		SceneDiffItem result;
+		result.path = path;
+		result.transformKey = transform;
+		result.materialKey = material;
+		result.animationKey = animation;
+		return result;
+	};
+
+	auto reproduces = [](const std::vector<SceneDiffItem>& from, const std::vector<SceneDiffItem>& to, const SceneDiff& diff) {
+		std::vector<SceneDiffItem> applied(to.size());
+		std::vector<bool> filled(to.size(), false);
+		for (const SceneDiff::Match& match : diff.matched)
+		{
+			applied[match.to] = from[match.from];
+			if (match.transformChanged)
+				applied[match.to].transformKey = to[match.to].transformKey;
+			if (match.materialChanged)
+				applied[match.to].materialKey = to[match.to].materialKey;
+			if (match.animationChanged)
+				applied[match.to].animationKey = to[match.to].animationKey;
+			filled[match.to] = true;
+		}
+		for (size_t j : diff.added)
+		{
+			if (filled[j])
+				return false;
+			applied[j] = to[j];
+			filled[j] = true;
+		}
+		if (diff.matched.size() + diff.removed.size() != from.size())
+			return false;
+		for (size_t j = 0; j < to.size(); j++)
+		{
+			if (!filled[j] || applied[j].path != to[j].path || applied[j].transformKey != to[j].transformKey ||
+				applied[j].materialKey != to[j].materialKey || applied[j].animationKey != to[j].animationKey)
+				return false;
+		}
+		return true;
+	};
+
+	const std::vector<SceneDiffItem> base = {
+		item("a.obj", 1), item("b.obj", 2), item("a.obj", 3), item("c.obj", 4), item("b.obj", 5),
+	};
+
+	{
+		SceneDiff diff = DiffScenes(base, base);
+		check(diff.Empty() && diff.matched.size() == base.size(), "identical scenes give an empty diff");
+	}
+	{
+		auto next = base;
+		next[2].transformKey = 30;
+		next[3].materialKey = 7;
+		SceneDiff diff = DiffScenes(base, next);
+		check(!diff.ChangesStructure() && !diff.ChangesOrder() && diff.EditCount() == 2 &&
+			diff.matched[2].transformChanged && !diff.matched[2].materialChanged &&
+			diff.matched[3].materialChanged && !diff.matched[3].transformChanged &&
+			reproduces(base, next, diff), "transform and material edits stay edits");
+	}
+	{
+		auto next = base;
+		next.push_back(item("d.obj", 6));
+		SceneDiff diff = DiffScenes(base, next);
+		check(diff.added.size() == 1 && diff.added[0] == 5 && diff.removed.empty() && diff.EditCount() == 0 &&
+			reproduces(base, next, diff), "appended instance is one add");
+	}
+	{
+		auto next = base;
+		next.erase(next.begin() + 1);
+		SceneDiff diff = DiffScenes(base, next);
+		check(diff.removed.size() == 1 && diff.removed[0] == 1 && diff.added.empty() && diff.EditCount() == 0 &&
+			reproduces(base, next, diff), "removed instance is one remove, the rest only moves");
+	}
+	{
+		std::vector<SceneDiffItem> next(base.rbegin(), base.rend());
+		SceneDiff diff = DiffScenes(base, next);
+		check(!diff.ChangesStructure() && diff.EditCount() == 0 && diff.ChangesOrder() &&
+			reproduces(base, next, diff), "reordering costs no edits");
+	}
+	{
+		auto next = base;
+		next[3].path = "d.obj";
+		SceneDiff diff = DiffScenes(base, next);
+		check(diff.removed.size() == 1 && diff.added.size() == 1 && diff.EditCount() == 0 &&
+			reproduces(base, next, diff), "a new mesh path is a remove and an add");
+	}
+	{
+		std::vector<SceneDiffItem> from = { item("a.obj", 1), item("a.obj", 1), item("a.obj", 1) };
+		std::vector<SceneDiffItem> to = { item("a.obj", 1), item("a.obj", 1) };
+		SceneDiff diff = DiffScenes(from, to);
+		check(diff.removed.size() == 1 && diff.removed[0] == 2 && diff.EditCount() == 0 && !diff.ChangesOrder() &&
+			reproduces(from, to, diff), "duplicate instances drop the last copy");
+	}
+	{
+		SceneDiff diff = DiffScenes(std::vector<SceneDiffItem>(), base);
+		check(diff.added.size() == base.size() && reproduces(std::vector<SceneDiffItem>(), base, diff), "loading into an empty scene adds everything");
+		diff = DiffScenes(base, std::vector<SceneDiffItem>());
+		check(diff.removed.size() == base.size() && diff.matched.empty(), "clearing the scene removes everything");
+	}
+
+	// Random edits of a large scene; the diff may pair a remove with an add of
+	// the same mesh into one edit, but never needs more operations than made
+	uint32_t seed = 4321;
+	auto random = [&seed](uint32_t range) {
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) % range;
+	};
+	const char* paths[] = { "a.obj", "b.obj", "c.obj", "d.obj", "e.obj" };
+	bool allReproduced = true;
+	bool allMinimal = true;
+	double slowestMs = 0.0;
+	for (int round = 0; round < 20; round++)
+	{
+		std::vector<SceneDiffItem> from;
+		for (uint64_t i = 0; i < 10000; i++)
+			from.push_back(item(paths[random(5)], i + 1, random(8)));
+
+		auto to = from;
+		size_t operations = 0;
+		for (int e = 0; e < 50; e++, operations++)
+			to[random(static_cast<uint32_t>(to.size()))].transformKey += 100000;
+		for (int e = 0; e < 20; e++, operations++)
+			to.erase(to.begin() + random(static_cast<uint32_t>(to.size())));
+		for (int e = 0; e < 20; e++, operations++)
+			to.insert(to.begin() + random(static_cast<uint32_t>(to.size())), item(paths[random(5)], 200000 + e));
+		for (int e = 0; e < 100; e++)
+			std::swap(to[random(static_cast<uint32_t>(to.size()))], to[random(static_cast<uint32_t>(to.size()))]);
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		SceneDiff diff = DiffScenes(from, to);
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		slowestMs = ms > slowestMs ? ms : slowestMs;
+
+		allReproduced = allReproduced && reproduces(from, to, diff);
+		allMinimal = allMinimal && diff.EditCount() + diff.added.size() + diff.removed.size() <= operations;
+	}
+	check(allReproduced, "random edits of 10000 instances are reproduced");
+	check(allMinimal, "random edits need no more operations than were made");
+	std::cout << "  slowest diff of 10000 instances: " << slowestMs << " ms\n";
+
+	return check.Finish("scene diff");
+}
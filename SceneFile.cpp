@@ -0,0 +1,299 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include <cstring>
+#include <unordered_map>
+
+// Binary scene container (.bscene), a lossless alternative to scene.json that
+// is memory-mapped and copied into SceneData without any parsing.
+//
+// Layout of a scene file:
+//   SceneFileHeader
+//   SceneFileInstance instances[instanceCount]
+//   SceneFileMaterial materials[materialCount]   de-duplicated
+//   AnimationFrame    frames[frameCount]         every track, back to back
+//   char              strings[stringBytes]       model paths, not terminated
+//
+// All values are little-endian, as written by x64 Windows.
+
+namespace
+{
+	const uint32_t kSceneFileMagic = 0x4E435342; // "BSCN"
+	const uint32_t kSceneFileVersion = 2; // 2: interpolation modes and position tangents
+
+	const uint32_t kSceneHasCamera = 1u << 0;
+	const uint32_t kSceneHasLight = 1u << 1;
+
+	struct SceneFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t flags;
+		uint32_t instanceCount;
+		uint32_t materialCount;
+		uint32_t frameCount;
+		uint32_t stringBytes;
+		uint32_t reserved;
+		DirectX::XMFLOAT3 cameraEye;
+		DirectX::XMFLOAT3 cameraCenter;
+		DirectX::XMFLOAT3 cameraUp;
+		DirectX::XMFLOAT3 lightPosition;
+		DirectX::XMFLOAT3 lightColor;
+		float lightIntensity;
+		int32_t lightType;
+	};
+
+	struct SceneFileInstance
+	{
+		uint32_t pathOffset;
+		uint32_t pathLength;
+		int32_t id;
+		uint32_t material;
+		uint32_t firstFrame;
+		uint32_t frameCount;
+		DirectX::XMFLOAT3 position;
+		DirectX::XMFLOAT3 rotation;
+		DirectX::XMFLOAT3 scale;
+		int32_t rotationInterpolation;
+		int32_t positionInterpolation;
+	};
+
+	struct SceneFileMaterial
+	{
+		DirectX::XMFLOAT3 albedo;
+		int32_t emission;
+		float roughness;
+		int32_t isMetallic;
+		int32_t isGlass;
+		float IOR;
+	};
+
+	// Appends a POD array to the blob
+	template <typename T>
+	void AppendArray(std::vector<uint8_t>& blob, const T* data, size_t count)
+	{
+		if (count == 0)
+			return;
+		const size_t offset = blob.size();
+		blob.resize(offset + count * sizeof(T));
+		memcpy(blob.data() + offset, data, count * sizeof(T));
+	}
+}
+
+bool D3D12HelloTriangle::IsBinarySceneFile(const std::string& path)
+{
+	return HasExtension(path, ".bscene");
+}
+
+bool D3D12HelloTriangle::ReadSceneFile(const std::string& path, SceneData& outScene, std::string& outError)
+{
+	outScene = SceneData();
+	if (IsBinarySceneFile(path))
+		return ReadSceneBinary(path, outScene, outError);
+	return ReadSceneJsonSax(path, outScene, outError);
+}
+
+bool D3D12HelloTriangle::WriteSceneFile(const std::string& path, const SceneData& scene)
+{
+	if (IsBinarySceneFile(path))
+		return WriteSceneBinary(path, scene);
+	return WriteSceneJson(path, scene);
+}
+
+bool D3D12HelloTriangle::ReadSceneBinary(const std::string& path, SceneData& outScene, std::string& outError)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		outError = "Cannot open scene file: " + path;
+		return false;
+	}
+
+	SceneFileHeader header;
+	if (file.Size() < sizeof(header))
+	{
+		outError = "Scene file is truncated: " + path;
+		return false;
+	}
+	memcpy(&header, file.Data(), sizeof(header));
+	if (header.magic != kSceneFileMagic || header.version != kSceneFileVersion)
+	{
+		outError = "Unsupported scene file version: " + path;
+		return false;
+	}
+
+	const size_t instanceOffset = sizeof(SceneFileHeader);
+	const size_t materialOffset = instanceOffset + static_cast<size_t>(header.instanceCount) * sizeof(SceneFileInstance);
+	const size_t frameOffset = materialOffset + static_cast<size_t>(header.materialCount) * sizeof(SceneFileMaterial);
+	const size_t stringOffset = frameOffset + static_cast<size_t>(header.frameCount) * sizeof(AnimationFrame);
+	if (file.Size() != stringOffset + header.stringBytes)
+	{
+		outError = "Scene file is truncated: " + path;
+		return false;
+	}
+
+	const uint8_t* data = file.Data();
+	const SceneFileInstance* instances = reinterpret_cast<const SceneFileInstance*>(data + instanceOffset);
+	const SceneFileMaterial* materials = reinterpret_cast<const SceneFileMaterial*>(data + materialOffset);
+	const AnimationFrame* frames = reinterpret_cast<const AnimationFrame*>(data + frameOffset);
+	const char* strings = reinterpret_cast<const char*>(data + stringOffset);
+
+	outScene.hasCamera = (header.flags & kSceneHasCamera) != 0;
+	outScene.cameraEye = header.cameraEye;
+	outScene.cameraCenter = header.cameraCenter;
+	outScene.cameraUp = header.cameraUp;
+	outScene.hasLight = (header.flags & kSceneHasLight) != 0;
+	outScene.light.position = header.lightPosition;
+	outScene.light.color = header.lightColor;
+	outScene.light.intensity = header.lightIntensity;
+	outScene.light.type = header.lightType;
+
+	outScene.models.resize(header.instanceCount);
+	for (uint32_t i = 0; i < header.instanceCount; i++)
+	{
+		const SceneFileInstance& instance = instances[i];
+		if (instance.material >= header.materialCount ||
+			static_cast<uint64_t>(instance.pathOffset) + instance.pathLength > header.stringBytes ||
+			static_cast<uint64_t>(instance.firstFrame) + instance.frameCount > header.frameCount ||
+			instance.rotationInterpolation < 0 ||
+			instance.rotationInterpolation > static_cast<int32_t>(RotationInterpolation::Slerp) ||
+			instance.positionInterpolation < 0 ||
+			instance.positionInterpolation > static_cast<int32_t>(PositionInterpolation::Hermite))
+		{
+			outScene.models.clear();
+			outError = "Corrupt scene file: " + path;
+			return false;
+		}
+
+		const SceneFileMaterial& material = materials[instance.material];
+		ModelDesc& desc = outScene.models[i];
+		desc.id = instance.id;
+		desc.path.assign(strings + instance.pathOffset, instance.pathLength);
+		desc.position = instance.position;
+		desc.rotation = instance.rotation;
+		desc.scale = instance.scale;
+		desc.albedo = material.albedo;
+		desc.emission = material.emission;
+		desc.roughness = material.roughness;
+		desc.isMetallic = material.isMetallic;
+		desc.isGlass = material.isGlass;
+		desc.IOR = material.IOR;
+		desc.animationFrames.assign(frames + instance.firstFrame, frames + instance.firstFrame + instance.frameCount);
+		desc.rotationInterpolation = static_cast<RotationInterpolation>(instance.rotationInterpolation);
+		desc.positionInterpolation = static_cast<PositionInterpolation>(instance.positionInterpolation);
+	}
+	return true;
+}
+
+bool D3D12HelloTriangle::WriteSceneBinary(const std::string& path, const SceneData& scene)
+{
+	std::vector<SceneFileInstance> instances;
+	std::vector<SceneFileMaterial> materials;
+	std::vector<AnimationFrame> frames;
+	std::string strings;
+	instances.reserve(scene.models.size());
+
+	// Generated scenes repeat a handful of meshes and materials many times
+	std::unordered_map<std::string, uint32_t> pathOffsets;
+	std::unordered_map<std::string, uint32_t> materialIndices;
+
+	for (const ModelDesc& desc : scene.models)
+	{
+		SceneFileMaterial material;
+		memset(&material, 0, sizeof(material)); // the bytes are the de-duplication key
+		material.albedo = desc.albedo;
+		material.emission = desc.emission;
+		material.roughness = desc.roughness;
+		material.isMetallic = desc.isMetallic;
+		material.isGlass = desc.isGlass;
+		material.IOR = desc.IOR;
+		auto materialIt = materialIndices.emplace(
+			std::string(reinterpret_cast<const char*>(&material), sizeof(material)),
+			static_cast<uint32_t>(materials.size()));
+		if (materialIt.second)
+			materials.push_back(material);
+
+		auto pathIt = pathOffsets.emplace(desc.path, static_cast<uint32_t>(strings.size()));
+		if (pathIt.second)
+			strings += desc.path;
+
+		SceneFileInstance instance;
+		memset(&instance, 0, sizeof(instance));
+		instance.pathOffset = pathIt.first->second;
+		instance.pathLength = static_cast<uint32_t>(desc.path.size());
+		instance.id = desc.id;
+		instance.material = materialIt.first->second;
+		instance.firstFrame = static_cast<uint32_t>(frames.size());
+		instance.frameCount = static_cast<uint32_t>(desc.animationFrames.size());
+		instance.position = desc.position;
+		instance.rotation = desc.rotation;
+		instance.scale = desc.scale;
+		instance.rotationInterpolation = static_cast<int32_t>(desc.rotationInterpolation);
+		instance.positionInterpolation = static_cast<int32_t>(desc.positionInterpolation);
+		instances.push_back(instance);
+
+		frames.insert(frames.end(), desc.animationFrames.begin(), desc.animationFrames.end());
+	}
+
+	SceneFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = kSceneFileMagic;
+	header.version = kSceneFileVersion;
+	header.flags = (scene.hasCamera ? kSceneHasCamera : 0u) | (scene.hasLight ? kSceneHasLight : 0u);
+	header.instanceCount = static_cast<uint32_t>(instances.size());
+	header.materialCount = static_cast<uint32_t>(materials.size());
+	header.frameCount = static_cast<uint32_t>(frames.size());
+	header.stringBytes = static_cast<uint32_t>(strings.size());
+	header.cameraEye = scene.cameraEye;
+	header.cameraCenter = scene.cameraCenter;
+	header.cameraUp = scene.cameraUp;
+	header.lightPosition = scene.light.position;
+	header.lightColor = scene.light.color;
+	header.lightIntensity = scene.light.intensity;
+	header.lightType = scene.light.type;
+
+	std::vector<uint8_t> blob;
+	blob.reserve(sizeof(header) + instances.size() * sizeof(SceneFileInstance) +
+		materials.size() * sizeof(SceneFileMaterial) + frames.size() * sizeof(AnimationFrame) + strings.size());
+	AppendArray(blob, &header, 1);
+	AppendArray(blob, instances.data(), instances.size());
+	AppendArray(blob, materials.data(), materials.size());
+	AppendArray(blob, frames.data(), frames.size());
+	AppendArray(blob, strings.data(), strings.size());
+
+	return WriteFileAtomic(path, blob.data(), blob.size());
+}
+
+bool D3D12HelloTriangle::SameSceneData(const SceneData& a, const SceneData& b)
+{
+	auto same3 = [](const XMFLOAT3& x, const XMFLOAT3& y) { return x.x == y.x && x.y == y.y && x.z == y.z; };
+
+	if (a.hasCamera != b.hasCamera || a.hasLight != b.hasLight || a.models.size() != b.models.size())
+		return false;
+	if (a.hasCamera && !(same3(a.cameraEye, b.cameraEye) && same3(a.cameraCenter, b.cameraCenter) && same3(a.cameraUp, b.cameraUp)))
+		return false;
+	if (a.hasLight && !(same3(a.light.position, b.light.position) && same3(a.light.color, b.light.color) &&
+		a.light.intensity == b.light.intensity && a.light.type == b.light.type))
+		return false;
+
+	for (size_t i = 0; i < a.models.size(); i++)
+	{
+		const ModelDesc& x = a.models[i];
+		const ModelDesc& y = b.models[i];
+		if (x.id != y.id || x.path != y.path || !same3(x.position, y.position) || !same3(x.rotation, y.rotation) ||
+			!same3(x.scale, y.scale) || !same3(x.albedo, y.albedo) || x.emission != y.emission ||
+			x.roughness != y.roughness || x.isMetallic != y.isMetallic || x.isGlass != y.isGlass || x.IOR != y.IOR ||
+			x.animationFrames.size() != y.animationFrames.size() ||
+			x.rotationInterpolation != y.rotationInterpolation || x.positionInterpolation != y.positionInterpolation)
+			return false;
+		for (size_t f = 0; f < x.animationFrames.size(); f++)
+		{
+			const AnimationFrame& p = x.animationFrames[f];
+			const AnimationFrame& q = y.animationFrames[f];
+			if (p.time != q.time || !same3(p.position, q.position) || !same3(p.rotation, q.rotation) || !same3(p.scale, q.scale) ||
+				!same3(p.tangent, q.tangent))
+				return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,94 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include "SceneGenerator.h"
+#include <cfloat>
+#include <chrono>
+#include <iostream>
+
+// Converts a scene between JSON and .bscene, then reads the output back and
+// checks that nothing was lost
+int D3D12HelloTriangle::RunSceneConverter(const std::string& inputPath, const std::string& outputPath)
+{
+	if (inputPath.empty() || outputPath.empty())
+	{
+		std::cout << "Usage: -convertscene <input.json|.bscene> <output.json|.bscene>\n";
+		return 1;
+	}
+
+	SceneData scene;
+	std::string error;
+	if (!ReadSceneFile(inputPath, scene, error))
+	{
+		std::cout << error << "\n";
+		return 1;
+	}
+	if (!WriteSceneFile(outputPath, scene))
+	{
+		std::cout << "Cannot write " << outputPath << "\n";
+		return 1;
+	}
+
+	SceneData check;
+	if (!ReadSceneFile(outputPath, check, error) || !SameSceneData(scene, check))
+	{
+		std::cout << outputPath << ": round trip mismatch " << error << "\n";
+		return 1;
+	}
+
+	size_t frames = 0;
+	for (const auto& model : scene.models)
+		frames += model.animationFrames.size();
+	std::cout << inputPath << " -> " << outputPath << ": " << scene.models.size() << " models, "
+		<< frames << " animation frames\n";
+	return 0;
+}
+
+// Writes a generated scene as JSON and as .bscene and compares how long
+// ReadSceneFile takes for each. Both must produce identical SceneData.
+int D3D12HelloTriangle::RunSceneLoadBenchmark(unsigned instanceCount)
+{
+	if (instanceCount == 0)
+		instanceCount = 10000;
+
+	const SceneData scene = GenerateBenchmarkScene(instanceCount);
+
+	const std::string directory = "Cache/Scenes/";
+	const std::string jsonPath = directory + "bench.json";
+	const std::string binaryPath = directory + "bench.bscene";
+	if (!EnsureDirectory(directory) || !WriteSceneFile(jsonPath, scene) || !WriteSceneFile(binaryPath, scene))
+	{
+		std::cout << "Cannot write the benchmark scenes to " << directory << "\n";
+		return 1;
+	}
+
+	int result = 0;
+	const std::string paths[] = { jsonPath, binaryPath };
+	double bestMs[2] = { DBL_MAX, DBL_MAX };
+	for (int format = 0; format < 2; format++)
+	{
+		for (int run = 0; run < 5; run++)
+		{
+			SceneData loaded;
+			std::string error;
+			const auto start = std::chrono::high_resolution_clock::now();
+			bool ok = ReadSceneFile(paths[format], loaded, error);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			bestMs[format] = ms < bestMs[format] ? ms : bestMs[format];
+
+			if (run == 0 && (!ok || !SameSceneData(scene, loaded)))
+			{
+				std::cout << paths[format] << ": does not match the generated scene " << error << "\n";
+				result = 1;
+			}
+		}
+
+		FileStamp stamp;
+		GetFileStamp(paths[format], stamp);
+		std::cout << paths[format] << ": " << stamp.size / 1024 << " KB, best of 5 loads " << bestMs[format] << " ms\n";
+	}
+
+	std::cout << instanceCount << " instances: binary loads x" << (bestMs[1] > 0.0 ? bestMs[0] / bestMs[1] : 0.0)
+		<< " faster than JSON\n";
+	return result;
+}
@@ -0,0 +1,210 @@
+#include "stdafx.h"
+#include "SceneGenerator.h"
+#include "FileUtils.h"
+#include <cmath>
+#include <numeric>
+#include <sstream>
+
+namespace
+{
+	const char* kBundledMeshes[] = {
+		"Models/ExampleScene/Sphere.obj",
+		"Models/ExampleScene/Cube.obj",
+		"Models/ExampleScene/Ring.obj",
+		"Models/ExampleScene/Glass.obj",
+		"Models/ExampleScene/CrazyGlass.obj",
+	};
+
+	class Random
+	{
+	public:
+		explicit Random(uint32_t seed) : m_state(seed) {}
+
+		uint32_t Next()
+		{
+			m_state = m_state * 1664525u + 1013904223u;
+			return m_state >> 8;
+		}
+
+		// [0, 1)
+		float Unit() { return static_cast<float>(Next()) / static_cast<float>(1 << 24); }
+		float Range(float low, float high) { return low + (high - low) * Unit(); }
+
+	private:
+		uint32_t m_state;
+	};
+
+	// Instance indices in random order; the first n of it pick n instances
+	std::vector<unsigned> Shuffled(unsigned count, Random& random)
+	{
+		std::vector<unsigned> order(count);
+		std::iota(order.begin(), order.end(), 0u);
+		for (unsigned i = count; i > 1; i--)
+			std::swap(order[i - 1], order[random.Next() % i]);
+		return order;
+	}
+
+	std::string ProceduralMeshPath(const SceneGeneratorOptions& options, unsigned index)
+	{
+		char name[32];
+		sprintf_s(name, "mesh_%04u.obj", index);
+		return options.meshDirectory + name;
+	}
+
+	// A sphere with index-dependent bumps and tessellation, as an .obj
+	std::string ProceduralMeshObj(unsigned index)
+	{
+		const unsigned segments = 12 + (index * 7) % 36;
+		const unsigned rings = segments / 2;
+		const float lobes = static_cast<float>(2 + index % 5);
+		const float amplitude = 0.05f + 0.03f * static_cast<float>(index % 4);
+
+		std::ostringstream obj;
+		obj << "# Procedural mesh " << index << " written by the scene generator\n";
+		for (unsigned r = 0; r <= rings; r++)
+		{
+			const float theta = DirectX::XM_PI * r / rings;
+			for (unsigned s = 0; s <= segments; s++)
+			{
+				const float phi = DirectX::XM_2PI * s / segments;
+				const float nx = sinf(theta) * cosf(phi), ny = cosf(theta), nz = sinf(theta) * sinf(phi);
+				const float radius = 1.0f + amplitude * sinf(lobes * theta) * cosf(lobes * phi);
+				obj << "v " << nx * radius << ' ' << ny * radius << ' ' << nz * radius << "\n";
+				obj << "vn " << nx << ' ' << ny << ' ' << nz << "\n";
+			}
+		}
+		for (unsigned r = 0; r < rings; r++)
+		{
+			for (unsigned s = 0; s < segments; s++)
+			{
+				const unsigned a = r * (segments + 1) + s + 1; // .obj indices start at 1
+				const unsigned b = a + segments + 1;
+				// The first and last ring meet in a pole, skip the triangles that collapse there
+				if (r != 0)
+					obj << "f " << a << "//" << a << ' ' << a + 1 << "//" << a + 1 << ' ' << b << "//" << b << "\n";
+				if (r != rings - 1)
+					obj << "f " << a + 1 << "//" << a + 1 << ' ' << b + 1 << "//" << b + 1 << ' ' << b << "//" << b << "\n";
+			}
+		}
+		return obj.str();
+	}
+}
+
+std::vector<std::string> GeneratedMeshPaths(const SceneGeneratorOptions& options)
+{
+	const unsigned count = options.meshes ? options.meshes : 1;
+	std::vector<std::string> paths;
+	paths.reserve(count);
+	for (unsigned i = 0; i < count; i++)
+		paths.push_back(i < _countof(kBundledMeshes) ? std::string(kBundledMeshes[i]) : ProceduralMeshPath(options, i));
+	return paths;
+}
+
+bool WriteGeneratedMeshes(const SceneGeneratorOptions& options, std::string& outError)
+{
+	if (options.meshes <= _countof(kBundledMeshes))
+		return true;
+	if (!EnsureDirectory(options.meshDirectory))
+	{
+		outError = "Cannot create " + options.meshDirectory;
+		return false;
+	}
+
+	for (unsigned i = _countof(kBundledMeshes); i < options.meshes; i++)
+	{
+		const std::string path = ProceduralMeshPath(options, i);
+		FileStamp stamp;
+		if (GetFileStamp(path, stamp))
+			continue;
+		const std::string obj = ProceduralMeshObj(i);
+		if (!WriteFileAtomic(path, obj.data(), obj.size()))
+		{
+			outError = "Cannot write " + path;
+			return false;
+		}
+	}
+	return true;
+}
+
+D3D12HelloTriangle::SceneData GenerateScene(const SceneGeneratorOptions& options)
+{
+	typedef D3D12HelloTriangle::ModelDesc ModelDesc;
+	typedef D3D12HelloTriangle::AnimationFrame AnimationFrame;
+
+	const std::vector<std::string> meshPaths = GeneratedMeshPaths(options);
+	const float extent = options.extent > 0.0f ? options.extent : 4.0f * sqrtf(static_cast<float>(options.instances)) + 10.0f;
+
+	D3D12HelloTriangle::SceneData scene;
+	scene.hasCamera = true;
+	scene.cameraEye = { 0.0f, extent * 0.3f, extent * 1.2f };
+	scene.cameraCenter = { 0.0f, 0.0f, 0.0f };
+	scene.cameraUp = { 0.0f, 1.0f, 0.0f };
+	scene.hasLight = true;
+	scene.light.position = { 0.0f, extent * 0.5f, 0.0f };
+	scene.light.color = { 1.0f, 1.0f, 1.0f };
+	scene.light.intensity = 1.0f;
+	scene.light.type = 0;
+
+	Random random(options.seed);
+	scene.models.resize(options.instances);
+	for (unsigned i = 0; i < options.instances; i++)
+	{
+		ModelDesc& desc = scene.models[i];
+		desc.id = static_cast<int>(i);
+		desc.path = meshPaths[random.Next() % meshPaths.size()];
+		desc.position = { random.Range(-extent, extent), random.Range(0.0f, 10.0f), random.Range(-extent, extent) };
+		desc.rotation = { 0.0f, random.Range(0.0f, 360.0f), 0.0f };
+		const float scale = random.Range(0.5f, 1.5f);
+		desc.scale = { scale, scale, scale };
+		desc.albedo = { random.Unit(), random.Unit(), random.Unit() };
+		desc.roughness = random.Unit();
+		desc.isMetallic = random.Next() % 5 == 0;
+	}
+
+	const std::vector<unsigned> materialOrder = Shuffled(options.instances, random);
+	const unsigned emissive = options.emissive < options.instances ? options.emissive : options.instances;
+	const unsigned glassEnd = emissive + options.glass < options.instances ? emissive + options.glass : options.instances;
+	for (unsigned k = 0; k < emissive; k++)
+	{
+		ModelDesc& desc = scene.models[materialOrder[k]];
+		desc.emission = 1 + static_cast<int>(random.Next() % 5);
+		desc.isMetallic = false;
+	}
+	for (unsigned k = emissive; k < glassEnd; k++)
+	{
+		ModelDesc& desc = scene.models[materialOrder[k]];
+		desc.isGlass = true;
+		desc.isMetallic = false;
+		desc.albedo = { 1.0f, 1.0f, 1.0f };
+		desc.IOR = random.Range(1.3f, 1.8f);
+	}
+
+	// A bob and a full turn that ends where it started, so the loop is seamless
+	const std::vector<unsigned> animationOrder = Shuffled(options.instances, random);
+	const unsigned animated = options.animated < options.instances ? options.animated : options.instances;
+	for (unsigned k = 0; k < animated; k++)
+	{
+		ModelDesc& desc = scene.models[animationOrder[k]];
+		const float period = random.Range(2.0f, 6.0f);
+		const float height = random.Range(0.5f, 3.0f);
+		const float offsets[] = { 0.0f, height, 0.0f, -height * 0.5f, 0.0f };
+		for (int f = 0; f < 5; f++)
+		{
+			AnimationFrame frame;
+			frame.time = period * f / 4.0f;
+			frame.position = { desc.position.x, desc.position.y + offsets[f], desc.position.z };
+			frame.rotation = { 0.0f, desc.rotation.y + 90.0f * f, 0.0f };
+			frame.scale = desc.scale;
+			desc.animationFrames.push_back(frame);
+		}
+	}
+	return scene;
+}
+
+D3D12HelloTriangle::SceneData GenerateBenchmarkScene(unsigned instanceCount)
+{
+	SceneGeneratorOptions options;
+	options.instances = instanceCount;
+	options.animated = instanceCount / 8;
+	return GenerateScene(options);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "D3D12HelloTriangle.h"
+#include <string>
+#include <vector>
+
+// Procedural stress scenes for scaling tests. The same options and seed always
+// give the same scene, so results of different builds can be compared.
+
+struct SceneGeneratorOptions
+{
+	unsigned instances = 1000;
+	// Distinct mesh paths. The bundled example meshes come first, the rest are
+	// procedural meshes written to meshDirectory by WriteGeneratedMeshes.
+	unsigned meshes = 4;
+	unsigned animated = 0; // instances with a looping keyframe track
+	unsigned emissive = 0;
+	unsigned glass = 0;    // never the same instances as the emissive ones
+	uint32_t seed = 12345;
+	float extent = 0.0f;   // half width of the area the instances cover, 0 scales it with the count
+	std::string meshDirectory = "Models/Generated/";
+};
+
+// Mesh paths a scene generated with these options refers to
+std::vector<std::string> GeneratedMeshPaths(const SceneGeneratorOptions& options);
+
+// Writes the procedural meshes that are missing from meshDirectory
+bool WriteGeneratedMeshes(const SceneGeneratorOptions& options, std::string& outError);
+
+D3D12HelloTriangle::SceneData GenerateScene(const SceneGeneratorOptions& options);
+
+// The scene the scene file benchmarks read: instanceCount instances of the
+// bundled meshes with the default seed, every 8th one animated
+D3D12HelloTriangle::SceneData GenerateBenchmarkScene(unsigned instanceCount);
@@ -0,0 +1,191 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include "SceneGenerator.h"
+#include "TestUtils.h"
+#include <cfloat>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+int D3D12HelloTriangle::RunSceneGenerator(const std::string& outputPath, const std::vector<std::string>& arguments)
+{
+	if (outputPath.empty())
+	{
+		std::cout << "Usage: -genscene <out.json|out.bscene> [-instances n] [-meshes n] [-animated n] [-emissive n] [-glass n] [-seed n] [-extent size] [-meshdir dir]\n";
+		return 1;
+	}
+
+	SceneGeneratorOptions options;
+	for (size_t i = 0; i < arguments.size(); i += 2)
+	{
+		const std::string& name = arguments[i];
+		if (i + 1 >= arguments.size())
+		{
+			std::cout << "Missing value for " << name << "\n";
+			return 1;
+		}
+		const std::string& value = arguments[i + 1];
+		const unsigned number = static_cast<unsigned>(strtoul(value.c_str(), nullptr, 10));
+		if (name == "-instances")
+			options.instances = number;
+		else if (name == "-meshes")
+			options.meshes = number;
+		else if (name == "-animated")
+			options.animated = number;
+		else if (name == "-emissive")
+			options.emissive = number;
+		else if (name == "-glass")
+			options.glass = number;
+		else if (name == "-seed")
+			options.seed = number;
+		else if (name == "-extent")
+			options.extent = strtof(value.c_str(), nullptr);
+		else if (name == "-meshdir")
+			options.meshDirectory = (value.empty() || value.back() == '/' || value.back() == '\\') ? value : value + "/";
+		else
+		{
+			std::cout << "Unknown option " << name << "\n";
+			return 1;
+		}
+	}
+
+	std::string error;
+	if (!WriteGeneratedMeshes(options, error))
+	{
+		std::cout << error << "\n";
+		return 1;
+	}
+
+	const SceneData scene = GenerateScene(options);
+	if (!WriteSceneFile(outputPath, scene))
+	{
+		std::cout << "Cannot write " << outputPath << "\n";
+		return 1;
+	}
+
+	size_t animated = 0, emissive = 0, glass = 0;
+	for (const ModelDesc& desc : scene.models)
+	{
+		animated += desc.animationFrames.empty() ? 0 : 1;
+		emissive += desc.emission != -1 ? 1 : 0;
+		glass += desc.isGlass ? 1 : 0;
+	}
+	std::cout << outputPath << ": " << scene.models.size() << " instances of " << GeneratedMeshPaths(options).size() << " meshes, "
+		<< animated << " animated, " << emissive << " emissive, " << glass << " glass\n";
+	return 0;
+}
+
+// Generated scenes of 100 to maxInstances instances: time to read the scene
+// file, heap the result takes, and the per-frame CPU work that grows with the
+// instance count: UpdateModelTranslations, then what BuildTLAS does before it
+// records anything, i.e. SyncInstanceTransforms and the instance records and
+// upload ranges of the instances that moved. Meshes are not loaded, their cost
+// does not depend on the number of instances.
+int D3D12HelloTriangle::RunSceneScalingBenchmark(unsigned maxInstances)
+{
+	if (maxInstances == 0)
+		maxInstances = 100000;
+
+	const std::string directory = "Cache/Scenes/";
+	if (!EnsureDirectory(directory))
+	{
+		std::cout << "Cannot create " << directory << "\n";
+		return 1;
+	}
+
+	const int frameCount = 60;
+	for (unsigned instanceCount = 100; instanceCount <= maxInstances; instanceCount *= 10)
+	{
+		SceneGeneratorOptions options;
+		options.instances = instanceCount;
+		options.meshes = 5;
+		options.animated = instanceCount / 10;
+		options.emissive = instanceCount / 100;
+		options.glass = instanceCount / 20;
+		const SceneData scene = GenerateScene(options);
+
+		const std::string base = directory + "scale_" + std::to_string(instanceCount);
+		const std::string paths[] = { base + ".json", base + ".bscene" };
+		double readMs[2] = { DBL_MAX, DBL_MAX };
+		int64_t sceneBytes = 0;
+		int64_t peakBytes = 0;
+		for (int format = 0; format < 2; format++)
+		{
+			if (!WriteSceneFile(paths[format], scene))
+			{
+				std::cout << "Cannot write " << paths[format] << "\n";
+				return 1;
+			}
+
+			for (int run = 0; run < 3; run++)
+			{
+				SceneData loaded;
+				std::string error;
+				ResetAllocationCounters();
+				g_countAllocations = true;
+				const auto start = std::chrono::high_resolution_clock::now();
+				bool ok = ReadSceneFile(paths[format], loaded, error);
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+				g_countAllocations = false;
+				if (!ok)
+				{
+					std::cout << paths[format] << ": " << error << "\n";
+					return 1;
+				}
+				readMs[format] = ms < readMs[format] ? ms : readMs[format];
+				if (format == 0 && run == 0)
+				{
+					sceneBytes = g_liveBytes.load();
+					peakBytes = g_peakLiveBytes.load();
+				}
+			}
+		}
+
+		std::vector<ModelDesc> descs = scene.models;
+		AnimationTracks tracks;
+		BuildAnimationTracks(descs, tracks);
+
+		// BuildTLAS without the GPU: no BLAS or hit group behind the records.
+		// The first frame fills every record, as RebuildInstanceList does.
+		TransformSystem transforms;
+		InstanceDescStore records;
+		SyncInstanceTransforms(descs, descs.size(), transforms);
+		records.Resize(descs.size());
+		for (size_t i = 0; i < descs.size(); i++)
+			records.Set(i, 0, transforms.World(i), static_cast<UINT>(i), 0);
+		records.TakeDirtyRanges(InstanceRecordGap);
+
+		double animateMs = 0.0, transformMs = 0.0, recordMs = 0.0;
+		size_t movedCount = 0, rangeCount = 0;
+		for (int frame = 1; frame <= frameCount; frame++)
+		{
+			const auto start = std::chrono::high_resolution_clock::now();
+			EvaluateAnimationTracks(tracks, frame / 60.0f, descs);
+			const auto animated = std::chrono::high_resolution_clock::now();
+			SyncInstanceTransforms(descs, descs.size(), transforms);
+			const auto synced = std::chrono::high_resolution_clock::now();
+			for (uint32_t i : transforms.LastChangedInstances())
+				records.Set(i, 0, transforms.World(i), i, 0);
+			const std::vector<InstanceRecordRange> ranges = records.TakeDirtyRanges(InstanceRecordGap);
+			const auto recorded = std::chrono::high_resolution_clock::now();
+
+			animateMs += std::chrono::duration<double, std::milli>(animated - start).count();
+			transformMs += std::chrono::duration<double, std::milli>(synced - animated).count();
+			recordMs += std::chrono::duration<double, std::milli>(recorded - synced).count();
+			movedCount += transforms.LastChangedInstances().size();
+			rangeCount += ranges.size();
+		}
+
+		std::cout << instanceCount << " instances (" << options.animated << " animated):\n"
+			<< "  read: json " << readMs[0] << " ms, bscene " << readMs[1] << " ms\n";
+		if (kAllocationCounters)
+			std::cout << "  memory: " << sceneBytes / 1024 << " KB scene, " << peakBytes / 1024 << " KB peak while reading json\n";
+		else
+			std::cout << "  memory: needs a build with COUNT_ALLOCATIONS, e.g. Debug\n";
+		std::cout << "  per frame: animation " << animateMs / frameCount << " ms, transforms " << transformMs / frameCount
+			<< " ms, instance records " << recordMs / frameCount << " ms (" << movedCount / frameCount << " moved, "
+			<< rangeCount / frameCount << " upload ranges)\n";
+	}
+	return 0;
+}
@@ -0,0 +1,341 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include "libraries/nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+// Streaming reader for scene.json. nlohmann's SAX interface hands us one token
+// at a time and the handler writes it straight into SceneData, so no json DOM
+// is ever built. ReadSceneJson (ModelLoading.cpp) is the DOM reference
+// implementation this one has to match, see RunSceneJsonParityCheck.
+
+namespace
+{
+	typedef D3D12HelloTriangle::SceneData SceneData;
+	typedef D3D12HelloTriangle::ModelDesc ModelDesc;
+	typedef D3D12HelloTriangle::AnimationFrame AnimationFrame;
+
+	// Fields given on an animation frame. Missing ones repeat the previous frame,
+	// or the model itself, which is only known once the whole model was read.
+	const uint8_t kFrameHasPosition = 1;
+	const uint8_t kFrameHasRotation = 2;
+	const uint8_t kFrameHasScale = 4;
+
+	class SceneSaxHandler : public nlohmann::json_sax<json>
+	{
+	public:
+		explicit SceneSaxHandler(SceneData& scene) : m_scene(scene) {}
+
+		const std::string& Error() const { return m_error; }
+
+		bool null() override { return Scalar(Value()); }
+		bool boolean(bool val) override { Value v; v.type = Value::Bool; v.integer = val ? 1 : 0; v.real = v.integer; return Scalar(v); }
+		bool number_integer(number_integer_t val) override { Value v; v.type = Value::Number; v.integer = val; v.real = static_cast<double>(val); return Scalar(v); }
+		bool number_unsigned(number_unsigned_t val) override { Value v; v.type = Value::Number; v.integer = static_cast<int64_t>(val); v.real = static_cast<double>(val); return Scalar(v); }
+		bool number_float(number_float_t val, const string_t&) override { Value v; v.type = Value::Number; v.integer = static_cast<int64_t>(val); v.real = val; return Scalar(v); }
+		bool binary(binary_t&) override { return Fail("unexpected binary value"); }
+
+		bool string(string_t& val) override
+		{
+			if (!m_stack.empty() && Top() == Context::Model && m_key == "path")
+			{
+				m_model.path = val;
+				m_modelHasPath = true;
+				return true;
+			}
+			if (!m_stack.empty() && Top() == Context::Animation)
+			{
+				if (m_key == "rotationInterpolation" && !ParseInterpolation(val, m_model.rotationInterpolation))
+					return Fail("unknown rotationInterpolation '" + val + "'");
+				if (m_key == "positionInterpolation" && !ParseInterpolation(val, m_model.positionInterpolation))
+					return Fail("unknown positionInterpolation '" + val + "'");
+				return true;
+			}
+			Value v;
+			v.type = Value::String;
+			return Scalar(v);
+		}
+
+		bool key(string_t& val) override
+		{
+			m_key = val;
+			return true;
+		}
+
+		bool start_object(std::size_t) override
+		{
+			if (m_stack.empty())
+			{
+				m_stack.push_back(Context::Root);
+				return true;
+			}
+
+			Context next = Context::Skip;
+			switch (Top())
+			{
+			case Context::Root:
+				if (m_key == "camera")
+				{
+					next = Context::Camera;
+					m_scene.hasCamera = true;
+				}
+				else if (m_key == "light")
+				{
+					next = Context::Light;
+					m_scene.hasLight = true;
+				}
+				break;
+			case Context::Models:
+				next = Context::Model;
+				m_model = ModelDesc();
+				m_modelHasId = m_modelHasPath = false;
+				m_frameFields.clear();
+				break;
+			case Context::Model:
+				if (m_key == "animationFrames")
+					next = Context::Animation;
+				break;
+			case Context::Frames:
+				next = Context::Frame;
+				m_model.animationFrames.push_back(AnimationFrame());
+				m_model.animationFrames.back().time = 1.0f;
+				m_frameFields.push_back(0);
+				break;
+			default:
+				break;
+			}
+			m_stack.push_back(next);
+			return true;
+		}
+
+		bool end_object() override
+		{
+			if (Top() == Context::Model && !FinishModel())
+				return false;
+			m_stack.pop_back();
+			return true;
+		}
+
+		bool start_array(std::size_t) override
+		{
+			if (m_stack.empty())
+				return Fail("the scene must be an object");
+
+			Context next = Context::Skip;
+			XMFLOAT3* vector = nullptr;
+			switch (Top())
+			{
+			case Context::Root:
+				if (m_key == "models")
+				{
+					next = Context::Models;
+					m_scene.models.clear();
+				}
+				break;
+			case Context::Camera:
+				vector = m_key == "eye" ? &m_scene.cameraEye :
+					m_key == "center" ? &m_scene.cameraCenter :
+					m_key == "up" ? &m_scene.cameraUp : nullptr;
+				break;
+			case Context::Light:
+				vector = m_key == "position" ? &m_scene.light.position :
+					m_key == "color" ? &m_scene.light.color : nullptr;
+				break;
+			case Context::Model:
+				vector = m_key == "position" ? &m_model.position :
+					m_key == "rotation" ? &m_model.rotation :
+					m_key == "scale" ? &m_model.scale :
+					m_key == "albedo" ? &m_model.albedo : nullptr;
+				break;
+			case Context::Animation:
+				if (m_key == "frames")
+				{
+					next = Context::Frames;
+					m_model.animationFrames.clear();
+					m_frameFields.clear();
+				}
+				break;
+			case Context::Frame:
+			{
+				AnimationFrame& frame = m_model.animationFrames.back();
+				uint8_t& fields = m_frameFields.back();
+				if (m_key == "position") { vector = &frame.position; fields |= kFrameHasPosition; }
+				else if (m_key == "rotation") { vector = &frame.rotation; fields |= kFrameHasRotation; }
+				else if (m_key == "scale") { vector = &frame.scale; fields |= kFrameHasScale; }
+				else if (m_key == "tangent") vector = &frame.tangent;
+				break;
+			}
+			default:
+				break;
+			}
+
+			if (vector)
+			{
+				next = Context::Vector;
+				m_vector = vector;
+				m_vectorKey = m_key;
+				m_vectorCount = 0;
+			}
+			m_stack.push_back(next);
+			return true;
+		}
+
+		bool end_array() override
+		{
+			if (Top() == Context::Vector && m_vectorCount < 3)
+				return Fail("'" + m_vectorKey + "' needs 3 components");
+			m_stack.pop_back();
+			return true;
+		}
+
+		bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+		{
+			// Same message as the DOM reader, which sees the same exception
+			m_error = std::string("Scene JSON parse error: ") + ex.what();
+			return false;
+		}
+
+	private:
+		enum class Context { Root, Camera, Light, Models, Model, Animation, Frames, Frame, Vector, Skip };
+
+		struct Value
+		{
+			enum Type { Null, Bool, Number, String } type = Null;
+			int64_t integer = 0;
+			double real = 0.0;
+		};
+
+		Context Top() const { return m_stack.back(); }
+
+		bool Fail(const std::string& message)
+		{
+			m_error = "Scene JSON error: " + message;
+			return false;
+		}
+
+		bool Number(const Value& v, const char* field, float& out)
+		{
+			if (v.type != Value::Number && v.type != Value::Bool)
+				return Fail(std::string("'") + field + "' must be a number");
+			out = static_cast<float>(v.real);
+			return true;
+		}
+
+		bool Number(const Value& v, const char* field, int& out)
+		{
+			if (v.type != Value::Number && v.type != Value::Bool)
+				return Fail(std::string("'") + field + "' must be a number");
+			out = static_cast<int>(v.integer);
+			return true;
+		}
+
+		bool Scalar(const Value& v)
+		{
+			if (m_stack.empty())
+				return Fail("the scene must be an object");
+
+			switch (Top())
+			{
+			case Context::Vector:
+			{
+				float component = 0.0f;
+				if (!Number(v, m_vectorKey.c_str(), component))
+					return false;
+				// Extra components are ignored, like the DOM reader does
+				float* components[] = { &m_vector->x, &m_vector->y, &m_vector->z };
+				if (m_vectorCount < 3)
+					*components[m_vectorCount] = component;
+				m_vectorCount++;
+				return true;
+			}
+			case Context::Light:
+				if (m_key == "intensity")
+					return Number(v, "intensity", m_scene.light.intensity);
+				if (m_key == "type")
+					return Number(v, "type", m_scene.light.type);
+				return true;
+			case Context::Model:
+				if (m_key == "id")
+				{
+					m_modelHasId = true;
+					return Number(v, "id", m_model.id);
+				}
+				if (m_key == "path")
+					return Fail("'path' must be a string");
+				if (m_key == "emission")
+					return Number(v, "emission", m_model.emission);
+				if (m_key == "roughness")
+					return Number(v, "roughness", m_model.roughness);
+				if (m_key == "isMetallic")
+					return Number(v, "isMetallic", m_model.isMetallic);
+				if (m_key == "isGlass")
+					return Number(v, "isGlass", m_model.isGlass);
+				if (m_key == "IOR")
+					return Number(v, "IOR", m_model.IOR);
+				return true;
+			case Context::Frame:
+				if (m_key == "time")
+					return Number(v, "time", m_model.animationFrames.back().time);
+				return true;
+			default:
+				return true;
+			}
+		}
+
+		bool FinishModel()
+		{
+			if (!m_modelHasId || !m_modelHasPath)
+				return Fail("model " + std::to_string(m_scene.models.size()) + " needs an id and a path");
+
+			XMFLOAT3 prevPosition = m_model.position;
+			XMFLOAT3 prevRotation = m_model.rotation;
+			XMFLOAT3 prevScale = m_model.scale;
+			for (size_t i = 0; i < m_model.animationFrames.size(); i++)
+			{
+				AnimationFrame& frame = m_model.animationFrames[i];
+				const uint8_t fields = m_frameFields[i];
+				if (fields & kFrameHasPosition) prevPosition = frame.position; else frame.position = prevPosition;
+				if (fields & kFrameHasRotation) prevRotation = frame.rotation; else frame.rotation = prevRotation;
+				if (fields & kFrameHasScale) prevScale = frame.scale; else frame.scale = prevScale;
+			}
+
+			m_scene.models.push_back(std::move(m_model));
+			return true;
+		}
+
+		SceneData& m_scene;
+		std::string m_error;
+
+		std::vector<Context> m_stack;
+		std::string m_key;
+
+		ModelDesc m_model;
+		bool m_modelHasId = false;
+		bool m_modelHasPath = false;
+		std::vector<uint8_t> m_frameFields;
+
+		XMFLOAT3* m_vector = nullptr;
+		std::string m_vectorKey;
+		int m_vectorCount = 0;
+	};
+}
+
+bool D3D12HelloTriangle::ReadSceneJsonSax(const std::string& path, SceneData& outScene, std::string& outError)
+{
+	MappedFile file;
+	if (!file.Open(path))
+	{
+		outError = "Cannot open scene file: " + path;
+		return false;
+	}
+
+	SceneSaxHandler handler(outScene);
+	const char* begin = reinterpret_cast<const char*>(file.Data());
+	if (!json::sax_parse(begin, begin + file.Size(), &handler))
+	{
+		outError = handler.Error();
+		return false;
+	}
+	return true;
+}
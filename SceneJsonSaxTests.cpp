@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "FileUtils.h"
+#include "SceneGenerator.h"
+#include "TestUtils.h"
+#include <cfloat>
+#include <chrono>
+#include <iostream>
+
+// Reads every .json scene under Models/ with the DOM and the streaming reader
+// and compares the results. Returns 1 if any scene differs.
+int D3D12HelloTriangle::RunSceneJsonParityCheck()
+{
+	std::vector<std::string> paths;
+	FindFiles("Models/", ".json", paths);
+	if (paths.empty())
+	{
+		std::cout << "No .json scenes found in Models/\n";
+		return 1;
+	}
+
+	int result = 0;
+	for (const auto& path : paths)
+	{
+		SceneData dom, sax;
+		std::string domError, saxError;
+		bool domOk = ReadSceneJson(path, dom, domError);
+		bool saxOk = ReadSceneJsonSax(path, sax, saxError);
+
+		std::string status;
+		if (domOk != saxOk)
+			status = "FAIL (DOM: " + (domOk ? std::string("ok") : domError) + ", SAX: " + (saxOk ? std::string("ok") : saxError) + ")";
+		else if (!domOk)
+			status = domError == saxError ? "PASS (both fail: " + domError + ")" : "FAIL (" + domError + " / " + saxError + ")";
+		else
+			status = SameSceneData(dom, sax) ? "PASS" : "FAIL";
+
+		std::cout << path << ": " << status << " (" << dom.models.size() << " models)\n";
+		if (status.compare(0, 4, "FAIL") == 0)
+			result = 1;
+	}
+	return result;
+}
+
+// Parse time and heap traffic of the DOM and streaming scene.json readers on a
+// generated scene
+int D3D12HelloTriangle::RunSceneJsonBenchmark(unsigned instanceCount)
+{
+	if (instanceCount == 0)
+		instanceCount = 10000;
+
+	const std::string directory = "Cache/Scenes/";
+	const std::string path = directory + "bench.json";
+	const SceneData scene = GenerateBenchmarkScene(instanceCount);
+	if (!EnsureDirectory(directory) || !WriteSceneJson(path, scene))
+	{
+		std::cout << "Cannot write " << path << "\n";
+		return 1;
+	}
+
+	typedef bool (*SceneReader)(const std::string&, SceneData&, std::string&);
+	const SceneReader readers[] = { &ReadSceneJson, &ReadSceneJsonSax };
+	const char* names[] = { "DOM", "SAX" };
+
+	int result = 0;
+	for (int r = 0; r < 2; r++)
+	{
+		double bestMs = DBL_MAX;
+		for (int run = 0; run < 5; run++)
+		{
+			SceneData loaded;
+			std::string error;
+			const auto start = std::chrono::high_resolution_clock::now();
+			bool ok = readers[r](path, loaded, error);
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			bestMs = ms < bestMs ? ms : bestMs;
+			if (run == 0 && (!ok || !SameSceneData(scene, loaded)))
+			{
+				std::cout << names[r] << ": does not match the generated scene " << error << "\n";
+				result = 1;
+			}
+		}
+
+		if (!kAllocationCounters)
+		{
+			std::cout << names[r] << ": best of 5 " << bestMs << " ms\n";
+			continue;
+		}
+
+		// One more run just for the heap statistics, the result is freed outside the window
+		SceneData loaded;
+		std::string error;
+		ResetAllocationCounters();
+		g_countAllocations = true;
+		readers[r](path, loaded, error);
+		g_countAllocations = false;
+
+		std::cout << names[r] << ": best of 5 " << bestMs << " ms, " << g_allocationCount.load() << " allocations, "
+			<< g_allocatedBytes.load() / 1024 << " KB allocated, peak " << g_peakLiveBytes.load() / 1024 << " KB live\n";
+	}
+	if (kAllocationCounters)
+		std::cout << "(" << instanceCount << " instances; the SceneData result itself is included in every reader's numbers)\n";
+	else
+		std::cout << "(" << instanceCount << " instances; heap statistics need a build with COUNT_ALLOCATIONS, e.g. Debug)\n";
+	return result;
+}
@@ -0,0 +1,237 @@
+#include "stdafx.h"
+#include "ShaderCache.h"
+#include "FileUtils.h"
+#include <cstring>
+#include <set>
+
+// Layout of a cache entry, Cache/Shaders/<key>.dxil:
+//   ShaderCacheHeader
+//   char binary[binarySize]
+//
+// The key is also in the header, and the binary hash catches a damaged file;
+// either mismatch is a miss and the entry is written again.
+
+namespace
+{
+	const uint32_t kShaderCacheMagic = 0x52444853; // "SHDR"
+	const uint32_t kShaderCacheVersion = 1;
+	const int kMaxIncludeDepth = 32;
+
+	struct ShaderCacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t key;
+		uint64_t binarySize;
+		uint64_t binaryHash;
+	};
+
+	struct IncludeDirective
+	{
+		std::string name;
+		bool quoted; // "name" rather than <name>
+	};
+
+	// The #include lines of `source`, also those inside #if blocks or block
+	// comments: an include too many only costs an invalidation
+	std::vector<IncludeDirective> FindIncludes(const std::string& source)
+	{
+		std::vector<IncludeDirective> includes;
+		size_t lineStart = 0;
+		while (lineStart < source.size())
+		{
+			size_t lineEnd = source.find('\n', lineStart);
+			if (lineEnd == std::string::npos)
+				lineEnd = source.size();
+
+			size_t i = lineStart;
+			auto skipSpaces = [&]() {
+				while (i < lineEnd && (source[i] == ' ' || source[i] == '\t'))
+					i++;
+			};
+			skipSpaces();
+			if (i < lineEnd && source[i] == '#')
+			{
+				i++;
+				skipSpaces();
+				if (source.compare(i, 7, "include") == 0)
+				{
+					i += 7;
+					skipSpaces();
+					if (i < lineEnd && (source[i] == '"' || source[i] == '<'))
+					{
+						const char close = source[i] == '"' ? '"' : '>';
+						const size_t nameEnd = source.find(close, i + 1);
+						if (nameEnd != std::string::npos && nameEnd < lineEnd)
+							includes.push_back({ source.substr(i + 1, nameEnd - i - 1), close == '"' });
+					}
+				}
+			}
+			lineStart = lineEnd + 1;
+		}
+		return includes;
+	}
+
+	std::string JoinPath(const std::string& directory, const std::string& name)
+	{
+		if (directory.empty())
+			return name;
+		const char last = directory[directory.size() - 1];
+		return last == '/' || last == '\\' ? directory + name : directory + "/" + name;
+	}
+
+	uint64_t HashString(const std::string& text, uint64_t seed)
+	{
+		// The terminator keeps "ab"+"c" and "a"+"bc" apart
+		return HashFnv1a64(text.c_str(), text.size() + 1, seed);
+	}
+
+	// Hashes `path` and, depth first, every file it includes
+	void HashFileTree(const std::string& path, const std::string& contents, const ShaderCompileRequest& request,
+		int depth, std::set<std::string>& visited, std::vector<std::string>& files, uint64_t& hash)
+	{
+		files.push_back(path);
+		hash = HashString(path, hash);
+		const uint64_t size = contents.size();
+		hash = HashFnv1a64(&size, sizeof(size), hash);
+		hash = HashFnv1a64(contents.data(), contents.size(), hash);
+		if (depth >= kMaxIncludeDepth)
+			return;
+
+		for (const IncludeDirective& include : FindIncludes(contents))
+		{
+			std::vector<std::string> candidates;
+			if (include.quoted)
+				candidates.push_back(JoinPath(DirectoryOf(path), include.name));
+			for (const std::string& directory : request.includeDirectories)
+				candidates.push_back(JoinPath(directory, include.name));
+
+			// An include found nowhere adds nothing; once it appears, its
+			// contents change the key
+			for (const std::string& candidate : candidates)
+			{
+				std::vector<char> data;
+				if (!ReadWholeFile(candidate, data))
+					continue;
+				// Included twice, as with include guards, it only counts once
+				if (visited.insert(candidate).second)
+					HashFileTree(candidate, std::string(data.begin(), data.end()), request, depth + 1, visited, files, hash);
+				break;
+			}
+		}
+	}
+}
+
+ShaderCache::ShaderCache(ShaderCompilerBackend& compiler, const std::string& directory)
+	: m_compiler(compiler), m_directory(directory), m_compilerVersion(compiler.Version())
+{
+}
+
+bool ShaderCache::ComputeKey(const ShaderCompileRequest& request, uint64_t& outKey, std::vector<std::string>* outFiles)
+{
+	std::vector<char> source;
+	if (!ReadWholeFile(request.path, source))
+		return false;
+	outKey = HashRequest(request, std::string(source.begin(), source.end()), outFiles);
+	return true;
+}
+
+uint64_t ShaderCache::HashRequest(const ShaderCompileRequest& request, const std::string& source, std::vector<std::string>* outFiles)
+{
+	uint64_t hash = HashFnv1a64(m_compilerVersion.c_str(), m_compilerVersion.size() + 1);
+	hash = HashString(request.target, hash);
+	hash = HashString(request.entryPoint, hash);
+	for (const auto& define : request.defines)
+	{
+		hash = HashString(define.first, hash);
+		hash = HashString(define.second, hash);
+	}
+	for (const std::string& directory : request.includeDirectories)
+		hash = HashString(directory, hash);
+
+	std::set<std::string> visited;
+	visited.insert(request.path);
+	std::vector<std::string> files;
+	HashFileTree(request.path, source, request, 0, visited, files, hash);
+
+	if (outFiles)
+		*outFiles = files;
+	return hash;
+}
+
+std::string ShaderCache::EntryPath(uint64_t key) const
+{
+	return m_directory + ToHexString(key) + ".dxil";
+}
+
+bool ShaderCache::Compile(const ShaderCompileRequest& request, std::vector<char>& outBinary, std::string& outErrors)
+{
+	std::vector<char> data;
+	if (!ReadWholeFile(request.path, data))
+	{
+		outErrors = "Cannot read shader file " + request.path;
+		m_stats.failed++;
+		return false;
+	}
+
+	// The compiler gets the bytes that were hashed, so a save landing in
+	// between cannot store a binary under the key of the older source
+	const std::string source(data.begin(), data.end());
+	const uint64_t key = HashRequest(request, source, nullptr);
+	if (ReadEntry(key, outBinary))
+	{
+		m_stats.hits++;
+		return true;
+	}
+
+	if (!m_compiler.Compile(request, source, outBinary, outErrors))
+	{
+		m_stats.failed++;
+		return false;
+	}
+	m_stats.compiled++;
+	if (!WriteEntry(key, outBinary))
+		m_stats.writeFailures++;
+	return true;
+}
+
+bool ShaderCache::ReadEntry(uint64_t key, std::vector<char>& outBinary)
+{
+	std::vector<char> data;
+	if (!ReadWholeFile(EntryPath(key), data) || data.size() < sizeof(ShaderCacheHeader))
+		return false;
+
+	ShaderCacheHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+	if (header.magic != kShaderCacheMagic ||
+		header.version != kShaderCacheVersion ||
+		header.key != key ||
+		header.binarySize != data.size() - sizeof(header))
+		return false;
+
+	const char* binary = data.data() + sizeof(header);
+	if (HashFnv1a64(binary, static_cast<size_t>(header.binarySize)) != header.binaryHash)
+		return false;
+
+	outBinary.assign(binary, binary + header.binarySize);
+	return true;
+}
+
+bool ShaderCache::WriteEntry(uint64_t key, const std::vector<char>& binary)
+{
+	ShaderCacheHeader header = {};
+	header.magic = kShaderCacheMagic;
+	header.version = kShaderCacheVersion;
+	header.key = key;
+	header.binarySize = binary.size();
+	header.binaryHash = HashFnv1a64(binary.data(), binary.size());
+
+	std::vector<char> blob(sizeof(header) + binary.size());
+	memcpy(blob.data(), &header, sizeof(header));
+	if (!binary.empty())
+		memcpy(blob.data() + sizeof(header), binary.data(), binary.size());
+
+	if (!EnsureDirectory(m_directory))
+		return false;
+	return WriteFileAtomic(EntryPath(key), blob.data(), blob.size());
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// On-disk cache of compiled shaders. An entry is keyed by a hash of the
+// source, every file it includes (resolved the way the compiler would), the
+// entry point, target, defines and compiler version, so any edit or compiler
+// update misses and recompiles. The compiler is behind ShaderCompilerBackend:
+// DXC in the renderer, a stub in tests.
+
+struct ShaderCompileRequest
+{
+	std::string path;       // source file, e.g. "shaders/RayGen.hlsl"
+	std::string entryPoint; // empty for libraries
+	std::string target;     // profile, e.g. "lib_6_3" or "cs_6_0"
+	std::vector<std::pair<std::string, std::string> > defines;
+	std::vector<std::string> includeDirectories; // searched after the including file's directory
+};
+
+class ShaderCompilerBackend
+{
+public:
+	virtual ~ShaderCompilerBackend() {}
+
+	// Identifies the compiler build; part of every key
+	virtual std::string Version() = 0;
+	// Compiles `source`, the contents of request.path; on failure `outErrors` says why
+	virtual bool Compile(const ShaderCompileRequest& request, const std::string& source,
+		std::vector<char>& outBinary, std::string& outErrors) = 0;
+};
+
+struct ShaderCacheStats
+{
+	size_t hits = 0;
+	size_t compiled = 0;
+	size_t failed = 0;        // compile errors, never cached
+	size_t writeFailures = 0; // compiled but could not be stored
+};
+
+class ShaderCache
+{
+public:
+	explicit ShaderCache(ShaderCompilerBackend& compiler, const std::string& directory = "Cache/Shaders/");
+
+	// Binary of `request`, from the cache or compiled and stored
+	bool Compile(const ShaderCompileRequest& request, std::vector<char>& outBinary, std::string& outErrors);
+
+	// Key of `request` with the files as they are now. `outFiles` gets the
+	// source and the includes found, in the order they were hashed. False when
+	// the source cannot be read.
+	bool ComputeKey(const ShaderCompileRequest& request, uint64_t& outKey, std::vector<std::string>* outFiles = nullptr);
+	std::string EntryPath(uint64_t key) const;
+
+	const ShaderCacheStats& Stats() const { return m_stats; }
+
+private:
+	// Key of `request` with `source` as the contents of request.path
+	uint64_t HashRequest(const ShaderCompileRequest& request, const std::string& source, std::vector<std::string>* outFiles);
+	bool ReadEntry(uint64_t key, std::vector<char>& outBinary);
+	bool WriteEntry(uint64_t key, const std::vector<char>& binary);
+
+	ShaderCompilerBackend& m_compiler;
+	std::string m_directory;
+	std::string m_compilerVersion;
+	ShaderCacheStats m_stats;
+};
+
+// ShaderCache keys, hits and invalidation with a stub compiler (-testshadercache), ShaderCacheTests.cpp
+int RunShaderCacheSelfTest();
@@ -0,0 +1,162 @@
+#include "stdafx.h"
+#include "ShaderCache.h"
+#include "FileUtils.h"
+#include "ShaderTestCompilers.h"
+#include "TestUtils.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <set>
+
+// ShaderCache with a stub compiler on files written under Cache/: hits and
+// misses, persistence across instances, invalidation by every part of the
+// key, include resolution and damaged entries.
+int RunShaderCacheSelfTest()
+{
+	TestChecks check;
+
+	const std::string root = "Cache/ShaderCacheTest/";
+	const std::string sources = root + "src/";
+	const std::string cacheDirectory = root + "cache/";
+	if (!EnsureDirectory(sources + "lib"))
+	{
+		std::cout << "FAIL cannot create " << sources << "\n";
+		return 1;
+	}
+	auto writeText = [](const std::string& path, const std::string& text) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << text;
+	};
+	auto exists = [](const std::string& path) {
+		std::vector<char> data;
+		return ReadWholeFile(path, data);
+	};
+	std::set<std::string> entries;
+
+	writeText(sources + "Main.hlsl", "#include \"Common.hlsl\"\n  #  include <Inc.hlsl>\nvoid Main() {}\n");
+	writeText(sources + "Common.hlsl", "#ifndef COMMON\n#define COMMON\nfloat common;\n#endif\n");
+	writeText(sources + "lib/Inc.hlsl", "#include \"Common.hlsl\"\nfloat inc;\n");
+
+	// A version no earlier run used, so entries left by one do not hit
+	const std::string version = "stub " + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	StubShaderCompiler compiler(version);
+	ShaderCompileRequest request;
+	request.path = sources + "Main.hlsl";
+	request.entryPoint = "Main";
+	request.target = "lib_6_3";
+	request.includeDirectories = { sources + "lib" };
+
+	{
+		ShaderCache cache(compiler, cacheDirectory);
+		uint64_t key = 0;
+		std::vector<std::string> files;
+		check(cache.ComputeKey(request, key, &files) && files.size() == 3 && files[1] == sources + "Common.hlsl" &&
+			files[2] == sources + "lib/Inc.hlsl", "the key covers the source and both includes, each once");
+		entries.insert(cache.EntryPath(key));
+
+		std::vector<char> first, second;
+		std::string errors;
+		check(cache.Compile(request, first, errors) && compiler.calls == 1 && cache.Stats().compiled == 1 && exists(cache.EntryPath(key)),
+			"first compile misses and stores the entry");
+		check(cache.Compile(request, second, errors) && compiler.calls == 1 && cache.Stats().hits == 1 && second == first,
+			"second compile hits with the same binary");
+	}
+
+	{
+		ShaderCache cache(compiler, cacheDirectory);
+		std::vector<char> binary;
+		std::string errors;
+		check(cache.Compile(request, binary, errors) && compiler.calls == 1, "a new cache instance hits what the previous one stored");
+
+		uint64_t before = 0, after = 0;
+		cache.ComputeKey(request, before);
+		writeText(sources + "Common.hlsl", "#ifndef COMMON\n#define COMMON\nfloat common2;\n#endif\n");
+		cache.ComputeKey(request, after);
+		entries.insert(cache.EntryPath(after));
+		check(after != before && cache.Compile(request, binary, errors) && compiler.calls == 2, "editing an include misses");
+		writeText(sources + "Common.hlsl", "#ifndef COMMON\n#define COMMON\nfloat common;\n#endif\n");
+		check(cache.Compile(request, binary, errors) && compiler.calls == 2, "undoing the edit hits the earlier entry");
+
+		writeText(sources + "lib/Inc.hlsl", "#include \"Common.hlsl\"\nfloat inc2;\n");
+		cache.ComputeKey(request, after);
+		check(after != before, "editing an include found through the include directories changes the key");
+		writeText(sources + "lib/Inc.hlsl", "#include \"Common.hlsl\"\nfloat inc;\n");
+	}
+
+	{
+		ShaderCache cache(compiler, cacheDirectory);
+		uint64_t base = 0;
+		cache.ComputeKey(request, base);
+		auto keyOf = [&cache](const ShaderCompileRequest& changed) {
+			uint64_t key = 0;
+			cache.ComputeKey(changed, key);
+			return key;
+		};
+		ShaderCompileRequest changed = request;
+		changed.entryPoint = "Other";
+		const uint64_t entryKey = keyOf(changed);
+		changed = request;
+		changed.target = "lib_6_5";
+		const uint64_t targetKey = keyOf(changed);
+		changed = request;
+		changed.defines.push_back({ "COMPACT_VERTICES", "1" });
+		const uint64_t defineKey = keyOf(changed);
+		changed.defines[0].second = "0";
+		const uint64_t defineValueKey = keyOf(changed);
+		check(entryKey != base && targetKey != base && defineKey != base && defineValueKey != base && defineValueKey != defineKey,
+			"entry point, target, defines and define values are part of the key");
+
+		StubShaderCompiler newer(version + ".1");
+		ShaderCache newerCache(newer, cacheDirectory);
+		uint64_t newerKey = 0;
+		newerCache.ComputeKey(request, newerKey);
+		check(newerKey != base, "another compiler version changes the key");
+	}
+
+	{
+		ShaderCache cache(compiler, cacheDirectory);
+		ShaderCompileRequest later = request;
+		later.path = sources + "Later.hlsl";
+		std::remove((sources + "NotYet.hlsl").c_str());
+		writeText(later.path, "#include \"NotYet.hlsl\"\n");
+		uint64_t before = 0, after = 0;
+		check(cache.ComputeKey(later, before), "a missing include still gives a key");
+		writeText(sources + "NotYet.hlsl", "float notYet;\n");
+		cache.ComputeKey(later, after);
+		check(after != before, "the missing include appearing changes the key");
+
+		ShaderCompileRequest cycle = request;
+		cycle.path = sources + "CycleA.hlsl";
+		writeText(sources + "CycleA.hlsl", "#include \"CycleB.hlsl\"\n");
+		writeText(sources + "CycleB.hlsl", "#include \"CycleA.hlsl\"\n");
+		std::vector<std::string> files;
+		check(cache.ComputeKey(cycle, before, &files) && files.size() == 2, "files including each other are hashed once each");
+	}
+
+	{
+		ShaderCache cache(compiler, cacheDirectory);
+		uint64_t key = 0;
+		cache.ComputeKey(request, key);
+		writeText(cache.EntryPath(key), "SHDR");
+		std::vector<char> binary;
+		std::string errors;
+		const size_t calls = compiler.calls;
+		check(cache.Compile(request, binary, errors) && compiler.calls == calls + 1, "a damaged entry is compiled again");
+		check(cache.Compile(request, binary, errors) && compiler.calls == calls + 1, "and rewritten");
+
+		ShaderCompileRequest broken = request;
+		broken.path = sources + "Broken.hlsl";
+		writeText(broken.path, "#error nope\n");
+		cache.ComputeKey(broken, key);
+		check(!cache.Compile(broken, binary, errors) && errors.find("#error") != std::string::npos && !exists(cache.EntryPath(key)) &&
+			cache.Stats().failed == 1, "a compile error is reported and not cached");
+
+		broken.path = sources + "Missing.hlsl";
+		check(!cache.Compile(broken, binary, errors) && cache.Stats().failed == 2, "a missing source fails");
+	}
+
+	for (const std::string& entry : entries)
+		std::remove(entry.c_str());
+
+	return check.Finish("shader cache");
+}
@@ -0,0 +1,86 @@
+#include "stdafx.h"
+#include "ShaderCompileScheduler.h"
+#include <chrono>
+
+ShaderCompileScheduler::ShaderCompileScheduler(CompilerFactory makeCompiler, const std::string& cacheDirectory, unsigned threadCount)
+	: m_makeCompiler(makeCompiler), m_cacheDirectory(cacheDirectory), m_pool(threadCount)
+{
+}
+
+void ShaderCompileScheduler::Dispatch(const std::vector<ShaderCompileRequest>& requests)
+{
+	for (const ShaderCompileRequest& request : requests)
+	{
+		m_pending.push_back(m_pool.Submit([this, request]() {
+			const auto start = std::chrono::high_resolution_clock::now();
+			Worker& worker = CurrentWorker();
+			const size_t hitsBefore = worker.cache->Stats().hits;
+
+			ShaderCompileResult result;
+			result.ok = worker.cache->Compile(request, result.binary, result.errors);
+			result.cached = worker.cache->Stats().hits != hitsBefore;
+			result.ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			return result;
+		}));
+	}
+}
+
+std::vector<ShaderCompileResult> ShaderCompileScheduler::Join()
+{
+	// Everything finishes before a failure is rethrown, so nothing is left running
+	std::vector<std::future<ShaderCompileResult> > pending;
+	pending.swap(m_pending);
+	for (auto& job : pending)
+		job.wait();
+
+	std::vector<ShaderCompileResult> results;
+	for (auto& job : pending)
+		results.push_back(job.get());
+	return results;
+}
+
+bool ShaderCompileScheduler::Busy() const
+{
+	for (const auto& job : m_pending)
+	{
+		if (job.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return true;
+	}
+	return false;
+}
+
+size_t ShaderCompileScheduler::CompilerCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_workers.size();
+}
+
+ShaderCacheStats ShaderCompileScheduler::Stats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	ShaderCacheStats total;
+	for (const auto& worker : m_workers)
+	{
+		const ShaderCacheStats& stats = worker.second->cache->Stats();
+		total.hits += stats.hits;
+		total.compiled += stats.compiled;
+		total.failed += stats.failed;
+		total.writeFailures += stats.writeFailures;
+	}
+	return total;
+}
+
+ShaderCompileScheduler::Worker& ShaderCompileScheduler::CurrentWorker()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::unique_ptr<Worker>& worker = m_workers[std::this_thread::get_id()];
+	if (!worker)
+	{
+		// Made under the lock: compilers may not be safe to create concurrently either
+		std::unique_ptr<Worker> created(new Worker());
+		created->compiler = m_makeCompiler();
+		created->cache.reset(new ShaderCache(*created->compiler, m_cacheDirectory));
+		worker = std::move(created);
+	}
+	return *worker;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "ShaderCache.h"
+#include "ThreadPool.h"
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+struct ShaderCompileResult
+{
+	bool ok = false;
+	std::vector<char> binary;
+	std::string errors;
+	bool cached = false; // from the cache, nothing compiled
+	double ms = 0.0;     // on the worker, cache lookup included
+};
+
+// Compiles shaders through ShaderCache on a pool of worker threads. Compilers
+// are not shared between threads: each worker makes its own, and its own
+// cache over the same directory, the first time it picks up a job.
+class ShaderCompileScheduler
+{
+public:
+	typedef std::function<std::unique_ptr<ShaderCompilerBackend>()> CompilerFactory;
+
+	// threadCount == 0 uses one worker per hardware thread
+	ShaderCompileScheduler(CompilerFactory makeCompiler, const std::string& cacheDirectory, unsigned threadCount = 0);
+
+	// Starts compiling `requests` behind any batch still running
+	void Dispatch(const std::vector<ShaderCompileRequest>& requests);
+	// Waits for everything dispatched; results in dispatch order
+	std::vector<ShaderCompileResult> Join();
+	// True while something dispatched is still compiling; Join() then blocks
+	bool Busy() const;
+
+	unsigned ThreadCount() const { return m_pool.Size(); }
+	size_t CompilerCount();
+	// Summed over the workers; only while no batch is running
+	ShaderCacheStats Stats();
+
+private:
+	struct Worker
+	{
+		std::unique_ptr<ShaderCompilerBackend> compiler;
+		std::unique_ptr<ShaderCache> cache;
+	};
+	Worker& CurrentWorker();
+
+	CompilerFactory m_makeCompiler;
+	std::string m_cacheDirectory;
+	std::mutex m_mutex;
+	std::map<std::thread::id, std::unique_ptr<Worker> > m_workers;
+	std::vector<std::future<ShaderCompileResult> > m_pending;
+	// Last, so the workers are joined before the state they use goes away
+	ThreadPool m_pool;
+};
+
+// ShaderCompileScheduler with a mock compiler that sleeps (-testshaderscheduler), ShaderCompileSchedulerTests.cpp
+int RunShaderSchedulerSelfTest();
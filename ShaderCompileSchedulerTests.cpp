@@ -0,0 +1,102 @@
+#include "stdafx.h"
+#include "ShaderCompileScheduler.h"
+#include "FileUtils.h"
+#include "ShaderTestCompilers.h"
+#include "TestUtils.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+// ShaderCompileScheduler with compilers that sleep 50 ms per shader: results
+// in dispatch order, a compiler per worker never shared, compiles overlapping,
+// failures reported per shader, and a second batch served by the cache.
+int RunShaderSchedulerSelfTest()
+{
+	TestChecks check;
+
+	const std::string sources = "Cache/ShaderSchedulerTest/src/";
+	const std::string cacheDirectory = "Cache/ShaderSchedulerTest/cache/";
+	if (!EnsureDirectory(sources))
+	{
+		std::cout << "FAIL cannot create " << sources << "\n";
+		return 1;
+	}
+	std::vector<ShaderCompileRequest> requests;
+	for (int i = 0; i < 9; i++)
+	{
+		ShaderCompileRequest request;
+		request.path = sources + "Shader" + std::to_string(i) + ".hlsl";
+		request.target = "lib_6_3";
+		std::ofstream(request.path, std::ios::binary | std::ios::trunc) << (i == 4 ? "#error broken\n" : "float shader" + std::to_string(i) + ";\n");
+		requests.push_back(request);
+	}
+
+	// A version no earlier run used, so their entries do not hit
+	const std::string version = "slow " + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	const int latencyMs = 50;
+	auto run = [&](unsigned threadCount, SlowShaderCompiler::Shared& shared, size_t& compilers, double& wallMs) {
+		ShaderCompileScheduler scheduler([&shared, &version, latencyMs]() {
+			return std::unique_ptr<ShaderCompilerBackend>(new SlowShaderCompiler(shared, version + " " + std::to_string(reinterpret_cast<uintptr_t>(&shared)), latencyMs));
+		}, cacheDirectory, threadCount);
+		const auto start = std::chrono::high_resolution_clock::now();
+		scheduler.Dispatch(requests);
+		std::vector<ShaderCompileResult> results = scheduler.Join();
+		wallMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+		compilers = scheduler.CompilerCount();
+		return results;
+	};
+
+	SlowShaderCompiler::Shared serialShared, parallelShared;
+	size_t serialCompilers = 0, parallelCompilers = 0;
+	double serialMs = 0.0, parallelMs = 0.0;
+	const std::vector<ShaderCompileResult> serial = run(1, serialShared, serialCompilers, serialMs);
+	const unsigned threadCount = 4;
+	const std::vector<ShaderCompileResult> parallel = run(threadCount, parallelShared, parallelCompilers, parallelMs);
+
+	bool ordered = serial.size() == requests.size() && parallel.size() == requests.size();
+	for (size_t i = 0; ordered && i < requests.size(); i++)
+	{
+		const std::string expected = requests[i].path + "|lib_6_3|float shader" + std::to_string(i) + ";\n";
+		ordered = i == 4 ? !parallel[i].ok && parallel[i].errors.find("#error") != std::string::npos :
+			parallel[i].ok && std::string(parallel[i].binary.begin(), parallel[i].binary.end()) == expected && parallel[i].binary == serial[i].binary;
+	}
+	check(ordered, "results come back in dispatch order, the broken shader failing alone");
+	check(serialShared.peak == 1 && serialCompilers == 1, "one thread: one compiler, no overlap");
+	check(parallelShared.peak > 1 && parallelCompilers <= threadCount && parallelCompilers > 1,
+		"four threads: compiles overlap, at most one compiler per worker");
+	check(serialShared.sharedUse == 0 && parallelShared.sharedUse == 0, "a compiler is only ever used by the thread that made it");
+	std::cout << "  9 shaders at " << latencyMs << " ms: " << serialMs << " ms on 1 thread, " << parallelMs << " ms on " << threadCount << "\n";
+
+	{
+		// The same compilers again: all but the broken shader come from the cache
+		SlowShaderCompiler::Shared& shared = parallelShared;
+		const int callsBefore = shared.calls;
+		ShaderCompileScheduler scheduler([&shared, &version, latencyMs]() {
+			return std::unique_ptr<ShaderCompilerBackend>(new SlowShaderCompiler(shared, version + " " + std::to_string(reinterpret_cast<uintptr_t>(&shared)), latencyMs));
+		}, cacheDirectory, threadCount);
+		scheduler.Dispatch(requests);
+		const std::vector<ShaderCompileResult> again = scheduler.Join();
+		size_t cached = 0;
+		for (const ShaderCompileResult& result : again)
+			cached += result.cached ? 1 : 0;
+		const ShaderCacheStats stats = scheduler.Stats();
+		check(cached == requests.size() - 1 && shared.calls == callsBefore + 1 && stats.hits == cached && stats.failed == 1,
+			"a second batch hits the cache, only the broken shader compiles again");
+	}
+
+	{
+		// Batches dispatched back to back are joined together
+		SlowShaderCompiler::Shared shared;
+		ShaderCompileScheduler scheduler([&shared, &version]() {
+			return std::unique_ptr<ShaderCompilerBackend>(new SlowShaderCompiler(shared, version + " batches", 1));
+		}, cacheDirectory, 2);
+		scheduler.Dispatch(std::vector<ShaderCompileRequest>(requests.begin(), requests.begin() + 3));
+		scheduler.Dispatch(std::vector<ShaderCompileRequest>(requests.begin() + 3, requests.end()));
+		const std::vector<ShaderCompileResult> results = scheduler.Join();
+		check(results.size() == requests.size() && results[8].ok && scheduler.Join().empty(), "two dispatches, one join with every result");
+	}
+
+	return check.Finish("shader scheduler");
+}
@@ -0,0 +1,100 @@
+#include "stdafx.h"
+#include "ShaderHotReload.h"
+
+void ShaderHotReload::Track(size_t shader, const std::vector<std::string>& files)
+{
+	m_files[shader] = files;
+}
+
+std::vector<std::string> ShaderHotReload::WatchedFiles() const
+{
+	std::set<std::string> files;
+	for (const auto& shader : m_files)
+		files.insert(shader.second.begin(), shader.second.end());
+	return std::vector<std::string>(files.begin(), files.end());
+}
+
+std::vector<size_t> ShaderHotReload::Dependents(const std::string& file) const
+{
+	std::vector<size_t> dependents;
+	for (const auto& shader : m_files)
+	{
+		for (const std::string& dependency : shader.second)
+		{
+			if (dependency == file)
+			{
+				dependents.push_back(shader.first);
+				break;
+			}
+		}
+	}
+	return dependents;
+}
+
+void ShaderHotReload::FilesChanged(const std::vector<std::string>& files)
+{
+	bool marked = false;
+	for (const std::string& file : files)
+	{
+		for (size_t shader : Dependents(file))
+		{
+			m_dirty.insert(shader);
+			marked = true;
+		}
+	}
+	// A failed batch never went live, so it goes again with whatever fixes it
+	if (marked && m_state == State::Failed)
+		m_dirty.insert(m_batch.begin(), m_batch.end());
+}
+
+std::vector<size_t> ShaderHotReload::BeginCompile()
+{
+	if (m_state == State::Compiling || m_state == State::Ready || m_dirty.empty())
+		return {};
+
+	m_batch.assign(m_dirty.begin(), m_dirty.end());
+	m_dirty.clear();
+	m_state = State::Compiling;
+	return m_batch;
+}
+
+void ShaderHotReload::CompileFinished(const std::vector<bool>& ok, const std::string& errors)
+{
+	if (m_state != State::Compiling)
+		return;
+
+	bool allOk = ok.size() == m_batch.size();
+	for (size_t i = 0; allOk && i < ok.size(); i++)
+		allOk = ok[i];
+	m_state = allOk ? State::Ready : State::Failed;
+	if (!allOk)
+		m_error = errors;
+}
+
+std::vector<size_t> ShaderHotReload::TakeSwap()
+{
+	if (m_state != State::Ready)
+		return {};
+
+	m_state = State::Idle;
+	m_error.clear();
+	return m_batch;
+}
+
+void ShaderHotReload::SwapFailed(const std::string& errors)
+{
+	m_state = State::Failed;
+	m_error = errors;
+}
+
+const char* ShaderHotReload::StateName(State state)
+{
+	switch (state)
+	{
+	case State::Idle: return "up to date";
+	case State::Compiling: return "compiling";
+	case State::Ready: return "waiting for frame";
+	case State::Failed: return "failed";
+	}
+	return "";
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Bookkeeping of shader hot reload, without a device or a compiler.
+//
+// Every shader is tracked with the files it is built from, its source and
+// whatever it includes as ShaderCache::ComputeKey finds them, so a save of
+// Common.hlsl marks every shader including it. The marked shaders compile as
+// one batch in the background and the batch goes live at a frame boundary,
+// only if all of it compiled: a broken save leaves the running pipeline as it
+// was. Saves made while a batch compiles wait for the next one.
+class ShaderHotReload
+{
+public:
+	enum class State
+	{
+		Idle,      // nothing compiled that is not live
+		Compiling, // a batch is on the workers
+		Ready,     // the batch compiled, waiting for TakeSwap()
+		Failed,    // the batch did not compile or link; the old pipeline stays
+	};
+
+	// Shader `shader` is built from `files`, replacing what it was built from
+	void Track(size_t shader, const std::vector<std::string>& files);
+	// Every file some shader is built from, sorted
+	std::vector<std::string> WatchedFiles() const;
+	// The shaders built from `file`, sorted
+	std::vector<size_t> Dependents(const std::string& file) const;
+
+	// `files` were saved: their dependents go into the next batch
+	void FilesChanged(const std::vector<std::string>& files);
+	// The shaders of the next batch, or none while a batch is compiling or
+	// waiting to be swapped in, or when nothing changed
+	std::vector<size_t> BeginCompile();
+	// Outcome of the batch BeginCompile returned, `ok` per shader in its order
+	void CompileFinished(const std::vector<bool>& ok, const std::string& errors);
+	// At a frame boundary: the shaders of a compiled batch to swap in, once
+	std::vector<size_t> TakeSwap();
+	// The pipeline could not be built from the batch TakeSwap returned, and the
+	// old one was put back
+	void SwapFailed(const std::string& errors);
+
+	State GetState() const { return m_state; }
+	// The shaders of the batch compiling, ready or last swapped, in order
+	const std::vector<size_t>& Batch() const { return m_batch; }
+	// Of the last batch that failed, until one goes live
+	const std::string& Error() const { return m_error; }
+	static const char* StateName(State state);
+
+private:
+	std::map<size_t, std::vector<std::string> > m_files;
+	std::set<size_t> m_dirty;
+	std::vector<size_t> m_batch; // the one compiling, ready, failed or last swapped
+	State m_state = State::Idle;
+	std::string m_error;
+};
+
+// ShaderHotReload dependencies and swap state machine, no GPU (-testshaderreload), ShaderHotReloadTests.cpp
+int RunShaderHotReloadSelfTest();
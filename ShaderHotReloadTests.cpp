@@ -0,0 +1,248 @@
+#include "stdafx.h"
+#include "ShaderHotReload.h"
+#include "ShaderCompileScheduler.h"
+#include "FileUtils.h"
+#include "ShaderTestCompilers.h"
+#include "TestUtils.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+// ShaderHotReload without a GPU: dependencies found through ShaderCache on
+// files written under Cache/, batches and the swap state machine on scripted
+// saves, a reload loop over ShaderCompileScheduler with a broken save and its
+// fix, and random saves and outcomes checked against a model of what is live.
+int RunShaderHotReloadSelfTest()
+{
+	TestChecks check;
+	typedef ShaderHotReload::State State;
+	typedef std::vector<size_t> Shaders;
+
+	const std::string sources = "Cache/ShaderReloadTest/src/";
+	const std::string cacheDirectory = "Cache/ShaderReloadTest/cache/";
+	if (!EnsureDirectory(sources))
+	{
+		std::cout << "FAIL cannot create " << sources << "\n";
+		return 1;
+	}
+	auto writeText = [](const std::string& path, const std::string& text) {
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file << text;
+	};
+	const std::string common = sources + "Common.hlsl";
+	const std::string sampling = sources + "Sampling.hlsl";
+	writeText(common, "float common;\n");
+	writeText(sampling, "#include \"Common.hlsl\"\nfloat sampling;\n");
+	writeText(sources + "RayGen.hlsl", "#include \"Common.hlsl\"\nvoid RayGen() {}\n");
+	writeText(sources + "BSDFShader.hlsl", "#include \"Common.hlsl\"\n#include \"Sampling.hlsl\"\nvoid ClosestHit_BSDF() {}\n");
+	writeText(sources + "Denoise.hlsl", "void CSMain() {}\n");
+
+	std::vector<ShaderCompileRequest> requests;
+	for (const char* name : { "RayGen.hlsl", "BSDFShader.hlsl", "Denoise.hlsl" })
+	{
+		ShaderCompileRequest request;
+		request.path = sources + name;
+		request.target = "lib_6_3";
+		requests.push_back(request);
+	}
+
+	// A version no earlier run used, so their entries do not hit
+	const std::string version = "reload " + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+	StubShaderCompiler scanner(version);
+	ShaderCache files(scanner, cacheDirectory);
+	ShaderHotReload reload;
+	auto track = [&](size_t shader) {
+		uint64_t key = 0;
+		std::vector<std::string> found;
+		if (files.ComputeKey(requests[shader], key, &found))
+			reload.Track(shader, found);
+	};
+	for (size_t i = 0; i < requests.size(); i++)
+		track(i);
+
+	check(reload.Dependents(common) == Shaders({ 0, 1 }) && reload.Dependents(sampling) == Shaders({ 1 }) &&
+		reload.Dependents(requests[2].path) == Shaders({ 2 }) && reload.WatchedFiles().size() == 5,
+		"a shader depends on its source and its includes, also nested ones");
+
+	reload.FilesChanged({ common });
+	const Shaders first = reload.BeginCompile();
+	check(first == Shaders({ 0, 1 }) && reload.GetState() == State::Compiling, "a save of Common.hlsl recompiles both its dependents");
+	reload.FilesChanged({ requests[2].path });
+	check(reload.BeginCompile().empty(), "no second batch while one compiles");
+	reload.CompileFinished({ true, true }, "");
+	check(reload.GetState() == State::Ready && reload.BeginCompile().empty(), "a compiled batch waits for the frame boundary");
+	check(reload.TakeSwap() == first && reload.TakeSwap().empty() && reload.GetState() == State::Idle, "the batch is swapped in once");
+	check(reload.BeginCompile() == Shaders({ 2 }), "the save made while compiling is the next batch");
+	reload.CompileFinished({ true }, "");
+	reload.TakeSwap();
+
+	reload.FilesChanged({ sources + "Unrelated.hlsl" });
+	check(reload.BeginCompile().empty(), "a file no shader is built from changes nothing");
+
+	reload.FilesChanged({ sampling });
+	check(reload.BeginCompile() == Shaders({ 1 }), "a nested include only recompiles what includes it");
+	reload.CompileFinished({ false }, "BSDFShader.hlsl: error");
+	check(reload.GetState() == State::Failed && reload.TakeSwap().empty() && reload.Error() == "BSDFShader.hlsl: error",
+		"a failed batch is not swapped in and keeps its error");
+	check(reload.BeginCompile().empty(), "a failed batch waits for the next save");
+	reload.FilesChanged({ requests[2].path });
+	check(reload.BeginCompile() == Shaders({ 1, 2 }), "the next save retries the failed batch with it");
+	reload.CompileFinished({ true, true }, "");
+	check(reload.TakeSwap() == Shaders({ 1, 2 }) && reload.Error().empty(), "a batch that goes live clears the error");
+
+	reload.FilesChanged({ requests[0].path });
+	reload.BeginCompile();
+	reload.CompileFinished({ true }, "");
+	reload.TakeSwap();
+	reload.SwapFailed("link error");
+	check(reload.GetState() == State::Failed && reload.Error() == "link error", "a pipeline that does not link is a failure too");
+	reload.FilesChanged({ requests[2].path });
+	check(reload.BeginCompile() == Shaders({ 0, 2 }), "and is retried on the next save");
+	reload.CompileFinished({ true, true, true }, "");
+	check(reload.GetState() == State::Failed, "results that do not match the batch fail it");
+
+	writeText(sources + "BSDFShader.hlsl", "#include \"Common.hlsl\"\nvoid ClosestHit_BSDF() {}\n");
+	track(1);
+	const std::vector<std::string> watched = reload.WatchedFiles();
+	check(reload.Dependents(sampling).empty() && std::find(watched.begin(), watched.end(), sampling) == watched.end(),
+		"an include removed from a shader is no longer watched");
+
+	{
+		// The renderer's loop without the renderer: poll, join once idle, swap
+		// what compiled, dispatch what changed
+		SlowShaderCompiler::Shared shared;
+		ShaderCompileScheduler scheduler([&shared, &version]() {
+			return std::unique_ptr<ShaderCompilerBackend>(new SlowShaderCompiler(shared, version, 50));
+		}, cacheDirectory, 2);
+		ShaderHotReload loop;
+		std::vector<std::vector<char> > live(requests.size(), std::vector<char>(1, 'x'));
+		for (size_t i = 0; i < requests.size(); i++)
+		{
+			uint64_t key = 0;
+			std::vector<std::string> found;
+			files.ComputeKey(requests[i], key, &found);
+			loop.Track(i, found);
+		}
+		std::vector<ShaderCompileResult> results;
+		auto frame = [&]() {
+			if (loop.GetState() == State::Compiling && !scheduler.Busy())
+			{
+				results = scheduler.Join();
+				std::vector<bool> ok;
+				std::string errors;
+				for (const ShaderCompileResult& result : results)
+				{
+					ok.push_back(result.ok);
+					errors += result.errors;
+				}
+				loop.CompileFinished(ok, errors);
+			}
+			const Shaders swap = loop.TakeSwap();
+			for (size_t i = 0; i < swap.size(); i++)
+				live[swap[i]] = results[i].binary;
+			const Shaders batch = loop.BeginCompile();
+			std::vector<ShaderCompileRequest> dispatched;
+			for (size_t shader : batch)
+				dispatched.push_back(requests[shader]);
+			scheduler.Dispatch(dispatched);
+		};
+		auto settle = [&]() {
+			frame();
+			for (int i = 0; i < 2000 && (loop.GetState() == State::Compiling || loop.GetState() == State::Ready); i++)
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				frame();
+			}
+		};
+		auto text = [](const std::vector<char>& binary) { return std::string(binary.begin(), binary.end()); };
+
+		// Common.hlsl saved, BSDFShader.hlsl saved half way through an edit
+		writeText(common, "float common2;\n");
+		writeText(requests[1].path, "#include \"Common.hlsl\"\nvoid ClosestHit_BSDF() { #error\n");
+		loop.FilesChanged({ common, requests[1].path });
+		frame();
+		frame();
+		check(loop.GetState() == State::Compiling && scheduler.Busy(), "the batch compiles in the background, frames go on");
+		settle();
+		check(loop.GetState() == State::Failed && loop.Error().find("#error") != std::string::npos && text(live[0]) == "x" && text(live[1]) == "x",
+			"one broken shader keeps the old binaries of the whole batch and reports the error");
+
+		writeText(requests[1].path, "#include \"Common.hlsl\"\nvoid ClosestHit_BSDF() {}\n");
+		loop.FilesChanged({ requests[1].path });
+		settle();
+		check(loop.GetState() == State::Idle && loop.Error().empty() && text(live[0]).find("RayGen") != std::string::npos &&
+			text(live[1]).find("ClosestHit_BSDF() {}") != std::string::npos && text(live[2]) == "x",
+			"the fix swaps in the whole batch, the other shader stays");
+	}
+
+	{
+		// Random saves, compile and link outcomes; then saves fixing whatever
+		// failed, until nothing is pending. Every shader must end up live at
+		// the last version saved.
+		uint32_t seed = 12345;
+		auto random = [&seed](uint32_t range) {
+			seed = seed * 1664525u + 1013904223u;
+			return (seed >> 8) % range;
+		};
+		const size_t shaderCount = 6;
+		const std::vector<std::string> modelFiles = { "Common", "A", "B", "C", "D", "E", "F", "Shared" };
+		ShaderHotReload model;
+		for (size_t shader = 0; shader < shaderCount; shader++)
+		{
+			std::vector<std::string> built = { modelFiles[1 + shader] };
+			if (shader % 2 == 0)
+				built.push_back("Common");
+			if (shader >= 4)
+				built.push_back("Shared");
+			model.Track(shader, built);
+		}
+
+		std::vector<int> saved(shaderCount, 0), compiling(shaderCount, 0), liveVersion(shaderCount, 0);
+		bool neverTwoBatches = true;
+		auto save = [&](const std::string& file) {
+			for (size_t shader : model.Dependents(file))
+				saved[shader]++;
+			model.FilesChanged({ file });
+		};
+		auto step = [&](bool succeed) {
+			const State before = model.GetState();
+			const Shaders batch = model.BeginCompile();
+			if (!batch.empty())
+			{
+				neverTwoBatches = neverTwoBatches && before != State::Compiling && before != State::Ready;
+				for (size_t shader : batch)
+					compiling[shader] = saved[shader];
+			}
+			if (model.GetState() == State::Compiling && (succeed || random(3) == 0))
+				model.CompileFinished(std::vector<bool>(model.Batch().size(), succeed || random(4) != 0), "error");
+			const Shaders swap = model.TakeSwap();
+			if (!swap.empty() && !succeed && random(10) == 0)
+			{
+				model.SwapFailed("link");
+				return;
+			}
+			for (size_t shader : swap)
+				liveVersion[shader] = compiling[shader];
+		};
+
+		for (int i = 0; i < 2000; i++)
+		{
+			if (random(3) == 0)
+				save(modelFiles[random(static_cast<uint32_t>(modelFiles.size()))]);
+			step(false);
+		}
+		for (int i = 0; i < 100; i++)
+		{
+			if (model.GetState() == State::Failed)
+				save(modelFiles[1 + model.Batch()[0]]);
+			step(true);
+		}
+		check(neverTwoBatches, "random: a batch never starts while another is compiling or waiting");
+		check(model.GetState() == State::Idle && liveVersion == saved, "random: every shader ends up live at its last save");
+	}
+
+	return check.Finish("shader hot reload");
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ShaderCache.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compiler backends for the shader cache, scheduler and hot reload tests
+
+// Stands in for DXC: the "binary" spells out what it was asked to
+// compile, and sources containing "#error" fail
+class StubShaderCompiler : public ShaderCompilerBackend
+{
+public:
+	std::string version;
+	size_t calls = 0;
+
+	explicit StubShaderCompiler(const std::string& version) : version(version) {}
+
+	std::string Version() override { return version; }
+	bool Compile(const ShaderCompileRequest& request, const std::string& source,
+		std::vector<char>& outBinary, std::string& outErrors) override
+	{
+		calls++;
+		if (source.find("#error") != std::string::npos)
+		{
+			outErrors = request.path + ": #error";
+			return false;
+		}
+		std::string binary = version + "|" + request.target + "|" + request.entryPoint + "|";
+		for (const auto& define : request.defines)
+			binary += define.first + "=" + define.second + ";";
+		binary += source;
+		outBinary.assign(binary.begin(), binary.end());
+		return true;
+	}
+};
+
+// Compiles like StubShaderCompiler after sleeping, and records which
+// threads used it and how many compiles overlapped
+class SlowShaderCompiler : public ShaderCompilerBackend
+{
+public:
+	struct Shared
+	{
+		std::atomic<int> active{ 0 };
+		std::atomic<int> peak{ 0 };
+		std::atomic<int> sharedUse{ 0 }; // compiles on another thread than the compiler's first
+		std::atomic<int> calls{ 0 };
+	};
+
+	SlowShaderCompiler(Shared& shared, const std::string& version, int latencyMs)
+		: m_shared(shared), m_version(version), m_latencyMs(latencyMs) {}
+
+	std::string Version() override { return m_version; }
+	bool Compile(const ShaderCompileRequest& request, const std::string& source,
+		std::vector<char>& outBinary, std::string& outErrors) override
+	{
+		if (m_owner == std::thread::id())
+			m_owner = std::this_thread::get_id();
+		else if (m_owner != std::this_thread::get_id())
+			m_shared.sharedUse++;
+
+		const int active = ++m_shared.active;
+		int peak = m_shared.peak;
+		while (active > peak && !m_shared.peak.compare_exchange_weak(peak, active)) {}
+		m_shared.calls++;
+		std::this_thread::sleep_for(std::chrono::milliseconds(m_latencyMs));
+		m_shared.active--;
+
+		if (source.find("#error") != std::string::npos)
+		{
+			outErrors = request.path + ": #error";
+			return false;
+		}
+		const std::string binary = request.path + "|" + request.target + "|" + source;
+		outBinary.assign(binary.begin(), binary.end());
+		return true;
+	}
+
+private:
+	Shared& m_shared;
+	std::string m_version;
+	int m_latencyMs;
+	std::thread::id m_owner;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Log.h"
+#include <chrono>
+#include <string>
+
+// Wall time of the consecutive stages of one operation, printed as one line
+class StageTimer
+{
+public:
+	explicit StageTimer(const std::string& label)
+		: m_line(label + ":"), m_start(std::chrono::high_resolution_clock::now()), m_lap(m_start) {}
+
+	// Ends the stage that ran since the previous lap
+	void Lap(const char* stage)
+	{
+		const auto now = std::chrono::high_resolution_clock::now();
+		m_line += std::string(" ") + stage + " " + FormatMs(now - m_lap) + ",";
+		m_lap = now;
+	}
+
+	void Print() const
+	{
+		Log() << m_line + " total " + FormatMs(m_lap - m_start) + "\n";
+	}
+
+private:
+	static std::string FormatMs(std::chrono::high_resolution_clock::duration duration)
+	{
+		return std::to_string(std::chrono::duration<double, std::milli>(duration).count()) + " ms";
+	}
+
+	std::string m_line;
+	std::chrono::high_resolution_clock::time_point m_start;
+	std::chrono::high_resolution_clock::time_point m_lap;
+};
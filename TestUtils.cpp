@@ -0,0 +1,89 @@
+#include "stdafx.h"
+#include "TestUtils.h"
+#include "FileUtils.h"
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <malloc.h>
+#include <new>
+
+std::atomic<bool> g_countAllocations(false);
+std::atomic<size_t> g_allocationCount(0);
+std::atomic<size_t> g_allocatedBytes(0);
+std::atomic<int64_t> g_liveBytes(0);
+std::atomic<int64_t> g_peakLiveBytes(0);
+
+void ResetAllocationCounters()
+{
+	g_allocationCount = 0;
+	g_allocatedBytes = 0;
+	g_liveBytes = 0;
+	g_peakLiveBytes = 0;
+}
+
+#ifdef COUNT_ALLOCATIONS
+// Replaces the global allocator with one that can count. It is the same
+// malloc/free the CRT's operator new uses; when counting is off the only
+// extra cost is one relaxed load.
+void* operator new(size_t size)
+{
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	if (g_countAllocations.load(std::memory_order_relaxed))
+	{
+		g_allocationCount++;
+		g_allocatedBytes += size;
+		int64_t live = g_liveBytes += static_cast<int64_t>(_msize(p));
+		int64_t peak = g_peakLiveBytes.load();
+		while (live > peak && !g_peakLiveBytes.compare_exchange_weak(peak, live)) {}
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	if (p && g_countAllocations.load(std::memory_order_relaxed))
+		g_liveBytes -= static_cast<int64_t>(_msize(p));
+	free(p);
+}
+#endif
+
+void TestChecks::operator()(bool condition, const std::string& what)
+{
+	std::cout << (condition ? "  PASS " : "  FAIL ") << what << "\n";
+	if (!condition)
+		m_failures++;
+}
+
+int TestChecks::Finish(const std::string& name) const
+{
+	if (m_failures == 0)
+	{
+		std::cout << "All " << name << " checks passed\n";
+		return 0;
+	}
+	std::string title = name;
+	title[0] = static_cast<char>(toupper(static_cast<unsigned char>(title[0])));
+	std::cout << title << " checks FAILED\n";
+	return 1;
+}
+
+void FindFiles(const std::string& directory, const char* extension, std::vector<std::string>& outPaths)
+{
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((directory + "*").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		std::string name = findData.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			FindFiles(directory + name + "/", extension, outPaths);
+		else if (HasExtension(name, extension))
+			outPaths.push_back(directory + name);
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+}
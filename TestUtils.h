@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Shared by the headless tests and benchmarks (the *Tests.cpp files and
+// LoadBenchmark.cpp).
+
+// Pass/fail bookkeeping of a self test. check(condition, what) prints a PASS
+// or FAIL line; Finish prints the summary and gives the exit code.
+class TestChecks
+{
+public:
+	void operator()(bool condition, const std::string& what);
+	// A failure the test reported itself
+	void Fail() { m_failures++; }
+	// "All <name> checks passed" and 0, or "<Name> checks FAILED" and 1
+	int Finish(const std::string& name) const;
+
+private:
+	int m_failures = 0;
+};
+
+// Heap use while g_countAllocations is set. Kept only in builds that define
+// COUNT_ALLOCATIONS (the Debug configuration), where TestUtils.cpp replaces the
+// global operator new and delete; elsewhere the counters stay zero and the
+// renderer keeps the CRT's allocator.
+#ifdef COUNT_ALLOCATIONS
+const bool kAllocationCounters = true;
+#else
+const bool kAllocationCounters = false;
+#endif
+extern std::atomic<bool> g_countAllocations;
+extern std::atomic<size_t> g_allocationCount;
+extern std::atomic<size_t> g_allocatedBytes;
+extern std::atomic<int64_t> g_liveBytes;
+extern std::atomic<int64_t> g_peakLiveBytes;
+void ResetAllocationCounters();
+
+// Every file under directory (recursively) whose name ends with extension
+void FindFiles(const std::string& directory, const char* extension, std::vector<std::string>& outPaths);
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads. Tasks are run in submission order by
+// whichever worker is free; Submit returns a future for the task's result.
+class ThreadPool
+{
+public:
+	// threadCount == 0 uses one worker per hardware thread
+	explicit ThreadPool(unsigned threadCount = 0)
+	{
+		if (threadCount == 0)
+			threadCount = DefaultThreadCount();
+
+		m_workers.reserve(threadCount);
+		for (unsigned i = 0; i < threadCount; i++)
+			m_workers.emplace_back([this] { WorkerLoop(); });
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+		m_condition.notify_all();
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template <typename F>
+	auto Submit(F&& task) -> std::future<decltype(task())>
+	{
+		typedef decltype(task()) Result;
+		auto packaged = std::make_shared<std::packaged_task<Result()> >(std::forward<F>(task));
+		std::future<Result> result = packaged->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.push([packaged] { (*packaged)(); });
+		}
+		m_condition.notify_one();
+		return result;
+	}
+
+	unsigned Size() const { return static_cast<unsigned>(m_workers.size()); }
+
+	static unsigned DefaultThreadCount()
+	{
+		unsigned count = std::thread::hardware_concurrency();
+		return count > 0 ? count : 4;
+	}
+
+private:
+	void WorkerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+				if (m_tasks.empty())
+					return;
+				task = std::move(m_tasks.front());
+				m_tasks.pop();
+			}
+			task();
+		}
+	}
+
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()> > m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stopping = false;
+};
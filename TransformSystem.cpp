@@ -0,0 +1,127 @@
+#include "stdafx.h"
+#include "TransformSystem.h"
+#include "ThreadPool.h"
+#include <cstring>
+#include <future>
+
+using namespace DirectX;
+
+TransformSystem::TransformSystem()
+{
+}
+
+TransformSystem::~TransformSystem()
+{
+}
+
+void TransformSystem::Resize(size_t count)
+{
+	const size_t oldCount = Count();
+	if (count < oldCount)
+	{
+		// Forget the dirty instances that went away
+		size_t kept = 0;
+		for (uint32_t index : m_dirtyList)
+		{
+			if (index < count)
+				m_dirtyList[kept++] = index;
+		}
+		m_dirtyList.resize(kept);
+	}
+
+	const Trs identity = { XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) };
+	m_trs.resize(count, identity);
+	m_world.resize(count);
+	m_dirty.resize(count, 0);
+	for (size_t i = oldCount; i < count; i++)
+	{
+		m_dirty[i] = 1;
+		m_dirtyList.push_back(static_cast<uint32_t>(i));
+	}
+}
+
+void TransformSystem::Set(size_t index, const XMFLOAT3& position, const XMFLOAT3& rotation, const XMFLOAT3& scale)
+{
+	const Trs trs = { position, rotation, scale };
+	if (memcmp(&m_trs[index], &trs, sizeof(Trs)) == 0)
+		return;
+
+	m_trs[index] = trs;
+	if (!m_dirty[index])
+	{
+		m_dirty[index] = 1;
+		m_dirtyList.push_back(static_cast<uint32_t>(index));
+	}
+}
+
+void TransformSystem::MarkAllDirty()
+{
+	m_dirtyList.clear();
+	for (size_t i = 0; i < Count(); i++)
+	{
+		m_dirty[i] = 1;
+		m_dirtyList.push_back(static_cast<uint32_t>(i));
+	}
+}
+
+TransformRange TransformSystem::Update()
+{
+	m_lastChanged = TransformRange();
+	m_changed.clear();
+	if (m_dirtyList.empty())
+		return m_lastChanged;
+
+	const size_t count = m_dirtyList.size();
+	if (count < m_parallelThreshold)
+	{
+		Rebuild(m_dirtyList.data(), count);
+	}
+	else
+	{
+		if (!m_pool)
+			m_pool.reset(new ThreadPool());
+
+		// A few chunks per worker, so an unlucky slow chunk does not hold up the rest
+		const size_t chunkCount = m_pool->Size() * 4;
+		const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+		std::vector<std::future<void> > chunks;
+		for (size_t first = 0; first < count; first += chunkSize)
+		{
+			const size_t chunk = count - first < chunkSize ? count - first : chunkSize;
+			const uint32_t* indices = m_dirtyList.data() + first;
+			chunks.push_back(m_pool->Submit([this, indices, chunk] { Rebuild(indices, chunk); }));
+		}
+		for (auto& chunk : chunks)
+			chunk.get();
+	}
+
+	m_changed.swap(m_dirtyList);
+	uint32_t low = m_changed[0], high = m_changed[0];
+	for (uint32_t index : m_changed)
+	{
+		low = index < low ? index : low;
+		high = index > high ? index : high;
+		m_dirty[index] = 0;
+	}
+
+	m_lastChanged.first = low;
+	m_lastChanged.end = static_cast<size_t>(high) + 1;
+	return m_lastChanged;
+}
+
+void TransformSystem::Rebuild(const uint32_t* indices, size_t count)
+{
+	for (size_t k = 0; k < count; k++)
+	{
+		const uint32_t i = indices[k];
+		XMStoreFloat4x4(&m_world[i], Compose(m_trs[i].position, m_trs[i].rotation, m_trs[i].scale));
+	}
+}
+
+XMMATRIX TransformSystem::Compose(const XMFLOAT3& position, const XMFLOAT3& rotation, const XMFLOAT3& scale)
+{
+	XMMATRIX scaleMatrix = XMMatrixScaling(scale.x, scale.y, scale.z);
+	XMMATRIX rotationMatrix = XMMatrixRotationRollPitchYaw(XMConvertToRadians(rotation.x), XMConvertToRadians(rotation.y), XMConvertToRadians(rotation.z));
+	XMMATRIX translationMatrix = XMMatrixTranslation(position.x, position.y, position.z);
+	return scaleMatrix * rotationMatrix * translationMatrix;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+// Instances [first, end) of a TransformSystem; empty when first >= end
+struct TransformRange
+{
+	size_t first = 0;
+	size_t end = 0;
+	bool Empty() const { return first >= end; }
+};
+
+// Object to world matrices of all instances, kept with the translation,
+// rotation and scale they were built from. Set marks an instance dirty only
+// when its TRS actually changed, and Update rebuilds just the dirty matrices,
+// split across worker threads when there are many of them.
+class TransformSystem
+{
+public:
+	TransformSystem();
+	~TransformSystem();
+
+	// Grows or shrinks to `count` instances; new ones are identity and dirty
+	void Resize(size_t count);
+	size_t Count() const { return m_trs.size(); }
+
+	// Rotation is Euler angles in degrees (pitch, yaw, roll), as in ModelDesc
+	void Set(size_t index, const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& rotation, const DirectX::XMFLOAT3& scale);
+	void MarkAllDirty();
+	size_t DirtyCount() const { return m_dirtyList.size(); }
+
+	// Rebuilds the dirty matrices and returns the range of instances they span
+	TransformRange Update();
+	// What the last Update changed: the range, and the instances themselves (in no particular order)
+	TransformRange LastChanged() const { return m_lastChanged; }
+	const std::vector<uint32_t>& LastChangedInstances() const { return m_changed; }
+
+	DirectX::XMMATRIX World(size_t index) const { return DirectX::XMLoadFloat4x4(&m_world[index]); }
+
+	// Dirty instances from which Update uses worker threads
+	void SetParallelThreshold(size_t dirtyCount) { m_parallelThreshold = dirtyCount; }
+
+	// scale * rotation * translation, the transform of a ModelDesc
+	static DirectX::XMMATRIX Compose(const DirectX::XMFLOAT3& position, const DirectX::XMFLOAT3& rotation, const DirectX::XMFLOAT3& scale);
+
+private:
+	struct Trs
+	{
+		DirectX::XMFLOAT3 position;
+		DirectX::XMFLOAT3 rotation;
+		DirectX::XMFLOAT3 scale;
+	};
+
+	void Rebuild(const uint32_t* indices, size_t count);
+
+	std::vector<Trs> m_trs;
+	std::vector<DirectX::XMFLOAT4X4> m_world;
+	std::vector<uint8_t> m_dirty;
+	std::vector<uint32_t> m_dirtyList;
+	std::vector<uint32_t> m_changed;
+	TransformRange m_lastChanged;
+
+	size_t m_parallelThreshold = 16384;
+	std::unique_ptr<ThreadPool> m_pool; // created on the first parallel Update
+};
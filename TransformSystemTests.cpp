@@ -0,0 +1,93 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "SceneGenerator.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+// Instance matrices per frame: rebuilding all of them, as BuildTLAS used to,
+// against TransformSystem with 1%, 10% and 100% of the instances moving, on
+// one thread and on the workers. The matrices have to match ModelTransform.
+int D3D12HelloTriangle::RunTransformBenchmark(unsigned instanceCount)
+{
+	if (instanceCount == 0)
+		instanceCount = 100000;
+
+	SceneGeneratorOptions options;
+	options.instances = instanceCount;
+	options.animated = 0;
+	const std::vector<ModelDesc> descs = GenerateScene(options).models;
+	const int frameCount = 100;
+	std::cout << instanceCount << " instances, " << frameCount << " frames\n";
+
+	std::vector<std::pair<D3D12_GPU_VIRTUAL_ADDRESS, XMMATRIX> > instances;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frameCount; frame++)
+	{
+		instances.clear();
+		for (size_t i = 0; i < descs.size(); i++)
+			instances.push_back({ 0, ModelTransform(descs[i]) });
+	}
+	const double fullMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frameCount;
+	std::cout << "every matrix every frame: " << fullMs << " ms/frame\n";
+
+	size_t mismatches = 0;
+	uint32_t seed = 5;
+	for (double fraction : { 0.01, 0.1, 1.0 })
+	{
+		const size_t moving = static_cast<size_t>(instanceCount * fraction);
+		std::cout << fraction * 100.0 << "% moving:\n";
+		for (int threaded = 0; threaded < 2; threaded++)
+		{
+			std::vector<ModelDesc> moved = descs;
+			TransformSystem transforms;
+			transforms.SetParallelThreshold(threaded ? 0 : static_cast<size_t>(-1));
+			transforms.Resize(moved.size());
+			for (size_t i = 0; i < moved.size(); i++)
+				transforms.Set(i, moved[i].position, moved[i].rotation, moved[i].scale);
+			transforms.Update();
+			for (size_t i = 0; i < moved.size(); i++)
+				instances[i].second = transforms.World(i);
+
+			double totalMs = 0.0;
+			size_t dirty = 0;
+			for (int frame = 0; frame < frameCount; frame++)
+			{
+				// Random instances, so the changed range spans most of the list
+				for (size_t k = 0; k < moving; k++)
+				{
+					seed = seed * 1664525u + 1013904223u;
+					const size_t i = moving == moved.size() ? k : (seed >> 8) % moved.size();
+					moved[i].position.y += 0.01f;
+					moved[i].rotation.y += 1.0f;
+				}
+
+				start = std::chrono::high_resolution_clock::now();
+				for (size_t i = 0; i < moved.size(); i++)
+					transforms.Set(i, moved[i].position, moved[i].rotation, moved[i].scale);
+				dirty += transforms.DirtyCount();
+				transforms.Update();
+				for (uint32_t i : transforms.LastChangedInstances())
+					instances[i].second = transforms.World(i);
+				totalMs += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			}
+
+			for (size_t i = 0; i < moved.size(); i++)
+			{
+				XMFLOAT4X4 a, b;
+				XMStoreFloat4x4(&a, instances[i].second);
+				XMStoreFloat4x4(&b, ModelTransform(moved[i]));
+				if (memcmp(&a, &b, sizeof(a)) != 0)
+					mismatches++;
+			}
+			std::cout << "  " << (threaded ? "worker threads " : "one thread     ") << totalMs / frameCount << " ms/frame ("
+				<< fullMs / (totalMs / frameCount) << "x), " << dirty / frameCount << " dirty per frame\n";
+		}
+	}
+
+	if (mismatches)
+		std::cout << "FAIL " << mismatches << " instance matrices differ from ModelTransform\n";
+	return mismatches == 0 ? 0 : 1;
+}
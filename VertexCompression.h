@@ -0,0 +1,103 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+#include <cmath>
+#include <cstdint>
+
+// Quantized shading attributes of the compact vertex layout. The position
+// stays a separate, tightly packed float3 stream that the BLAS builds read.
+// Must match SCompactVertexAttributes in shaders/VertexFetch.hlsl.
+struct CompactVertexAttributes
+{
+	uint32_t normal;      // octahedral, 2 x snorm16
+	uint32_t color;       // RGBA8 unorm, R in the low byte
+	uint16_t roughness;   // half
+	uint16_t emission[3]; // half
+};
+static_assert(sizeof(CompactVertexAttributes) == 16, "CompactVertexAttributes must stay 16 bytes");
+
+// Worst case errors of the round trips below, for unit length normals and
+// colors/values in [0, 1]. Halves below kHalfMinNormal are denormal and have
+// a fixed absolute error instead of a relative one.
+const float kOctahedralNormalMaxAngle = 0.0001f; // radians
+const float kColorRGBA8MaxError = 0.5f / 255.0f;
+const float kHalfMaxRelativeError = 1.0f / 2048.0f;
+const float kHalfMinNormal = 1.0f / 16384.0f;
+const float kHalfDenormalMaxError = 1.0f / 16777216.0f;
+
+inline float SignNotZero(float v)
+{
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+inline int16_t QuantizeSnorm16(float v)
+{
+	v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+	return static_cast<int16_t>(std::lround(v * 32767.0f));
+}
+
+inline uint32_t EncodeOctahedralNormal(const DirectX::XMFLOAT3& n)
+{
+	float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+	if (l1 == 0.0f)
+		return EncodeOctahedralNormal(DirectX::XMFLOAT3(0.0f, 1.0f, 0.0f));
+
+	float x = n.x / l1;
+	float y = n.y / l1;
+	if (n.z < 0.0f)
+	{
+		// Fold the lower hemisphere over the diagonals
+		float foldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+		float foldedY = (1.0f - std::fabs(x)) * SignNotZero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	return static_cast<uint16_t>(QuantizeSnorm16(x)) |
+		(static_cast<uint32_t>(static_cast<uint16_t>(QuantizeSnorm16(y))) << 16);
+}
+
+inline DirectX::XMFLOAT3 DecodeOctahedralNormal(uint32_t packed)
+{
+	float x = static_cast<int16_t>(packed & 0xFFFF) / 32767.0f;
+	float y = static_cast<int16_t>(packed >> 16) / 32767.0f;
+	x = x < -1.0f ? -1.0f : x;
+	y = y < -1.0f ? -1.0f : y;
+
+	float z = 1.0f - std::fabs(x) - std::fabs(y);
+	float t = z < 0.0f ? -z : 0.0f;
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+
+	float length = std::sqrt(x * x + y * y + z * z);
+	return DirectX::XMFLOAT3(x / length, y / length, z / length);
+}
+
+inline uint32_t EncodeColorRGBA8(const DirectX::XMFLOAT4& color)
+{
+	auto toByte = [](float v) {
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		return static_cast<uint32_t>(std::lround(v * 255.0f));
+	};
+	return toByte(color.x) | (toByte(color.y) << 8) | (toByte(color.z) << 16) | (toByte(color.w) << 24);
+}
+
+inline DirectX::XMFLOAT4 DecodeColorRGBA8(uint32_t packed)
+{
+	return DirectX::XMFLOAT4(
+		(packed & 0xFF) / 255.0f,
+		((packed >> 8) & 0xFF) / 255.0f,
+		((packed >> 16) & 0xFF) / 255.0f,
+		(packed >> 24) / 255.0f);
+}
+
+inline uint16_t EncodeHalf(float v)
+{
+	return DirectX::PackedVector::XMConvertFloatToHalf(v);
+}
+
+inline float DecodeHalf(uint16_t v)
+{
+	return DirectX::PackedVector::XMConvertHalfToFloat(v);
+}
@@ -0,0 +1,223 @@
+#include "stdafx.h"
+#include "D3D12HelloTriangle.h"
+#include "TestUtils.h"
+#include <cmath>
+#include <iostream>
+
+namespace
+{
+	// Angle between two unit vectors, accurate near 0 unlike acos of the dot product
+	double AngleBetween(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		const double cx = double(a.y) * b.z - double(a.z) * b.y;
+		const double cy = double(a.z) * b.x - double(a.x) * b.z;
+		const double cz = double(a.x) * b.y - double(a.y) * b.x;
+		const double dot = double(a.x) * b.x + double(a.y) * b.y + double(a.z) * b.z;
+		return std::atan2(std::sqrt(cx * cx + cy * cy + cz * cz), dot);
+	}
+
+	XMFLOAT3 Normalized(float x, float y, float z)
+	{
+		const float length = std::sqrt(x * x + y * y + z * z);
+		return XMFLOAT3(x / length, y / length, z / length);
+	}
+
+	double NormalError(const XMFLOAT3& n)
+	{
+		return AngleBetween(n, DecodeOctahedralNormal(EncodeOctahedralNormal(n)));
+	}
+
+	double ColorError(const XMFLOAT4& c)
+	{
+		const XMFLOAT4 d = DecodeColorRGBA8(EncodeColorRGBA8(c));
+		const double errors[4] = { std::fabs(double(d.x) - c.x), std::fabs(double(d.y) - c.y),
+			std::fabs(double(d.z) - c.z), std::fabs(double(d.w) - c.w) };
+		double worst = 0.0;
+		for (double e : errors)
+			worst = e > worst ? e : worst;
+		return worst;
+	}
+
+	// Error of a half round trip as a fraction of its bound, relative for
+	// normal halves and absolute for denormal ones
+	double HalfError(float v, float decoded)
+	{
+		const double error = std::fabs(double(decoded) - v);
+		if (std::fabs(v) < kHalfMinNormal)
+			return error / kHalfDenormalMaxError;
+		return error / std::fabs(v) / kHalfMaxRelativeError;
+	}
+
+	double HalfError(float v)
+	{
+		return HalfError(v, DecodeHalf(EncodeHalf(v)));
+	}
+}
+
+// Checks the error bounds documented in VertexCompression.h on random and
+// edge case inputs and on the vertices of every bundled model, then reports
+// the vertex memory of both layouts for each model.
+int D3D12HelloTriangle::RunVertexCompressionCheck()
+{
+	TestChecks check;
+
+	uint32_t seed = 12345u;
+	auto random = [&seed]() {
+		seed = seed * 1664525u + 1013904223u;
+		return (seed >> 8) / 16777216.0f;
+	};
+
+	// Normals: the axes, the seams of the octahedron, the folded lower
+	// hemisphere, and uniformly distributed random directions
+	double worstNormal = 0.0;
+	std::vector<XMFLOAT3> normals;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (float sign = -1.0f; sign <= 1.0f; sign += 2.0f)
+			normals.push_back(XMFLOAT3(axis == 0 ? sign : 0.0f, axis == 1 ? sign : 0.0f, axis == 2 ? sign : 0.0f));
+	}
+	for (int i = 0; i < 64; i++)
+	{
+		const float angle = i * 6.2831853f / 64.0f;
+		normals.push_back(Normalized(std::cos(angle), std::sin(angle), 0.0f));
+		normals.push_back(Normalized(std::cos(angle), std::sin(angle), -1e-6f));
+		normals.push_back(Normalized(std::cos(angle), std::sin(angle), -1.0f));
+	}
+	normals.push_back(Normalized(1.0f, 1.0f, 1.0f));
+	normals.push_back(Normalized(-1.0f, -1.0f, -1.0f));
+	while (normals.size() < 1000000)
+	{
+		const float x = random() * 2.0f - 1.0f;
+		const float y = random() * 2.0f - 1.0f;
+		const float z = random() * 2.0f - 1.0f;
+		const float lengthSquared = x * x + y * y + z * z;
+		if (lengthSquared > 1e-6f && lengthSquared <= 1.0f)
+			normals.push_back(Normalized(x, y, z));
+	}
+	for (const XMFLOAT3& n : normals)
+	{
+		const double error = NormalError(n);
+		worstNormal = error > worstNormal ? error : worstNormal;
+	}
+	std::cout << "Octahedral normal: worst error " << worstNormal << " rad over " << normals.size()
+		<< " directions (bound " << kOctahedralNormalMaxAngle << ")\n";
+	check(worstNormal <= kOctahedralNormalMaxAngle, "octahedral normals stay within their bound");
+	const XMFLOAT3 zeroDecoded = DecodeOctahedralNormal(EncodeOctahedralNormal(XMFLOAT3(0.0f, 0.0f, 0.0f)));
+	check(zeroDecoded.x == 0.0f && zeroDecoded.y == 1.0f && zeroDecoded.z == 0.0f, "a zero normal decodes to +Y");
+
+	// Colors: every byte value, the midpoints between them and random values
+	double worstByte = 0.0;
+	double worstColor = 0.0;
+	for (int i = 0; i <= 255; i++)
+	{
+		const float exact = i / 255.0f;
+		const float between = (i + 0.5f) / 255.0f < 1.0f ? (i + 0.5f) / 255.0f : 1.0f;
+		const double byteError = ColorError(XMFLOAT4(exact, exact, exact, exact));
+		const double betweenError = ColorError(XMFLOAT4(between, between, between, between));
+		worstByte = byteError > worstByte ? byteError : worstByte;
+		worstColor = betweenError > worstColor ? betweenError : worstColor;
+	}
+	check(worstByte < 1e-6, "byte values survive exactly");
+	for (int i = 0; i < 1000000; i++)
+	{
+		const double error = ColorError(XMFLOAT4(random(), random(), random(), random()));
+		worstColor = error > worstColor ? error : worstColor;
+	}
+	std::cout << "RGBA8 color: worst error " << worstColor << " (bound " << kColorRGBA8MaxError << ")\n";
+	check(worstColor <= kColorRGBA8MaxError + 1e-7, "RGBA8 colors stay within their bound");
+	const XMFLOAT4 clamped = DecodeColorRGBA8(EncodeColorRGBA8(XMFLOAT4(-0.5f, 1.5f, 0.0f, 1.0f)));
+	check(clamped.x == 0.0f && clamped.y == 1.0f && clamped.z == 0.0f && clamped.w == 1.0f, "out of range colors clamp");
+
+	// Halves: log-uniform over [2^-24, 1], the range of roughness and most
+	// emission, denormals included, and a few brighter emission values
+	double worstHalf = 0.0;
+	for (int i = 0; i < 1000000; i++)
+	{
+		const float v = std::ldexp(1.0f + random(), -static_cast<int>(random() * 24.0f) - 1);
+		const double error = HalfError(v);
+		worstHalf = error > worstHalf ? error : worstHalf;
+	}
+	const float emissions[] = { 0.0f, 1.0f, 2.5f, 10.0f, 100.0f, 1000.0f };
+	for (float v : emissions)
+	{
+		const double error = HalfError(v);
+		worstHalf = error > worstHalf ? error : worstHalf;
+	}
+	std::cout << "Half: worst error " << worstHalf << " of its bound\n";
+	check(worstHalf <= 1.0, "halves stay within their bound");
+
+	// The bundled models, packed like CreateMeshBuffers packs them
+	std::vector<std::string> paths;
+	FindFiles("Models/", ".obj", paths);
+	FindFiles("Models/", ".gltf", paths);
+	if (paths.empty())
+	{
+		std::cout << "No models found in Models/\n";
+		return 1;
+	}
+
+	uint64_t fullTotal = 0;
+	uint64_t compactTotal = 0;
+	double worstModelNormal = 0.0;
+	double worstModelColor = 0.0;
+	double worstModelHalf = 0.0;
+	for (const auto& path : paths)
+	{
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+		LoadModel(path, vertices, indices);
+		if (vertices.empty())
+		{
+			std::cout << path << ": load failed\n";
+			check.Fail();
+			continue;
+		}
+
+		std::vector<XMFLOAT3> positions;
+		std::vector<CompactVertexAttributes> attributes;
+		CompressVertices(vertices.data(), vertices.size(), positions, attributes);
+		bool positionsExact = positions.size() == vertices.size();
+		for (size_t i = 0; positionsExact && i < vertices.size(); i++)
+		{
+			const Vertex& v = vertices[i];
+			const CompactVertexAttributes& a = attributes[i];
+			positionsExact = positions[i].x == v.position.x && positions[i].y == v.position.y && positions[i].z == v.position.z;
+
+			// Loaders normalize, but not exactly to float precision
+			const double normalError = AngleBetween(Normalized(v.normal.x, v.normal.y, v.normal.z), DecodeOctahedralNormal(a.normal));
+			worstModelNormal = normalError > worstModelNormal ? normalError : worstModelNormal;
+			const XMFLOAT4 color = DecodeColorRGBA8(a.color);
+			const double colorErrors[4] = { std::fabs(double(color.x) - v.color.x), std::fabs(double(color.y) - v.color.y),
+				std::fabs(double(color.z) - v.color.z), std::fabs(double(color.w) - v.color.w) };
+			for (double e : colorErrors)
+				worstModelColor = e > worstModelColor ? e : worstModelColor;
+			const float values[4] = { v.roughness, v.emmision.x, v.emmision.y, v.emmision.z };
+			const uint16_t halves[4] = { a.roughness, a.emission[0], a.emission[1], a.emission[2] };
+			for (int k = 0; k < 4; k++)
+			{
+				const double e = HalfError(values[k], DecodeHalf(halves[k]));
+				worstModelHalf = e > worstModelHalf ? e : worstModelHalf;
+			}
+		}
+		if (!positionsExact)
+		{
+			std::cout << path << ": positions changed\n";
+			check.Fail();
+		}
+
+		const uint64_t fullBytes = vertices.size() * sizeof(Vertex);
+		const uint64_t compactBytes = positions.size() * sizeof(XMFLOAT3) + attributes.size() * sizeof(CompactVertexAttributes);
+		fullTotal += fullBytes;
+		compactTotal += compactBytes;
+		std::cout << path << ": " << vertices.size() << " vertices, full " << fullBytes / 1024.0 << " KB, compact "
+			<< compactBytes / 1024.0 << " KB\n";
+	}
+	std::cout << "Vertex memory of " << paths.size() << " models: full layout " << fullTotal / 1024 << " KB, compact layout "
+		<< compactTotal / 1024 << " KB (" << 100.0 * compactTotal / (fullTotal ? fullTotal : 1) << "%)\n";
+	std::cout << "Worst errors on the models: normal " << worstModelNormal << " rad, color " << worstModelColor
+		<< ", half " << worstModelHalf << " of its bound\n";
+	check(worstModelNormal <= kOctahedralNormalMaxAngle && worstModelColor <= kColorRGBA8MaxError + 1e-7 &&
+		worstModelHalf <= 1.0, "the bundled models' attributes stay within the bounds");
+
+	return check.Finish("vertex compression");
+}
@@ -70,7 +70,7 @@ void BottomLevelASGenerator::AddVertexBuffer(
 // API:
 //   - triangles (no custom intersector support)
 //   - 3xfloat32 format
-//   - 32-bit indices
+//   - 16- or 32-bit indices
 void BottomLevelASGenerator::AddVertexBuffer(
     ID3D12Resource *vertexBuffer, // Buffer containing the vertex coordinates,
                                   // possibly interleaved with other vertex data
@@ -88,11 +88,12 @@ void BottomLevelASGenerator::AddVertexBuffer(
                                      // vertices. This buffer cannot be nullptr
     UINT64 transformOffsetInBytes,   // Offset of the transform matrix in the
                                      // transform buffer
-    bool isOpaque /* = true */ // If true, the geometry is considered opaque,
-                               // optimizing the search for a closest hit
+    bool isOpaque /* = true */, // If true, the geometry is considered opaque,
+                                // optimizing the search for a closest hit
+    DXGI_FORMAT indexFormat /* = DXGI_FORMAT_R32_UINT */ // Format of the indices
 ) {
   // Create the DX12 descriptor representing the input data, assumed to be
-  // opaque triangles, with 3xf32 vertex coordinates and 32-bit indices
+  // opaque triangles, with 3xf32 vertex coordinates and 16/32-bit indices
   D3D12_RAYTRACING_GEOMETRY_DESC descriptor = {};
   descriptor.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
   descriptor.Triangles.VertexBuffer.StartAddress =
@@ -104,7 +105,7 @@ void BottomLevelASGenerator::AddVertexBuffer(
       indexBuffer ? (indexBuffer->GetGPUVirtualAddress() + indexOffsetInBytes)
                   : 0;
   descriptor.Triangles.IndexFormat =
-      indexBuffer ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_UNKNOWN;
+      indexBuffer ? indexFormat : DXGI_FORMAT_UNKNOWN;
   descriptor.Triangles.IndexCount = indexCount;
   descriptor.Triangles.Transform3x4 =
       transformBuffer
@@ -126,8 +127,10 @@ void BottomLevelASGenerator::ComputeASBufferSizes(
                           // allow iterative updates
     UINT64 *scratchSizeInBytes, // Required scratch memory on the GPU to build
                                 // the acceleration structure
-    UINT64 *resultSizeInBytes   // Required GPU memory to store the acceleration
+    UINT64 *resultSizeInBytes,  // Required GPU memory to store the acceleration
                                 // structure
+    bool allowCompaction        // If true, the acceleration structure can be
+                                // compacted after the build
 ) {
   // The generated AS can support iterative updates. This may change the final
   // size of the AS as well as the temporary memory requirements, and hence has
@@ -136,6 +139,8 @@ void BottomLevelASGenerator::ComputeASBufferSizes(
       allowUpdate
           ? D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE
           : D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
+  if (allowCompaction)
+    m_flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_COMPACTION;
 
   // Describe the work being requested, in this case the construction of a
   // (possibly dynamic) bottom-level hierarchy, with the given vertex buffers
@@ -187,25 +192,42 @@ void BottomLevelASGenerator::Generate(
                                    // structure, used if an iterative update
                                    // is requested
 ) {
+  Generate(commandList, scratchBuffer->GetGPUVirtualAddress(),
+           resultBuffer->GetGPUVirtualAddress(), resultBuffer, updateOnly,
+           previousResult ? previousResult->GetGPUVirtualAddress() : 0);
+}
+
+//--------------------------------------------------------------------------------------------------
+// Same as above, with the scratch and result given as GPU addresses so they can
+// live anywhere inside larger buffers. resultBuffer is the buffer holding the
+// result, on which the UAV barrier is placed; when null, the caller places the
+// barriers, as when recording several builds in a row.
+void BottomLevelASGenerator::Generate(
+    ID3D12GraphicsCommandList4 *commandList,
+    D3D12_GPU_VIRTUAL_ADDRESS scratchAddress,
+    D3D12_GPU_VIRTUAL_ADDRESS resultAddress, ID3D12Resource *resultBuffer,
+    bool updateOnly, D3D12_GPU_VIRTUAL_ADDRESS previousResult,
+    const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC
+        *postbuildInfo) {
 
   D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags = m_flags;
   // The stored flags represent whether the AS has been built for updates or
   // not. If yes and an update is requested, the builder is told to only update
   // the AS instead of fully rebuilding it
-  if (flags ==
-          D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE &&
+  if ((flags &
+       D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) &&
       updateOnly) {
-    flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+    flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
   }
 
   // Sanity checks
-  if (m_flags !=
-          D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE &&
+  if (!(m_flags &
+        D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE) &&
       updateOnly) {
     throw std::logic_error(
         "Cannot update a bottom-level AS not originally built for updates");
   }
-  if (updateOnly && previousResult == nullptr) {
+  if (updateOnly && previousResult == 0) {
     throw std::logic_error(
         "Bottom-level hierarchy update requires the previous hierarchy");
   }
@@ -222,21 +244,22 @@ void BottomLevelASGenerator::Generate(
   buildDesc.Inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
   buildDesc.Inputs.NumDescs = static_cast<UINT>(m_vertexBuffers.size());
   buildDesc.Inputs.pGeometryDescs = m_vertexBuffers.data();
-  buildDesc.DestAccelerationStructureData = {
-      resultBuffer->GetGPUVirtualAddress()};
-  buildDesc.ScratchAccelerationStructureData = {
-      scratchBuffer->GetGPUVirtualAddress()};
-  buildDesc.SourceAccelerationStructureData =
-      previousResult ? previousResult->GetGPUVirtualAddress() : 0;
+  buildDesc.DestAccelerationStructureData = {resultAddress};
+  buildDesc.ScratchAccelerationStructureData = {scratchAddress};
+  buildDesc.SourceAccelerationStructureData = previousResult;
   buildDesc.Inputs.Flags = flags;
 
   // Build the AS
-  commandList->BuildRaytracingAccelerationStructure(&buildDesc, 0, nullptr);
+  commandList->BuildRaytracingAccelerationStructure(
+      &buildDesc, postbuildInfo ? 1 : 0, postbuildInfo);
 
   // Wait for the builder to complete by setting a barrier on the resulting
   // buffer. This is particularly important as the construction of the top-level
   // hierarchy may be called right afterwards, before executing the command
   // list.
+  if (resultBuffer == nullptr) {
+    return;
+  }
   D3D12_RESOURCE_BARRIER uavBarrier;
   uavBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
   uavBarrier.UAV.pResource = resultBuffer;
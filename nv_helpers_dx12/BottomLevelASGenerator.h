@@ -101,8 +101,8 @@ public:
   );
 
   /// Add a vertex buffer along with its index buffer in GPU memory into the acceleration structure.
-  /// The vertices are supposed to be represented by 3 float32 value, and the indices are 32-bit
-  /// unsigned ints
+  /// The vertices are supposed to be represented by 3 float32 value, and the indices are 16- or
+  /// 32-bit unsigned ints
   void AddVertexBuffer(ID3D12Resource* vertexBuffer, /// Buffer containing the vertex coordinates,
                                                      /// possibly interleaved with other vertex data
                        UINT64 vertexOffsetInBytes,   /// Offset of the first vertex in the vertex
@@ -123,8 +123,10 @@ public:
                                                         /// be nullptr
                        UINT64 transformOffsetInBytes,   /// Offset of the transform matrix in the
                                                         /// transform buffer
-                       bool isOpaque = true /// If true, the geometry is considered opaque,
-                                            /// optimizing the search for a closest hit
+                       bool isOpaque = true, /// If true, the geometry is considered opaque,
+                                             /// optimizing the search for a closest hit
+                       DXGI_FORMAT indexFormat = DXGI_FORMAT_R32_UINT /// DXGI_FORMAT_R16_UINT or
+                                                                      /// DXGI_FORMAT_R32_UINT
   );
 
   /// Compute the size of the scratch space required to build the acceleration structure, as well as
@@ -136,8 +138,10 @@ public:
                                   /// allow iterative updates
       UINT64* scratchSizeInBytes, /// Required scratch memory on the GPU to
                                   /// build the acceleration structure
-      UINT64* resultSizeInBytes   /// Required GPU memory to store the
+      UINT64* resultSizeInBytes,  /// Required GPU memory to store the
                                   /// acceleration structure
+      bool allowCompaction = false /// If true, the acceleration structure can be
+                                   /// copied into a compacted one after the build
   );
 
   /// Enqueue the construction of the acceleration structure on a command list, using
@@ -154,6 +158,21 @@ public:
                                                /// if an iterative update is requested
   );
 
+  /// Same, with the buffers given as GPU addresses, for acceleration structures placed inside a
+  /// larger buffer. The UAV barrier after the build is on resultBuffer, the buffer holding the
+  /// result; with a null resultBuffer no barrier is added, for callers batching several builds
+  /// that place the barriers themselves.
+  void Generate(
+      ID3D12GraphicsCommandList4* commandList, /// Command list on which the build will be enqueued
+      D3D12_GPU_VIRTUAL_ADDRESS scratchAddress, /// Scratch memory used by the builder
+      D3D12_GPU_VIRTUAL_ADDRESS resultAddress,  /// Where the acceleration structure is written
+      ID3D12Resource* resultBuffer,             /// Buffer containing resultAddress
+      bool updateOnly = false,       /// If true, simply refit the existing acceleration structure
+      D3D12_GPU_VIRTUAL_ADDRESS previousResult = 0, /// Optional previous acceleration structure
+      const D3D12_RAYTRACING_ACCELERATION_STRUCTURE_POSTBUILD_INFO_DESC* postbuildInfo =
+          nullptr /// Optional postbuild information written by the build, such as the compacted size
+  );
+
 private:
   /// Vertex buffer descriptors used to generate the AS
   std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> m_vertexBuffers = {};
@@ -1,4 +1,5 @@
 #include "Common.hlsl"
+#include "VertexFetch.hlsl"
 
 
 cbuffer Lights : register(b1)
@@ -9,8 +10,6 @@ cbuffer Lights : register(b1)
     int lightType;
 };
 
-StructuredBuffer<STriVertex> BTriVertex : register(t0);
-StructuredBuffer<int> indices : register(t1);
 StructuredBuffer<ModelInstanceGPU> gInstanceBuffer : register(t2);
 RaytracingAccelerationStructure SceneBVH : register(t3);
 
@@ -26,11 +25,11 @@ void ClosestHit_BSDF(inout HitInfo payload : SV_RayPayload, Attributes attrib)
     float3 rayOrigin = WorldRayDirection();
     payload.worldPosition = rayOrigin + rayDistance * incoming;
     
-    uint vertId = 3 * PrimitiveIndex();
+    uint3 tri = LoadTriangleIndices(PrimitiveIndex() + gInstanceBuffer[InstanceID()].lodTriangleOffset, gInstanceBuffer[InstanceID()].smallIndices);
 
-    float3 p0 = BTriVertex[indices[vertId + 0]].vertex;
-    float3 p1 = BTriVertex[indices[vertId + 1]].vertex;
-    float3 p2 = BTriVertex[indices[vertId + 2]].vertex;
+    float3 p0 = GetVertexPosition(tri.x);
+    float3 p1 = GetVertexPosition(tri.y);
+    float3 p2 = GetVertexPosition(tri.z);
     
     float3 barycentrics =
         float3(1.f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
@@ -83,9 +82,9 @@ void ClosestHit_BSDF(inout HitInfo payload : SV_RayPayload, Attributes attrib)
     //further BSDF
     payload.randomSeed = HashSeed(payload.randomSeed);
 
-    float3 n0 = BTriVertex[indices[vertId + 0]].normal;
-    float3 n1 = BTriVertex[indices[vertId + 1]].normal;
-    float3 n2 = BTriVertex[indices[vertId + 2]].normal;
+    float3 n0 = GetVertexNormal(tri.x);
+    float3 n1 = GetVertexNormal(tri.y);
+    float3 n2 = GetVertexNormal(tri.z);
 
     float3 hitNormalObj = normalize(n0 * barycentrics.x + n1 * barycentrics.y + n2 * barycentrics.z);
     float3 hitNormal = normalize(mul(hitNormalObj, (float3x3) WorldToObject3x4()));
@@ -102,9 +101,9 @@ void ClosestHit_BSDF(inout HitInfo payload : SV_RayPayload, Attributes attrib)
     float3 baseColor = inst.albedo;
     if (inst.albedo.x < 0)
     {
-        baseColor = BTriVertex[indices[vertId + 0]].color * barycentrics.x +
-            BTriVertex[indices[vertId + 1]].color * barycentrics.y +
-            BTriVertex[indices[vertId + 2]].color * barycentrics.z;
+        baseColor = GetVertexColor(tri.x) * barycentrics.x +
+            GetVertexColor(tri.y) * barycentrics.y +
+            GetVertexColor(tri.z) * barycentrics.z;
     }
     payload.colorAndDistance.xyz = float3(0, 0, 0);
     float roughness;
@@ -125,9 +124,9 @@ void ClosestHit_BSDF(inout HitInfo payload : SV_RayPayload, Attributes attrib)
         if (inst.roughness < 0)
         {
             //roughness interpolation
-            float3 r0 = BTriVertex[indices[vertId + 0]].roughness;
-            float3 r1 = BTriVertex[indices[vertId + 1]].roughness;
-            float3 r2 = BTriVertex[indices[vertId + 2]].roughness;
+            float3 r0 = GetVertexRoughness(tri.x);
+            float3 r1 = GetVertexRoughness(tri.y);
+            float3 r2 = GetVertexRoughness(tri.z);
             roughness = r0 * barycentrics.x + r1 * barycentrics.y + r2 * barycentrics.z;
         }
         payload.normalAndRoughness.w = roughness;
@@ -115,7 +115,9 @@ struct ModelInstanceGPU
     int isMetallic;
     int isGlass;
     float IOR;
-    float pad[3];
+    int smallIndices;
+    int lodTriangleOffset;
+    float pad;
 };
 
 float3 LinearToSRGB(float3 c)
@@ -1,7 +1,6 @@
 #include "Common.hlsl"
+#include "VertexFetch.hlsl"
 
-StructuredBuffer<STriVertex> BTriVertex : register(t0);
-StructuredBuffer<int> indices : register(t1);
 StructuredBuffer<ModelInstanceGPU> gInstanceBuffer : register(t2);
 
 
@@ -10,10 +9,10 @@ void ClosestHit_Flat(inout HitInfo payload : SV_RayPayload, Attributes attrib)
 {
     float3 barycentrics =
     float3(1.f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
-    uint vertId = 3 * PrimitiveIndex();
-    float3 hitColor = BTriVertex[indices[vertId + 0]].color * barycentrics.x +
-                    BTriVertex[indices[vertId + 1]].color * barycentrics.y +
-                    BTriVertex[indices[vertId + 2]].color * barycentrics.z;
+    uint3 tri = LoadTriangleIndices(PrimitiveIndex() + gInstanceBuffer[InstanceID()].lodTriangleOffset, gInstanceBuffer[InstanceID()].smallIndices);
+    float3 hitColor = GetVertexColor(tri.x) * barycentrics.x +
+                    GetVertexColor(tri.y) * barycentrics.y +
+                    GetVertexColor(tri.z) * barycentrics.z;
     
     //ModelInstanceGPU inst = gInstanceBuffer[BTriVertex[indices[vertId + 0]].id];
     
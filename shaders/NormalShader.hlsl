@@ -1,7 +1,7 @@
 #include "Common.hlsl"
+#include "VertexFetch.hlsl"
 
-StructuredBuffer<STriVertex> BTriVertex : register(t0);
-StructuredBuffer<int> indices : register(t1);
+StructuredBuffer<ModelInstanceGPU> gInstanceBuffer : register(t2);
 
 [shader("closesthit")]
 void ClosestHit_Normal(inout HitInfo payload : SV_RayPayload, Attributes attrib)
@@ -9,10 +9,10 @@ void ClosestHit_Normal(inout HitInfo payload : SV_RayPayload, Attributes attrib)
     float3 barycentrics =
     float3(1.f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
     
-    uint vertId = 3 * PrimitiveIndex();
-    float3 hitNormalObj = BTriVertex[indices[vertId + 0]].normal * barycentrics.x +
-                    BTriVertex[indices[vertId + 1]].normal * barycentrics.y +
-                    BTriVertex[indices[vertId + 2]].normal * barycentrics.z;
+    uint3 tri = LoadTriangleIndices(PrimitiveIndex() + gInstanceBuffer[InstanceID()].lodTriangleOffset, gInstanceBuffer[InstanceID()].smallIndices);
+    float3 hitNormalObj = GetVertexNormal(tri.x) * barycentrics.x +
+                    GetVertexNormal(tri.y) * barycentrics.y +
+                    GetVertexNormal(tri.z) * barycentrics.z;
 
     float3 hitColor = normalize(mul(hitNormalObj, (float3x3)WorldToObject3x4()));
 
@@ -1,4 +1,5 @@
 #include "Common.hlsl"
+#include "VertexFetch.hlsl"
 
 cbuffer Lights : register(b1)
 {
@@ -8,8 +9,7 @@ cbuffer Lights : register(b1)
     float pad2;
 };
 
-StructuredBuffer<STriVertex> BTriVertex : register(t0);
-StructuredBuffer<int> indices : register(t1);
+StructuredBuffer<ModelInstanceGPU> gInstanceBuffer : register(t2);
 
 [shader("closesthit")] 
 void ClosestHit_Phong(inout HitInfo payload : SV_RayPayload, Attributes attrib) 
@@ -17,14 +17,14 @@ void ClosestHit_Phong(inout HitInfo payload : SV_RayPayload, Attributes attrib)
     float3 barycentrics =
     float3(1.f - attrib.bary.x - attrib.bary.y, attrib.bary.x, attrib.bary.y);
     
-    uint vertId = 3 * PrimitiveIndex();
-    float3 p0 = BTriVertex[indices[vertId + 0]].vertex;
-    float3 p1 = BTriVertex[indices[vertId + 1]].vertex;
-    float3 p2 = BTriVertex[indices[vertId + 2]].vertex;
+    uint3 tri = LoadTriangleIndices(PrimitiveIndex() + gInstanceBuffer[InstanceID()].lodTriangleOffset, gInstanceBuffer[InstanceID()].smallIndices);
+    float3 p0 = GetVertexPosition(tri.x);
+    float3 p1 = GetVertexPosition(tri.y);
+    float3 p2 = GetVertexPosition(tri.z);
 
-    float3 n0 = BTriVertex[indices[vertId + 0]].normal;
-    float3 n1 = BTriVertex[indices[vertId + 1]].normal;
-    float3 n2 = BTriVertex[indices[vertId + 2]].normal;
+    float3 n0 = GetVertexNormal(tri.x);
+    float3 n1 = GetVertexNormal(tri.y);
+    float3 n2 = GetVertexNormal(tri.z);
     
     float3 hitPosObj = p0 * barycentrics.x + p1 * barycentrics.y + p2 * barycentrics.z;
     float3 hitPos = mul(ObjectToWorld3x4(), float4(hitPosObj, 1.0f)).xyz;
@@ -40,9 +40,9 @@ void ClosestHit_Phong(inout HitInfo payload : SV_RayPayload, Attributes attrib)
     float3 reflectDir = reflect(-viewDir, hitNormal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0f), 32.0f); // shininess 32
 
-    float3 baseColor = BTriVertex[indices[vertId + 0]].color * barycentrics.x +
-                    BTriVertex[indices[vertId + 1]].color * barycentrics.y +
-                    BTriVertex[indices[vertId + 2]].color * barycentrics.z;
+    float3 baseColor = GetVertexColor(tri.x) * barycentrics.x +
+                    GetVertexColor(tri.y) * barycentrics.y +
+                    GetVertexColor(tri.z) * barycentrics.z;
     float3 ambient = 0.1f * baseColor; // 10% of material color
     float3 finalColor = ambient + baseColor * lightColor * diff + spec * lightColor * 0.2;
     finalColor = saturate(finalColor);
@@ -0,0 +1,114 @@
+// Vertex attribute access for the hit shaders.
+// By default every vertex is one 64 byte STriVertex (t0). When the application
+// runs with -compactvertices the shaders are compiled with COMPACT_VERTICES:
+// t0 then only holds the float3 positions the BLAS was built from, and the
+// quantized shading attributes are in t4 (see VertexCompression.h).
+//
+// Indices (t1) are raw 16- or 32-bit values, depending on the mesh
+// (ModelInstanceGPU::smallIndices). The LODs of a mesh follow its full index
+// list in the same buffer, so PrimitiveIndex() of a LOD BLAS has to be offset
+// by ModelInstanceGPU::lodTriangleOffset.
+
+ByteAddressBuffer indices : register(t1);
+
+// Vertex indices of a triangle of the current geometry
+uint3 LoadTriangleIndices(uint primitiveIndex, int smallIndices)
+{
+    if (smallIndices == 0)
+        return indices.Load3(primitiveIndex * 12);
+
+    // Three 16-bit indices start either on a 4 byte boundary or 2 bytes after
+    // one; the buffer is padded so the second dword always exists
+    uint offset = primitiveIndex * 6;
+    uint2 words = indices.Load2(offset & ~3u);
+    if ((offset & 2) == 0)
+        return uint3(words.x & 0xFFFF, words.x >> 16, words.y & 0xFFFF);
+    return uint3(words.x >> 16, words.y & 0xFFFF, words.y >> 16);
+}
+
+#ifdef COMPACT_VERTICES
+
+struct SCompactVertexAttributes
+{
+    uint normal;             // octahedral, 2 x snorm16
+    uint color;              // RGBA8
+    uint roughnessEmissionX; // 2 x half
+    uint emissionYZ;         // 2 x half
+};
+
+StructuredBuffer<float3> BTriPosition : register(t0);
+StructuredBuffer<SCompactVertexAttributes> BTriAttributes : register(t4);
+
+float3 DecodeOctahedralNormal(uint packed)
+{
+    int2 snorm = int2(int(packed << 16) >> 16, int(packed) >> 16);
+    float2 e = max(float2(snorm) / 32767.0f, -1.0f);
+
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+float4 DecodeColorRGBA8(uint packed)
+{
+    return float4(packed & 0xFF, (packed >> 8) & 0xFF, (packed >> 16) & 0xFF, packed >> 24) / 255.0f;
+}
+
+float3 GetVertexPosition(uint index)
+{
+    return BTriPosition[index];
+}
+
+float3 GetVertexNormal(uint index)
+{
+    return DecodeOctahedralNormal(BTriAttributes[index].normal);
+}
+
+float4 GetVertexColor(uint index)
+{
+    return DecodeColorRGBA8(BTriAttributes[index].color);
+}
+
+float GetVertexRoughness(uint index)
+{
+    return f16tof32(BTriAttributes[index].roughnessEmissionX & 0xFFFF);
+}
+
+float3 GetVertexEmission(uint index)
+{
+    SCompactVertexAttributes a = BTriAttributes[index];
+    return float3(f16tof32(a.roughnessEmissionX >> 16), f16tof32(a.emissionYZ & 0xFFFF), f16tof32(a.emissionYZ >> 16));
+}
+
+#else
+
+StructuredBuffer<STriVertex> BTriVertex : register(t0);
+
+float3 GetVertexPosition(uint index)
+{
+    return BTriVertex[index].vertex;
+}
+
+float3 GetVertexNormal(uint index)
+{
+    return BTriVertex[index].normal;
+}
+
+float4 GetVertexColor(uint index)
+{
+    return BTriVertex[index].color;
+}
+
+float GetVertexRoughness(uint index)
+{
+    return BTriVertex[index].roughness;
+}
+
+float3 GetVertexEmission(uint index)
+{
+    return BTriVertex[index].emmision;
+}
+
+#endif